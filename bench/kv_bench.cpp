@@ -0,0 +1,617 @@
+// In-process throughput of the server's layers, without sockets or
+// PostgreSQL:
+//   cache    get (all hits), put (overwrites) and evict (inserts into a full
+//            cache) on each cache engine, at several capacities and thread
+//            counts
+//   pool     ThreadPool tasks submitted from outside the pool and
+//            resubmitted from inside it
+//   handler  Router, RequestHandler and a sharded LRU cache in front of an
+//            in-memory StorageBackend: GETs that hit, GETs that mostly miss,
+//            POSTs and batch GETs
+// Results print as a table. --json writes them to a file, and --baseline
+// compares each case against such a file from an earlier build.
+//
+// Usage: kv_bench [--suite cache,pool,handler] [--threads 1,4,16] [--json FILE]
+//                 [--baseline FILE] (--help for the rest)
+
+#include "cache.h"
+#include "sharded_cache.h"
+#include "clock_cache.h"
+#include "thread_pool.h"
+#include "request_handler.h"
+#include "router.h"
+#include "storage_backend.h"
+#include "metrics.h"
+#include "pool_scenarios.h"
+#include <json.hpp>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <shared_mutex>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <ctime>
+
+using json = nlohmann::json;
+
+namespace {
+
+// StorageBackend kept in a hash map. latency, if set, is slept on every
+// call, standing in for a database round trip. Keys never expire; the
+// benchmarks don't set expiry times.
+class MemoryBackend : public StorageBackend {
+public:
+    explicit MemoryBackend(std::chrono::microseconds latency) : latency_(latency) {}
+
+    bool connect() override { return true; }
+    void disconnect() override {}
+    bool is_connected() const override { return true; }
+
+    bool create(const std::string& key, const std::string& value, bool* inserted = nullptr,
+                uint64_t expires_at = 0) override {
+        (void)expires_at;
+        wait();
+        auto stored = std::make_shared<std::string>(value);
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        auto [it, added] = data_.try_emplace(key, stored);
+        if (!added) {
+            it->second = stored;
+        }
+        if (inserted) *inserted = added;
+        return true;
+    }
+
+    std::shared_ptr<std::string> read(const std::string& key, bool* failed = nullptr,
+                                      uint64_t* expires_at = nullptr) override {
+        wait();
+        if (failed) *failed = false;
+        if (expires_at) *expires_at = 0;
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = data_.find(key);
+        return it == data_.end() ? nullptr : it->second;
+    }
+
+    bool delete_key(const std::string& key, bool* deleted = nullptr) override {
+        wait();
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        bool erased = data_.erase(key) > 0;
+        if (deleted) *deleted = erased;
+        return true;
+    }
+
+    bool read_many(const std::vector<std::string>& keys,
+                   std::vector<std::shared_ptr<std::string>>& values,
+                   std::vector<uint64_t>* expires_at = nullptr) override {
+        wait();
+        values.assign(keys.size(), nullptr);
+        if (expires_at) expires_at->assign(keys.size(), 0);
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto it = data_.find(keys[i]);
+            if (it != data_.end()) values[i] = it->second;
+        }
+        return true;
+    }
+
+    bool create_many(const std::vector<std::pair<std::string, std::string>>& items,
+                     std::vector<std::string>* overwritten = nullptr,
+                     const std::vector<uint64_t>* expires_at = nullptr) override {
+        (void)expires_at;
+        wait();
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        for (const auto& [key, value] : items) {
+            auto stored = std::make_shared<std::string>(value);
+            auto [it, added] = data_.try_emplace(key, stored);
+            if (!added) {
+                it->second = stored;
+                if (overwritten) overwritten->push_back(key);
+            }
+        }
+        return true;
+    }
+
+    bool delete_many(const std::vector<std::string>& keys, std::vector<std::string>* deleted = nullptr) override {
+        wait();
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        for (const auto& key : keys) {
+            if (data_.erase(key) > 0 && deleted) deleted->push_back(key);
+        }
+        return true;
+    }
+
+    long long count_keys() override {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return static_cast<long long>(data_.size());
+    }
+
+    bool scan_keys(const std::function<void(std::string_view)>& fn) override {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        for (const auto& entry : data_) {
+            fn(entry.first);
+        }
+        return true;
+    }
+
+private:
+    std::chrono::microseconds latency_;
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<std::string>> data_;
+
+    void wait() const {
+        if (latency_.count() > 0) {
+            std::this_thread::sleep_for(latency_);
+        }
+    }
+};
+
+struct Options {
+    std::vector<std::string> suites = {"cache", "pool", "handler"};
+    std::vector<size_t> threads;
+    std::vector<std::string> policies = {"lru", "clock", "sharded"};
+    std::vector<size_t> cache_sizes = {1000, 100000, 1000000};
+    size_t value_size = 100;
+    std::chrono::milliseconds duration{300};  // Per timed case
+    size_t pool_tasks = 1000000;
+    size_t handler_keys = 100000;
+    size_t batch_size = 100;
+    std::chrono::microseconds backend_latency{0};
+    std::string json_path;
+    std::string baseline_path;
+};
+
+// Cheap per-thread generator, so drawing a key costs next to nothing
+struct XorShift {
+    uint64_t state;
+
+    explicit XorShift(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    size_t below(size_t n) { return static_cast<size_t>(next() % n); }
+};
+
+struct TimedRun {
+    uint64_t ops = 0;
+    uint64_t errors = 0;
+    double seconds = 0;
+};
+
+// Call op(rng) on each of `threads` threads until duration has passed.
+// op returns false for a failed operation.
+template <typename Op>
+TimedRun run_timed(size_t threads, std::chrono::milliseconds duration, Op op) {
+    struct alignas(64) Counts {
+        uint64_t ops = 0;
+        uint64_t errors = 0;
+    };
+    std::vector<Counts> counts(threads);
+    std::atomic<bool> go{false};
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> waiting{0};
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            XorShift rng(t + 1);
+            Counts local;
+            waiting.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            // Check the stop flag every few operations only
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 64; ++i) {
+                    if (!op(rng)) local.errors++;
+                }
+                local.ops += 64;
+            }
+            counts[t] = local;
+        });
+    }
+    while (waiting.load() < threads) {
+        std::this_thread::yield();
+    }
+
+    auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(duration);
+    stop.store(true);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    TimedRun run;
+    run.seconds = seconds_since(start);
+    for (const auto& c : counts) {
+        run.ops += c.ops;
+        run.errors += c.errors;
+    }
+    return run;
+}
+
+json make_result(const std::string& suite, const std::string& name, json params, uint64_t ops, double seconds,
+                 size_t threads) {
+    json result;
+    result["suite"] = suite;
+    result["name"] = name;
+    result["params"] = std::move(params);
+    result["ops"] = ops;
+    result["seconds"] = seconds;
+    result["ops_per_sec"] = ops / seconds;
+    // Wall time per operation on one thread
+    result["ns_per_op"] = ops > 0 ? seconds * 1e9 * threads / ops : 0.0;
+    return result;
+}
+
+std::vector<std::string> make_keys(size_t count) {
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (size_t i = 1; i <= count; ++i) {
+        keys.push_back("key:" + std::to_string(i));
+    }
+    return keys;
+}
+
+std::unique_ptr<Cache> make_cache(const std::string& policy, size_t capacity) {
+    if (policy == "lru") return std::make_unique<LRUCache>(capacity);
+    if (policy == "tinylfu") return std::make_unique<LRUCache>(capacity, 0, true);
+    if (policy == "clock") return std::make_unique<ClockCache>(capacity);
+    if (policy == "sharded") return std::make_unique<ShardedCache>(capacity, 0, 16);
+    return nullptr;
+}
+
+// get: uniform reads of keys that all fit, so every one hits. put:
+// overwrites of those keys. evict: writes over four times the capacity
+// into a full cache, so most of them evict an entry.
+void bench_cache(const Options& options, std::vector<json>& results) {
+    std::string value(options.value_size, 'v');
+    for (size_t capacity : options.cache_sizes) {
+        auto keys = make_keys(capacity * 4);
+        size_t resident = std::max<size_t>(1, capacity / 2);
+
+        for (const auto& policy : options.policies) {
+            for (size_t threads : options.threads) {
+                for (const char* op : {"get", "put", "evict"}) {
+                    auto cache = make_cache(policy, capacity);
+                    if (!cache) {
+                        std::cerr << "Unknown cache policy '" << policy << "'" << std::endl;
+                        return;
+                    }
+                    std::string which = op;
+                    size_t prefill = which == "evict" ? capacity : resident;
+                    for (size_t i = 0; i < prefill; ++i) {
+                        cache->put(keys[i], value);
+                    }
+                    cache->reset_stats();
+
+                    TimedRun run;
+                    if (which == "get") {
+                        run = run_timed(threads, options.duration, [&](XorShift& rng) {
+                            return static_cast<bool>(cache->get(keys[rng.below(resident)]));
+                        });
+                    } else {
+                        size_t space = which == "evict" ? keys.size() : resident;
+                        run = run_timed(threads, options.duration, [&](XorShift& rng) {
+                            cache->put(keys[rng.below(space)], value);
+                            return true;
+                        });
+                    }
+
+                    CacheStats stats = cache->get_stats();
+                    json params = {{"policy", policy}, {"op", which}, {"capacity", capacity}, {"threads", threads},
+                                   {"value_size", options.value_size}};
+                    std::string name = policy + "/" + which + "/capacity=" + std::to_string(capacity) +
+                                       "/threads=" + std::to_string(threads);
+                    json result = make_result("cache", name, params, run.ops, run.seconds, threads);
+                    if (which == "get") {
+                        result["misses"] = run.errors;
+                    } else {
+                        result["evictions"] = stats.evictions;
+                    }
+                    results.push_back(std::move(result));
+                }
+            }
+        }
+    }
+}
+
+// external: 4 producers outside the pool with at most 64 tasks in flight
+// each, like the event loop. internal: chains of tasks that resubmit
+// themselves from inside the pool.
+void bench_pool(const Options& options, std::vector<json>& results) {
+    for (size_t threads : options.threads) {
+        ThreadPool pool(threads);
+        size_t producers = 4;
+        size_t per_producer = options.pool_tasks / producers;
+        double external = run_windowed(pool, producers, per_producer, 64);
+        results.push_back(make_result("pool", "external/threads=" + std::to_string(threads),
+                                      {{"op", "external"}, {"threads", threads}, {"producers", producers}},
+                                      producers * per_producer, external, threads));
+
+        size_t chains = threads * 4;
+        size_t length = std::max<size_t>(1, options.pool_tasks / chains);
+        double internal = run_chains(pool, chains, length);
+        json result = make_result("pool", "internal/threads=" + std::to_string(threads),
+                                  {{"op", "internal"}, {"threads", threads}, {"chains", chains}},
+                                  chains * length, internal, threads);
+        result["steals"] = pool.get_steals();
+        results.push_back(std::move(result));
+    }
+}
+
+// Requests go through Router::route as a front end would pass them, so
+// body parsing, the handler, the cache and response writing are included.
+// get_hit reads keys that are all cached; get_miss reads from a cache a
+// tenth of the key space, so ~90% go to the backend and evict on fill.
+void bench_handler(const Options& options, std::vector<json>& results) {
+    auto backend = std::make_shared<MemoryBackend>(options.backend_latency);
+    auto keys = make_keys(options.handler_keys);
+    std::string value(options.value_size, 'v');
+
+    std::vector<std::pair<std::string, std::string>> items;
+    for (const auto& key : keys) {
+        items.emplace_back(key, value);
+        if (items.size() == StorageBackend::kMaxBatchRows) {
+            backend->create_many(items);
+            items.clear();
+        }
+    }
+    backend->create_many(items);
+
+    // Requests are built up front so the loop only measures the server side
+    std::vector<HttpRequest> gets(keys.size());
+    std::vector<HttpRequest> posts(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        gets[i].method = "GET";
+        gets[i].path = "/api/kv";
+        gets[i].params["key"] = keys[i];
+        posts[i].method = "POST";
+        posts[i].path = "/api/kv";
+        posts[i].body = json{{"key", keys[i]}, {"value", value}}.dump();
+    }
+    std::vector<HttpRequest> batches(256);
+    XorShift pick(42);
+    for (auto& batch : batches) {
+        json batch_keys = json::array();
+        for (size_t i = 0; i < options.batch_size; ++i) {
+            batch_keys.push_back(keys[pick.below(keys.size())]);
+        }
+        batch.method = "POST";
+        batch.path = "/api/kv/batch/get";
+        batch.body = json{{"keys", batch_keys}}.dump();
+    }
+
+    struct Scenario {
+        const char* name;
+        Route route;
+        const std::vector<HttpRequest>* requests;
+        size_t cache_capacity;
+        bool prefill;
+    };
+    const Scenario scenarios[] = {
+        {"get_hit", Route::kGet, &gets, keys.size(), true},
+        {"get_miss", Route::kGet, &gets, std::max<size_t>(1, keys.size() / 10), false},
+        {"put", Route::kPut, &posts, keys.size(), true},
+        {"batch_get", Route::kBatchGet, &batches, keys.size(), true},
+    };
+
+    for (const auto& scenario : scenarios) {
+        for (size_t threads : options.threads) {
+            std::shared_ptr<Cache> cache = std::make_shared<ShardedCache>(scenario.cache_capacity, 0, 16);
+            if (scenario.prefill) {
+                for (const auto& key : keys) {
+                    cache->put(key, value);
+                }
+            }
+            auto handler = std::make_shared<RequestHandler>(cache, backend);
+            Router router(handler);
+            const auto& requests = *scenario.requests;
+
+            TimedRun run = run_timed(threads, options.duration, [&](XorShift& rng) {
+                HttpResponse res;
+                router.route(requests[rng.below(requests.size())], res);
+                return res.status == 200;
+            });
+
+            // The router times every request into the handler's metrics
+            HistogramSnapshot latency = handler->get_metrics().snapshot(scenario.route);
+            CacheStats stats = cache->get_stats();
+            json params = {{"op", scenario.name}, {"threads", threads}, {"keys", keys.size()},
+                           {"cache_capacity", scenario.cache_capacity}, {"value_size", options.value_size},
+                           {"backend_latency_us", options.backend_latency.count()}};
+            if (scenario.route == Route::kBatchGet) {
+                params["batch_size"] = options.batch_size;
+            }
+            std::string name = std::string(scenario.name) + "/threads=" + std::to_string(threads);
+            json result = make_result("handler", name, params, run.ops, run.seconds, threads);
+            result["errors"] = run.errors;
+            result["p50_us"] = latency.quantile(0.5) / 1000.0;
+            result["p99_us"] = latency.quantile(0.99) / 1000.0;
+            if (stats.hits + stats.misses > 0) {
+                result["hit_rate"] = static_cast<double>(stats.hits) / (stats.hits + stats.misses);
+            }
+            results.push_back(std::move(result));
+        }
+    }
+}
+
+// ops_per_sec of each case in an earlier --json file, by name
+std::unordered_map<std::string, double> load_baseline(const std::string& path) {
+    std::unordered_map<std::string, double> baseline;
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot read baseline " << path << std::endl;
+        return baseline;
+    }
+    try {
+        json doc = json::parse(in);
+        for (const auto& result : doc.at("results")) {
+            baseline[result.at("name").get<std::string>()] = result.at("ops_per_sec").get<double>();
+        }
+    } catch (const json::exception& e) {
+        std::cerr << "Bad baseline " << path << ": " << e.what() << std::endl;
+    }
+    return baseline;
+}
+
+void print_results(const std::vector<json>& results, const std::unordered_map<std::string, double>& baseline) {
+    std::string suite;
+    for (auto& result : results) {
+        if (result["suite"] != suite) {
+            suite = result["suite"];
+            std::cout << "\n[" << suite << "]\n"
+                      << std::left << std::setw(44) << "case" << std::right << std::setw(14) << "ops/s"
+                      << std::setw(10) << "ns/op" << (baseline.empty() ? "" : "  vs baseline") << std::endl;
+        }
+        std::string name = result["name"];
+        std::cout << std::left << std::setw(44) << name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << result["ops_per_sec"].get<double>() << std::setw(10)
+                  << result["ns_per_op"].get<double>();
+        auto it = baseline.find(name);
+        if (it != baseline.end() && it->second > 0) {
+            double change = (result["ops_per_sec"].get<double>() / it->second - 1.0) * 100.0;
+            std::cout << "  " << std::showpos << std::setprecision(1) << change << "%" << std::noshowpos;
+        }
+        if (result.contains("p99_us")) {
+            std::cout << std::setprecision(1) << "  p50 " << result["p50_us"].get<double>() << " us, p99 "
+                      << result["p99_us"].get<double>() << " us";
+        }
+        std::cout << std::endl;
+    }
+}
+
+template <typename T>
+bool parse_list(const std::string& text, std::vector<T>& out) {
+    out.clear();
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (item.empty()) continue;
+        if constexpr (std::is_same_v<T, std::string>) {
+            out.push_back(item);
+        } else {
+            out.push_back(static_cast<T>(std::stoull(item)));
+        }
+    }
+    return !out.empty();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+    options.threads = {1, std::min<size_t>(4, cpus), cpus};
+
+    std::string arg;
+    try {
+        for (int i = 1; i < argc; i++) {
+            arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--suite" && has_value) {
+                parse_list(argv[++i], options.suites);
+            } else if (arg == "--threads" && has_value) {
+                parse_list(argv[++i], options.threads);
+            } else if (arg == "--policies" && has_value) {
+                parse_list(argv[++i], options.policies);
+            } else if (arg == "--cache-sizes" && has_value) {
+                parse_list(argv[++i], options.cache_sizes);
+            } else if (arg == "--value-size" && has_value) {
+                options.value_size = std::stoul(argv[++i]);
+            } else if (arg == "--duration-ms" && has_value) {
+                options.duration = std::chrono::milliseconds(std::stoul(argv[++i]));
+            } else if (arg == "--pool-tasks" && has_value) {
+                options.pool_tasks = std::stoul(argv[++i]);
+            } else if (arg == "--handler-keys" && has_value) {
+                options.handler_keys = std::stoul(argv[++i]);
+            } else if (arg == "--batch-size" && has_value) {
+                options.batch_size = std::stoul(argv[++i]);
+            } else if (arg == "--backend-latency-us" && has_value) {
+                options.backend_latency = std::chrono::microseconds(std::stoul(argv[++i]));
+            } else if (arg == "--json" && has_value) {
+                options.json_path = argv[++i];
+            } else if (arg == "--baseline" && has_value) {
+                options.baseline_path = argv[++i];
+            } else if (arg == "--help") {
+                std::cout << "Usage: kv_bench [options]\n"
+                          << "Options:\n"
+                          << "  --suite <list>             Suites to run: cache,pool,handler (default: all)\n"
+                          << "  --threads <list>           Thread counts (default: 1,4,CPU count)\n"
+                          << "  --policies <list>          Cache engines: lru,tinylfu,clock,sharded\n"
+                          << "                             (default: lru,clock,sharded)\n"
+                          << "  --cache-sizes <list>       Cache capacities in entries (default: 1000,100000,1000000)\n"
+                          << "  --value-size <bytes>       Value size (default: 100)\n"
+                          << "  --duration-ms <ms>         Length of each cache and handler case (default: 300)\n"
+                          << "  --pool-tasks <num>         Tasks per pool case (default: 1000000)\n"
+                          << "  --handler-keys <num>       Keys stored for the handler suite (default: 100000)\n"
+                          << "  --batch-size <num>         Keys per batch GET (default: 100)\n"
+                          << "  --backend-latency-us <us>  Delay per backend call (default: 0)\n"
+                          << "  --json <file>              Write the results as JSON\n"
+                          << "  --baseline <file>          Compare against the JSON of an earlier run\n"
+                          << "  --help                     Show this help message\n";
+                return 0;
+            } else {
+                std::cerr << "Unknown option " << arg << " (see --help)" << std::endl;
+                return 1;
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << "Bad value for " << arg << std::endl;
+        return 1;
+    }
+    options.threads.erase(std::remove(options.threads.begin(), options.threads.end(), 0), options.threads.end());
+    std::sort(options.threads.begin(), options.threads.end());
+    options.threads.erase(std::unique(options.threads.begin(), options.threads.end()), options.threads.end());
+    if (options.threads.empty()) {
+        std::cerr << "No thread counts to run" << std::endl;
+        return 1;
+    }
+
+    auto baseline = options.baseline_path.empty() ? std::unordered_map<std::string, double>()
+                                                  : load_baseline(options.baseline_path);
+
+    std::vector<json> results;
+    for (const auto& suite : options.suites) {
+        if (suite == "cache") {
+            bench_cache(options, results);
+        } else if (suite == "pool") {
+            bench_pool(options, results);
+        } else if (suite == "handler") {
+            bench_handler(options, results);
+        } else {
+            std::cerr << "Unknown suite '" << suite << "'" << std::endl;
+            return 1;
+        }
+    }
+    print_results(results, baseline);
+
+    if (!options.json_path.empty()) {
+        json doc;
+        doc["timestamp"] = static_cast<long long>(std::time(nullptr));
+        doc["cpus"] = cpus;
+#if defined(__VERSION__)
+        doc["compiler"] = __VERSION__;
+#endif
+        doc["results"] = results;
+        std::ofstream out(options.json_path);
+        out << doc.dump(2) << std::endl;
+        if (!out) {
+            std::cerr << "Cannot write " << options.json_path << std::endl;
+            return 1;
+        }
+        std::cout << "\nResults written to " << options.json_path << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,128 @@
+#ifndef BENCH_POOL_SCENARIOS_H
+#define BENCH_POOL_SCENARIOS_H
+
+// Task submission patterns shared by thread_pool_bench and kv_bench. Each
+// returns the seconds taken to run every task; Pool needs enqueue(callable).
+
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstddef>
+
+// Counts finished tasks and lets the driver wait for all of them
+class Latch {
+public:
+    explicit Latch(size_t count) : remaining_(count) {}
+
+    void count_down() {
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return remaining_.load(std::memory_order_acquire) == 0; });
+    }
+
+private:
+    std::atomic<size_t> remaining_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+using Clock = std::chrono::steady_clock;
+
+inline double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Producers outside the pool submit tasks_per_producer tasks each as fast
+// as they can; with no limit on tasks in flight the queues fill up
+template <typename Pool>
+double run_burst(Pool& pool, size_t producers, size_t tasks_per_producer) {
+    Latch done(producers * tasks_per_producer);
+    auto start = Clock::now();
+
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&pool, &done, tasks_per_producer] {
+            for (size_t i = 0; i < tasks_per_producer; ++i) {
+                pool.enqueue([&done] { done.count_down(); });
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    done.wait();
+    return seconds_since(start);
+}
+
+// Like run_burst, but each producer keeps at most window tasks in flight,
+// the way the event loop is bounded by its open connections
+template <typename Pool>
+double run_windowed(Pool& pool, size_t producers, size_t tasks_per_producer, size_t window) {
+    Latch done(producers * tasks_per_producer);
+    auto start = Clock::now();
+
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&pool, &done, tasks_per_producer, window] {
+            std::atomic<size_t> in_flight{0};
+            for (size_t i = 0; i < tasks_per_producer; ++i) {
+                while (in_flight.load(std::memory_order_acquire) >= window) {
+                    std::this_thread::yield();
+                }
+                in_flight.fetch_add(1, std::memory_order_relaxed);
+                pool.enqueue([&done, &in_flight] {
+                    in_flight.fetch_sub(1, std::memory_order_release);
+                    done.count_down();
+                });
+            }
+            while (in_flight.load(std::memory_order_acquire) > 0) {
+                std::this_thread::yield();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    done.wait();
+    return seconds_since(start);
+}
+
+// Each of chains tasks resubmits itself from inside the pool until it has
+// run length times, which a work-stealing pool keeps on the submitting
+// worker's queue unless another worker runs dry and steals it
+template <typename Pool>
+struct ChainStep {
+    Pool* pool;
+    Latch* done;
+    size_t remaining;
+
+    void operator()() {
+        done->count_down();
+        if (--remaining > 0) {
+            pool->enqueue(*this);
+        }
+    }
+};
+
+template <typename Pool>
+double run_chains(Pool& pool, size_t chains, size_t length) {
+    Latch done(chains * length);
+    auto start = Clock::now();
+
+    for (size_t c = 0; c < chains; ++c) {
+        pool.enqueue(ChainStep<Pool>{&pool, &done, length});
+    }
+    done.wait();
+    return seconds_since(start);
+}
+
+#endif // BENCH_POOL_SCENARIOS_H
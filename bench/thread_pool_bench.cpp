@@ -0,0 +1,145 @@
+// Enqueue/dequeue throughput of ThreadPool against the single-queue pool it
+// replaced. Tasks are trivial, so the numbers measure queueing overhead.
+//
+// Usage: thread_pool_bench [--threads N] [--producers N] [--tasks N] [--pin]
+
+#include "thread_pool.h"
+#include "pool_scenarios.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <stdexcept>
+
+// The previous ThreadPool: one std::queue of std::function behind one mutex
+class LegacyThreadPool {
+public:
+    explicit LegacyThreadPool(size_t num_threads) : stop_(false) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            workers_.emplace_back([this] { worker_thread(); });
+        }
+    }
+
+    ~LegacyThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            stop_ = true;
+        }
+        condition_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void enqueue(std::function<void()> task) {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            if (stop_) {
+                throw std::runtime_error("ThreadPool is stopped");
+            }
+            tasks_.push(task);
+        }
+        condition_.notify_one();
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex queue_mutex_;
+    std::condition_variable condition_;
+    bool stop_;
+
+    void worker_thread() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            condition_.wait(lock, [this] { return !tasks_.empty() || stop_; });
+            if (stop_ && tasks_.empty()) {
+                break;
+            }
+            auto task = std::move(tasks_.front());
+            tasks_.pop();
+            lock.unlock();
+            task();
+        }
+    }
+};
+
+static void report(const std::string& name, size_t tasks, double legacy_seconds, double pool_seconds) {
+    double legacy_rate = tasks / legacy_seconds;
+    double pool_rate = tasks / pool_seconds;
+    std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(0)
+              << std::setw(16) << legacy_rate << std::setw(16) << pool_rate
+              << std::setprecision(2) << std::setw(10) << pool_rate / legacy_rate << "x" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t threads = std::thread::hardware_concurrency();
+    size_t producers = 4;
+    size_t tasks = 1000000;
+    bool pin = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+        } else if (arg == "--producers" && i + 1 < argc) {
+            producers = std::stoul(argv[++i]);
+        } else if (arg == "--tasks" && i + 1 < argc) {
+            tasks = std::stoul(argv[++i]);
+        } else if (arg == "--pin") {
+            pin = true;
+        } else if (arg == "--help") {
+            std::cout << "Usage: thread_pool_bench [options]\n"
+                      << "Options:\n"
+                      << "  --threads <num>    Worker threads (default: CPU count)\n"
+                      << "  --producers <num>  Threads submitting from outside the pool (default: 4)\n"
+                      << "  --tasks <num>      Tasks per scenario (default: 1000000)\n"
+                      << "  --pin              Pin ThreadPool workers to CPUs\n"
+                      << "  --help             Show this help message\n";
+            return 0;
+        }
+    }
+    threads = std::max<size_t>(threads, 1);
+    producers = std::max<size_t>(producers, 1);
+
+    size_t per_producer = tasks / producers;
+    size_t window = 64;
+    size_t chains = threads * 4;
+    size_t length = tasks / chains;
+
+    std::cout << "Workers: " << threads << ", producers: " << producers << ", tasks: " << tasks
+              << (pin ? ", pinned" : "") << std::endl;
+    std::cout << std::left << std::setw(12) << "Scenario" << std::right << std::setw(16) << "Legacy (t/s)"
+              << std::setw(16) << "Stealing (t/s)" << std::setw(11) << "Speedup" << std::endl;
+
+    double legacy_windowed, legacy_burst, legacy_chains;
+    {
+        LegacyThreadPool pool(threads);
+        legacy_windowed = run_windowed(pool, producers, per_producer, window);
+        legacy_burst = run_burst(pool, producers, per_producer);
+        legacy_chains = run_chains(pool, chains, length);
+    }
+
+    double pool_windowed, pool_burst, pool_chains;
+    uint64_t steals;
+    {
+        ThreadPool pool(threads, pin);
+        pool_windowed = run_windowed(pool, producers, per_producer, window);
+        pool_burst = run_burst(pool, producers, per_producer);
+        pool_chains = run_chains(pool, chains, length);
+        steals = pool.get_steals();
+    }
+
+    report("windowed", producers * per_producer, legacy_windowed, pool_windowed);
+    report("burst", producers * per_producer, legacy_burst, pool_burst);
+    report("chains", chains * length, legacy_chains, pool_chains);
+    std::cout << "Steals: " << steals << std::endl;
+    return 0;
+}
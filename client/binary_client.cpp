@@ -0,0 +1,107 @@
+#include "binary_client.h"
+#include <cerrno>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+BinaryClient::~BinaryClient() {
+    close();
+}
+
+bool BinaryClient::connect(const std::string& host, int port, int timeout_ms) {
+    close();
+
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+        return false;
+    }
+
+    for (addrinfo* addr = result; addr != nullptr; addr = addr->ai_next) {
+        int fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+        if (fd < 0) continue;
+
+        timeval timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        if (::connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+            fd_ = fd;
+            break;
+        }
+        ::close(fd);
+    }
+    freeaddrinfo(result);
+    return fd_ >= 0;
+}
+
+void BinaryClient::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    out_.clear();
+    in_.clear();
+    in_offset_ = 0;
+}
+
+void BinaryClient::queue(BinaryOp op, uint32_t opaque, const std::string& key, const std::string& value) {
+    append_binary_request(out_, op, opaque, key, value);
+}
+
+bool BinaryClient::flush() {
+    size_t sent = 0;
+    while (sent < out_.size()) {
+        ssize_t n = send(fd_, out_.data() + sent, out_.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close();
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    out_.clear();
+    return true;
+}
+
+bool BinaryClient::fill(size_t bytes) {
+    if (in_offset_ > 0 && in_offset_ == in_.size()) {
+        in_.clear();
+        in_offset_ = 0;
+    }
+    char buf[16 * 1024];
+    while (in_.size() - in_offset_ < bytes) {
+        ssize_t n = recv(fd_, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            close();
+            return false;
+        }
+        in_.append(buf, static_cast<size_t>(n));
+    }
+    return true;
+}
+
+bool BinaryClient::read_response(BinaryHeader& header, std::string& value) {
+    if (fd_ < 0 || !fill(BinaryHeader::kSize)) {
+        return false;
+    }
+    header = BinaryHeader::decode(in_.data() + in_offset_);
+    if (header.magic != BinaryHeader::kResponseMagic) {
+        close();
+        return false;
+    }
+    if (!fill(BinaryHeader::kSize + header.body_size())) {
+        return false;
+    }
+    value.assign(in_.data() + in_offset_ + BinaryHeader::kSize + header.key_size, header.value_size);
+    in_offset_ += BinaryHeader::kSize + header.body_size();
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef BINARY_CLIENT_H
+#define BINARY_CLIENT_H
+
+#include "binary_protocol.h"
+#include <string>
+#include <cstdint>
+
+// Blocking client for the binary protocol over one persistent connection.
+// Requests are queued and sent together by flush(), so a caller can keep
+// several in flight and then read the responses back in order.
+class BinaryClient {
+public:
+    BinaryClient() = default;
+    ~BinaryClient();
+
+    BinaryClient(const BinaryClient&) = delete;
+    BinaryClient& operator=(const BinaryClient&) = delete;
+
+    // timeout_ms bounds every send and receive
+    bool connect(const std::string& host, int port, int timeout_ms = 1000);
+    void close();
+    bool is_connected() const { return fd_ >= 0; }
+
+    void queue(BinaryOp op, uint32_t opaque, const std::string& key, const std::string& value = std::string());
+    bool flush();
+
+    // Next response; false if the connection failed (and is now closed)
+    bool read_response(BinaryHeader& header, std::string& value);
+
+private:
+    int fd_ = -1;
+    std::string out_;
+    std::string in_;        // Received bytes not yet returned
+    size_t in_offset_ = 0;
+
+    bool fill(size_t bytes);
+};
+
+#endif // BINARY_CLIENT_H
@@ -5,33 +5,160 @@
 #include <random>
 #include <iomanip>
 #include <cmath>
+#include <fstream>
+#include <algorithm>
+#include <cctype>
 #include <json.hpp>
 
 using json = nlohmann::json;
 
-LoadGenerator::LoadGenerator(const std::string& server_url, int num_threads, int duration_seconds, const std::string& workload_type)
-    : server_url_(server_url), num_threads_(num_threads), duration_seconds_(duration_seconds), 
-      workload_type_(workload_type), stop_flag_(false),
-      total_requests_atomic_(0), successful_requests_atomic_(0), failed_requests_atomic_(0),
-      total_response_time_atomic_(0.0) {}
+void LatencyRecorder::add_to(HistogramSnapshot& snapshot, uint64_t& max_ns_out) const {
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        snapshot.buckets[i] += buckets[i];
+    }
+    snapshot.count += count;
+    snapshot.sum_ns += sum_ns;
+    max_ns_out = std::max(max_ns_out, max_ns);
+}
 
-void LoadGenerator::run() {
-    stats_.start_time = std::chrono::system_clock::now();
-    
+namespace {
+
+// Percent-encode a key for a query string; generated keys pass through
+std::string url_encode(const std::string& key) {
+    static const char kHex[] = "0123456789ABCDEF";
+    std::string out;
+    out.reserve(key.size());
+    for (char c : key) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (isalnum(byte) || c == '-' || c == '_' || c == '.' || c == '~' || c == ':') {
+            out += c;
+        } else {
+            out += '%';
+            out += kHex[byte >> 4];
+            out += kHex[byte & 0xf];
+        }
+    }
+    return out;
+}
+
+bool binary_success(const BinaryHeader& header) {
+    return header.status == static_cast<uint8_t>(BinaryStatus::kOk) ||
+           (header.status == static_cast<uint8_t>(BinaryStatus::kNotFound) &&
+            header.opcode == static_cast<uint8_t>(BinaryOp::kGet));
+}
+
+void queue_binary(BinaryClient& client, const Operation& op, uint32_t opaque) {
+    switch (op.type) {
+        case OpType::kRead:
+            client.queue(BinaryOp::kGet, opaque, op.key);
+            break;
+        case OpType::kWrite:
+            client.queue(BinaryOp::kSet, opaque, op.key, make_value(op.value_size));
+            break;
+        case OpType::kDelete:
+            client.queue(BinaryOp::kDelete, opaque, op.key);
+            break;
+    }
+}
+
+Operation to_operation(const TraceEntry& entry) {
+    Operation op;
+    op.type = entry.op == TraceOp::kGet ? OpType::kRead : entry.op == TraceOp::kPut ? OpType::kWrite : OpType::kDelete;
+    op.key = entry.key;
+    op.value_size = entry.value_size;
+    return op;
+}
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+}
+
+}  // namespace
+
+LoadGenerator::LoadGenerator(const LoadGeneratorConfig& config)
+    : server_url_(config.server_url), num_threads_(std::max(config.num_threads, 1)),
+      duration_seconds_(config.duration_seconds), workload_type_(config.workload_type),
+      batch_size_(config.batch_size), protocol_(config.protocol), binary_port_(config.binary_port),
+      pipeline_(std::max(config.pipeline, 1)), rate_(std::max(config.rate, 0.0)), workload_(config.workload),
+      preload_(config.preload), replay_path_(config.replay_path), replay_speed_(std::max(config.replay_speed, 0.0)),
+      stop_flag_(false) {}
+
+bool LoadGenerator::run() {
     std::cout << "Starting load test..." << std::endl;
-    std::cout << "Server URL: " << server_url_ << std::endl;
+    if (protocol_ == "binary") {
+        std::cout << "Server: " << binary_host() << ":" << binary_port_ << " (binary, pipeline " << pipeline_
+                  << ")" << std::endl;
+    } else {
+        std::cout << "Server URL: " << server_url_ << std::endl;
+    }
     std::cout << "Number of threads: " << num_threads_ << std::endl;
-    std::cout << "Duration: " << duration_seconds_ << " seconds" << std::endl;
-    std::cout << "Workload type: " << workload_type_ << std::endl;
+    if (duration_seconds_ > 0) {
+        std::cout << "Duration: " << duration_seconds_ << " seconds" << std::endl;
+    }
+    if (!replay_path_.empty()) {
+        std::cout << "Replaying: " << replay_path_ << " at ";
+        if (replay_speed_ > 0) {
+            std::cout << replay_speed_ << "x speed" << std::endl;
+        } else {
+            std::cout << "full speed" << std::endl;
+        }
+    } else {
+        std::cout << "Workload type: " << workload_type_ << std::endl;
+        std::cout << "Keys: " << workload_.describe() << std::endl;
+        if (is_batch_workload()) {
+            std::cout << "Batch size: " << batch_size_ << " keys" << std::endl;
+        }
+        if (rate_ > 0) {
+            std::cout << "Mode: open loop at " << rate_ << " req/sec" << std::endl;
+        } else {
+            std::cout << "Mode: closed loop" << std::endl;
+        }
+    }
     std::cout << std::string(50, '-') << std::endl;
     
+    if (!workload_.is_valid()) {
+        std::cerr << "Invalid workload: " << workload_.get_error() << std::endl;
+        return false;
+    }
+    if (protocol_ == "binary" && is_batch_workload() && replay_path_.empty()) {
+        std::cerr << "Batch workloads need --protocol http" << std::endl;
+        return false;
+    }
+    if (!replay_path_.empty() && !load_trace()) {
+        return false;
+    }
+    if (preload_ && !preload_keys()) {
+        return false;
+    }
+    
+    workers_.assign(num_threads_, WorkerStats());
+    active_workers_ = num_threads_;
+    start_ = std::chrono::steady_clock::now();
     std::vector<std::thread> threads;
     for (int i = 0; i < num_threads_; ++i) {
-        threads.emplace_back([this] { worker_thread(); });
+        if (!replay_path_.empty()) {
+            threads.emplace_back([this, i] { replay_thread(i); });
+        } else if (protocol_ == "binary") {
+            threads.emplace_back([this, i] { binary_worker_thread(i); });
+        } else {
+            threads.emplace_back([this, i] { worker_thread(i); });
+        }
     }
     
-    // Wait for duration
-    std::this_thread::sleep_for(std::chrono::seconds(duration_seconds_));
+    // Wait for the duration, or until a replay runs out of operations
+    auto deadline = start_ + std::chrono::seconds(duration_seconds_);
+    while (active_workers_ > 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (duration_seconds_ > 0 && now >= deadline) {
+            break;
+        }
+        auto wait = std::chrono::milliseconds(50);
+        if (duration_seconds_ > 0 && deadline - now < wait) {
+            std::this_thread::sleep_until(deadline);
+        } else {
+            std::this_thread::sleep_for(wait);
+        }
+    }
     stop_flag_ = true;
     
     // Wait for all threads to finish
@@ -41,162 +168,702 @@ void LoadGenerator::run() {
         }
     }
     
-    stats_.end_time = std::chrono::system_clock::now();
-    stats_.total_requests = total_requests_atomic_.load();
-    stats_.successful_requests = successful_requests_atomic_.load();
-    stats_.failed_requests = failed_requests_atomic_.load();
-    stats_.total_response_time_ms = total_response_time_atomic_.load();
-    
+    stats_.duration_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    collect_stats();
     print_results();
+    return true;
 }
 
-void LoadGenerator::worker_thread() {
-    std::random_device rd;
-    std::mt19937 gen(rd() + std::hash<std::thread::id>{}(std::this_thread::get_id())); //std::this_thread::get_id());
-    
+// Time between sends for one thread, each send carrying requests_per_send
+// requests; zero in closed loop
+std::chrono::nanoseconds LoadGenerator::send_interval(int requests_per_send) const {
+    if (rate_ <= 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    double per_thread = rate_ / num_threads_;
+    return std::chrono::nanoseconds(static_cast<int64_t>(1e9 * requests_per_send / per_thread));
+}
+
+// Threads start staggered across one interval so their sends interleave
+std::chrono::steady_clock::time_point LoadGenerator::first_send(int index, std::chrono::nanoseconds interval) const {
+    return start_ + interval * index / num_threads_;
+}
+
+// Wait until when; false if the run ended first. Sleeps overshoot by tens
+// of microseconds, which open-loop latency would count, so the last stretch
+// is spent yielding instead.
+bool LoadGenerator::wait_until(std::chrono::steady_clock::time_point when) const {
+    const auto spin = std::chrono::microseconds(200);
     while (!stop_flag_) {
-        generate_request();
+        auto now = std::chrono::steady_clock::now();
+        if (now >= when) {
+            return true;
+        }
+        if (when - now > spin) {
+            std::this_thread::sleep_until(std::min(when - spin, now + std::chrono::milliseconds(100)));
+        } else {
+            std::this_thread::yield();
+        }
     }
+    return false;
 }
 
-void LoadGenerator::generate_request() {
+void LoadGenerator::worker_thread(int index) {
+    WorkerStats& stats = workers_[index];
     std::random_device rd;
-    std::mt19937 gen(rd() + std::hash<std::thread::id>{}(std::this_thread::get_id())); //std::this_thread::get_id());
-    std::uniform_int_distribution<> key_dist(1, 100000);
-    std::uniform_real_distribution<> op_dist(0.0, 1.0);
+    std::mt19937_64 gen(rd() + std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    Operation op;
     
+    // One keep-alive connection for the whole run; httplib reconnects if it drops
     httplib::Client cli(server_url_);
+    cli.set_keep_alive(true);
     cli.set_connection_timeout(0, 500000);  // 500ms timeout
     cli.set_read_timeout(1, 0);
     
-    auto start_time = std::chrono::high_resolution_clock::now();
-    
-    try {
-        std::string key = "key:" + std::to_string(key_dist(gen));
-        std::string value = "value:" + std::to_string(key_dist(gen));
+    auto interval = send_interval(1);
+    auto scheduled = first_send(index, interval);
+    while (!stop_flag_) {
+        if (interval.count() > 0) {
+            if (!wait_until(scheduled)) {
+                break;
+            }
+        } else {
+            scheduled = std::chrono::steady_clock::now();
+        }
         
-        bool success = false;
+        auto sent = std::chrono::steady_clock::now();
+        bool success = generate_request(cli, gen, op);
+        auto done = std::chrono::steady_clock::now();
         
-        if (workload_type_ == "put_all") {
-            // Create/Delete only
-            double op = op_dist(gen);
-            if (op < 0.5) {
-                json body;
-                body["key"] = key;
-                body["value"] = value;
-                auto res = cli.Post("/api/kv", body.dump(), "application/json");
-                success = (res && res->status == 200);
-            } else {
-                auto res = cli.Delete("/api/kv?key=" + key);
-                success = (res && res->status == 200);
+        stats.requests++;
+        if (success) {
+            stats.successes++;
+        } else {
+            stats.failures++;
+        }
+        stats.latency.record(elapsed_ns(scheduled, done));
+        stats.service_time.record(elapsed_ns(sent, done));
+        // The next send is due on schedule even if this one ran late
+        scheduled += interval;
+    }
+    active_workers_--;
+}
+
+bool LoadGenerator::generate_request(httplib::Client& cli, std::mt19937_64& gen, Operation& op) {
+    try {
+        if (workload_type_ == "get_batch") {
+            // Read batch_size keys per request
+            json body;
+            body["keys"] = json::array();
+            for (int i = 0; i < batch_size_; ++i) {
+                body["keys"].push_back(workload_.next_key(gen));
             }
-        } 
-        else if (workload_type_ == "get_all") {
-            // Read unique keys only
-            auto res = cli.Get("/api/kv?key=" + key);
-            success = (res && (res->status == 200 || res->status == 404));
-        } 
-        else if (workload_type_ == "get_popular") {
-            // Read same keys repeatedly (popular keys)
-            std::uniform_int_distribution<> popular_dist(1, 100);  // Only 100 popular keys
-            std::string popular_key = "popular:" + std::to_string(popular_dist(gen));
-            auto res = cli.Get("/api/kv?key=" + popular_key);
-            success = (res && (res->status == 200 || res->status == 404));
-        } 
-        else if (workload_type_ == "get_put") {
-            // Mixed workload
-            double op = op_dist(gen);
-            if (op < 0.7) {
-                // 70% reads
-                auto res = cli.Get("/api/kv?key=" + key);
-                success = (res && (res->status == 200 || res->status == 404));
-            } else {
-                // 30% writes
-                json body;
-                body["key"] = key;
-                body["value"] = value;
-                auto res = cli.Post("/api/kv", body.dump(), "application/json");
-                success = (res && res->status == 200);
+            auto res = cli.Post("/api/kv/batch/get", body.dump(), "application/json");
+            return res && res->status == 200;
+        }
+        if (workload_type_ == "put_batch") {
+            // Write batch_size keys per request
+            json body;
+            body["items"] = json::array();
+            for (int i = 0; i < batch_size_; ++i) {
+                json item;
+                item["key"] = workload_.next_key(gen);
+                item["value"] = make_value(workload_.next_value_size(gen));
+                body["items"].push_back(item);
+            }
+            auto res = cli.Post("/api/kv/batch/put", body.dump(), "application/json");
+            return res && res->status == 200;
+        }
+        
+        workload_.next(gen, op);
+        return send_http(cli, op);
+    } catch (const std::exception& e) {
+        return false;
+    }
+}
+
+bool LoadGenerator::send_http(httplib::Client& cli, const Operation& op) {
+    switch (op.type) {
+        case OpType::kRead: {
+            auto res = cli.Get("/api/kv?key=" + url_encode(op.key));
+            return res && (res->status == 200 || res->status == 404);
+        }
+        case OpType::kWrite: {
+            json body;
+            body["key"] = op.key;
+            body["value"] = make_value(op.value_size);
+            auto res = cli.Post("/api/kv", body.dump(), "application/json");
+            return res && res->status == 200;
+        }
+        case OpType::kDelete: {
+            auto res = cli.Delete("/api/kv?key=" + url_encode(op.key));
+            return res && res->status == 200;
+        }
+    }
+    return false;
+}
+
+void LoadGenerator::binary_worker_thread(int index) {
+    WorkerStats& stats = workers_[index];
+    std::random_device rd;
+    std::mt19937_64 gen(rd() + std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    Operation op;
+    
+    // One connection for the whole run; each round trip carries pipeline_
+    // requests, scheduled together in open loop
+    BinaryClient client;
+    BinaryHeader header;
+    std::string value;
+    uint32_t opaque = 0;
+    auto interval = send_interval(pipeline_);
+    auto scheduled = first_send(index, interval);
+    while (!stop_flag_) {
+        if (interval.count() > 0) {
+            if (!wait_until(scheduled)) {
+                break;
             }
-        } 
-        else {
-            // Default: get_all
-            auto res = cli.Get("/api/kv?key=" + key);
-            success = (res && (res->status == 200 || res->status == 404));
+        } else {
+            scheduled = std::chrono::steady_clock::now();
         }
         
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto response_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
+        if (!client.is_connected() && !client.connect(binary_host(), binary_port_)) {
+            stats.requests += pipeline_;
+            stats.failures += pipeline_;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            scheduled += interval;
+            continue;
+        }
         
-        total_requests_atomic_++;
-        total_response_time_atomic_ = total_response_time_atomic_ + response_time;
+        auto sent = std::chrono::steady_clock::now();
+        uint32_t first = opaque;
+        for (int i = 0; i < pipeline_; ++i) {
+            workload_.next(gen, op);
+            queue_binary(client, op, opaque++);
+        }
         
+        uint64_t successes = 0;
+        if (client.flush()) {
+            for (int i = 0; i < pipeline_; ++i) {
+                if (!client.read_response(header, value) || header.opaque != first + i) {
+                    client.close();
+                    break;
+                }
+                if (binary_success(header)) {
+                    successes++;
+                }
+            }
+        }
+        
+        // Every request in a window waits for the whole round trip
+        auto done = std::chrono::steady_clock::now();
+        stats.requests += pipeline_;
+        stats.successes += successes;
+        stats.failures += pipeline_ - successes;
+        stats.latency.record(elapsed_ns(scheduled, done), pipeline_);
+        stats.service_time.record(elapsed_ns(sent, done), pipeline_);
+        scheduled += interval;
+    }
+    active_workers_--;
+}
+
+// Read the trace and deal its operations out to threads by key
+bool LoadGenerator::load_trace() {
+    std::ifstream file(replay_path_);
+    if (!file) {
+        std::cerr << "Cannot open trace " << replay_path_ << std::endl;
+        return false;
+    }
+    
+    replay_.assign(num_threads_, std::vector<TraceEntry>());
+    std::string line;
+    TraceEntry entry;
+    uint64_t first_offset = UINT64_MAX;
+    size_t loaded = 0;
+    size_t skipped = 0;
+    while (std::getline(file, line)) {
+        if (!parse_trace_line(line, entry)) {
+            skipped += !line.empty() && line[0] != '#';
+            continue;
+        }
+        first_offset = std::min(first_offset, entry.offset_us);
+        replay_[std::hash<std::string>{}(entry.key) % num_threads_].push_back(entry);
+        loaded++;
+    }
+    if (loaded == 0) {
+        std::cerr << "Trace " << replay_path_ << " holds no operations" << std::endl;
+        return false;
+    }
+    
+    // Start replaying at the first recorded operation, not at the start of recording
+    uint64_t last_offset = 0;
+    for (auto& entries : replay_) {
+        for (auto& e : entries) {
+            e.offset_us -= first_offset;
+            last_offset = std::max(last_offset, e.offset_us);
+        }
+    }
+    std::cout << "Loaded " << loaded << " operations spanning " << std::fixed << std::setprecision(1)
+              << last_offset / 1e6 << " s";
+    if (skipped > 0) {
+        std::cout << " (" << skipped << " malformed lines skipped)";
+    }
+    std::cout << std::endl;
+    return true;
+}
+
+// One thread's share of a replay. In open loop (speed > 0) each operation
+// is due at its recorded offset divided by the speed, and latency counts
+// from then. Over the binary protocol up to pipeline_ operations that are
+// due together go in one round trip.
+void LoadGenerator::replay_thread(int index) {
+    WorkerStats& stats = workers_[index];
+    const auto& entries = replay_[index];
+    auto due = [this](const TraceEntry& entry) {
+        return start_ + std::chrono::nanoseconds(static_cast<int64_t>(entry.offset_us * 1e3 / replay_speed_));
+    };
+    auto record = [&stats](bool success, std::chrono::steady_clock::time_point scheduled,
+                           std::chrono::steady_clock::time_point sent, std::chrono::steady_clock::time_point done) {
+        stats.requests++;
         if (success) {
-            successful_requests_atomic_++;
+            stats.successes++;
         } else {
-            failed_requests_atomic_++;
+            stats.failures++;
+        }
+        stats.latency.record(elapsed_ns(scheduled, done));
+        stats.service_time.record(elapsed_ns(sent, done));
+    };
+    
+    if (protocol_ != "binary") {
+        httplib::Client cli(server_url_);
+        cli.set_keep_alive(true);
+        cli.set_connection_timeout(0, 500000);
+        cli.set_read_timeout(1, 0);
+        for (const auto& entry : entries) {
+            auto scheduled = std::chrono::steady_clock::now();
+            if (replay_speed_ > 0) {
+                scheduled = due(entry);
+                if (!wait_until(scheduled)) {
+                    break;
+                }
+            } else if (stop_flag_) {
+                break;
+            }
+            
+            auto sent = std::chrono::steady_clock::now();
+            bool success = false;
+            try {
+                success = send_http(cli, to_operation(entry));
+            } catch (const std::exception&) {
+                success = false;
+            }
+            record(success, scheduled, sent, std::chrono::steady_clock::now());
+        }
+        active_workers_--;
+        return;
+    }
+    
+    BinaryClient client;
+    BinaryHeader header;
+    std::string value;
+    uint32_t opaque = 0;
+    std::vector<std::chrono::steady_clock::time_point> scheduled;
+    size_t next = 0;
+    while (next < entries.size()) {
+        if (replay_speed_ > 0) {
+            if (!wait_until(due(entries[next]))) {
+                break;
+            }
+        } else if (stop_flag_) {
+            break;
         }
         
-    } catch (const std::exception& e) {
-        total_requests_atomic_++;
-        failed_requests_atomic_++;
+        // Everything already due, up to the pipeline depth
+        auto sent = std::chrono::steady_clock::now();
+        size_t end = next;
+        scheduled.clear();
+        while (end < entries.size() && end - next < static_cast<size_t>(pipeline_)) {
+            auto when = replay_speed_ > 0 ? due(entries[end]) : sent;
+            if (end > next && when > sent) {
+                break;
+            }
+            scheduled.push_back(when);
+            end++;
+        }
+        
+        bool connected = client.is_connected() || client.connect(binary_host(), binary_port_);
+        uint32_t first = opaque;
+        if (connected) {
+            for (size_t i = next; i < end; ++i) {
+                queue_binary(client, to_operation(entries[i]), opaque++);
+            }
+        }
+        bool ok = connected && client.flush();
+        for (size_t i = next; i < end; ++i) {
+            ok = ok && client.read_response(header, value) && header.opaque == first + (i - next);
+            record(ok && binary_success(header), scheduled[i - next], sent, std::chrono::steady_clock::now());
+        }
+        if (!ok) {
+            client.close();
+        }
+        next = end;
+    }
+    active_workers_--;
+}
+
+// Write every key once so reads hit stored data from the start
+bool LoadGenerator::preload_keys() {
+    auto started = std::chrono::steady_clock::now();
+    uint64_t keys = workload_.get_key_count();
+    uint64_t per_thread = (keys + num_threads_ - 1) / num_threads_;
+    std::atomic<uint64_t> failed{0};
+    
+    std::cout << "Preloading " << keys << " keys..." << std::endl;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads_; ++i) {
+        uint64_t first = std::min(keys, i * per_thread);
+        uint64_t last = std::min(keys, first + per_thread);
+        threads.emplace_back([this, first, last, &failed] { preload_range(first, last, failed); });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    std::cout << "Preloaded " << keys - failed << " keys in " << std::fixed << std::setprecision(1) << seconds
+              << " s" << std::endl;
+    if (failed > 0) {
+        std::cerr << failed << " keys could not be written" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void LoadGenerator::preload_range(uint64_t first, uint64_t last, std::atomic<uint64_t>& failed) {
+    std::mt19937_64 gen(first);
+    
+    if (protocol_ == "binary") {
+        // SETs pipelined kPreloadBatch at a time
+        BinaryClient client;
+        BinaryHeader header;
+        std::string value;
+        if (!client.connect(binary_host(), binary_port_)) {
+            failed += last - first;
+            return;
+        }
+        for (uint64_t start = first; start < last; start += kPreloadBatch) {
+            uint64_t end = std::min(last, start + kPreloadBatch);
+            for (uint64_t i = start; i < end; ++i) {
+                client.queue(BinaryOp::kSet, static_cast<uint32_t>(i), workload_.key_at(i),
+                             make_value(workload_.next_value_size(gen)));
+            }
+            bool ok = client.flush();
+            for (uint64_t i = start; i < end; ++i) {
+                ok = ok && client.read_response(header, value);
+                if (!ok || header.status != static_cast<uint8_t>(BinaryStatus::kOk)) {
+                    failed++;
+                }
+            }
+            if (!ok && !client.connect(binary_host(), binary_port_)) {
+                failed += last - end;
+                return;
+            }
+        }
+        return;
+    }
+    
+    // Batch puts of kPreloadBatch keys
+    httplib::Client cli(server_url_);
+    cli.set_keep_alive(true);
+    cli.set_connection_timeout(1, 0);
+    cli.set_read_timeout(30, 0);
+    for (uint64_t start = first; start < last; start += kPreloadBatch) {
+        uint64_t end = std::min(last, start + kPreloadBatch);
+        json body;
+        body["items"] = json::array();
+        for (uint64_t i = start; i < end; ++i) {
+            json item;
+            item["key"] = workload_.key_at(i);
+            item["value"] = make_value(workload_.next_value_size(gen));
+            body["items"].push_back(item);
+        }
+        auto res = cli.Post("/api/kv/batch/put", body.dump(), "application/json");
+        if (!res || res->status != 200) {
+            failed += end - start;
+        }
+    }
+}
+
+// Host part of server_url_ ("http://host:port")
+std::string LoadGenerator::binary_host() const {
+    std::string host = server_url_;
+    size_t scheme = host.find("://");
+    if (scheme != std::string::npos) {
+        host.erase(0, scheme + 3);
+    }
+    size_t end = host.find_first_of(":/");
+    if (end != std::string::npos) {
+        host.erase(end);
     }
+    return host;
+}
+
+// Replays follow the recorded schedule unless sent at full speed
+bool LoadGenerator::is_open_loop() const {
+    return replay_path_.empty() ? rate_ > 0 : replay_speed_ > 0;
+}
+
+bool LoadGenerator::is_batch_workload() const {
+    return workload_type_ == "get_batch" || workload_type_ == "put_batch";
 }
 
 LoadGeneratorStats LoadGenerator::get_stats() const {
     return stats_;
 }
 
+void LoadGenerator::collect_stats() {
+    for (const auto& worker : workers_) {
+        stats_.total_requests += worker.requests;
+        stats_.successful_requests += worker.successes;
+        stats_.failed_requests += worker.failures;
+        worker.latency.add_to(stats_.latency, stats_.max_latency_ns);
+        worker.service_time.add_to(stats_.service_time, stats_.max_service_time_ns);
+    }
+}
+
+namespace {
+
+struct LatencySummary {
+    double mean_us, p50_us, p90_us, p99_us, p999_us, max_us;
+};
+
+// Bucket midpoints can overshoot the largest sample; the max is exact
+LatencySummary summarize(const HistogramSnapshot& histogram, uint64_t max_ns) {
+    auto at = [&](double q) { return std::min(histogram.quantile(q), max_ns) / 1e3; };
+    double mean = histogram.count > 0 ? static_cast<double>(histogram.sum_ns) / histogram.count / 1e3 : 0.0;
+    return {mean, at(0.5), at(0.9), at(0.99), at(0.999), max_ns / 1e3};
+}
+
+json summary_json(const LatencySummary& summary) {
+    json out;
+    out["mean"] = summary.mean_us;
+    out["p50"] = summary.p50_us;
+    out["p90"] = summary.p90_us;
+    out["p99"] = summary.p99_us;
+    out["p999"] = summary.p999_us;
+    out["max"] = summary.max_us;
+    return out;
+}
+
+}  // namespace
+
 void LoadGenerator::print_results() {
-    auto duration = std::chrono::duration_cast<std::chrono::seconds>(stats_.end_time - stats_.start_time);
-    double throughput = (double)stats_.successful_requests / duration.count();
-    double avg_response_time = stats_.total_response_time_ms / std::max(1UL, stats_.successful_requests);
+    double throughput = stats_.successful_requests / std::max(stats_.duration_s, 1e-9);
+    LatencySummary latency = summarize(stats_.latency, stats_.max_latency_ns);
+    LatencySummary service = summarize(stats_.service_time, stats_.max_service_time_ns);
+    double success_rate = stats_.total_requests > 0
+                              ? 100.0 * stats_.successful_requests / stats_.total_requests
+                              : 0.0;
     
     std::cout << std::string(50, '-') << std::endl;
     std::cout << "\n=== Load Test Results ===" << std::endl;
     std::cout << "Workload Type: " << workload_type_ << std::endl;
-    std::cout << "Duration: " << duration.count() << " seconds" << std::endl;
+    std::cout << "Duration: " << std::fixed << std::setprecision(2) << stats_.duration_s << " seconds" << std::endl;
     std::cout << "Total Requests: " << stats_.total_requests << std::endl;
     std::cout << "Successful Requests: " << stats_.successful_requests << std::endl;
     std::cout << "Failed Requests: " << stats_.failed_requests << std::endl;
     std::cout << "Throughput: " << std::fixed << std::setprecision(2) << throughput << " req/sec" << std::endl;
-    std::cout << "Avg Response Time: " << std::fixed << std::setprecision(2) << avg_response_time << " ms" << std::endl;
-    std::cout << "Success Rate: " << std::fixed << std::setprecision(2) 
-              << (100.0 * stats_.successful_requests / stats_.total_requests) << "%" << std::endl;
+    if (is_batch_workload()) {
+        std::cout << "Key Throughput: " << std::fixed << std::setprecision(2) << throughput * batch_size_
+                  << " keys/sec" << std::endl;
+    }
+    std::cout << "Latency (us): mean " << std::setprecision(1) << latency.mean_us << "  p50 " << latency.p50_us
+              << "  p90 " << latency.p90_us << "  p99 " << latency.p99_us << "  p99.9 " << latency.p999_us
+              << "  max " << latency.max_us << std::endl;
+    if (is_open_loop()) {
+        // Without the wait for the scheduled send, i.e. what a closed-loop
+        // tool would have reported
+        std::cout << "Service Time (us): mean " << service.mean_us << "  p50 " << service.p50_us << "  p90 "
+                  << service.p90_us << "  p99 " << service.p99_us << "  p99.9 " << service.p999_us << "  max "
+                  << service.max_us << std::endl;
+    }
+    std::cout << "Success Rate: " << std::fixed << std::setprecision(2) << success_rate << "%" << std::endl;
     std::cout << std::endl;
 }
 
+bool LoadGenerator::write_json(const std::string& path) const {
+    json out;
+    out["workload"] = workload_type_;
+    out["protocol"] = protocol_;
+    out["threads"] = num_threads_;
+    out["pipeline"] = pipeline_;
+    out["batch_size"] = is_batch_workload() ? batch_size_ : 1;
+    out["keys"] = workload_.describe();
+    if (!replay_path_.empty()) {
+        out["replay"] = replay_path_;
+        out["replay_speed"] = replay_speed_;
+    }
+    out["mode"] = is_open_loop() ? "open" : "closed";
+    out["target_rate"] = rate_;
+    out["duration_s"] = stats_.duration_s;
+    out["requests"] = stats_.total_requests;
+    out["successes"] = stats_.successful_requests;
+    out["failures"] = stats_.failed_requests;
+    out["throughput_rps"] = stats_.successful_requests / std::max(stats_.duration_s, 1e-9);
+    out["latency_us"] = summary_json(summarize(stats_.latency, stats_.max_latency_ns));
+    out["service_time_us"] = summary_json(summarize(stats_.service_time, stats_.max_service_time_ns));
+    
+    std::ofstream file(path, std::ios::trunc);
+    file << out.dump(2) << "\n";
+    return static_cast<bool>(file);
+}
+
+bool LoadGenerator::write_csv(const std::string& path) const {
+    bool fresh;
+    {
+        std::ifstream existing(path, std::ios::ate);
+        fresh = !existing || existing.tellg() == 0;
+    }
+    
+    std::ofstream file(path, std::ios::app);
+    if (fresh) {
+        file << "workload,protocol,threads,pipeline,mode,target_rate,duration_s,requests,successes,failures,"
+                "throughput_rps,mean_us,p50_us,p90_us,p99_us,p999_us,max_us,service_p50_us,service_p99_us\n";
+    }
+    LatencySummary latency = summarize(stats_.latency, stats_.max_latency_ns);
+    LatencySummary service = summarize(stats_.service_time, stats_.max_service_time_ns);
+    file << std::fixed << std::setprecision(2) << workload_type_ << ',' << protocol_ << ',' << num_threads_ << ','
+         << pipeline_ << ',' << (is_open_loop() ? "open" : "closed") << ',' << rate_ << ',' << stats_.duration_s << ','
+         << stats_.total_requests << ',' << stats_.successful_requests << ',' << stats_.failed_requests << ','
+         << stats_.successful_requests / std::max(stats_.duration_s, 1e-9) << ',' << latency.mean_us << ','
+         << latency.p50_us << ',' << latency.p90_us << ',' << latency.p99_us << ',' << latency.p999_us << ','
+         << latency.max_us << ',' << service.p50_us << ',' << service.p99_us << "\n";
+    return static_cast<bool>(file);
+}
+
 int main(int argc, char* argv[]) {
-    std::string server_url = "http://localhost:8080";
-    int num_threads = 10;
-    int duration = 60;
-    std::string workload_type = "get_all";
+    LoadGeneratorConfig config;
+    int duration = -1;  // Default depends on --replay
+    std::string json_path;
+    std::string csv_path;
+    
+    // Workload options apply on top of the --workload preset, whatever their order
+    std::string mix, key_distribution, value_size, key_prefix;
+    double zipf_theta = -1, hot_keys = -1, hot_ops = -1;
+    long long keys = -1;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
         if (arg == "--url" && i + 1 < argc) {
-            server_url = argv[++i];
+            config.server_url = argv[++i];
         } else if (arg == "--threads" && i + 1 < argc) {
-            num_threads = std::stoi(argv[++i]);
+            config.num_threads = std::stoi(argv[++i]);
         } else if (arg == "--duration" && i + 1 < argc) {
             duration = std::stoi(argv[++i]);
         } else if (arg == "--workload" && i + 1 < argc) {
-            workload_type = argv[++i];
+            config.workload_type = argv[++i];
+        } else if (arg == "--batch-size" && i + 1 < argc) {
+            config.batch_size = std::stoi(argv[++i]);
+        } else if (arg == "--protocol" && i + 1 < argc) {
+            config.protocol = argv[++i];
+        } else if (arg == "--binary-port" && i + 1 < argc) {
+            config.binary_port = std::stoi(argv[++i]);
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            config.pipeline = std::stoi(argv[++i]);
+        } else if (arg == "--rate" && i + 1 < argc) {
+            config.rate = std::stod(argv[++i]);
+        } else if (arg == "--keys" && i + 1 < argc) {
+            keys = std::stoll(argv[++i]);
+        } else if (arg == "--key-prefix" && i + 1 < argc) {
+            key_prefix = argv[++i];
+        } else if (arg == "--key-dist" && i + 1 < argc) {
+            key_distribution = argv[++i];
+        } else if (arg == "--zipf-theta" && i + 1 < argc) {
+            zipf_theta = std::stod(argv[++i]);
+        } else if (arg == "--hot-keys" && i + 1 < argc) {
+            hot_keys = std::stod(argv[++i]);
+        } else if (arg == "--hot-ops" && i + 1 < argc) {
+            hot_ops = std::stod(argv[++i]);
+        } else if (arg == "--mix" && i + 1 < argc) {
+            mix = argv[++i];
+        } else if (arg == "--value-size" && i + 1 < argc) {
+            value_size = argv[++i];
+        } else if (arg == "--preload") {
+            config.preload = true;
+        } else if (arg == "--replay" && i + 1 < argc) {
+            config.replay_path = argv[++i];
+        } else if (arg == "--replay-speed" && i + 1 < argc) {
+            config.replay_speed = std::stod(argv[++i]);
+        } else if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (arg == "--csv" && i + 1 < argc) {
+            csv_path = argv[++i];
         } else if (arg == "--help") {
             std::cout << "Usage: load_generator [options]\n"
                       << "Options:\n"
                       << "  --url <url>              Server URL (default: http://localhost:8080)\n"
                       << "  --threads <num>          Number of client threads (default: 10)\n"
-                      << "  --duration <seconds>     Test duration in seconds (default: 60)\n"
-                      << "  --workload <type>        Workload type: put_all, get_all, get_popular, get_put\n"
+                      << "  --duration <seconds>     Test duration in seconds (default: 60; with --replay,\n"
+                      << "                           until the trace ends)\n"
+                      << "  --workload <type>        Workload type: put_all, get_all, get_popular, get_put,\n"
+                      << "                           get_batch, put_batch\n"
+                      << "  --batch-size <num>       Keys per request for batch workloads (default: 100)\n"
+                      << "  --protocol <name>        http or binary (default: http)\n"
+                      << "  --binary-port <port>     Binary protocol port on the --url host (default: 9090)\n"
+                      << "  --pipeline <num>         Binary requests in flight per thread (default: 1)\n"
+                      << "  --rate <req/sec>         Open loop: send at this total rate on a fixed schedule and\n"
+                      << "                           measure latency from each scheduled send (default: 0,\n"
+                      << "                           closed loop)\n"
+                      << "Workload options (override the --workload preset):\n"
+                      << "  --keys <num>             Keys in the key space (default: 100000)\n"
+                      << "  --key-prefix <prefix>    Keys are <prefix>1..<prefix>N (default: key:)\n"
+                      << "  --key-dist <name>        uniform, zipf or hotspot (default: uniform)\n"
+                      << "  --zipf-theta <theta>     Zipf skew, between 0 and 1 (default: 0.99)\n"
+                      << "  --hot-keys <fraction>    Hotspot: fraction of keys that are hot (default: 0.2)\n"
+                      << "  --hot-ops <fraction>     Hotspot: fraction of operations on hot keys (default: 0.8)\n"
+                      << "  --mix <r:w:d>            Read:write:delete weights, e.g. 90:9:1\n"
+                      << "  --value-size <spec>      <n>, <min>-<max> or lognormal:<median>:<sigma> bytes\n"
+                      << "                           (default: 10)\n"
+                      << "  --preload                Write every key before the timed run\n"
+                      << "Replay:\n"
+                      << "  --replay <file>          Replay a trace written by kv_server --trace-file\n"
+                      << "  --replay-speed <x>       Speed relative to the recording; 0 = as fast as\n"
+                      << "                           possible (default: 1)\n"
+                      << "Output:\n"
+                      << "  --json <file>            Write the results to file as JSON\n"
+                      << "  --csv <file>             Append the results to file as a CSV row\n"
                       << "  --help                   Show this help message\n";
             return 0;
         }
     }
     
-    LoadGenerator generator(server_url, num_threads, duration, workload_type);
-    generator.run();
+    config.duration_seconds = duration >= 0 ? duration : config.replay_path.empty() ? 60 : 0;
+    config.workload = WorkloadConfig::preset(config.workload_type);
+    if (keys >= 0) config.workload.key_count = static_cast<uint64_t>(keys);
+    if (!key_prefix.empty()) config.workload.key_prefix = key_prefix;
+    if (!key_distribution.empty()) config.workload.key_distribution = key_distribution;
+    if (zipf_theta >= 0) config.workload.zipf_theta = zipf_theta;
+    if (hot_keys >= 0) config.workload.hot_keys = hot_keys;
+    if (hot_ops >= 0) config.workload.hot_ops = hot_ops;
+    if (!value_size.empty()) config.workload.value_size = value_size;
+    if (!mix.empty() && !config.workload.set_mix(mix)) {
+        std::cerr << "Bad --mix '" << mix << "'; expected read:write:delete weights" << std::endl;
+        return 1;
+    }
+    
+    LoadGenerator generator(config);
+    if (!generator.run()) {
+        return 1;
+    }
     
-    return 0;
+    int status = 0;
+    if (!json_path.empty() && !generator.write_json(json_path)) {
+        std::cerr << "Cannot write " << json_path << std::endl;
+        status = 1;
+    }
+    if (!csv_path.empty() && !generator.write_csv(csv_path)) {
+        std::cerr << "Cannot write " << csv_path << std::endl;
+        status = 1;
+    }
+    return status;
 }
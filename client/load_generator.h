@@ -6,43 +6,147 @@
 #include <chrono>
 #include <atomic>
 #include <memory>
+#include <random>
+#include <algorithm>
+#include "binary_client.h"
+#include "workload.h"
+#include "metrics.h"
+#include "trace_recorder.h"
+
+namespace httplib {
+class Client;
+}
+
+// Latencies recorded by one worker thread, in ns, in the server's histogram
+// buckets; merged into a HistogramSnapshot after the run
+struct LatencyRecorder {
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(HistogramBuckets::kCount);
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+
+    // n requests that each took ns
+    void record(uint64_t ns, uint64_t n = 1) {
+        buckets[HistogramBuckets::index_of(ns)] += n;
+        count += n;
+        sum_ns += ns * n;
+        max_ns = std::max(max_ns, ns);
+    }
+
+    void add_to(HistogramSnapshot& snapshot, uint64_t& max_ns_out) const;
+};
 
 struct LoadGeneratorStats {
     uint64_t total_requests = 0;
     uint64_t successful_requests = 0;
     uint64_t failed_requests = 0;
-    double total_response_time_ms = 0.0;
-    uint64_t min_response_time_ms = UINT64_MAX;
-    uint64_t max_response_time_ms = 0;
-    std::chrono::system_clock::time_point start_time;
-    std::chrono::system_clock::time_point end_time;
+    double duration_s = 0.0;
+    // Open loop: from each request's scheduled send time, so time spent
+    // queued behind a slow response counts (coordinated-omission correction).
+    // Closed loop: the same as service_time.
+    HistogramSnapshot latency;
+    uint64_t max_latency_ns = 0;
+    // From the actual send to the response
+    HistogramSnapshot service_time;
+    uint64_t max_service_time_ns = 0;
+};
+
+struct LoadGeneratorConfig {
+    std::string server_url = "http://localhost:8080";
+    int num_threads = 10;
+    int duration_seconds = 60;  // With replay, 0 runs until the trace ends
+    std::string workload_type = "get_all";
+    int batch_size = 100;       // Keys per request for the batch workloads
+
+    // "binary" sends to binary_port on the host of server_url, pipeline
+    // requests at a time over one connection per thread
+    std::string protocol = "http";
+    int binary_port = 9090;
+    int pipeline = 1;
+
+    // > 0 runs open loop: requests are sent on a fixed schedule of rate
+    // per second in total, whether or not earlier ones have returned;
+    // 0 runs closed loop, each thread sending as fast as responses come
+    double rate = 0.0;
+
+    // Keys, operation mix and value sizes (starts from the workload_type preset)
+    WorkloadConfig workload;
+
+    // Write every key of the key space before the timed run
+    bool preload = false;
+
+    // Replay a trace recorded by the server (--trace-file) instead of
+    // generating requests. Each key's operations stay on one thread, in
+    // order. speed scales the original timing (2 = twice as fast); 0 sends
+    // as fast as responses allow.
+    std::string replay_path;
+    double replay_speed = 1.0;
 };
 
 class LoadGenerator {
 public:
-    LoadGenerator(const std::string& server_url, int num_threads, int duration_seconds, const std::string& workload_type);
-    
-    // Run the load test
-    void run();
-    
+    explicit LoadGenerator(const LoadGeneratorConfig& config);
+
+    // Run the load test; false if it could not start
+    bool run();
+
     // Get statistics
     LoadGeneratorStats get_stats() const;
-    
+
+    // Machine-readable results: a JSON object, or one CSV row appended to
+    // path (with a header row if the file is new). False if it can't be written.
+    bool write_json(const std::string& path) const;
+    bool write_csv(const std::string& path) const;
+
 private:
+    // Keys per request while preloading
+    static constexpr size_t kPreloadBatch = 1000;
+
+    // Counts and latencies owned by one worker thread
+    struct alignas(64) WorkerStats {
+        uint64_t requests = 0;
+        uint64_t successes = 0;
+        uint64_t failures = 0;
+        LatencyRecorder latency;
+        LatencyRecorder service_time;
+    };
+
     std::string server_url_;
     int num_threads_;
     int duration_seconds_;
     std::string workload_type_;
+    int batch_size_;  // Keys per request for the batch workloads
+    std::string protocol_;
+    int binary_port_;
+    int pipeline_;    // Binary requests in flight per connection
+    double rate_;     // Requests per second across all threads; 0 = closed loop
+    Workload workload_;
+    bool preload_;
+    std::string replay_path_;
+    double replay_speed_;
     LoadGeneratorStats stats_;
     std::atomic<bool> stop_flag_;
-    std::atomic<uint64_t> total_requests_atomic_;
-    std::atomic<uint64_t> successful_requests_atomic_;
-    std::atomic<uint64_t> failed_requests_atomic_;
-    std::atomic<double> total_response_time_atomic_;
-    
-    void worker_thread();
-    void generate_request();
+    std::atomic<int> active_workers_{0};
+    std::chrono::steady_clock::time_point start_;
+    std::vector<WorkerStats> workers_;
+    std::vector<std::vector<TraceEntry>> replay_;  // Per thread
+
+    void worker_thread(int index);
+    bool generate_request(httplib::Client& cli, std::mt19937_64& gen, Operation& op);
+    bool send_http(httplib::Client& cli, const Operation& op);
+    void binary_worker_thread(int index);
+    void replay_thread(int index);
+    bool load_trace();
+    bool preload_keys();
+    void preload_range(uint64_t first, uint64_t last, std::atomic<uint64_t>& failed);
+    std::string binary_host() const;
+    std::chrono::nanoseconds send_interval(int requests_per_send) const;
+    std::chrono::steady_clock::time_point first_send(int index, std::chrono::nanoseconds interval) const;
+    bool wait_until(std::chrono::steady_clock::time_point when) const;
+    void collect_stats();
     void print_results();
+    bool is_open_loop() const;
+    bool is_batch_workload() const;
 };
 
 #endif // LOAD_GENERATOR_H
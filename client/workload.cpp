@@ -0,0 +1,208 @@
+#include "workload.h"
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+WorkloadConfig WorkloadConfig::preset(const std::string& workload_type) {
+    WorkloadConfig config;
+    if (workload_type == "put_all") {
+        // Create/Delete only
+        config.read_ratio = 0.0;
+        config.write_ratio = 0.5;
+        config.delete_ratio = 0.5;
+    } else if (workload_type == "get_popular") {
+        // Read same keys repeatedly (popular keys)
+        config.key_prefix = "popular:";
+        config.key_count = 100;
+    } else if (workload_type == "get_put") {
+        // 70% reads, 30% writes
+        config.read_ratio = 0.7;
+        config.write_ratio = 0.3;
+    } else if (workload_type == "put_batch") {
+        config.read_ratio = 0.0;
+        config.write_ratio = 1.0;
+    }
+    // get_all and get_batch: reads of the whole key space
+    return config;
+}
+
+bool WorkloadConfig::set_mix(const std::string& mix) {
+    double weights[3];
+    std::istringstream in(mix);
+    char sep1 = 0, sep2 = 0;
+    if (!(in >> weights[0] >> sep1 >> weights[1] >> sep2 >> weights[2]) || sep1 != ':' || sep2 != ':' ||
+        !in.eof()) {
+        return false;
+    }
+    if (weights[0] < 0 || weights[1] < 0 || weights[2] < 0 || weights[0] + weights[1] + weights[2] <= 0) {
+        return false;
+    }
+    read_ratio = weights[0];
+    write_ratio = weights[1];
+    delete_ratio = weights[2];
+    return true;
+}
+
+Workload::Workload(const WorkloadConfig& config) : config_(config) {
+    if (config_.key_count == 0) {
+        error_ = "key count must be positive";
+        return;
+    }
+
+    double total = config_.read_ratio + config_.write_ratio + config_.delete_ratio;
+    if (total <= 0) {
+        error_ = "operation mix is empty";
+        return;
+    }
+    read_cutoff_ = config_.read_ratio / total;
+    write_cutoff_ = (config_.read_ratio + config_.write_ratio) / total;
+
+    if (config_.key_distribution == "zipf") {
+        keys_ = KeyDistribution::kZipf;
+        double theta = config_.zipf_theta;
+        if (!(theta > 0 && theta < 1)) {
+            error_ = "zipf theta must be between 0 and 1";
+            return;
+        }
+        double n = static_cast<double>(config_.key_count);
+        for (uint64_t i = 1; i <= config_.key_count; ++i) {
+            zeta_n_ += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+        double zeta_2 = 1.0 + 1.0 / std::pow(2.0, theta);
+        zipf_alpha_ = 1.0 / (1.0 - theta);
+        zipf_eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta_2 / zeta_n_);
+    } else if (config_.key_distribution == "hotspot") {
+        keys_ = KeyDistribution::kHotspot;
+        hot_count_ = std::min(config_.key_count,
+                              std::max<uint64_t>(1, static_cast<uint64_t>(config_.hot_keys * config_.key_count)));
+        if (!(config_.hot_keys > 0 && config_.hot_keys <= 1 && config_.hot_ops >= 0 && config_.hot_ops <= 1)) {
+            error_ = "hot key and hot operation fractions must be between 0 and 1";
+            return;
+        }
+    } else if (config_.key_distribution != "uniform") {
+        error_ = "unknown key distribution '" + config_.key_distribution + "'";
+        return;
+    }
+
+    if (!parse_value_size(config_.value_size)) {
+        error_ = "bad value size '" + config_.value_size + "'";
+    }
+}
+
+bool Workload::parse_value_size(const std::string& spec) {
+    try {
+        if (spec.compare(0, 10, "lognormal:") == 0) {
+            size_t colon = spec.find(':', 10);
+            if (colon == std::string::npos) return false;
+            double median = std::stod(spec.substr(10, colon - 10));
+            double sigma = std::stod(spec.substr(colon + 1));
+            if (median < 1 || sigma < 0) return false;
+            value_sizes_ = ValueSizes::kLogNormal;
+            lognormal_mu_ = std::log(median);
+            lognormal_sigma_ = sigma;
+            return true;
+        }
+        size_t used = 0;
+        unsigned long long low = std::stoull(spec, &used);
+        if (used == spec.size()) {
+            value_sizes_ = ValueSizes::kFixed;
+            min_value_ = max_value_ = static_cast<size_t>(low);
+        } else if (spec[used] == '-') {
+            size_t rest = 0;
+            unsigned long long high = std::stoull(spec.substr(used + 1), &rest);
+            if (used + 1 + rest != spec.size() || high < low) return false;
+            value_sizes_ = ValueSizes::kUniform;
+            min_value_ = static_cast<size_t>(low);
+            max_value_ = static_cast<size_t>(high);
+        } else {
+            return false;
+        }
+        return max_value_ <= WorkloadConfig::kMaxValueSize;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+uint64_t Workload::next_index(std::mt19937_64& gen) const {
+    uint64_t n = config_.key_count;
+    switch (keys_) {
+        case KeyDistribution::kUniform:
+            break;
+        case KeyDistribution::kZipf: {
+            double u = std::uniform_real_distribution<double>(0.0, 1.0)(gen);
+            double uz = u * zeta_n_;
+            if (uz < 1.0) return 0;
+            if (uz < 1.0 + std::pow(0.5, config_.zipf_theta)) return std::min<uint64_t>(1, n - 1);
+            auto index = static_cast<uint64_t>(n * std::pow(zipf_eta_ * u - zipf_eta_ + 1.0, zipf_alpha_));
+            return std::min(index, n - 1);
+        }
+        case KeyDistribution::kHotspot:
+            if (hot_count_ >= n || std::uniform_real_distribution<double>(0.0, 1.0)(gen) < config_.hot_ops) {
+                return std::uniform_int_distribution<uint64_t>(0, hot_count_ - 1)(gen);
+            }
+            return std::uniform_int_distribution<uint64_t>(hot_count_, n - 1)(gen);
+    }
+    return std::uniform_int_distribution<uint64_t>(0, n - 1)(gen);
+}
+
+std::string Workload::key_at(uint64_t index) const {
+    return config_.key_prefix + std::to_string(index + 1);
+}
+
+std::string Workload::next_key(std::mt19937_64& gen) const {
+    return key_at(next_index(gen));
+}
+
+size_t Workload::next_value_size(std::mt19937_64& gen) const {
+    switch (value_sizes_) {
+        case ValueSizes::kFixed:
+            return min_value_;
+        case ValueSizes::kUniform:
+            return std::uniform_int_distribution<size_t>(min_value_, max_value_)(gen);
+        case ValueSizes::kLogNormal: {
+            double size = std::lognormal_distribution<double>(lognormal_mu_, lognormal_sigma_)(gen);
+            return static_cast<size_t>(std::min(std::max(size, 1.0), double(WorkloadConfig::kMaxValueSize)));
+        }
+    }
+    return min_value_;
+}
+
+void Workload::next(std::mt19937_64& gen, Operation& op) const {
+    double pick = std::uniform_real_distribution<double>(0.0, 1.0)(gen);
+    op.type = pick < read_cutoff_ ? OpType::kRead : pick < write_cutoff_ ? OpType::kWrite : OpType::kDelete;
+    op.key = next_key(gen);
+    op.value_size = op.type == OpType::kWrite ? next_value_size(gen) : 0;
+}
+
+std::string Workload::describe() const {
+    std::ostringstream out;
+    out << config_.key_count << " keys (" << config_.key_prefix << "N), " << config_.key_distribution;
+    if (config_.key_distribution == "zipf") {
+        out << " theta " << config_.zipf_theta;
+    } else if (config_.key_distribution == "hotspot") {
+        out << " " << config_.hot_ops * 100 << "% of ops on " << config_.hot_keys * 100 << "% of keys";
+    }
+    out << "; mix " << read_cutoff_ * 100 << "% read, " << (write_cutoff_ - read_cutoff_) * 100 << "% write, "
+        << (1.0 - write_cutoff_) * 100 << "% delete; values " << config_.value_size << " bytes";
+    return out.str();
+}
+
+std::string make_value(size_t size) {
+    // Letters from a cheap generator, so values look like text rather than
+    // one repeated byte; larger values repeat the block
+    static const std::string block = [] {
+        std::string letters(4096, 'a');
+        uint32_t state = 12345;
+        for (char& c : letters) {
+            state = state * 1103515245u + 12345u;
+            c = static_cast<char>('a' + (state >> 16) % 26);
+        }
+        return letters;
+    }();
+    std::string value;
+    value.reserve(size);
+    while (value.size() < size) {
+        value.append(block, 0, std::min(block.size(), size - value.size()));
+    }
+    return value;
+}
@@ -0,0 +1,104 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+
+enum class OpType {
+    kRead,
+    kWrite,
+    kDelete,
+};
+
+struct Operation {
+    OpType type = OpType::kRead;
+    std::string key;
+    size_t value_size = 0;  // Writes
+};
+
+// What a run sends. Presets for the named workloads come from
+// WorkloadConfig::preset(); command-line options then override fields.
+struct WorkloadConfig {
+    std::string key_prefix = "key:";
+    uint64_t key_count = 100000;     // Keys are key_prefix + 1..key_count
+
+    // uniform, zipf (rank r drawn with probability ~ 1/r^zipf_theta) or
+    // hotspot (hot_ops of the operations go to the first hot_keys of the
+    // key space, the rest to the others)
+    std::string key_distribution = "uniform";
+    double zipf_theta = 0.99;
+    double hot_keys = 0.2;
+    double hot_ops = 0.8;
+
+    // Relative weights of reads, writes and deletes
+    double read_ratio = 1.0;
+    double write_ratio = 0.0;
+    double delete_ratio = 0.0;
+
+    // Value sizes: "<n>" bytes, "<min>-<max>" uniform, or
+    // "lognormal:<median>:<sigma>" (capped at kMaxValueSize)
+    std::string value_size = "10";
+
+    static constexpr size_t kMaxValueSize = 16 << 20;
+
+    static WorkloadConfig preset(const std::string& workload_type);
+
+    // "R:W:D" weights, e.g. "90:9:1"; false if malformed
+    bool set_mix(const std::string& mix);
+};
+
+// Draws operations for a WorkloadConfig. Immutable once built, so one
+// instance serves every thread, each with its own generator.
+class Workload {
+public:
+    explicit Workload(const WorkloadConfig& config);
+
+    // False (with a message) if the configuration can't be used
+    bool is_valid() const { return error_.empty(); }
+    const std::string& get_error() const { return error_; }
+
+    void next(std::mt19937_64& gen, Operation& op) const;
+    std::string next_key(std::mt19937_64& gen) const;
+    size_t next_value_size(std::mt19937_64& gen) const;
+
+    // Key for index 0..key_count-1, e.g. for preloading
+    std::string key_at(uint64_t index) const;
+    uint64_t get_key_count() const { return config_.key_count; }
+
+    std::string describe() const;
+
+private:
+    enum class KeyDistribution { kUniform, kZipf, kHotspot };
+    enum class ValueSizes { kFixed, kUniform, kLogNormal };
+
+    WorkloadConfig config_;
+    std::string error_;
+    KeyDistribution keys_ = KeyDistribution::kUniform;
+    uint64_t hot_count_ = 0;   // Hotspot: keys 0..hot_count_-1 are hot
+
+    // Cumulative operation weights, normalized
+    double read_cutoff_ = 1.0;
+    double write_cutoff_ = 1.0;
+
+    // Zipf constants (Gray et al., "Quickly Generating Billion-Record
+    // Synthetic Databases"), computed once in O(key_count)
+    double zeta_n_ = 0;
+    double zipf_alpha_ = 0;
+    double zipf_eta_ = 0;
+
+    ValueSizes value_sizes_ = ValueSizes::kFixed;
+    size_t min_value_ = 10;
+    size_t max_value_ = 10;
+    double lognormal_mu_ = 0;
+    double lognormal_sigma_ = 0;
+
+    uint64_t next_index(std::mt19937_64& gen) const;
+    bool parse_value_size(const std::string& spec);
+};
+
+// Value of the given size; the contents don't matter to the server
+std::string make_value(size_t size);
+
+#endif // WORKLOAD_H
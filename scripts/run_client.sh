@@ -2,19 +2,23 @@
 
 # CPU pinning for load generator (cores 4-7)
 # Adjust core numbers based on your system
+# Options after the first three are passed to the load generator
+# (e.g. --rate 5000 --csv results.csv)
 if [ $# -lt 3 ]; then
-    echo "Usage: $0 <num_threads> <duration_seconds> <workload_type>"
-    echo "Workload types: put_all, get_all, get_popular, get_put"
+    echo "Usage: $0 <num_threads> <duration_seconds> <workload_type> [load_generator options]"
+    echo "Workload types: put_all, get_all, get_popular, get_put, get_batch, put_batch"
     exit 1
 fi
 
 NUM_THREADS=$1
 DURATION=$2
 WORKLOAD=$3
+shift 3
 
 echo "Running load test with $NUM_THREADS threads for $DURATION seconds (workload: $WORKLOAD)..."
 taskset -c 4-7 ./build/bin/load_generator \
     --url "http://localhost:8080" \
     --threads $NUM_THREADS \
     --duration $DURATION \
-    --workload $WORKLOAD
+    --workload $WORKLOAD \
+    "$@"
@@ -1,39 +1,42 @@
 #!/bin/bash
 
 # Run a complete load test experiment with multiple load levels
-# Usage: ./run_experiment.sh <workload_type> <output_file>
+# Usage: ./run_experiment.sh <workload_type> <output_file> [rate_per_sec]
+#
+# Each load level appends one CSV row to <output_file> (throughput, latency
+# percentiles in microseconds, success counts) and writes its full result
+# as JSON next to it. With rate_per_sec the load generator runs open loop
+# at that rate, so latency includes time spent behind slow responses.
 
 if [ $# -lt 2 ]; then
-    echo "Usage: $0 <workload_type> <output_file>"
-    echo "Workload types: put_all, get_all, get_popular, get_put"
+    echo "Usage: $0 <workload_type> <output_file> [rate_per_sec]"
+    echo "Workload types: put_all, get_all, get_popular, get_put, get_batch, put_batch"
     exit 1
 fi
 
 WORKLOAD=$1
 OUTPUT_FILE=$2
+RATE=${3:-0}
 DURATION=300  # 5 minutes per test
 LOAD_LEVELS=(5 10 20 50 100)
 
-echo "=== Running Load Test Experiment ===" > $OUTPUT_FILE
-echo "Workload: $WORKLOAD" >> $OUTPUT_FILE
-echo "Duration per test: $DURATION seconds" >> $OUTPUT_FILE
-echo "Load levels: ${LOAD_LEVELS[@]}" >> $OUTPUT_FILE
-echo "" >> $OUTPUT_FILE
-echo "Load Level,Throughput (req/sec),Avg Response Time (ms),Success Rate (%)" >> $OUTPUT_FILE
+echo "=== Running Load Test Experiment ==="
+echo "Workload: $WORKLOAD"
+echo "Duration per test: $DURATION seconds"
+echo "Load levels: ${LOAD_LEVELS[@]}"
+if [ "$RATE" != "0" ]; then
+    echo "Open loop at $RATE req/sec"
+fi
+echo ""
 
+rm -f "$OUTPUT_FILE"
 for load_level in "${LOAD_LEVELS[@]}"; do
     echo "Running test with $load_level threads..."
     
-    # Run the load test and capture output
-    OUTPUT=$(bash scripts/run_client.sh $load_level $DURATION $WORKLOAD 2>&1)
-    
-    # Extract metrics from output
-    THROUGHPUT=$(echo "$OUTPUT" | grep "Throughput:" | awk '{print $2}')
-    AVG_RESPONSE=$(echo "$OUTPUT" | grep "Avg Response Time:" | awk '{print $4}')
-    SUCCESS_RATE=$(echo "$OUTPUT" | grep "Success Rate:" | awk '{print $3}')
-    
-    # Append to output file
-    echo "$load_level,$THROUGHPUT,$AVG_RESPONSE,$SUCCESS_RATE" >> $OUTPUT_FILE
+    bash scripts/run_client.sh $load_level $DURATION $WORKLOAD \
+        --rate $RATE \
+        --csv "$OUTPUT_FILE" \
+        --json "${OUTPUT_FILE%.*}_${load_level}.json"
     
     # Wait between tests
     sleep 10
@@ -41,4 +44,4 @@ done
 
 echo ""
 echo "Experiment complete! Results saved to $OUTPUT_FILE"
-cat $OUTPUT_FILE
+cat "$OUTPUT_FILE"
@@ -14,16 +14,26 @@ else
 fi
 
 # Step 2: Create tables and grant privileges
-psql -U postgres -h localhost -d kvstore <<EOF
+psql -U postgres -h localhost -d kvstore <<'EOF'
 CREATE TABLE IF NOT EXISTS kv_store (
     id SERIAL PRIMARY KEY,
     key VARCHAR(255) NOT NULL UNIQUE,
-    value TEXT NOT NULL,
+    value BYTEA NOT NULL,
+    expires_at BIGINT,
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
     updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
 );
 
 CREATE INDEX IF NOT EXISTS idx_key ON kv_store(key);
+ALTER TABLE kv_store ADD COLUMN IF NOT EXISTS expires_at BIGINT;
+DO $$
+BEGIN
+    IF (SELECT data_type FROM information_schema.columns
+        WHERE table_name = 'kv_store' AND column_name = 'value') = 'text' THEN
+        ALTER TABLE kv_store ALTER COLUMN value TYPE BYTEA USING convert_to(value, 'UTF8');
+    END IF;
+END $$;
+CREATE INDEX IF NOT EXISTS idx_expires_at ON kv_store(expires_at) WHERE expires_at IS NOT NULL;
 
 GRANT ALL PRIVILEGES ON ALL TABLES IN SCHEMA public TO postgres;
 GRANT ALL PRIVILEGES ON ALL SEQUENCES IN SCHEMA public TO postgres;
@@ -8,7 +8,8 @@ CREATE DATABASE IF NOT EXISTS kvstore;
 CREATE TABLE IF NOT EXISTS kv_store (
     id SERIAL PRIMARY KEY,
     key VARCHAR(255) NOT NULL UNIQUE,
-    value TEXT NOT NULL,
+    value BYTEA NOT NULL,
+    expires_at BIGINT,
     created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
     updated_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP
 );
@@ -16,6 +17,21 @@ CREATE TABLE IF NOT EXISTS kv_store (
 -- Create index on key for faster lookups
 CREATE INDEX IF NOT EXISTS idx_key ON kv_store(key);
 
+-- Expiry time in Unix seconds (NULL: never); added to tables created before it
+ALTER TABLE kv_store ADD COLUMN IF NOT EXISTS expires_at BIGINT;
+
+-- Values are raw bytes; converts the TEXT column of tables created before
+DO $$
+BEGIN
+    IF (SELECT data_type FROM information_schema.columns
+        WHERE table_name = 'kv_store' AND column_name = 'value') = 'text' THEN
+        ALTER TABLE kv_store ALTER COLUMN value TYPE BYTEA USING convert_to(value, 'UTF8');
+    END IF;
+END $$;
+
+-- Lets the expiry sweeper find expired rows without a full scan
+CREATE INDEX IF NOT EXISTS idx_expires_at ON kv_store(expires_at) WHERE expires_at IS NOT NULL;
+
 -- Grant permissions to postgres user
 GRANT ALL PRIVILEGES ON DATABASE kvstore TO postgres;
 GRANT ALL PRIVILEGES ON ALL TABLES IN SCHEMA public TO postgres;
@@ -1,9 +1,11 @@
 #!/bin/bash
 
 # Basic functional testing script
-# Tests all API endpoints
+# Tests all API endpoints. Runs against either backend: start the server
+# with PostgreSQL or with --backend local, and pass its URL if it isn't
+# the default.
 
-SERVER_URL="http://localhost:8080"
+SERVER_URL="${1:-http://localhost:8080}"
 PASS=0
 FAIL=0
 
@@ -108,6 +110,113 @@ else
 fi
 echo ""
 
+# Test 8: Batch put, get and delete
+echo "Test 8: Batch Put/Get/Delete"
+curl -s -X POST $SERVER_URL/api/kv/batch/put \
+  -H "Content-Type: application/json" \
+  -d '{"items": [{"key": "batch:1", "value": "one"}, {"key": "batch:2", "value": "two"}]}' > /dev/null
+RESPONSE=$(curl -s -w "\n%{http_code}" -X POST $SERVER_URL/api/kv/batch/get \
+  -H "Content-Type: application/json" \
+  -d '{"keys": ["batch:1", "batch:2", "batch:missing"]}')
+HTTP_CODE=$(echo "$RESPONSE" | tail -n1)
+BODY=$(echo "$RESPONSE" | head -n-1)
+curl -s -X POST $SERVER_URL/api/kv/batch/delete \
+  -H "Content-Type: application/json" \
+  -d '{"keys": ["batch:1", "batch:2"]}' > /dev/null
+if [ "$HTTP_CODE" = "200" ] && echo "$BODY" | grep -q '"value":"two"' && echo "$BODY" | grep -q "Key not found"; then
+    echo "PASS: Batch get returned per-key results"
+    ((PASS++))
+else
+    echo "FAIL: Batch get returned $HTTP_CODE or incorrect results"
+    ((FAIL++))
+fi
+echo ""
+
+# Test 9: Raw value read
+echo "Test 9: Raw Value Read"
+curl -s -o /dev/null -X POST $SERVER_URL/api/kv \
+  -H "Content-Type: application/json" \
+  -d '{"key": "raw:1", "value": "say \"hi\""}'
+RESPONSE=$(curl -s -w "\n%{http_code}" -H "Accept: application/octet-stream" "$SERVER_URL/api/kv?key=raw:1")
+HTTP_CODE=$(echo "$RESPONSE" | tail -n1)
+BODY=$(echo "$RESPONSE" | head -n-1)
+if [ "$HTTP_CODE" = "200" ] && [ "$BODY" = 'say "hi"' ]; then
+    echo "PASS: Raw read returned the stored bytes"
+    ((PASS++))
+else
+    echo "FAIL: Raw read returned $HTTP_CODE or incorrect bytes"
+    ((FAIL++))
+fi
+curl -s -o /dev/null -X DELETE "$SERVER_URL/api/kv?key=raw:1"
+echo ""
+
+# Test 10: Raw value upload and range read
+echo "Test 10: Raw Value Upload and Range Read"
+printf '0123456789abcdef' | curl -s -o /dev/null -X PUT -H "Transfer-Encoding: chunked" \
+  --data-binary @- "$SERVER_URL/api/kv/raw?key=raw:2"
+RESPONSE=$(curl -s -w "\n%{http_code}" -H "Range: bytes=4-9" "$SERVER_URL/api/kv/raw?key=raw:2")
+HTTP_CODE=$(echo "$RESPONSE" | tail -n1)
+BODY=$(echo "$RESPONSE" | head -n-1)
+if [ "$HTTP_CODE" = "206" ] && [ "$BODY" = "456789" ]; then
+    echo "PASS: Range read returned 206 with the requested bytes"
+    ((PASS++))
+else
+    echo "FAIL: Range read returned $HTTP_CODE or incorrect bytes"
+    ((FAIL++))
+fi
+curl -s -o /dev/null -X DELETE "$SERVER_URL/api/kv?key=raw:2"
+echo ""
+
+# Test 11: Prometheus metrics
+echo "Test 11: Metrics Endpoint"
+RESPONSE=$(curl -s -w "\n%{http_code}" "$SERVER_URL/metrics")
+HTTP_CODE=$(echo "$RESPONSE" | tail -n1)
+BODY=$(echo "$RESPONSE" | head -n-1)
+if [ "$HTTP_CODE" = "200" ] && echo "$BODY" | grep -q 'kv_request_duration_seconds{route="get",quantile="0.99"}'; then
+    echo "PASS: Metrics report request latencies"
+    ((PASS++))
+else
+    echo "FAIL: Metrics returned $HTTP_CODE or no GET latencies"
+    ((FAIL++))
+fi
+echo ""
+
+# Test 12: Key with a TTL expires
+echo "Test 12: Key Expiry"
+curl -s -o /dev/null -X POST $SERVER_URL/api/kv \
+  -H "Content-Type: application/json" \
+  -d '{"key": "ttl:1", "value": "short-lived", "ttl": 2}'
+BEFORE=$(curl -s "$SERVER_URL/api/kv?key=ttl:1")
+sleep 3
+AFTER=$(curl -s "$SERVER_URL/api/kv?key=ttl:1")
+if echo "$BEFORE" | grep -q "short-lived" && echo "$AFTER" | grep -q "not found"; then
+    echo "PASS: Key was readable until its TTL passed"
+    ((PASS++))
+else
+    echo "FAIL: Read returned $BEFORE before and $AFTER after the TTL"
+    ((FAIL++))
+fi
+echo ""
+
+# Test 13: Binary value through the raw endpoint
+echo "Test 13: Binary Raw Value"
+BIN_IN=$(mktemp)
+BIN_OUT=$(mktemp)
+printf 'a\000b\377\376c' > "$BIN_IN"
+curl -s -o /dev/null -X PUT --data-binary @"$BIN_IN" "$SERVER_URL/api/kv/raw?key=raw:3"
+HTTP_CODE=$(curl -s -o "$BIN_OUT" -w "%{http_code}" "$SERVER_URL/api/kv/raw?key=raw:3")
+JSON_BODY=$(curl -s "$SERVER_URL/api/kv?key=raw:3")
+if [ "$HTTP_CODE" = "200" ] && cmp -s "$BIN_IN" "$BIN_OUT" && echo "$JSON_BODY" | grep -q 'u0000b\\ufffd\\ufffdc'; then
+    echo "PASS: Raw read returned the stored bytes; JSON read replaced the invalid UTF-8"
+    ((PASS++))
+else
+    echo "FAIL: Raw read returned $HTTP_CODE or different bytes, or JSON read returned $JSON_BODY"
+    ((FAIL++))
+fi
+rm -f "$BIN_IN" "$BIN_OUT"
+curl -s -o /dev/null -X DELETE "$SERVER_URL/api/kv?key=raw:3"
+echo ""
+
 # Summary
 echo "=== Test Summary ==="
 echo "Passed: $PASS"
@@ -0,0 +1,188 @@
+#!/bin/bash
+
+# Restart tests for the local backend (--backend local)
+# Starts its own server on a scratch data directory with tiny segments, so
+# writes roll segments and compaction runs within seconds. It then checks
+# what survives a restart: overwrites, deletes (tombstones), expired keys,
+# segments merged by compaction while writes went on, and a torn write at
+# the end of the log.
+
+SERVER_BIN="${1:-./build/bin/kv_server}"
+PORT="${2:-18080}"
+SERVER_URL="http://localhost:$PORT"
+DATA_DIR=$(mktemp -d)
+SERVER_LOG="$DATA_DIR/server.log"
+SERVER_PID=""
+PASS=0
+FAIL=0
+
+start_server() {
+    # No expiry sweeps: expired records stay in the log for replay to skip
+    "$SERVER_BIN" --port "$PORT" --backend local --data-dir "$DATA_DIR/data" \
+        --segment-size 4K --compact-threshold 0.3 --expiry-interval 0 >> "$SERVER_LOG" 2>&1 &
+    SERVER_PID=$!
+    for _ in $(seq 50); do
+        curl -s -o /dev/null "$SERVER_URL/health" && return 0
+        sleep 0.1
+    done
+    echo "Server did not start; log in $SERVER_LOG"
+    exit 1
+}
+
+stop_server() {
+    kill -TERM "$SERVER_PID" 2>/dev/null
+    wait "$SERVER_PID" 2>/dev/null
+}
+
+put() {
+    curl -s -o /dev/null -X POST "$SERVER_URL/api/kv" -H "Content-Type: application/json" -d "$1"
+}
+
+# Raw value of a key, or "<status>" if it can't be read
+value_of() {
+    local response
+    response=$(curl -s -w "\n%{http_code}" -H "Accept: application/octet-stream" "$SERVER_URL/api/kv?key=$1")
+    if [ "$(echo "$response" | tail -n1)" = "200" ]; then
+        echo "$response" | head -n-1
+    else
+        echo "<$(echo "$response" | tail -n1)>"
+    fi
+}
+
+stat_of() {
+    curl -s "$SERVER_URL/api/stats" | grep -o "\"$1\":[0-9]*" | cut -d: -f2
+}
+
+# Every expected key holds its expected value; prints the first mismatch
+check_keys() {
+    local i got
+    for i in $(seq 1 40); do
+        got=$(value_of "k:$i")
+        if [ "$i" -le 10 ] && [ "$got" != "<404>" ]; then
+            echo "k:$i was deleted but reads $got"; return 1
+        elif [ "$i" -gt 10 ] && [ "$got" != "second-$i" ]; then
+            echo "k:$i reads $got, not second-$i"; return 1
+        fi
+    done
+    for i in $(seq 1 "$WRITTEN"); do
+        got=$(value_of "during:$i")
+        if [ "$got" != "during-$i" ]; then
+            echo "during:$i reads $got"; return 1
+        fi
+    done
+    got=$(value_of "ttl:short")
+    [ "$got" = "<404>" ] || { echo "ttl:short reads $got after expiring"; return 1; }
+    got=$(value_of "ttl:long")
+    [ "$got" = "kept" ] || { echo "ttl:long reads $got"; return 1; }
+    return 0
+}
+
+trap 'stop_server; rm -rf "$DATA_DIR"' EXIT
+
+echo "=== Local Backend Restart Tests ==="
+echo "Server: $SERVER_BIN on port $PORT, data in $DATA_DIR"
+echo ""
+start_server
+
+# Test 1: Write, overwrite, delete and expire
+echo "Test 1: Write, Overwrite, Delete, Expire"
+for i in $(seq 1 40); do
+    put "{\"key\": \"k:$i\", \"value\": \"first-$i-$(printf '%0100d' 0)\"}"
+done
+for i in $(seq 1 40); do
+    put "{\"key\": \"k:$i\", \"value\": \"second-$i\"}"
+done
+for i in $(seq 1 10); do
+    curl -s -o /dev/null -X DELETE "$SERVER_URL/api/kv?key=k:$i"
+done
+put '{"key": "ttl:short", "value": "gone", "ttl": 1}'
+put '{"key": "ttl:long", "value": "kept", "ttl": 3600}'
+WRITTEN=0
+sleep 1.5
+if MISMATCH=$(check_keys); then
+    echo "PASS: Reads see the latest write of every key"
+    ((PASS++))
+else
+    echo "FAIL: $MISMATCH"
+    ((FAIL++))
+fi
+echo ""
+
+# Test 2: Compaction while writes continue
+echo "Test 2: Compaction During Writes"
+COMPACTIONS=0
+for round in $(seq 1 40); do
+    for _ in $(seq 1 5); do
+        ((WRITTEN++))
+        put "{\"key\": \"during:$WRITTEN\", \"value\": \"during-$WRITTEN\"}"
+    done
+    # Dead records to compact away
+    put "{\"key\": \"k:40\", \"value\": \"filler-$round-$(printf '%0200d' 0)\"}"
+    put '{"key": "k:40", "value": "second-40"}'
+    COMPACTIONS=$(stat_of local_compactions)
+    [ "${COMPACTIONS:-0}" -gt 0 ] && [ "$round" -ge 10 ] && break
+    sleep 0.1
+done
+if [ "${COMPACTIONS:-0}" -gt 0 ] && MISMATCH=$(check_keys); then
+    echo "PASS: $COMPACTIONS compaction(s) ran and every key still reads back"
+    ((PASS++))
+else
+    echo "FAIL: ${MISMATCH:-no compaction ran (local_compactions = ${COMPACTIONS:-none})}"
+    ((FAIL++))
+fi
+echo ""
+
+# Test 3: Restart replays the log
+echo "Test 3: Restart"
+# k:11..k:40, the during: keys and ttl:long; the expired key is still in
+# the index until swept, but replay leaves it out
+KEYS=$((30 + WRITTEN + 1))
+stop_server
+start_server
+if MISMATCH=$(check_keys) && [ "$(stat_of local_keys)" = "$KEYS" ]; then
+    echo "PASS: $KEYS keys replayed with their latest values; deletes and expired keys stayed gone"
+    ((PASS++))
+else
+    echo "FAIL: ${MISMATCH:-local_keys is $(stat_of local_keys) after restart, expected $KEYS}"
+    ((FAIL++))
+fi
+echo ""
+
+# Test 4: Torn write at the end of the log
+echo "Test 4: Torn Tail"
+stop_server
+LAST_SEGMENT=$(ls "$DATA_DIR"/data/*.log | sort | tail -n1)
+SIZE=$(stat -c %s "$LAST_SEGMENT")
+# A record header promising an 8-byte key and 100-byte value, cut short
+printf '\x00\x00\x00\x00\x08\x00\x00\x00\x64\x00\x00\x00torn-wri' >> "$LAST_SEGMENT"
+start_server
+if [ "$(stat -c %s "$LAST_SEGMENT")" = "$SIZE" ] && grep -q "Truncated" "$SERVER_LOG" && MISMATCH=$(check_keys); then
+    put '{"key": "after:torn", "value": "appended"}'
+    stop_server
+    start_server
+    if [ "$(value_of after:torn)" = "appended" ] && MISMATCH=$(check_keys); then
+        echo "PASS: The partial record was truncated and later writes survive a restart"
+        ((PASS++))
+    else
+        echo "FAIL: After truncation: ${MISMATCH:-after:torn reads $(value_of after:torn)}"
+        ((FAIL++))
+    fi
+else
+    echo "FAIL: ${MISMATCH:-segment is $(stat -c %s "$LAST_SEGMENT") bytes, expected $SIZE after truncation}"
+    ((FAIL++))
+fi
+echo ""
+
+# Summary
+echo "=== Test Summary ==="
+echo "Passed: $PASS"
+echo "Failed: $FAIL"
+echo "Total: $((PASS + FAIL))"
+
+if [ $FAIL -eq 0 ]; then
+    echo "All tests passed!"
+    exit 0
+else
+    echo "Some tests failed!"
+    exit 1
+fi
@@ -0,0 +1,81 @@
+#include "admission.h"
+#include <algorithm>
+#include <functional>
+
+static uint64_t hash_key(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+}
+
+FrequencySketch::FrequencySketch(size_t expected_entries) {
+    size_t width = 64;
+    while (width < expected_entries * 2) {
+        width <<= 1;
+    }
+    table_.assign(width * kDepth, 0);
+    width_mask_ = width - 1;
+    sample_size_ = width * 5;
+}
+
+size_t FrequencySketch::index_of(uint64_t hash, int row) const {
+    // Double hashing: row i probes h1 + i * h2, with h2 forced odd
+    uint64_t h1 = hash * 0x9E3779B97F4A7C15ULL;
+    uint64_t h2 = (hash >> 32) | 1;
+    return row * (width_mask_ + 1) + (((h1 + row * h2) >> 17) & width_mask_);
+}
+
+void FrequencySketch::record(std::string_view key) {
+    uint64_t hash = hash_key(key);
+    bool incremented = false;
+    for (int row = 0; row < kDepth; ++row) {
+        uint8_t& counter = table_[index_of(hash, row)];
+        if (counter < kMaxCount) {
+            counter++;
+            incremented = true;
+        }
+    }
+    if (incremented && ++additions_ >= sample_size_) {
+        age();
+    }
+}
+
+uint8_t FrequencySketch::frequency(std::string_view key) const {
+    uint64_t hash = hash_key(key);
+    uint8_t result = kMaxCount;
+    for (int row = 0; row < kDepth; ++row) {
+        result = std::min(result, table_[index_of(hash, row)]);
+    }
+    return result;
+}
+
+void FrequencySketch::age() {
+    for (auto& counter : table_) {
+        counter >>= 1;
+    }
+    additions_ /= 2;
+    resets_++;
+}
+
+CandidateTracker::CandidateTracker(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)) {}
+
+void CandidateTracker::record(std::string_view key, bool admitted) {
+    uint64_t hash = hash_key(key);
+    auto result = outcomes_.emplace(hash, admitted);
+    if (!result.second) {
+        result.first->second = admitted;
+        return;
+    }
+    
+    order_.push_back(hash);
+    if (order_.size() > capacity_) {
+        outcomes_.erase(order_.front());
+        order_.pop_front();
+    }
+}
+
+CandidateTracker::Outcome CandidateTracker::lookup(std::string_view key) const {
+    auto it = outcomes_.find(hash_key(key));
+    if (it == outcomes_.end()) {
+        return Outcome::kUnknown;
+    }
+    return it->second ? Outcome::kAdmitted : Outcome::kRejected;
+}
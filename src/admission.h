@@ -0,0 +1,55 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <string_view>
+#include <unordered_map>
+#include <deque>
+#include <vector>
+#include <cstdint>
+
+// Count-min sketch of recent access frequencies (the TinyLFU filter).
+// Counters saturate at 15 and are all halved once the number of recorded
+// accesses reaches the sample size, so old popularity fades out.
+// Not thread-safe: the owning cache serializes access.
+class FrequencySketch {
+public:
+    // expected_entries sizes the table; roughly the cache capacity in entries
+    explicit FrequencySketch(size_t expected_entries);
+    
+    void record(std::string_view key);
+    uint8_t frequency(std::string_view key) const;
+    
+    uint64_t get_resets() const { return resets_; }
+    
+private:
+    static constexpr int kDepth = 4;
+    static constexpr uint8_t kMaxCount = 15;
+    
+    std::vector<uint8_t> table_;  // kDepth rows of width_ counters
+    size_t width_mask_;
+    size_t additions_ = 0;
+    size_t sample_size_;
+    uint64_t resets_ = 0;
+    
+    size_t index_of(uint64_t hash, int row) const;
+    void age();
+};
+
+// Remembers the outcome of recent admission decisions so hits and misses can
+// be attributed to keys that were admitted or rejected. Bounded FIFO.
+class CandidateTracker {
+public:
+    enum class Outcome { kUnknown, kAdmitted, kRejected };
+    
+    explicit CandidateTracker(size_t capacity);
+    
+    void record(std::string_view key, bool admitted);
+    Outcome lookup(std::string_view key) const;
+    
+private:
+    size_t capacity_;
+    std::unordered_map<uint64_t, bool> outcomes_;  // key hash -> admitted
+    std::deque<uint64_t> order_;
+};
+
+#endif // ADMISSION_H
@@ -0,0 +1,141 @@
+#include "binary_loop_server.h"
+#include <iostream>
+#include <vector>
+
+BinaryLoopServer::BinaryLoopServer(std::shared_ptr<ThreadPool> pool, std::shared_ptr<RequestHandler> handler)
+    : EventLoopServer(pool, BinaryHeader::kSize + kMaxKeyBytes + kMaxValueBytes), pool_(pool), handler_(handler) {}
+
+void BinaryLoopServer::process(uint64_t id, Connection& conn) {
+    std::vector<Request> batch;
+    size_t offset = 0;
+    size_t batch_bytes = 0;
+
+    while (batch.size() < kMaxBatchRequests && batch_bytes < kMaxBatchBytes) {
+        if (conn.in.size() - offset < BinaryHeader::kSize) {
+            break;
+        }
+        BinaryHeader header = BinaryHeader::decode(conn.in.data() + offset);
+        if (header.magic != BinaryHeader::kRequestMagic || header.key_size > kMaxKeyBytes ||
+            header.value_size > kMaxValueBytes) {
+            // Can't find the next frame boundary; answer what we have and hang up
+            std::cerr << "Binary protocol: malformed request, closing connection" << std::endl;
+            conn.in.clear();
+            if (batch.empty()) {
+                send_and_close(id, conn, std::string());
+                return;
+            }
+            conn.close_after_write = true;
+            break;
+        }
+
+        size_t frame_size = BinaryHeader::kSize + header.body_size();
+        if (conn.in.size() - offset < frame_size) {
+            break;
+        }
+        const char* body = conn.in.data() + offset + BinaryHeader::kSize;
+        Request request;
+        request.header = header;
+        request.key.assign(body, header.key_size);
+        request.value.assign(body + header.key_size, header.value_size);
+        batch.push_back(std::move(request));
+
+        offset += frame_size;
+        batch_bytes += frame_size;
+    }
+
+    if (batch.empty()) {
+        return;
+    }
+    if (!conn.close_after_write) {
+        conn.in.erase(0, offset);
+    }
+
+    auto work = std::make_shared<Batch>();
+    work->requests = std::move(batch);
+    dispatch_async(id, conn, [this, work](Done done) {
+        work->done = std::move(done);
+        run(work);
+    }, true);
+}
+
+void BinaryLoopServer::run(std::shared_ptr<Batch> batch) {
+    while (batch->next < batch->requests.size()) {
+        const Request& request = batch->requests[batch->next++];
+        if (static_cast<BinaryOp>(request.header.opcode) != BinaryOp::kGet || request.key.empty()) {
+            execute(request, batch->out);
+            continue;
+        }
+
+        uint64_t start = TickClock::now();
+        batch->suspended.store(false, std::memory_order_relaxed);
+        handler_->lookup_async(request.key, [this, batch, &request, start](LookupResult result) {
+            const BinaryHeader& header = request.header;
+            if (result.found) {
+                append_binary_response(batch->out, header.opcode, BinaryStatus::kOk, header.opaque,
+                                       result.value());
+            } else {
+                append_binary_response(batch->out, header.opcode, BinaryStatus::kNotFound, header.opaque);
+            }
+            uint64_t end = TickClock::now();
+            handler_->get_metrics().record(Route::kBinaryGet, end > start ? TickClock::to_ns(end - start) : 0);
+
+            if (!batch->suspended.exchange(true)) {
+                return;  // Answered before lookup_async returned; run() carries on
+            }
+            // On the database's thread, which must not block: resume on the pool
+            try {
+                pool_->enqueue([this, batch] { run(batch); });
+            } catch (const std::exception& e) {
+                // Pool already stopped; send what is done
+                batch->done(std::move(batch->out));
+            }
+        });
+        if (!batch->suspended.exchange(true)) {
+            return;  // The callback resumes the batch
+        }
+    }
+    batch->done(std::move(batch->out));
+}
+
+void BinaryLoopServer::execute(const Request& request, std::string& out) {
+    const BinaryHeader& header = request.header;
+    ScopedTimer<Route> timer(handler_->get_metrics(), Route::kNotFound);
+    if (request.key.empty()) {
+        append_binary_response(out, header.opcode, BinaryStatus::kBadRequest, header.opaque, "Key is required");
+        return;
+    }
+
+    switch (static_cast<BinaryOp>(header.opcode)) {
+        case BinaryOp::kGet:
+            // run() answers GETs, so it can wait for the database without
+            // holding the thread
+            return;
+        case BinaryOp::kSet:
+            timer.set_key(Route::kBinarySet);
+            if (request.key.size() > RequestHandler::kMaxKeyBytes) {
+                append_binary_response(out, header.opcode, BinaryStatus::kBadRequest, header.opaque,
+                                       "Key is too long");
+            } else if (handler_->store(request.key, request.value)) {
+                append_binary_response(out, header.opcode, BinaryStatus::kOk, header.opaque);
+            } else {
+                append_binary_response(out, header.opcode, BinaryStatus::kError, header.opaque,
+                                       "Failed to create in database");
+            }
+            return;
+        case BinaryOp::kDelete:
+            timer.set_key(Route::kBinaryDelete);
+            if (handler_->remove(request.key)) {
+                append_binary_response(out, header.opcode, BinaryStatus::kOk, header.opaque);
+            } else {
+                append_binary_response(out, header.opcode, BinaryStatus::kError, header.opaque,
+                                       "Failed to delete from database");
+            }
+            return;
+    }
+    append_binary_response(out, header.opcode, BinaryStatus::kBadRequest, header.opaque, "Unknown opcode");
+}
+
+std::string BinaryLoopServer::unavailable_response() {
+    // Nothing the client could act on; closing tells it to retry elsewhere
+    return std::string();
+}
@@ -0,0 +1,61 @@
+#ifndef BINARY_LOOP_SERVER_H
+#define BINARY_LOOP_SERVER_H
+
+#include "event_loop_server.h"
+#include "binary_protocol.h"
+#include "request_handler.h"
+#include <memory>
+#include <vector>
+#include <atomic>
+
+// The binary protocol (binary_protocol.h) on the epoll loop. Requests go
+// through the same RequestHandler as HTTP, so both front ends share the
+// cache, filters and database. Every complete request in the read buffer is
+// taken as one batch and run in order by a single pool task, so a pipelined
+// client pays one hand-off per batch rather than per request. When the
+// database reads asynchronously, a GET that misses the cache suspends its
+// batch instead of holding the pool thread; the read's callback queues the
+// rest of the batch back on the pool.
+class BinaryLoopServer : public EventLoopServer {
+public:
+    BinaryLoopServer(std::shared_ptr<ThreadPool> pool, std::shared_ptr<RequestHandler> handler);
+
+protected:
+    void process(uint64_t id, Connection& conn) override;
+    std::string unavailable_response() override;
+
+private:
+    static constexpr size_t kMaxKeyBytes = 64 * 1024;
+    static constexpr size_t kMaxValueBytes = 64 * 1024 * 1024;
+
+    // Requests taken per batch; the rest wait for the next one
+    static constexpr size_t kMaxBatchRequests = 1024;
+    static constexpr size_t kMaxBatchBytes = 4 * 1024 * 1024;
+
+    struct Request {
+        BinaryHeader header;
+        std::string key;
+        std::string value;
+    };
+
+    // A batch in progress; may be carried across database callbacks
+    struct Batch {
+        std::vector<Request> requests;
+        size_t next = 0;
+        std::string out;
+        Done done;
+        // Set by whichever of the GET's callback and the task that issued
+        // it finishes second, which then carries on with the batch
+        std::atomic<bool> suspended{false};
+    };
+
+    std::shared_ptr<ThreadPool> pool_;
+    std::shared_ptr<RequestHandler> handler_;
+
+    // Run requests from batch->next on; returns early when a GET waits on
+    // the database
+    void run(std::shared_ptr<Batch> batch);
+    void execute(const Request& request, std::string& out);
+};
+
+#endif // BINARY_LOOP_SERVER_H
@@ -0,0 +1,111 @@
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+// Length-prefixed binary protocol for internal callers. Every message, in
+// either direction, is a 16-byte header followed by the key and value:
+//
+//   offset  size  field
+//        0     1  magic       0x80 request, 0x81 response
+//        1     1  opcode      BinaryOp
+//        2     1  status      BinaryStatus (responses; 0 in requests)
+//        3     1  reserved    0
+//        4     4  key length
+//        8     4  value length
+//       12     4  opaque      copied from the request into its response
+//
+// Integers are big-endian. Responses carry no key; a GET hit carries the
+// value and an error carries a message as its value. A client may send any
+// number of requests without waiting; responses come back in order.
+enum class BinaryOp : uint8_t {
+    kGet = 1,
+    kSet = 2,
+    kDelete = 3,
+};
+
+enum class BinaryStatus : uint8_t {
+    kOk = 0,
+    kNotFound = 1,
+    kError = 2,       // The operation failed (e.g. the database write)
+    kBadRequest = 3,  // Unknown opcode or empty key
+};
+
+struct BinaryHeader {
+    static constexpr size_t kSize = 16;
+    static constexpr uint8_t kRequestMagic = 0x80;
+    static constexpr uint8_t kResponseMagic = 0x81;
+
+    uint8_t magic = 0;
+    uint8_t opcode = 0;
+    uint8_t status = 0;
+    uint32_t key_size = 0;
+    uint32_t value_size = 0;
+    uint32_t opaque = 0;
+
+    size_t body_size() const { return static_cast<size_t>(key_size) + value_size; }
+
+    void encode(std::string& out) const {
+        char buf[kSize] = {static_cast<char>(magic), static_cast<char>(opcode), static_cast<char>(status), 0};
+        put_u32(buf + 4, key_size);
+        put_u32(buf + 8, value_size);
+        put_u32(buf + 12, opaque);
+        out.append(buf, kSize);
+    }
+
+    // Reads kSize bytes
+    static BinaryHeader decode(const char* data) {
+        BinaryHeader header;
+        header.magic = static_cast<uint8_t>(data[0]);
+        header.opcode = static_cast<uint8_t>(data[1]);
+        header.status = static_cast<uint8_t>(data[2]);
+        header.key_size = get_u32(data + 4);
+        header.value_size = get_u32(data + 8);
+        header.opaque = get_u32(data + 12);
+        return header;
+    }
+
+    static void put_u32(char* p, uint32_t v) {
+        p[0] = static_cast<char>(v >> 24);
+        p[1] = static_cast<char>(v >> 16);
+        p[2] = static_cast<char>(v >> 8);
+        p[3] = static_cast<char>(v);
+    }
+
+    static uint32_t get_u32(const char* p) {
+        return (static_cast<uint32_t>(static_cast<uint8_t>(p[0])) << 24) |
+               (static_cast<uint32_t>(static_cast<uint8_t>(p[1])) << 16) |
+               (static_cast<uint32_t>(static_cast<uint8_t>(p[2])) << 8) |
+               static_cast<uint32_t>(static_cast<uint8_t>(p[3]));
+    }
+};
+
+inline void append_binary_request(std::string& out, BinaryOp op, uint32_t opaque, std::string_view key,
+                                  std::string_view value = std::string_view()) {
+    BinaryHeader header;
+    header.magic = BinaryHeader::kRequestMagic;
+    header.opcode = static_cast<uint8_t>(op);
+    header.key_size = static_cast<uint32_t>(key.size());
+    header.value_size = static_cast<uint32_t>(value.size());
+    header.opaque = opaque;
+    header.encode(out);
+    out.append(key.data(), key.size());
+    out.append(value.data(), value.size());
+}
+
+inline void append_binary_response(std::string& out, uint8_t opcode, BinaryStatus status, uint32_t opaque,
+                                   std::string_view value = std::string_view()) {
+    BinaryHeader header;
+    header.magic = BinaryHeader::kResponseMagic;
+    header.opcode = opcode;
+    header.status = static_cast<uint8_t>(status);
+    header.value_size = static_cast<uint32_t>(value.size());
+    header.opaque = opaque;
+    header.encode(out);
+    out.append(value.data(), value.size());
+}
+
+#endif // BINARY_PROTOCOL_H
@@ -0,0 +1,180 @@
+#include "body_parser.h"
+#include "utf8.h"
+#include <cstdint>
+
+namespace {
+
+class BodyParser {
+public:
+    explicit BodyParser(std::string_view text) : text_(text) {}
+
+    bool parse(std::string& key, std::string& value) {
+        bool have_key = false;
+        bool have_value = false;
+
+        skip_space();
+        if (!consume('{')) return false;
+        skip_space();
+        if (consume('}')) return false;
+
+        while (true) {
+            skip_space();
+            if (!consume('"') || !read_string(name_)) return false;
+            skip_space();
+            if (!consume(':')) return false;
+            skip_space();
+
+            if (peek() == '"') {
+                pos_++;
+                std::string* target = &name_;
+                if (name_ == "key") {
+                    target = &key;
+                    have_key = true;
+                } else if (name_ == "value") {
+                    target = &value;
+                    have_value = true;
+                }
+                if (!read_string(*target)) return false;
+            } else if (name_ == "key" || name_ == "value" || !skip_scalar()) {
+                return false;
+            }
+
+            skip_space();
+            if (consume(',')) continue;
+            if (consume('}')) break;
+            return false;
+        }
+
+        skip_space();
+        return pos_ == text_.size() && have_key && have_value;
+    }
+
+private:
+    std::string_view text_;
+    size_t pos_ = 0;
+    std::string name_;
+
+    char peek() const { return pos_ < text_.size() ? text_[pos_] : '\0'; }
+
+    bool consume(char c) {
+        if (peek() != c) return false;
+        pos_++;
+        return true;
+    }
+
+    void skip_space() {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            pos_++;
+        }
+    }
+
+    // Numbers, true, false and null; the full parser rejects malformed ones
+    bool skip_scalar() {
+        size_t start = pos_;
+        while (pos_ < text_.size()) {
+            char c = text_[pos_];
+            bool number = (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E';
+            bool literal = (c >= 'a' && c <= 'z');
+            if (!number && !literal) break;
+            pos_++;
+        }
+        std::string_view token = text_.substr(start, pos_ - start);
+        if (token == "true" || token == "false" || token == "null") return true;
+        return !token.empty() && (token[0] == '-' || (token[0] >= '0' && token[0] <= '9'));
+    }
+
+    bool read_hex4(uint32_t& code) {
+        if (text_.size() - pos_ < 4) return false;
+        code = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = text_[pos_++];
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    static void append_utf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    // Called after the opening quote; copies unescaped runs in one go.
+    // Text that isn't valid UTF-8 fails, as it does in the full parser.
+    bool read_string(std::string& out) {
+        out.clear();
+        while (true) {
+            size_t run_start = pos_;
+            while (pos_ < text_.size() && text_[pos_] != '"' && text_[pos_] != '\\' &&
+                   static_cast<unsigned char>(text_[pos_]) >= 0x20) {
+                if (static_cast<unsigned char>(text_[pos_]) < 0x80) {
+                    pos_++;
+                    continue;
+                }
+                size_t size = utf8_sequence_length(text_.data() + pos_, text_.size() - pos_);
+                if (size == 0) return false;
+                pos_ += size;
+            }
+            out.append(text_.data() + run_start, pos_ - run_start);
+            if (pos_ >= text_.size()) return false;
+
+            char c = text_[pos_++];
+            if (c == '"') return true;
+            if (c != '\\') return false;  // Raw control character
+            if (pos_ >= text_.size()) return false;
+
+            switch (text_[pos_++]) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t code;
+                    if (!read_hex4(code)) return false;
+                    if (code >= 0xD800 && code <= 0xDBFF) {
+                        // High surrogate; the low half must follow
+                        uint32_t low;
+                        if (!consume('\\') || !consume('u') || !read_hex4(low) || low < 0xDC00 || low > 0xDFFF) {
+                            return false;
+                        }
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                        return false;
+                    }
+                    append_utf8(out, code);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+    }
+};
+
+}  // namespace
+
+bool parse_key_value_body(std::string_view body, std::string& key, std::string& value) {
+    BodyParser parser(body);
+    return parser.parse(key, value);
+}
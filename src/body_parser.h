@@ -0,0 +1,17 @@
+#ifndef BODY_PARSER_H
+#define BODY_PARSER_H
+
+#include <string>
+#include <string_view>
+
+// Reads the "key" and "value" strings of a flat JSON object such as
+// {"key": "k", "value": "v"} without building a document. Other members
+// are skipped if their values are strings, numbers, booleans or null.
+//
+// Returns false for anything else (nested values, missing members,
+// malformed input, strings that aren't valid UTF-8); callers then fall back to a full JSON parser, which
+// produces the proper error. key and value are overwritten, so callers can
+// pass reused buffers.
+bool parse_key_value_body(std::string_view body, std::string& key, std::string& value);
+
+#endif // BODY_PARSER_H
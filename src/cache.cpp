@@ -1,43 +1,209 @@
 #include "cache.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
 
-LRUCache::LRUCache(size_t max_size) : max_size_(max_size) {}
+CacheEntry* CacheEntry::create(SlabAllocator& slab, std::string_view key, std::string_view value,
+                               size_t raw_size, uint64_t expires_at) {
+    size_t chunk_size;
+    void* mem = slab.allocate(sizeof(CacheEntry) + key.size() + value.size(), chunk_size);
+    
+    auto* entry = static_cast<CacheEntry*>(mem);
+    entry->prev = nullptr;
+    entry->next = nullptr;
+    new (&entry->refs) std::atomic<uint32_t>(1);
+    entry->chunk_size = static_cast<uint32_t>(chunk_size);
+    entry->key_size = static_cast<uint32_t>(key.size());
+    entry->value_size = static_cast<uint32_t>(value.size());
+    entry->flags = 0;
+    entry->raw_size = static_cast<uint32_t>(raw_size);
+    entry->timer = TimerLink();
+    entry->timer.expires_at = expires_at;
+    std::memcpy(entry->data(), key.data(), key.size());
+    std::memcpy(entry->data() + key.size(), value.data(), value.size());
+    return entry;
+}
+
+void CacheEntry::release(SlabAllocator& slab, CacheEntry* entry) {
+    if (entry->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        if (entry->flags & kDetached) {
+            slab.unpin(entry->chunk_size);
+        }
+        slab.deallocate(entry, entry->chunk_size);
+    }
+}
+
+void CacheEntry::detach(SlabAllocator& slab, CacheEntry* entry) {
+    // Flag before dropping the reference, so whichever release turns out
+    // to be the last one sees it
+    if (entry->refs.load(std::memory_order_acquire) > 1) {
+        entry->flags |= kDetached;
+        slab.pin(entry->chunk_size);
+    }
+    release(slab, entry);
+}
+
+size_t CacheEntry::charge_for(const SlabAllocator& slab, size_t key_size, size_t value_size) {
+    return slab.chunk_size_for(sizeof(CacheEntry) + key_size + value_size) + kIndexOverhead;
+}
+
+CacheValue::CacheValue(CacheEntry* entry, SlabAllocator* slab) : entry_(entry), slab_(slab) {
+    if (entry_ != nullptr) {
+        entry_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+CacheValue::CacheValue(const CacheValue& other) : CacheValue(other.entry_, other.slab_) {}
+
+CacheValue::CacheValue(CacheValue&& other) noexcept : entry_(other.entry_), slab_(other.slab_) {
+    other.entry_ = nullptr;
+    other.slab_ = nullptr;
+}
+
+CacheValue& CacheValue::operator=(CacheValue other) noexcept {
+    std::swap(entry_, other.entry_);
+    std::swap(slab_, other.slab_);
+    return *this;
+}
+
+CacheValue::~CacheValue() {
+    if (entry_ != nullptr) {
+        CacheEntry::release(*slab_, entry_);
+    }
+}
+
+CacheStats& CacheStats::operator+=(const CacheStats& other) {
+    size += other.size;
+    max_size += other.max_size;
+    bytes += other.bytes;
+    max_bytes += other.max_bytes;
+    reserved_bytes += other.reserved_bytes;
+    hits += other.hits;
+    misses += other.misses;
+    evictions += other.evictions;
+    expired += other.expired;
+    expiry_timers += other.expiry_timers;
+    compressed_entries += other.compressed_entries;
+    compression_saved_bytes += other.compression_saved_bytes;
+    admitted += other.admitted;
+    rejected += other.rejected;
+    admitted_requests += other.admitted_requests;
+    admitted_hits += other.admitted_hits;
+    rejected_requests += other.rejected_requests;
+    rejected_hits += other.rejected_hits;
+    return *this;
+}
+
+LRUCache::LRUCache(size_t max_size, size_t max_bytes, bool admission)
+    : max_size_(max_size), max_bytes_(max_bytes),
+      slab_(SlabAllocator::page_size_for_budget(max_bytes)),
+      admission_(admission && (max_bytes > 0 || max_size >= 2)),
+      expiry_wheel_(expiry_now()) {
+    if (admission_) {
+        // The window takes 1% of the capacity; the rest is the main LRU
+        if (max_size_ > 0) {
+            window_max_size_ = std::max<size_t>(1, max_size_ / 100);
+        }
+        window_max_bytes_ = max_bytes_ / 100;
+        
+        size_t expected_entries = max_size_ > 0 ? max_size_ : std::max<size_t>(64, max_bytes_ / 256);
+        sketch_.reset(new FrequencySketch(expected_entries));
+        candidates_.reset(new CandidateTracker(expected_entries * 4));
+    }
+}
+
+LRUCache::~LRUCache() {
+    for (List* list : {&main_, &window_}) {
+        while (list->front != nullptr) {
+            CacheEntry* next = list->front->next;
+            CacheEntry::release(slab_, list->front);
+            list->front = next;
+        }
+    }
+}
 
-std::shared_ptr<std::string> LRUCache::get(const std::string& key) {
+CacheValue LRUCache::get(const std::string& key) {
     std::unique_lock<std::mutex> lock(cache_mutex_);
     
     auto it = cache_map_.find(key);
     if (it == cache_map_.end()) {
-        misses_++;
-        return nullptr;  // Cache miss
+        record_access(key, false);
+        lock.unlock();
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return CacheValue();  // Cache miss
+    }
+    
+    CacheEntry* entry = it->second;
+    if (entry->expired()) {
+        erase_entry(entry);
+        record_access(key, false);
+        reserved_bytes_.store(slab_.get_reserved_bytes(), std::memory_order_relaxed);
+        lock.unlock();
+        expired_.fetch_add(1, std::memory_order_relaxed);
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return CacheValue();
     }
     
-    // Move to back (most recently used)
-    auto entry_it = it->second;
-    lru_list_.splice(lru_list_.end(), lru_list_, entry_it);
-    hits_++;
+    // Move to back (most recently used) of whichever list holds it
+    List& list = list_of(entry);
+    unlink(list, entry);
+    link_back(list, entry);
+    record_access(key, true);
+    CacheValue value(entry, &slab_);
+    lock.unlock();
     
-    return std::make_shared<std::string>(entry_it->value);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return value;
 }
 
-void LRUCache::put(const std::string& key, const std::string& value) {
+void LRUCache::put(const std::string& key, const std::string& value, size_t raw_size, uint64_t expires_at) {
     std::unique_lock<std::mutex> lock(cache_mutex_);
     
+    // Replacing an entry frees its chunk first so the new one can reuse it
+    // (the slab keeps the page even if that was its last chunk). An update of a key already in the main cache stays there.
+    uint8_t flags = admission_ ? CacheEntry::kInWindow : 0;
     auto it = cache_map_.find(key);
     if (it != cache_map_.end()) {
-        // Update existing entry
-        it->second->value = value;
-        lru_list_.splice(lru_list_.end(), lru_list_, it->second);
+        if (!(it->second->flags & CacheEntry::kInWindow)) {
+            flags = it->second->flags;
+        }
+        erase_entry(it->second);
+    }
+    
+    size_t charge = CacheEntry::charge_for(slab_, key.size(), value.size());
+    if ((max_bytes_ > 0 && charge > max_bytes_) || is_expired(expires_at, expiry_now())) {
+        // Larger than the whole budget, where caching it would flush
+        // everything else, or dead already
+        reserved_bytes_.store(slab_.get_reserved_bytes(), std::memory_order_relaxed);
         return;
     }
     
-    // Evict if cache is full
-    if (lru_list_.size() >= max_size_) {
+    if (!(flags & CacheEntry::kInWindow)) {
+        // Evict until the new entry fits
+        while (main_needs_eviction(charge)) {
+            evict_lru();
+        }
+    }
+    if (over_reserved()) {
+        slab_.trim();
+    }
+    for (size_t i = 0; i < kReservedEvictions && over_reserved(); ++i) {
         evict_lru();
     }
     
     // Add new entry to back (most recently used)
-    lru_list_.push_back({key, value});
-    cache_map_[key] = std::prev(lru_list_.end());
+    CacheEntry* entry = CacheEntry::create(slab_, key, value, raw_size, expires_at);
+    entry->flags = flags;
+    link_back(list_of(entry), entry);
+    cache_map_.emplace(entry->key(), entry);
+    count_bytes(entry, true);
+    schedule_expiry(entry);
+    
+    if (admission_) {
+        drain_window();
+    }
+    size_.store(cache_map_.size(), std::memory_order_relaxed);
+    reserved_bytes_.store(slab_.get_reserved_bytes(), std::memory_order_relaxed);
 }
 
 bool LRUCache::remove(const std::string& key) {
@@ -48,48 +214,268 @@ bool LRUCache::remove(const std::string& key) {
         return false;
     }
     
-    lru_list_.erase(it->second);
-    cache_map_.erase(it);
+    erase_entry(it->second);
+    reserved_bytes_.store(slab_.get_reserved_bytes(), std::memory_order_relaxed);
     return true;
 }
 
 bool LRUCache::exists(const std::string& key) {
     std::unique_lock<std::mutex> lock(cache_mutex_);
-    return cache_map_.find(key) != cache_map_.end();
+    auto it = cache_map_.find(key);
+    return it != cache_map_.end() && !it->second->expired();
 }
 
-size_t LRUCache::get_size() const {
+void LRUCache::collect_entries(std::vector<CacheValue>& entries) {
     std::unique_lock<std::mutex> lock(cache_mutex_);
-    return lru_list_.size();
+    entries.reserve(entries.size() + cache_map_.size());
+    for (List* list : {&main_, &window_}) {
+        for (CacheEntry* entry = list->back; entry != nullptr; entry = entry->prev) {
+            entries.emplace_back(entry, &slab_);
+        }
+    }
 }
 
-uint64_t LRUCache::get_hits() const {
+bool LRUCache::restore(std::string_view key, std::string_view value, size_t raw_size, uint64_t expires_at) {
     std::unique_lock<std::mutex> lock(cache_mutex_);
-    return hits_;
+    if (cache_map_.find(key) != cache_map_.end() || is_expired(expires_at, expiry_now())) {
+        return false;
+    }
+    
+    // Restored entries go straight to the main cache; the window is for
+    // keys whose popularity is still unknown
+    size_t charge = CacheEntry::charge_for(slab_, key.size(), value.size());
+    if (max_bytes_ > 0 && charge > max_bytes_ - window_max_bytes_) {
+        return false;
+    }
+    if (main_needs_eviction(charge)) {
+        return false;
+    }
+    
+    CacheEntry* entry = CacheEntry::create(slab_, key, value, raw_size, expires_at);
+    link_front(main_, entry);
+    cache_map_.emplace(entry->key(), entry);
+    count_bytes(entry, true);
+    schedule_expiry(entry);
+    size_.store(cache_map_.size(), std::memory_order_relaxed);
+    reserved_bytes_.store(slab_.get_reserved_bytes(), std::memory_order_relaxed);
+    return true;
 }
 
-uint64_t LRUCache::get_misses() const {
-    std::unique_lock<std::mutex> lock(cache_mutex_);
-    return misses_;
+size_t LRUCache::expire(uint64_t now) {
+    std::vector<std::string> due;
+    {
+        std::unique_lock<std::mutex> lock(cache_mutex_);
+        std::vector<TimerLink*> timers;
+        expiry_wheel_.advance(now, timers);
+        expiry_timers_.store(expiry_wheel_.size(), std::memory_order_relaxed);
+        due.reserve(timers.size());
+        for (TimerLink* timer : timers) {
+            due.emplace_back(CacheEntry::from_timer(timer)->key());
+        }
+    }
+    
+    // In batches, so requests get the lock in between
+    size_t expired = 0;
+    for (size_t start = 0; start < due.size(); start += kExpireBatch) {
+        std::unique_lock<std::mutex> lock(cache_mutex_);
+        for (size_t i = start; i < std::min(due.size(), start + kExpireBatch); ++i) {
+            // The key may have been overwritten meanwhile, with a later
+            // expiry or none
+            auto it = cache_map_.find(due[i]);
+            if (it != cache_map_.end() && is_expired(it->second->expires_at(), now)) {
+                erase_entry(it->second);
+                expired++;
+            }
+        }
+        reserved_bytes_.store(slab_.get_reserved_bytes(), std::memory_order_relaxed);
+    }
+    expired_.fetch_add(expired, std::memory_order_relaxed);
+    return expired;
 }
 
-uint64_t LRUCache::get_evictions() const {
-    std::unique_lock<std::mutex> lock(cache_mutex_);
-    return evictions_;
+CacheStats LRUCache::get_stats() const {
+    CacheStats stats;
+    stats.size = get_size();
+    stats.max_size = max_size_;
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.max_bytes = max_bytes_;
+    stats.reserved_bytes = reserved_bytes_.load(std::memory_order_relaxed);
+    stats.hits = get_hits();
+    stats.misses = get_misses();
+    stats.evictions = get_evictions();
+    stats.expired = expired_.load(std::memory_order_relaxed);
+    stats.expiry_timers = expiry_timers_.load(std::memory_order_relaxed);
+    stats.compressed_entries = compressed_entries_.load(std::memory_order_relaxed);
+    stats.compression_saved_bytes = saved_bytes_.load(std::memory_order_relaxed);
+    stats.admitted = admitted_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.admitted_requests = admitted_requests_.load(std::memory_order_relaxed);
+    stats.admitted_hits = admitted_hits_.load(std::memory_order_relaxed);
+    stats.rejected_requests = rejected_requests_.load(std::memory_order_relaxed);
+    stats.rejected_hits = rejected_hits_.load(std::memory_order_relaxed);
+    return stats;
 }
 
 void LRUCache::reset_stats() {
-    std::unique_lock<std::mutex> lock(cache_mutex_);
-    hits_ = 0;
-    misses_ = 0;
-    evictions_ = 0;
+    for (auto* counter : {&hits_, &misses_, &evictions_, &expired_, &admitted_, &rejected_,
+                          &admitted_requests_, &admitted_hits_, &rejected_requests_, &rejected_hits_}) {
+        counter->store(0, std::memory_order_relaxed);
+    }
+}
+
+bool LRUCache::main_needs_eviction(size_t incoming_charge) const {
+    if (main_.front == nullptr) {
+        return false;
+    }
+    if (max_size_ > 0 && main_.count + 1 > max_size_ - window_max_size_) {
+        return true;
+    }
+    return max_bytes_ > 0 && main_.bytes + incoming_charge > max_bytes_ - window_max_bytes_;
+}
+
+bool LRUCache::over_reserved() const {
+    return max_bytes_ > 0 && main_.front != nullptr && 
+           slab_.get_reserved_bytes() > max_bytes_ + slab_.get_pinned_bytes();
+}
+
+bool LRUCache::window_overflowing() const {
+    if (window_.front == nullptr) {
+        return false;
+    }
+    if (max_size_ > 0 && window_.count > window_max_size_) {
+        return true;
+    }
+    return max_bytes_ > 0 && window_.bytes > window_max_bytes_;
+}
+
+void LRUCache::link_back(List& list, CacheEntry* entry) {
+    entry->prev = list.back;
+    entry->next = nullptr;
+    if (list.back != nullptr) {
+        list.back->next = entry;
+    } else {
+        list.front = entry;
+    }
+    list.back = entry;
+    list.count++;
+    list.bytes += entry->charge();
+}
+
+void LRUCache::link_front(List& list, CacheEntry* entry) {
+    entry->prev = nullptr;
+    entry->next = list.front;
+    if (list.front != nullptr) {
+        list.front->prev = entry;
+    } else {
+        list.back = entry;
+    }
+    list.front = entry;
+    list.count++;
+    list.bytes += entry->charge();
+}
+
+void LRUCache::unlink(List& list, CacheEntry* entry) {
+    if (entry->prev != nullptr) {
+        entry->prev->next = entry->next;
+    } else {
+        list.front = entry->next;
+    }
+    if (entry->next != nullptr) {
+        entry->next->prev = entry->prev;
+    } else {
+        list.back = entry->prev;
+    }
+    list.count--;
+    list.bytes -= entry->charge();
+}
+
+void LRUCache::schedule_expiry(CacheEntry* entry) {
+    if (entry->expires_at() != 0) {
+        expiry_wheel_.schedule(&entry->timer);
+        expiry_timers_.store(expiry_wheel_.size(), std::memory_order_relaxed);
+    }
+}
+
+void LRUCache::erase_entry(CacheEntry* entry) {
+    cache_map_.erase(entry->key());
+    unlink(list_of(entry), entry);
+    if (entry->timer.scheduled()) {
+        expiry_wheel_.cancel(&entry->timer);
+        expiry_timers_.store(expiry_wheel_.size(), std::memory_order_relaxed);
+    }
+    size_.store(cache_map_.size(), std::memory_order_relaxed);
+    count_bytes(entry, false);
+    CacheEntry::detach(slab_, entry);
+}
+
+void LRUCache::count_bytes(const CacheEntry* entry, bool added) {
+    if (added) {
+        bytes_.fetch_add(entry->charge(), std::memory_order_relaxed);
+    } else {
+        bytes_.fetch_sub(entry->charge(), std::memory_order_relaxed);
+    }
+    if (entry->raw_size != 0) {
+        if (added) {
+            compressed_entries_.fetch_add(1, std::memory_order_relaxed);
+            saved_bytes_.fetch_add(entry->saved_bytes(), std::memory_order_relaxed);
+        } else {
+            compressed_entries_.fetch_sub(1, std::memory_order_relaxed);
+            saved_bytes_.fetch_sub(entry->saved_bytes(), std::memory_order_relaxed);
+        }
+    }
 }
 
 void LRUCache::evict_lru() {
-    if (!lru_list_.empty()) {
-        auto& front_entry = lru_list_.front();
-        cache_map_.erase(front_entry.key);
-        lru_list_.pop_front();
-        evictions_++;
+    if (main_.front != nullptr) {
+        erase_entry(main_.front);
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void LRUCache::drain_window() {
+    // Entries pushed out of the window compete with the main LRU victim
+    while (window_overflowing()) {
+        CacheEntry* candidate = window_.front;
+        
+        if (main_needs_eviction(candidate->charge())) {
+            CacheEntry* victim = main_.front;
+            if (sketch_->frequency(candidate->key()) <= sketch_->frequency(victim->key())) {
+                candidates_->record(candidate->key(), false);
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                erase_entry(candidate);
+                continue;
+            }
+            
+            candidates_->record(candidate->key(), true);
+            admitted_.fetch_add(1, std::memory_order_relaxed);
+            candidate->flags |= CacheEntry::kAdmitted;
+            while (main_needs_eviction(candidate->charge())) {
+                evict_lru();
+            }
+        }
+        
+        unlink(window_, candidate);
+        candidate->flags &= ~CacheEntry::kInWindow;
+        link_back(main_, candidate);
+    }
+}
+
+void LRUCache::record_access(std::string_view key, bool hit) {
+    if (!admission_) {
+        return;
+    }
+    
+    sketch_->record(key);
+    switch (candidates_->lookup(key)) {
+        case CandidateTracker::Outcome::kAdmitted:
+            admitted_requests_.fetch_add(1, std::memory_order_relaxed);
+            if (hit) admitted_hits_.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case CandidateTracker::Outcome::kRejected:
+            rejected_requests_.fetch_add(1, std::memory_order_relaxed);
+            if (hit) rejected_hits_.fetch_add(1, std::memory_order_relaxed);
+            break;
+        case CandidateTracker::Outcome::kUnknown:
+            break;
     }
 }
@@ -1,54 +1,288 @@
 #ifndef CACHE_H
 #define CACHE_H
 
+#include "slab_allocator.h"
+#include "admission.h"
+#include "timer_wheel.h"
+#include "expiry.h"
 #include <unordered_map>
-#include <list>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <vector>
+#include <atomic>
 #include <cstdint>
+#include <cstddef>
 
+// A cached key/value pair. The header, key bytes and value bytes share a
+// single slab chunk, so each entry is one allocation and the key is stored
+// once (the index refers to it through a string_view). Entries are immutable
+// once created and reference counted: the cache holds one reference and each
+// CacheValue handed out holds another.
 struct CacheEntry {
-    std::string key;
-    std::string value;
+    CacheEntry* prev;  // Recency list links (unused by CLOCK)
+    CacheEntry* next;
+    std::atomic<uint32_t> refs;
+    uint32_t chunk_size;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint8_t flags;
+    uint32_t raw_size;  // Size before compression; 0 if the value is stored as is
+    TimerLink timer;    // Expiry time, and the entry's place on the cache's timer wheel
+    
+    enum Flags : uint8_t {
+        kInWindow = 1 << 0,  // Admission window, not yet in the main cache
+        kAdmitted = 1 << 1,  // Won an admission contest against a victim
+        kDetached = 1 << 2,  // Out of the cache, kept alive by handles (pinned)
+    };
+    
+    std::string_view key() const { return {data(), key_size}; }
+    std::string_view value() const { return {data() + key_size, value_size}; }
+    uint64_t expires_at() const { return timer.expires_at; }
+    
+    static CacheEntry* from_timer(TimerLink* link) {
+        return reinterpret_cast<CacheEntry*>(reinterpret_cast<char*>(link) - offsetof(CacheEntry, timer));
+    }
+    
+    // Bytes charged against the cache's byte budget
+    size_t charge() const { return chunk_size + kIndexOverhead; }
+    
+    // Whether the expiry time has passed; reads the clock only for
+    // entries that have one
+    bool expired() const { return timer.expires_at != 0 && is_expired(timer.expires_at, expiry_now()); }
+    
+    // Memory saved by storing the value compressed
+    size_t saved_bytes() const { return raw_size > value_size ? raw_size - value_size : 0; }
+    
+    // Create with a single reference owned by the caller. A non-zero
+    // raw_size marks the value as compressed from that many bytes.
+    static CacheEntry* create(SlabAllocator& slab, std::string_view key, std::string_view value,
+                              size_t raw_size = 0, uint64_t expires_at = 0);
+    
+    // Drop one reference, returning the chunk to the slab with the last one
+    static void release(SlabAllocator& slab, CacheEntry* entry);
+    
+    // Drop the cache's reference to an entry it no longer holds. If handles
+    // still keep it alive, its chunk is counted as pinned until they let go.
+    static void detach(SlabAllocator& slab, CacheEntry* entry);
+    static size_t charge_for(const SlabAllocator& slab, size_t key_size, size_t value_size);
+    
+    // Approximate per-entry cost of the hash index (node plus bucket slot)
+    static constexpr size_t kIndexOverhead = 64;
+    
+private:
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+// Shared read-only reference to a cached value. Copying bumps the entry's
+// reference count instead of copying bytes, and the value stays valid even
+// if the entry is evicted or replaced meanwhile. The cache that produced it
+// must outlive the handle.
+class CacheValue {
+public:
+    CacheValue() = default;
+    CacheValue(CacheEntry* entry, SlabAllocator* slab);  // Adds a reference
+    CacheValue(const CacheValue& other);
+    CacheValue(CacheValue&& other) noexcept;
+    CacheValue& operator=(CacheValue other) noexcept;
+    ~CacheValue();
+    
+    explicit operator bool() const { return entry_ != nullptr; }
+    std::string_view key() const { return entry_ ? entry_->key() : std::string_view(); }
+    std::string_view view() const { return entry_ ? entry_->value() : std::string_view(); }
+    const char* data() const { return view().data(); }
+    size_t size() const { return entry_ ? entry_->value_size : 0; }
+    
+    // view() is compressed (gzip) and expands to raw_size() bytes
+    bool compressed() const { return entry_ && entry_->raw_size != 0; }
+    size_t raw_size() const { return compressed() ? entry_->raw_size : size(); }
+    
+    // Expiry time of the key (see expiry.h); 0 if it never expires
+    uint64_t expires_at() const { return entry_ ? entry_->expires_at() : 0; }
+    
+private:
+    CacheEntry* entry_ = nullptr;
+    SlabAllocator* slab_ = nullptr;
 };
 
-class LRUCache {
+struct CacheStats {
+    size_t size = 0;
+    size_t max_size = 0;
+    size_t bytes = 0;           // Charged bytes of live entries
+    size_t max_bytes = 0;       // Byte budget (0 = counting entries)
+    size_t reserved_bytes = 0;  // Memory held by the entry slabs
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t expired = 0;       // Entries dropped once their expiry time passed
+    size_t expiry_timers = 0;   // Entries waiting in the timer wheels
+    
+    // Entries held compressed, and the memory that saves
+    size_t compressed_entries = 0;
+    size_t compression_saved_bytes = 0;
+    
+    // Admission filter (W-TinyLFU); all zero when it is disabled
+    uint64_t admitted = 0;           // Candidates that displaced a less frequent victim
+    uint64_t rejected = 0;           // Candidates dropped in favour of the victim
+    uint64_t admitted_requests = 0;  // Lookups of keys last admitted...
+    uint64_t admitted_hits = 0;      // ...and how many of them hit
+    uint64_t rejected_requests = 0;  // Lookups of keys last rejected...
+    uint64_t rejected_hits = 0;      // ...and how many of them hit
+    
+    CacheStats& operator+=(const CacheStats& other);
+};
+
+// Interface shared by all cache implementations
+class Cache {
 public:
-    explicit LRUCache(size_t max_size);
+    virtual ~Cache() = default;
     
-    // Get value from cache (returns nullptr if not found)
-    std::shared_ptr<std::string> get(const std::string& key);
+    // Get value from cache (returns an empty handle if not found)
+    virtual CacheValue get(const std::string& key) = 0;
     
-    // Put key-value pair in cache
-    void put(const std::string& key, const std::string& value);
+    // Put key-value pair in cache. A non-zero raw_size means value is
+    // compressed and expands to raw_size bytes; get() hands it back as is.
+    // A non-zero expires_at (see expiry.h) drops the entry at that time.
+    virtual void put(const std::string& key, const std::string& value, size_t raw_size = 0,
+                     uint64_t expires_at = 0) = 0;
     
     // Delete key from cache
-    bool remove(const std::string& key);
+    virtual bool remove(const std::string& key) = 0;
     
     // Check if key exists
-    bool exists(const std::string& key);
+    virtual bool exists(const std::string& key) = 0;
+    
+    // Reference every entry, most recently used first, so the entries can
+    // be written out without holding the cache lock
+    virtual void collect_entries(std::vector<CacheValue>& entries) = 0;
+    
+    // Insert an entry behind everything already cached, as the next
+    // eviction candidate. Used to refill the cache from a snapshot: nothing
+    // is evicted to make room, and a key already cached is left alone.
+    // Returns whether the entry was inserted.
+    virtual bool restore(std::string_view key, std::string_view value, size_t raw_size = 0,
+                         uint64_t expires_at = 0) = 0;
+    
+    // Drop the entries whose expiry time is `now` or earlier, returning how
+    // many. Entries with an expiry are also checked on every lookup, so this
+    // only frees their memory sooner; called periodically by the sweeper.
+    virtual size_t expire(uint64_t now) = 0;
+    
+    // Due entries expire() erases per hold of the cache lock
+    static constexpr size_t kExpireBatch = 256;
+    
+    // Extra entries a write evicts while the slab holds more memory than
+    // the byte budget (partly empty pages of other size classes) even
+    // after returning the empty pages it keeps for reuse, so the cache
+    // sheds them gradually rather than all at once. Chunks still held by
+    // outstanding handles (a snapshot in progress) don't count, since
+    // evicting more would not give them back.
+    static constexpr size_t kReservedEvictions = 2;
     
     // Get cache statistics
-    size_t get_size() const;
-    size_t get_max_size() const { return max_size_; }
+    virtual CacheStats get_stats() const = 0;
+    virtual size_t get_max_size() const = 0;
+    virtual void reset_stats() = 0;
     
-    uint64_t get_hits() const;
-    uint64_t get_misses() const;
-    uint64_t get_evictions() const;
-    void reset_stats();
+    // Name of the eviction policy ("lru", "clock")
+    virtual std::string get_policy() const = 0;
+};
+
+// Exact LRU cache, optionally fronted by a W-TinyLFU admission filter.
+// With admission enabled, new keys enter a small LRU window (1% of the
+// capacity). A key leaving the window may only displace the main cache's
+// LRU victim if the frequency sketch has seen it more often, so a one-off
+// scan cannot flush the hot set.
+//
+// Entries with an expiry time are scheduled on a timer wheel, kept under
+// the cache lock, which expire() advances. Erasing an entry for any reason
+// cancels its timer.
+class LRUCache : public Cache {
+public:
+    // Capacity is max_size entries, or max_bytes of charged memory when
+    // max_bytes is non-zero (max_size 0 then means no entry limit)
+    explicit LRUCache(size_t max_size, size_t max_bytes = 0, bool admission = false);
+    ~LRUCache() override;
+    
+    CacheValue get(const std::string& key) override;
+    void put(const std::string& key, const std::string& value, size_t raw_size = 0,
+             uint64_t expires_at = 0) override;
+    bool remove(const std::string& key) override;
+    bool exists(const std::string& key) override;
+    void collect_entries(std::vector<CacheValue>& entries) override;
+    bool restore(std::string_view key, std::string_view value, size_t raw_size = 0,
+                 uint64_t expires_at = 0) override;
+    size_t expire(uint64_t now) override;
+    
+    // Statistics are kept in atomics so readers never take the cache lock
+    CacheStats get_stats() const override;
+    size_t get_size() const { return size_.load(std::memory_order_relaxed); }
+    size_t get_max_size() const override { return max_size_; }
+    
+    uint64_t get_hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t get_misses() const { return misses_.load(std::memory_order_relaxed); }
+    uint64_t get_evictions() const { return evictions_.load(std::memory_order_relaxed); }
+    void reset_stats() override;
+    std::string get_policy() const override { return admission_ ? "lru+tinylfu" : "lru"; }
     
 private:
+    struct List {
+        CacheEntry* front = nullptr;  // Least recently used
+        CacheEntry* back = nullptr;   // Most recently used
+        size_t count = 0;
+        size_t bytes = 0;
+    };
+    
     size_t max_size_;
-    std::unordered_map<std::string, std::list<CacheEntry>::iterator> cache_map_;
-    std::list<CacheEntry> lru_list_;  // Most recent at back, least recent at front
+    size_t max_bytes_;
+    std::unordered_map<std::string_view, CacheEntry*> cache_map_;
+    List main_;
+    List window_;
+    SlabAllocator slab_;
     mutable std::mutex cache_mutex_;
     
-    uint64_t hits_ = 0;
-    uint64_t misses_ = 0;
-    uint64_t evictions_ = 0;
+    bool admission_;
+    size_t window_max_size_ = 0;
+    size_t window_max_bytes_ = 0;
+    std::unique_ptr<FrequencySketch> sketch_;
+    std::unique_ptr<CandidateTracker> candidates_;
+    
+    TimerWheel expiry_wheel_;
+    
+    std::atomic<size_t> size_{0};
+    std::atomic<size_t> bytes_{0};
+    std::atomic<size_t> compressed_entries_{0};
+    std::atomic<size_t> saved_bytes_{0};
+    std::atomic<size_t> reserved_bytes_{0};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+    std::atomic<uint64_t> expired_{0};
+    std::atomic<size_t> expiry_timers_{0};
+    std::atomic<uint64_t> admitted_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> admitted_requests_{0};
+    std::atomic<uint64_t> admitted_hits_{0};
+    std::atomic<uint64_t> rejected_requests_{0};
+    std::atomic<uint64_t> rejected_hits_{0};
+    
+    List& list_of(CacheEntry* entry) { return (entry->flags & CacheEntry::kInWindow) ? window_ : main_; }
+    bool main_needs_eviction(size_t incoming_charge) const;
+    bool over_reserved() const;
+    bool window_overflowing() const;
+    void link_back(List& list, CacheEntry* entry);
+    void link_front(List& list, CacheEntry* entry);
+    void unlink(List& list, CacheEntry* entry);
+    void schedule_expiry(CacheEntry* entry);
+    void erase_entry(CacheEntry* entry);
     
+    // Add an entry to (or take it off) the byte and compression counts
+    void count_bytes(const CacheEntry* entry, bool added);
     void evict_lru();
+    void drain_window();
+    void record_access(std::string_view key, bool hit);
 };
 
 #endif // CACHE_H
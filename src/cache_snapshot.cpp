@@ -0,0 +1,319 @@
+#include "cache_snapshot.h"
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstddef>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t entries;
+    uint64_t records_bytes;
+    uint64_t checksum;    // FNV-1a over the record bytes
+    int64_t written_at;   // Unix seconds
+};
+
+constexpr char kMagic[8] = {'K', 'V', 'S', 'N', 'A', 'P', '0', '1'};
+constexpr uint32_t kVersion = 3;  // 2 added the raw size to each record, 3 the expiry time
+constexpr uint32_t kClean = 1 << 0;
+constexpr size_t kRecordHeader = 3 * sizeof(uint32_t) + sizeof(uint64_t);
+constexpr size_t kWriteBuffer = 1 << 20;
+
+uint64_t fnv1a(uint64_t hash, const char* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ULL;
+
+bool write_all(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+double millis_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+CacheSnapshot::CacheSnapshot(std::shared_ptr<Cache> cache, std::shared_ptr<StorageBackend> db,
+                             const std::string& path, std::chrono::seconds interval)
+    : cache_(cache), db_(db), path_(path), interval_(interval) {}
+
+CacheSnapshot::~CacheSnapshot() {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    if (running_) {
+        running_ = false;
+        lock.unlock();
+        writer_cv_.notify_all();
+        writer_.join();
+    }
+}
+
+bool CacheSnapshot::load() {
+    auto start = std::chrono::steady_clock::now();
+
+    int fd = open(path_.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            std::cout << "No cache snapshot at " << path_ << "; starting cold" << std::endl;
+        } else {
+            std::cerr << "Cannot open cache snapshot " << path_ << ": " << std::strerror(errno) << std::endl;
+        }
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        std::cerr << "Cache snapshot " << path_ << " is truncated; ignoring it" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        std::cerr << "Cannot map cache snapshot " << path_ << ": " << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    madvise(map, size, MADV_WILLNEED);
+
+    const char* base = static_cast<const char*>(map);
+    SnapshotHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    const char* records = base + sizeof(header);
+    size_t length = size - sizeof(header);
+
+    bool valid = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion &&
+                 header.records_bytes == length && fnv1a(kFnvOffset, records, length) == header.checksum;
+    size_t restored = 0;
+    bool clean = (header.flags & kClean) != 0;
+    if (valid) {
+        restored = restore_records(records, length, header.entries, !clean);
+    } else {
+        std::cerr << "Cache snapshot " << path_ << " is corrupt; ignoring it" << std::endl;
+    }
+    munmap(map, size);
+
+    // From now on the file may be older than the database
+    if (valid && clean) {
+        uint32_t flags = header.flags & ~kClean;
+        if (pwrite(fd, &flags, sizeof(flags), offsetof(SnapshotHeader, flags)) != sizeof(flags)) {
+            std::cerr << "Cannot clear the clean mark of " << path_ << std::endl;
+        }
+    }
+    ::close(fd);
+    if (!valid) {
+        return false;
+    }
+
+    double elapsed = millis_since(start);
+    {
+        std::unique_lock<std::mutex> lock(stats_mutex_);
+        stats_.loaded = true;
+        stats_.loaded_clean = clean;
+        stats_.loaded_entries = restored;
+        stats_.load_ms = elapsed;
+    }
+    std::cout << "Cache snapshot loaded: " << restored << " of " << header.entries << " entries in "
+              << static_cast<long>(elapsed) << " ms" << (clean ? "" : " (values re-read from the database)")
+              << std::endl;
+    return true;
+}
+
+size_t CacheSnapshot::restore_records(const char* records, size_t length, uint64_t count, bool refresh) {
+    size_t restored = 0;
+    size_t offset = 0;
+    std::vector<std::string> keys;
+
+    for (uint64_t i = 0; i < count; ++i) {
+        if (length - offset < kRecordHeader) {
+            break;
+        }
+        uint32_t sizes[3];
+        uint64_t expires_at;
+        std::memcpy(sizes, records + offset, sizeof(sizes));
+        std::memcpy(&expires_at, records + offset + sizeof(sizes), sizeof(expires_at));
+        uint32_t key_size = sizes[0];
+        uint32_t value_size = sizes[1];
+        offset += kRecordHeader;
+        if (length - offset < static_cast<size_t>(key_size) + value_size) {
+            break;
+        }
+
+        std::string_view key(records + offset, key_size);
+        std::string_view value(records + offset + key_size, value_size);
+        offset += static_cast<size_t>(key_size) + value_size;
+
+        if (!refresh) {
+            restored += cache_->restore(key, value, sizes[2], expires_at) ? 1 : 0;
+            continue;
+        }
+        keys.emplace_back(key);
+        if (keys.size() == StorageBackend::kMaxBatchRows) {
+            restored += restore_from_database(keys);
+            keys.clear();
+        }
+    }
+    if (!keys.empty()) {
+        restored += restore_from_database(keys);
+    }
+    return restored;
+}
+
+size_t CacheSnapshot::restore_from_database(const std::vector<std::string>& keys) {
+    std::vector<std::shared_ptr<std::string>> values;
+    std::vector<uint64_t> expiry;
+    if (!db_->read_many(keys, values, &expiry)) {
+        return 0;
+    }
+    size_t restored = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (values[i] && cache_->restore(keys[i], *values[i], 0, expiry[i])) {
+            restored++;
+        }
+    }
+    return restored;
+}
+
+void CacheSnapshot::start() {
+    if (interval_.count() <= 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    writer_ = std::thread([this] { writer_loop(); });
+}
+
+void CacheSnapshot::stop(bool clean) {
+    {
+        std::unique_lock<std::mutex> lock(writer_mutex_);
+        if (running_) {
+            running_ = false;
+            lock.unlock();
+            writer_cv_.notify_all();
+            writer_.join();
+        }
+    }
+    if (write(clean)) {
+        std::cout << "Cache snapshot written to " << path_ << std::endl;
+    }
+}
+
+void CacheSnapshot::writer_loop() {
+    std::unique_lock<std::mutex> lock(writer_mutex_);
+    while (running_) {
+        if (writer_cv_.wait_for(lock, interval_, [this] { return !running_; })) {
+            break;
+        }
+        lock.unlock();
+        write(false);
+        lock.lock();
+    }
+}
+
+bool CacheSnapshot::write(bool clean) {
+    std::unique_lock<std::mutex> write_lock(write_mutex_);
+    auto start = std::chrono::steady_clock::now();
+
+    // Take references under the cache lock; the copy to disk runs without it
+    std::vector<CacheValue> entries;
+    cache_->collect_entries(entries);
+
+    std::string temp_path = path_ + ".tmp";
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Cannot write cache snapshot " << temp_path << ": " << std::strerror(errno) << std::endl;
+        std::unique_lock<std::mutex> lock(stats_mutex_);
+        stats_.failures++;
+        return false;
+    }
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.flags = clean ? kClean : 0;
+    header.entries = entries.size();
+    header.written_at = static_cast<int64_t>(std::time(nullptr));
+
+    // Header goes last, once the checksum is known
+    bool ok = lseek(fd, sizeof(header), SEEK_SET) == static_cast<off_t>(sizeof(header));
+    std::string buffer;
+    buffer.reserve(kWriteBuffer + kRecordHeader);
+    uint64_t checksum = kFnvOffset;
+    uint64_t records_bytes = 0;
+    auto flush = [&] {
+        checksum = fnv1a(checksum, buffer.data(), buffer.size());
+        records_bytes += buffer.size();
+        ok = ok && write_all(fd, buffer.data(), buffer.size());
+        buffer.clear();
+    };
+
+    for (const auto& entry : entries) {
+        std::string_view key = entry.key();
+        std::string_view value = entry.view();
+        uint32_t sizes[3] = {static_cast<uint32_t>(key.size()), static_cast<uint32_t>(value.size()),
+                             static_cast<uint32_t>(entry.compressed() ? entry.raw_size() : 0)};
+        uint64_t expires_at = entry.expires_at();
+        buffer.append(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        buffer.append(reinterpret_cast<const char*>(&expires_at), sizeof(expires_at));
+        buffer.append(key.data(), key.size());
+        buffer.append(value.data(), value.size());
+        if (buffer.size() >= kWriteBuffer) {
+            flush();
+        }
+    }
+    flush();
+    entries.clear();
+
+    header.checksum = checksum;
+    header.records_bytes = records_bytes;
+    ok = ok && pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    ok = ok && fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    ok = ok && rename(temp_path.c_str(), path_.c_str()) == 0;
+
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    if (!ok) {
+        std::cerr << "Cannot write cache snapshot " << path_ << ": " << std::strerror(errno) << std::endl;
+        unlink(temp_path.c_str());
+        stats_.failures++;
+        return false;
+    }
+    stats_.writes++;
+    stats_.last_entries = header.entries;
+    stats_.last_bytes = sizeof(header) + records_bytes;
+    stats_.last_write_ms = millis_since(start);
+    return true;
+}
+
+SnapshotStats CacheSnapshot::get_stats() const {
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
@@ -0,0 +1,91 @@
+#ifndef CACHE_SNAPSHOT_H
+#define CACHE_SNAPSHOT_H
+
+#include "cache.h"
+#include "storage_backend.h"
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+struct SnapshotStats {
+    // Last load at startup
+    bool loaded = false;
+    bool loaded_clean = false;     // Values came from the file, not the database
+    size_t loaded_entries = 0;
+    double load_ms = 0;
+
+    // Snapshots written since startup
+    uint64_t writes = 0;
+    uint64_t failures = 0;
+    size_t last_entries = 0;
+    size_t last_bytes = 0;
+    double last_write_ms = 0;
+};
+
+// Copies the cache to disk and refills it from there after a restart, so a
+// restarted server doesn't send its whole hot set to the database at once.
+//
+// The file holds a fixed header and one record per entry, hottest first:
+//   uint32 key size, uint32 value size, uint32 raw size, uint64 expiry time,
+//   key bytes, value bytes
+// in host byte order. A non-zero raw size marks a value the cache holds
+// compressed; it is written and restored that way. Entries that expired
+// meanwhile are skipped on load. Snapshots are written to a temporary file
+// and renamed into place, so a crash mid-write leaves the previous one
+// intact.
+//
+// Only a snapshot taken after the server stopped taking requests is marked
+// clean and loaded as is. A periodic snapshot may be older than the
+// database, so loading one only takes its keys and re-reads their values
+// in batches. Loading clears the clean mark, so a file is trusted once.
+class CacheSnapshot {
+public:
+    // interval 0 disables periodic snapshots
+    CacheSnapshot(std::shared_ptr<Cache> cache, std::shared_ptr<StorageBackend> db,
+                  const std::string& path, std::chrono::seconds interval);
+    ~CacheSnapshot();
+
+    // Refill the cache from the file (memory-mapped). Call before serving;
+    // false if there is no usable snapshot.
+    bool load();
+
+    // Start writing snapshots every interval in the background
+    void start();
+
+    // Stop the background writer, then write a final snapshot. Pass clean
+    // only once no request can change the cache any more.
+    void stop(bool clean);
+
+    // Write a snapshot now; safe to call from any thread
+    bool write(bool clean);
+
+    SnapshotStats get_stats() const;
+    const std::string& get_path() const { return path_; }
+
+private:
+    std::shared_ptr<Cache> cache_;
+    std::shared_ptr<StorageBackend> db_;
+    std::string path_;
+    std::chrono::seconds interval_;
+
+    std::thread writer_;
+    std::mutex writer_mutex_;
+    std::condition_variable writer_cv_;
+    bool running_ = false;
+
+    std::mutex write_mutex_;  // One snapshot at a time
+    mutable std::mutex stats_mutex_;
+    SnapshotStats stats_;
+
+    void writer_loop();
+
+    // Restore the records of a validated file; refresh re-reads the values
+    size_t restore_records(const char* records, size_t length, uint64_t count, bool refresh);
+    size_t restore_from_database(const std::vector<std::string>& keys);
+};
+
+#endif // CACHE_SNAPSHOT_H
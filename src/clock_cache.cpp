@@ -0,0 +1,261 @@
+#include "clock_cache.h"
+#include <algorithm>
+
+ClockCache::ClockCache(size_t max_size, size_t max_bytes)
+    : max_size_(max_size), max_bytes_(max_bytes),
+      slab_(SlabAllocator::page_size_for_budget(max_bytes)),
+      expiry_wheel_(expiry_now()) {
+    if (max_size_ > 0) {
+        index_.reserve(max_size_);
+    }
+}
+
+ClockCache::~ClockCache() {
+    for (auto& slot : slots_) {
+        if (slot.entry != nullptr) {
+            CacheEntry::release(slab_, slot.entry);
+        }
+    }
+}
+
+CacheValue ClockCache::get(const std::string& key) {
+    std::shared_lock<std::shared_mutex> lock(cache_mutex_);
+    
+    auto it = index_.find(key);
+    if (it == index_.end() || slots_[it->second].entry->expired()) {
+        lock.unlock();
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return CacheValue();  // Cache miss
+    }
+    
+    // Mark as recently used; no list manipulation on the hit path
+    Slot& slot = slots_[it->second];
+    slot.referenced.store(true, std::memory_order_relaxed);
+    CacheValue value(slot.entry, &slab_);
+    lock.unlock();
+    
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return value;
+}
+
+void ClockCache::put(const std::string& key, const std::string& value, size_t raw_size, uint64_t expires_at) {
+    std::unique_lock<std::shared_mutex> lock(cache_mutex_);
+    
+    // An update replaces the entry but keeps its recency
+    bool referenced = false;
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        referenced = true;
+        erase_slot(it->second);
+    }
+    
+    size_t charge = CacheEntry::charge_for(slab_, key.size(), value.size());
+    if ((max_bytes_ > 0 && charge > max_bytes_) || is_expired(expires_at, expiry_now())) {
+        // Larger than the whole budget, where caching it would flush
+        // everything else, or dead already
+        reserved_bytes_.store(slab_.get_reserved_bytes(), std::memory_order_relaxed);
+        return;
+    }
+    
+    while (needs_eviction(charge)) {
+        evict_one();
+    }
+    if (over_reserved()) {
+        slab_.trim();
+    }
+    for (size_t i = 0; i < kReservedEvictions && over_reserved(); ++i) {
+        evict_one();
+    }
+    
+    // New entries start unreferenced so a one-off insert is the next victim
+    CacheEntry* entry = CacheEntry::create(slab_, key, value, raw_size, expires_at);
+    insert_slot(entry, referenced);
+    schedule_expiry(entry);
+}
+
+bool ClockCache::remove(const std::string& key) {
+    std::unique_lock<std::shared_mutex> lock(cache_mutex_);
+    
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return false;
+    }
+    
+    erase_slot(it->second);
+    reserved_bytes_.store(slab_.get_reserved_bytes(), std::memory_order_relaxed);
+    return true;
+}
+
+bool ClockCache::exists(const std::string& key) {
+    std::shared_lock<std::shared_mutex> lock(cache_mutex_);
+    auto it = index_.find(key);
+    return it != index_.end() && !slots_[it->second].entry->expired();
+}
+
+void ClockCache::collect_entries(std::vector<CacheValue>& entries) {
+    std::shared_lock<std::shared_mutex> lock(cache_mutex_);
+    entries.reserve(entries.size() + index_.size());
+    for (bool referenced : {true, false}) {
+        for (auto& slot : slots_) {
+            if (slot.entry != nullptr && slot.referenced.load(std::memory_order_relaxed) == referenced) {
+                entries.emplace_back(slot.entry, &slab_);
+            }
+        }
+    }
+}
+
+bool ClockCache::restore(std::string_view key, std::string_view value, size_t raw_size, uint64_t expires_at) {
+    std::unique_lock<std::shared_mutex> lock(cache_mutex_);
+    if (index_.find(key) != index_.end() || is_expired(expires_at, expiry_now())) {
+        return false;
+    }
+    
+    size_t charge = CacheEntry::charge_for(slab_, key.size(), value.size());
+    if ((max_bytes_ > 0 && charge > max_bytes_) || needs_eviction(charge)) {
+        return false;
+    }
+    CacheEntry* entry = CacheEntry::create(slab_, key, value, raw_size, expires_at);
+    insert_slot(entry, false);
+    schedule_expiry(entry);
+    return true;
+}
+
+size_t ClockCache::expire(uint64_t now) {
+    std::vector<std::string> due;
+    {
+        std::unique_lock<std::shared_mutex> lock(cache_mutex_);
+        std::vector<TimerLink*> timers;
+        expiry_wheel_.advance(now, timers);
+        expiry_timers_.store(expiry_wheel_.size(), std::memory_order_relaxed);
+        due.reserve(timers.size());
+        for (TimerLink* timer : timers) {
+            due.emplace_back(CacheEntry::from_timer(timer)->key());
+        }
+    }
+    
+    // In batches, so requests get the lock in between
+    size_t expired = 0;
+    for (size_t start = 0; start < due.size(); start += kExpireBatch) {
+        std::unique_lock<std::shared_mutex> lock(cache_mutex_);
+        for (size_t i = start; i < std::min(due.size(), start + kExpireBatch); ++i) {
+            // The key may have been overwritten meanwhile, with a later
+            // expiry or none
+            auto it = index_.find(due[i]);
+            if (it != index_.end() && is_expired(slots_[it->second].entry->expires_at(), now)) {
+                erase_slot(it->second);
+                expired++;
+            }
+        }
+        reserved_bytes_.store(slab_.get_reserved_bytes(), std::memory_order_relaxed);
+    }
+    expired_.fetch_add(expired, std::memory_order_relaxed);
+    return expired;
+}
+
+CacheStats ClockCache::get_stats() const {
+    CacheStats stats;
+    stats.size = size_.load(std::memory_order_relaxed);
+    stats.max_size = max_size_;
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.max_bytes = max_bytes_;
+    stats.reserved_bytes = reserved_bytes_.load(std::memory_order_relaxed);
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    stats.expired = expired_.load(std::memory_order_relaxed);
+    stats.expiry_timers = expiry_timers_.load(std::memory_order_relaxed);
+    stats.compressed_entries = compressed_entries_.load(std::memory_order_relaxed);
+    stats.compression_saved_bytes = saved_bytes_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ClockCache::reset_stats() {
+    hits_.store(0, std::memory_order_relaxed);
+    misses_.store(0, std::memory_order_relaxed);
+    evictions_.store(0, std::memory_order_relaxed);
+    expired_.store(0, std::memory_order_relaxed);
+}
+
+bool ClockCache::needs_eviction(size_t incoming_charge) const {
+    if (index_.empty()) {
+        return false;
+    }
+    if (max_size_ > 0 && index_.size() >= max_size_) {
+        return true;
+    }
+    return max_bytes_ > 0 && bytes_.load(std::memory_order_relaxed) + incoming_charge > max_bytes_;
+}
+
+bool ClockCache::over_reserved() const {
+    return max_bytes_ > 0 && !index_.empty() && 
+           slab_.get_reserved_bytes() > max_bytes_ + slab_.get_pinned_bytes();
+}
+
+void ClockCache::insert_slot(CacheEntry* entry, bool referenced) {
+    size_t index;
+    if (!free_slots_.empty()) {
+        index = free_slots_.back();
+        free_slots_.pop_back();
+    } else {
+        index = slots_.size();
+        slots_.emplace_back();
+    }
+    
+    Slot& slot = slots_[index];
+    slot.entry = entry;
+    slot.referenced.store(referenced, std::memory_order_relaxed);
+    index_.emplace(entry->key(), index);
+    size_.store(index_.size(), std::memory_order_relaxed);
+    bytes_.fetch_add(entry->charge(), std::memory_order_relaxed);
+    if (entry->raw_size != 0) {
+        compressed_entries_.fetch_add(1, std::memory_order_relaxed);
+        saved_bytes_.fetch_add(entry->saved_bytes(), std::memory_order_relaxed);
+    }
+    reserved_bytes_.store(slab_.get_reserved_bytes(), std::memory_order_relaxed);
+}
+
+void ClockCache::schedule_expiry(CacheEntry* entry) {
+    if (entry->expires_at() != 0) {
+        expiry_wheel_.schedule(&entry->timer);
+        expiry_timers_.store(expiry_wheel_.size(), std::memory_order_relaxed);
+    }
+}
+
+void ClockCache::erase_slot(size_t index) {
+    Slot& slot = slots_[index];
+    index_.erase(slot.entry->key());
+    if (slot.entry->timer.scheduled()) {
+        expiry_wheel_.cancel(&slot.entry->timer);
+        expiry_timers_.store(expiry_wheel_.size(), std::memory_order_relaxed);
+    }
+    size_.store(index_.size(), std::memory_order_relaxed);
+    bytes_.fetch_sub(slot.entry->charge(), std::memory_order_relaxed);
+    if (slot.entry->raw_size != 0) {
+        compressed_entries_.fetch_sub(1, std::memory_order_relaxed);
+        saved_bytes_.fetch_sub(slot.entry->saved_bytes(), std::memory_order_relaxed);
+    }
+    CacheEntry::detach(slab_, slot.entry);
+    slot.entry = nullptr;
+    free_slots_.push_back(index);
+}
+
+void ClockCache::evict_one() {
+    // Called with the exclusive lock held and at least one slot occupied.
+    // One full sweep clears every bit, so this ends within two rotations.
+    while (true) {
+        size_t index = hand_;
+        Slot& slot = slots_[index];
+        hand_ = (hand_ + 1) % slots_.size();
+        
+        if (slot.entry == nullptr) {
+            continue;  // Free slot
+        }
+        if (slot.referenced.exchange(false, std::memory_order_relaxed)) {
+            continue;  // Second chance
+        }
+        
+        erase_slot(index);
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef CLOCK_CACHE_H
+#define CLOCK_CACHE_H
+
+#include "cache.h"
+#include <shared_mutex>
+#include <deque>
+#include <vector>
+
+// Approximate-LRU cache using the CLOCK algorithm. Each slot carries an
+// access bit; a hit only sets that bit, so lookups run under a shared lock
+// and many readers proceed in parallel. Eviction sweeps a hand around the
+// slots, clearing bits, and replaces the first slot not accessed since the
+// previous sweep. An expired entry found by a lookup (under the shared
+// lock) is only reported missing; the timer wheel's expire() frees it.
+class ClockCache : public Cache {
+public:
+    // Capacity follows the same rules as LRUCache
+    explicit ClockCache(size_t max_size, size_t max_bytes = 0);
+    ~ClockCache() override;
+    
+    CacheValue get(const std::string& key) override;
+    void put(const std::string& key, const std::string& value, size_t raw_size = 0,
+             uint64_t expires_at = 0) override;
+    bool remove(const std::string& key) override;
+    bool exists(const std::string& key) override;
+    
+    // Entries referenced since the last sweep come first
+    void collect_entries(std::vector<CacheValue>& entries) override;
+    bool restore(std::string_view key, std::string_view value, size_t raw_size = 0,
+                 uint64_t expires_at = 0) override;
+    size_t expire(uint64_t now) override;
+    
+    CacheStats get_stats() const override;
+    size_t get_max_size() const override { return max_size_; }
+    void reset_stats() override;
+    std::string get_policy() const override { return "clock"; }
+    
+private:
+    struct Slot {
+        CacheEntry* entry = nullptr;  // nullptr when the slot is free
+        std::atomic<bool> referenced{false};
+    };
+    
+    size_t max_size_;
+    size_t max_bytes_;
+    std::deque<Slot> slots_;  // Grows on demand; deque keeps slot addresses stable
+    std::unordered_map<std::string_view, size_t> index_;  // key -> slot
+    std::vector<size_t> free_slots_;
+    size_t hand_ = 0;
+    SlabAllocator slab_;
+    TimerWheel expiry_wheel_;  // Under the exclusive lock
+    mutable std::shared_mutex cache_mutex_;
+    
+    std::atomic<size_t> size_{0};
+    std::atomic<size_t> bytes_{0};
+    std::atomic<size_t> compressed_entries_{0};
+    std::atomic<size_t> saved_bytes_{0};
+    std::atomic<size_t> reserved_bytes_{0};
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> evictions_{0};
+    std::atomic<uint64_t> expired_{0};
+    std::atomic<size_t> expiry_timers_{0};
+    
+    bool needs_eviction(size_t incoming_charge) const;
+    bool over_reserved() const;
+    void insert_slot(CacheEntry* entry, bool referenced);
+    void schedule_expiry(CacheEntry* entry);
+    void erase_slot(size_t index);
+    void evict_one();
+};
+
+#endif // CLOCK_CACHE_H
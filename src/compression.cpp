@@ -0,0 +1,89 @@
+#include "compression.h"
+#include <zlib.h>
+#include <cstring>
+#include <cstdint>
+
+namespace {
+
+// windowBits 15 plus 16 selects the gzip wrapper
+constexpr int kGzipWindowBits = 15 + 16;
+
+// One deflate and one inflate stream per thread; setting one up allocates
+// a few hundred KB, far more than compressing a typical value costs
+struct Streams {
+    z_stream deflater;
+    z_stream inflater;
+    bool deflater_ready = false;
+    bool inflater_ready = false;
+
+    Streams() {
+        std::memset(&deflater, 0, sizeof(deflater));
+        std::memset(&inflater, 0, sizeof(inflater));
+    }
+
+    ~Streams() {
+        if (deflater_ready) deflateEnd(&deflater);
+        if (inflater_ready) inflateEnd(&inflater);
+    }
+
+    z_stream* get_deflater() {
+        if (deflater_ready) {
+            deflateReset(&deflater);
+        } else if (deflateInit2(&deflater, Z_BEST_SPEED, Z_DEFLATED, kGzipWindowBits, 8,
+                                Z_DEFAULT_STRATEGY) == Z_OK) {
+            deflater_ready = true;
+        } else {
+            return nullptr;
+        }
+        return &deflater;
+    }
+
+    z_stream* get_inflater() {
+        if (inflater_ready) {
+            inflateReset(&inflater);
+        } else if (inflateInit2(&inflater, kGzipWindowBits) == Z_OK) {
+            inflater_ready = true;
+        } else {
+            return nullptr;
+        }
+        return &inflater;
+    }
+};
+
+Streams& streams() {
+    thread_local Streams instance;
+    return instance;
+}
+
+} // namespace
+
+bool gzip_compress(std::string_view in, std::string& out) {
+    z_stream* stream = streams().get_deflater();
+    if (!stream || in.size() > UINT32_MAX) {
+        return false;
+    }
+    out.resize(deflateBound(stream, in.size()));
+    stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream->avail_in = static_cast<uInt>(in.size());
+    stream->next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream->avail_out = static_cast<uInt>(out.size());
+    // deflateBound leaves room for everything, so one call finishes
+    if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
+        return false;
+    }
+    out.resize(stream->total_out);
+    return true;
+}
+
+bool gzip_decompress(std::string_view in, size_t raw_size, std::string& out) {
+    z_stream* stream = streams().get_inflater();
+    if (!stream || in.size() > UINT32_MAX || raw_size > UINT32_MAX) {
+        return false;
+    }
+    out.resize(raw_size);
+    stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    stream->avail_in = static_cast<uInt>(in.size());
+    stream->next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream->avail_out = static_cast<uInt>(out.size());
+    return inflate(stream, Z_FINISH) == Z_STREAM_END && stream->total_out == raw_size;
+}
@@ -0,0 +1,19 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <string>
+#include <string_view>
+
+// gzip (zlib's deflate at its fastest level) for cached values. gzip
+// rather than a bare block format, so a compressed value can be sent to an
+// HTTP client as it is, with Content-Encoding: gzip. Each thread keeps its
+// zlib streams and only resets them between calls.
+
+// Replace `out` with `in` compressed; false if zlib fails
+bool gzip_compress(std::string_view in, std::string& out);
+
+// Replace `out` with `in` decompressed. False unless `in` is a whole gzip
+// stream of exactly raw_size bytes.
+bool gzip_decompress(std::string_view in, size_t raw_size, std::string& out);
+
+#endif // COMPRESSION_H
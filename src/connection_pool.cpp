@@ -0,0 +1,187 @@
+#include "connection_pool.h"
+#include <iostream>
+
+PooledConnection::PooledConnection(ConnectionPool* pool, PGconn* conn)
+    : pool_(pool), conn_(conn) {}
+
+PooledConnection::PooledConnection(PooledConnection&& other) noexcept
+    : pool_(other.pool_), conn_(other.conn_), broken_(other.broken_) {
+    other.pool_ = nullptr;
+    other.conn_ = nullptr;
+}
+
+PooledConnection& PooledConnection::operator=(PooledConnection&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        conn_ = other.conn_;
+        broken_ = other.broken_;
+        other.pool_ = nullptr;
+        other.conn_ = nullptr;
+    }
+    return *this;
+}
+
+PooledConnection::~PooledConnection() {
+    release();
+}
+
+void PooledConnection::release() {
+    if (pool_ != nullptr && conn_ != nullptr) {
+        pool_->release(conn_, broken_);
+    }
+    pool_ = nullptr;
+    conn_ = nullptr;
+    broken_ = false;
+}
+
+ConnectionPool::ConnectionPool(const std::string& connection_string, size_t pool_size, SetupFn setup)
+    : connection_string_(connection_string), pool_size_(pool_size == 0 ? 1 : pool_size),
+      setup_(std::move(setup)) {}
+
+ConnectionPool::~ConnectionPool() {
+    close();
+}
+
+PGconn* ConnectionPool::open_connection() {
+    PGconn* conn = PQconnectdb(connection_string_.c_str());
+    if (PQstatus(conn) != CONNECTION_OK) {
+        std::cerr << "Connection failed: " << PQerrorMessage(conn) << std::endl;
+    }
+    return conn;
+}
+
+bool ConnectionPool::open() {
+    std::vector<Slot> slots;
+    size_t healthy = 0;
+    for (size_t i = 0; i < pool_size_; ++i) {
+        PGconn* conn = open_connection();
+        bool ready = (PQstatus(conn) == CONNECTION_OK) && run_setup(conn);
+        if (ready) {
+            healthy++;
+        } else if (healthy == 0) {
+            // The server is unreachable; don't retry the remaining slots
+            PQfinish(conn);
+            for (auto& slot : slots) {
+                PQfinish(slot.conn);
+            }
+            return false;
+        }
+        // Broken connections are kept and reset on first checkout
+        slots.push_back({conn, std::chrono::steady_clock::now(), !ready});
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex_);
+        idle_ = std::move(slots);
+        checked_out_ = 0;
+        open_ = true;
+    }
+    available_.notify_all();
+
+    std::cout << "Database connection pool established (" << healthy << "/" << pool_size_
+              << " connections)" << std::endl;
+    return true;
+}
+
+void ConnectionPool::close() {
+    std::vector<Slot> slots;
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex_);
+        if (!open_) return;
+        open_ = false;
+        available_.notify_all();
+        available_.wait(lock, [this] { return checked_out_ == 0; });
+        slots.swap(idle_);
+    }
+    for (auto& slot : slots) {
+        PQfinish(slot.conn);
+    }
+}
+
+bool ConnectionPool::is_open() const {
+    std::unique_lock<std::mutex> lock(pool_mutex_);
+    return open_;
+}
+
+size_t ConnectionPool::get_idle_count() const {
+    std::unique_lock<std::mutex> lock(pool_mutex_);
+    return idle_.size();
+}
+
+PooledConnection ConnectionPool::acquire() {
+    Slot slot;
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex_);
+        if (open_ && idle_.empty()) {
+            waits_.fetch_add(1, std::memory_order_relaxed);
+        }
+        available_.wait(lock, [this] { return !open_ || !idle_.empty(); });
+        if (!open_) {
+            return PooledConnection();
+        }
+        slot = idle_.back();
+        idle_.pop_back();
+        checked_out_++;
+    }
+
+    // Health check and reconnect happen outside the pool lock
+    if (!ensure_healthy(slot)) {
+        release(slot.conn, true);
+        return PooledConnection();
+    }
+    return PooledConnection(this, slot.conn);
+}
+
+bool ConnectionPool::ensure_healthy(Slot& slot) {
+    auto now = std::chrono::steady_clock::now();
+    if (PQstatus(slot.conn) == CONNECTION_OK) {
+        bool alive = (now - slot.last_used < kHealthCheckInterval);
+        if (!alive) {
+            // Idle for a while; the server may have dropped us without notice
+            PGresult* res = PQexec(slot.conn, "SELECT 1");
+            alive = (PQresultStatus(res) == PGRES_TUPLES_OK);
+            PQclear(res);
+        }
+        if (alive) {
+            return !slot.needs_setup || run_setup(slot.conn);
+        }
+    }
+
+    PQreset(slot.conn);
+    reconnects_.fetch_add(1, std::memory_order_relaxed);
+    if (PQstatus(slot.conn) != CONNECTION_OK) {
+        std::cerr << "Reconnect failed: " << PQerrorMessage(slot.conn) << std::endl;
+        return false;
+    }
+    // A reset starts a new session
+    return run_setup(slot.conn);
+}
+
+bool ConnectionPool::run_setup(PGconn* conn) {
+    if (setup_ && !setup_(conn)) {
+        std::cerr << "Connection setup failed: " << PQerrorMessage(conn) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ConnectionPool::release(PGconn* conn, bool broken) {
+    bool closing;
+    {
+        std::unique_lock<std::mutex> lock(pool_mutex_);
+        // A broken connection gets a zero timestamp so it is probed on next
+        // checkout, and its session is set up again
+        auto last_used = broken ? std::chrono::steady_clock::time_point()
+                                : std::chrono::steady_clock::now();
+        idle_.push_back({conn, last_used, broken});
+        checked_out_--;
+        closing = !open_;
+    }
+    if (closing) {
+        // close() is waiting for the last checkout to come back
+        available_.notify_all();
+    } else {
+        available_.notify_one();
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <libpq-fe.h>
+
+class ConnectionPool;
+
+// RAII handle for a connection checked out of the pool.
+// The connection goes back to the pool when the handle is destroyed.
+class PooledConnection {
+public:
+    PooledConnection() = default;
+    PooledConnection(ConnectionPool* pool, PGconn* conn);
+    PooledConnection(PooledConnection&& other) noexcept;
+    PooledConnection& operator=(PooledConnection&& other) noexcept;
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+    ~PooledConnection();
+
+    PGconn* get() const { return conn_; }
+    explicit operator bool() const { return conn_ != nullptr; }
+
+    // Mark the connection as broken so it is reset before its next use
+    void mark_broken() { broken_ = true; }
+
+private:
+    ConnectionPool* pool_ = nullptr;
+    PGconn* conn_ = nullptr;
+    bool broken_ = false;
+
+    void release();
+};
+
+class ConnectionPool {
+public:
+    // Per-connection session setup (e.g. preparing statements). Runs after
+    // every connect or reset; a connection it fails on is not handed out.
+    using SetupFn = std::function<bool(PGconn*)>;
+    
+    ConnectionPool(const std::string& connection_string, size_t pool_size, SetupFn setup = nullptr);
+    ~ConnectionPool();
+
+    // Open all connections (fails only if no connection could be made)
+    bool open();
+
+    // Close all connections; blocks until checked-out connections are returned
+    void close();
+
+    bool is_open() const;
+
+    // Check out a connection, waiting for one to become free.
+    // Returns an empty handle if the pool is closed or the server is unreachable.
+    PooledConnection acquire();
+
+    // Pool statistics
+    size_t get_pool_size() const { return pool_size_; }
+    size_t get_idle_count() const;
+    uint64_t get_reconnects() const { return reconnects_.load(std::memory_order_relaxed); }
+    uint64_t get_waits() const { return waits_.load(std::memory_order_relaxed); }
+
+private:
+    friend class PooledConnection;
+
+    struct Slot {
+        PGconn* conn;
+        std::chrono::steady_clock::time_point last_used;
+        bool needs_setup;  // Session state missing or unknown
+    };
+
+    std::string connection_string_;
+    size_t pool_size_;
+    SetupFn setup_;
+    std::vector<Slot> idle_;
+    size_t checked_out_ = 0;
+    bool open_ = false;
+    mutable std::mutex pool_mutex_;
+    std::condition_variable available_;
+
+    std::atomic<uint64_t> reconnects_{0};
+    std::atomic<uint64_t> waits_{0};
+
+    // Connections idle longer than this are probed before being handed out
+    static constexpr std::chrono::seconds kHealthCheckInterval{30};
+
+    PGconn* open_connection();
+    bool ensure_healthy(Slot& slot);
+    bool run_setup(PGconn* conn);
+    void release(PGconn* conn, bool broken);
+};
+
+#endif // CONNECTION_POOL_H
@@ -1,21 +1,104 @@
 #include "database.h"
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <future>
+#include <cstring>
+#include <cstdint>
+#include <arpa/inet.h>
+#include <endian.h>
 
-Database::Database(const std::string& connection_string)
-    : connection_string_(connection_string), conn_(nullptr) {}
+// Type OIDs from pg_type, fixed across Postgres versions
+static constexpr Oid kByteaOid = 17;
+static constexpr Oid kTextOid = 25;
+static constexpr Oid kTextArrayOid = 1009;
+static constexpr Oid kInt4Oid = 23;
+static constexpr Oid kInt8Oid = 20;
+
+struct PreparedStatement {
+    const char* name;
+    const char* sql;
+    int num_params;
+    Oid param_types[3];
+};
+
+// Prepared once per connection. Parameters are always sent in binary, so
+// values travel as raw bytes with no escaping or NUL terminators. Values
+// are bytea: any bytes, not just valid UTF-8 text.
+//
+// expires_at is Unix seconds, NULL for keys that never expire. Reads skip
+// rows whose time has come by the database's clock; the sweeper deletes
+// them later.
+static const PreparedStatement kStatements[] = {
+    {"kv_read", "SELECT value, expires_at FROM kv_store WHERE key = $1 "
+                "AND (expires_at IS NULL OR expires_at > floor(extract(epoch FROM now()))::int8)",
+     1, {kTextOid}},
+    // The offset is int8 so offset + 1 can't overflow; substring() takes
+    // int4, which any position inside a bytea value fits
+    {"kv_read_range", "SELECT octet_length(value)::int8, "
+                      "substring(value from least($2 + 1, 2147483647)::int4 for $3), "
+                      "expires_at FROM kv_store WHERE key = $1 "
+                      "AND (expires_at IS NULL OR expires_at > floor(extract(epoch FROM now()))::int8)",
+     3, {kTextOid, kInt8Oid, kInt4Oid}},
+    // xmax is zero only for a freshly inserted row version
+    {"kv_upsert", "INSERT INTO kv_store (key, value, expires_at) VALUES ($1, $2, NULLIF($3, 0)) "
+                  "ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value, expires_at = EXCLUDED.expires_at "
+                  "RETURNING (xmax = 0)",
+     3, {kTextOid, kByteaOid, kInt8Oid}},
+    {"kv_update", "UPDATE kv_store SET value = $2 WHERE key = $1", 2, {kTextOid, kByteaOid}},
+    {"kv_delete", "DELETE FROM kv_store WHERE key = $1", 1, {kTextOid}},
+    {"kv_read_many", "SELECT key, value, expires_at FROM kv_store WHERE key = ANY($1) "
+                     "AND (expires_at IS NULL OR expires_at > floor(extract(epoch FROM now()))::int8)",
+     1, {kTextArrayOid}},
+    {"kv_delete_many", "DELETE FROM kv_store WHERE key = ANY($1)", 1, {kTextArrayOid}},
+    {"kv_delete_many_returning", "DELETE FROM kv_store WHERE key = ANY($1) RETURNING key", 1, {kTextArrayOid}},
+    // SKIP LOCKED leaves rows being written alone; locking one that a
+    // write has just given a later expiry re-checks it and drops it
+    {"kv_delete_expired", "DELETE FROM kv_store WHERE key IN (SELECT key FROM kv_store "
+                          "WHERE expires_at <= floor(extract(epoch FROM now()))::int8 "
+                          "LIMIT $1 FOR UPDATE SKIP LOCKED) RETURNING key",
+     1, {kInt4Oid}},
+};
+
+// Result formats for PQexecPrepared
+static constexpr int kTextResult = 0;
+static constexpr int kBinaryResult = 1;
+
+Database::Database(const std::string& connection_string, size_t pool_size, size_t pipeline_connections)
+    : connection_string_(connection_string),
+      pool_(new ConnectionPool(connection_string, pool_size, &Database::prepare_statements)) {
+    if (pipeline_connections > 0) {
+        pipeline_.reset(new PipelineExecutor(connection_string, pipeline_connections,
+                                              &Database::prepare_statements));
+    }
+}
+
+bool Database::prepare_statements(PGconn* conn) {
+    // Clear anything left from before a reset so PQprepare can't collide
+    PGresult* res = PQexec(conn, "DEALLOCATE ALL");
+    bool ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+    PQclear(res);
+    
+    for (const auto& stmt : kStatements) {
+        if (!ok) break;
+        res = PQprepare(conn, stmt.name, stmt.sql, stmt.num_params, stmt.param_types);
+        ok = (PQresultStatus(res) == PGRES_COMMAND_OK);
+        PQclear(res);
+    }
+    return ok;
+}
 
 Database::~Database() {
     disconnect();
 }
 
 bool Database::connect() {
-    conn_ = PQconnectdb(connection_string_.c_str());
-    
-    if (PQstatus(conn_) != CONNECTION_OK) {
-        std::cerr << "Connection failed: " << PQerrorMessage(conn_) << std::endl;
-        PQfinish(conn_);
-        conn_ = nullptr;
+    if (!pool_->open()) {
+        return false;
+    }
+    if (pipeline_ && !pipeline_->open()) {
+        pool_->close();
         return false;
     }
     
@@ -24,93 +107,431 @@ bool Database::connect() {
 }
 
 void Database::disconnect() {
-    if (conn_ != nullptr) {
-        PQfinish(conn_);
-        conn_ = nullptr;
+    if (pipeline_) {
+        pipeline_->close();
     }
+    pool_->close();
 }
 
 bool Database::is_connected() const {
-    return conn_ != nullptr && PQstatus(conn_) == CONNECTION_OK;
+    return pool_->is_open();
 }
 
-bool Database::create(const std::string& key, const std::string& value) {
-    if (!is_connected()) return false;
-    
-    const char* paramValues[2] = {key.c_str(), value.c_str()};
-    PGresult* res = PQexecParams(conn_,
-        "INSERT INTO kv_store (key, value) VALUES ($1, $2) ON CONFLICT (key) DO UPDATE SET value = $2",
-        2, nullptr, paramValues, nullptr, nullptr, 0);
-    
-    bool success = (PQresultStatus(res) == PGRES_COMMAND_OK);
-    if (!success) {
-        std::cerr << "Create failed: " << PQerrorMessage(conn_) << std::endl;
-    }
+bool Database::ping() {
+    PGresult* res = execute("Ping", [](PGconn* conn) { return PQexec(conn, "SELECT 1"); });
+    if (!res) return false;
     PQclear(res);
-    return success;
+    return true;
+}
+
+PGresult* Database::execute(const char* op, const std::function<PGresult*(PGconn*)>& query) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        PooledConnection conn = pool_->acquire();
+        if (!conn) {
+            std::cerr << op << " failed: no database connection available" << std::endl;
+            return nullptr;
+        }
+        
+        PGresult* res = query(conn.get());
+        if (PQstatus(conn.get()) != CONNECTION_OK) {
+            // Connection dropped mid-query; have the pool reset it and retry
+            PQclear(res);
+            conn.mark_broken();
+            continue;
+        }
+        
+        ExecStatusType status = PQresultStatus(res);
+        if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+            std::cerr << op << " failed: " << PQerrorMessage(conn.get()) << std::endl;
+            PQclear(res);
+            return nullptr;
+        }
+        return res;
+    }
+    
+    std::cerr << op << " failed: lost connection to database" << std::endl;
+    return nullptr;
 }
 
-std::shared_ptr<std::string> Database::read(const std::string& key) {
-    if (!is_connected()) return nullptr;
+PGresult* Database::execute_prepared(const char* op, const char* statement,
+                                     std::initializer_list<std::string_view> params, int result_format) {
+    if (pipeline_) {
+        // Queue behind other requests' queries on a shared connection and
+        // wait only for our own result
+        auto promise = std::make_shared<std::promise<PGresult*>>();
+        std::future<PGresult*> result = promise->get_future();
+        PipelineQuery query{statement, {params.begin(), params.end()}, result_format,
+                            [promise](PGresult* res) { promise->set_value(res); }};
+        if (!pipeline_->submit(std::move(query))) {
+            std::cerr << op << " failed: database pipeline is closed" << std::endl;
+            return nullptr;
+        }
+        return check_result(op, result.get());
+    }
     
-    const char* paramValues[1] = {key.c_str()};
-    PGresult* res = PQexecParams(conn_,
-        "SELECT value FROM kv_store WHERE key = $1",
-        1, nullptr, paramValues, nullptr, nullptr, 0);
+    const char* values[3];
+    int lengths[3];
+    int formats[3];
+    int num_params = 0;
+    for (std::string_view param : params) {
+        values[num_params] = param.data();
+        lengths[num_params] = static_cast<int>(param.size());
+        formats[num_params] = 1;
+        num_params++;
+    }
     
-    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-        std::cerr << "Read failed: " << PQerrorMessage(conn_) << std::endl;
+    return execute(op, [&](PGconn* conn) {
+        return PQexecPrepared(conn, statement, num_params, values, lengths, formats, result_format);
+    });
+}
+
+PGresult* Database::check_result(const char* op, PGresult* res) {
+    if (!res) {
+        std::cerr << op << " failed: lost connection to database" << std::endl;
+        return nullptr;
+    }
+    ExecStatusType status = PQresultStatus(res);
+    if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
+        std::cerr << op << " failed: " << PQresultErrorMessage(res) << std::endl;
         PQclear(res);
         return nullptr;
     }
+    return res;
+}
+
+bool Database::create(const std::string& key, const std::string& value, bool* inserted, uint64_t expires_at) {
+    uint64_t expiry = htobe64(expires_at);
+    PGresult* res = execute_prepared("Create", "kv_upsert",
+                                     {key, value, std::string_view(reinterpret_cast<const char*>(&expiry),
+                                                                   sizeof(expiry))},
+                                     kTextResult);
     
+    if (!res) return false;
+    if (inserted) {
+        *inserted = PQntuples(res) > 0 && PQgetvalue(res, 0, 0)[0] == 't';
+    }
+    PQclear(res);
+    return true;
+}
+
+// Binary int8 expires_at column; 0 for NULL
+static uint64_t read_expiry(PGresult* res, int row, int column) {
+    if (PQgetisnull(res, row, column)) {
+        return 0;
+    }
+    uint64_t expiry;
+    memcpy(&expiry, PQgetvalue(res, row, column), sizeof(expiry));
+    return be64toh(expiry);
+}
+
+// Value of a kv_read result, which uses the binary format
+static std::shared_ptr<std::string> read_value(PGresult* res, uint64_t* expires_at) {
     if (PQntuples(res) == 0) {
-        PQclear(res);
         return nullptr;
     }
+    if (expires_at) {
+        *expires_at = read_expiry(res, 0, 1);
+    }
+    // Binary bytea is the raw bytes; the length comes from the result
+    return std::make_shared<std::string>(PQgetvalue(res, 0, 0), PQgetlength(res, 0, 0));
+}
+
+std::shared_ptr<std::string> Database::read(const std::string& key, bool* failed, uint64_t* expires_at) {
+    PGresult* res = execute_prepared("Read", "kv_read", {key}, kBinaryResult);
+    
+    if (failed) {
+        *failed = (res == nullptr);
+    }
+    if (!res) return nullptr;
+    
+    auto value = read_value(res, expires_at);
+    PQclear(res);
+    return value;
+}
+
+std::shared_ptr<std::string> Database::read_range(const std::string& key, uint64_t offset, uint64_t length,
+                                                  uint64_t* total, bool* failed, uint64_t* expires_at) {
+    // A bytea value can't reach 2^31 bytes, so clamped offsets and lengths
+    // still reach past its end
+    uint64_t from = htobe64(std::min<uint64_t>(offset, INT64_MAX - 1));
+    uint32_t count = htonl(static_cast<uint32_t>(std::min<uint64_t>(length, INT32_MAX)));
+    PGresult* res = execute_prepared("Read range", "kv_read_range",
+                                     {key, std::string_view(reinterpret_cast<const char*>(&from), sizeof(from)),
+                                      std::string_view(reinterpret_cast<const char*>(&count), sizeof(count))},
+                                     kBinaryResult);
+    
+    if (failed) {
+        *failed = (res == nullptr);
+    }
+    if (!res) return nullptr;
     
-    auto value = std::make_shared<std::string>(PQgetvalue(res, 0, 0));
+    std::shared_ptr<std::string> value;
+    if (PQntuples(res) > 0) {
+        uint64_t size;
+        memcpy(&size, PQgetvalue(res, 0, 0), sizeof(size));
+        *total = be64toh(size);
+        value = std::make_shared<std::string>(PQgetvalue(res, 0, 1), PQgetlength(res, 0, 1));
+        if (expires_at) {
+            *expires_at = read_expiry(res, 0, 2);
+        }
+    }
     PQclear(res);
     return value;
 }
 
+void Database::read_async(const std::string& key, ReadCallback done) {
+    if (!pipeline_) {
+        StorageBackend::read_async(key, std::move(done));
+        return;
+    }
+    
+    PipelineQuery query{"kv_read", {key}, kBinaryResult, [done](PGresult* res) {
+        res = check_result("Read", res);
+        if (!res) {
+            done(nullptr, true, 0);
+            return;
+        }
+        uint64_t expires_at = 0;
+        auto value = read_value(res, &expires_at);
+        PQclear(res);
+        done(std::move(value), false, expires_at);
+    }};
+    if (!pipeline_->submit(std::move(query))) {
+        std::cerr << "Read failed: database pipeline is closed" << std::endl;
+        done(nullptr, true, 0);
+    }
+}
+
 bool Database::update(const std::string& key, const std::string& value) {
-    if (!is_connected()) return false;
+    PGresult* res = execute_prepared("Update", "kv_update", {key, value}, kTextResult);
+    
+    if (!res) return false;
+    PQclear(res);
+    return true;
+}
+
+bool Database::delete_key(const std::string& key, bool* deleted) {
+    PGresult* res = execute_prepared("Delete", "kv_delete", {key}, kTextResult);
+    
+    if (!res) return false;
+    if (deleted) {
+        *deleted = std::atoll(PQcmdTuples(res)) > 0;
+    }
+    PQclear(res);
+    return true;
+}
+
+long long Database::count_keys() {
+    PGresult* res = execute("Count", [](PGconn* conn) {
+        return PQexec(conn, "SELECT count(*) FROM kv_store");
+    });
+    
+    if (!res) return -1;
+    long long count = std::atoll(PQgetvalue(res, 0, 0));
+    PQclear(res);
+    return count;
+}
+
+bool Database::scan_keys(const std::function<void(std::string_view)>& fn) {
+    PooledConnection conn = pool_->acquire();
+    if (!conn) {
+        std::cerr << "Key scan failed: no database connection available" << std::endl;
+        return false;
+    }
+    
+    // Single-row mode hands rows over as they arrive instead of
+    // materializing the whole result set in client memory
+    if (!PQsendQuery(conn.get(), "SELECT key FROM kv_store") || !PQsetSingleRowMode(conn.get())) {
+        std::cerr << "Key scan failed: " << PQerrorMessage(conn.get()) << std::endl;
+        conn.mark_broken();
+        return false;
+    }
+    
+    bool ok = true;
+    while (PGresult* res = PQgetResult(conn.get())) {
+        ExecStatusType status = PQresultStatus(res);
+        if (status == PGRES_SINGLE_TUPLE) {
+            fn(std::string_view(PQgetvalue(res, 0, 0), PQgetlength(res, 0, 0)));
+        } else if (status != PGRES_TUPLES_OK) {
+            std::cerr << "Key scan failed: " << PQerrorMessage(conn.get()) << std::endl;
+            ok = false;
+        }
+        PQclear(res);
+    }
+    
+    if (PQstatus(conn.get()) != CONNECTION_OK) {
+        conn.mark_broken();
+        return false;
+    }
+    return ok;
+}
+
+bool Database::read_many(const std::vector<std::string>& keys,
+                         std::vector<std::shared_ptr<std::string>>& values,
+                         std::vector<uint64_t>* expires_at) {
+    values.assign(keys.size(), nullptr);
+    if (expires_at) {
+        expires_at->assign(keys.size(), 0);
+    }
+    if (keys.empty()) return true;
+    
+    std::string key_array = to_binary_text_array(keys);
+    PGresult* res = execute_prepared("Batch read", "kv_read_many", {key_array}, kBinaryResult);
     
-    const char* paramValues[2] = {value.c_str(), key.c_str()};
-    PGresult* res = PQexecParams(conn_,
-        "UPDATE kv_store SET value = $1 WHERE key = $2",
-        2, nullptr, paramValues, nullptr, nullptr, 0);
+    if (!res) return false;
     
-    bool success = (PQresultStatus(res) == PGRES_COMMAND_OK);
-    if (!success) {
-        std::cerr << "Update failed: " << PQerrorMessage(conn_) << std::endl;
+    std::unordered_map<std::string_view, int> found;  // Key -> row
+    int rows = PQntuples(res);
+    found.reserve(rows);
+    for (int i = 0; i < rows; ++i) {
+        found.emplace(std::string_view(PQgetvalue(res, i, 0), PQgetlength(res, i, 0)), i);
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto it = found.find(keys[i]);
+        if (it != found.end()) {
+            values[i] = std::make_shared<std::string>(PQgetvalue(res, it->second, 1),
+                                                      PQgetlength(res, it->second, 1));
+            if (expires_at) {
+                (*expires_at)[i] = read_expiry(res, it->second, 2);
+            }
+        }
     }
     PQclear(res);
-    return success;
+    return true;
+}
+
+bool Database::create_many(const std::vector<std::pair<std::string, std::string>>& items,
+                           std::vector<std::string>* overwritten, const std::vector<uint64_t>* expires_at) {
+    for (size_t start = 0; start < items.size(); start += kMaxBatchRows) {
+        size_t count = std::min(kMaxBatchRows, items.size() - start);
+        
+        // Binary parameters, like the prepared statements, so values keep
+        // any bytes. A NULL expires_at (no expiry time) is a null parameter.
+        std::string sql = "INSERT INTO kv_store (key, value, expires_at) VALUES ";
+        std::vector<Oid> paramTypes;
+        std::vector<const char*> paramValues;
+        std::vector<int> paramLengths;
+        std::vector<uint64_t> expiry(count);
+        paramTypes.reserve(count * 3);
+        paramValues.reserve(count * 3);
+        paramLengths.reserve(count * 3);
+        for (size_t i = 0; i < count; ++i) {
+            const auto& item = items[start + i];
+            if (i > 0) sql += ",";
+            sql += "($" + std::to_string(3 * i + 1) + ", $" + std::to_string(3 * i + 2) + ", $" +
+                   std::to_string(3 * i + 3) + ")";
+            paramTypes.insert(paramTypes.end(), {kTextOid, kByteaOid, kInt8Oid});
+            paramValues.push_back(item.first.data());
+            paramLengths.push_back(static_cast<int>(item.first.size()));
+            paramValues.push_back(item.second.data());
+            paramLengths.push_back(static_cast<int>(item.second.size()));
+            uint64_t expiry_time = expires_at ? (*expires_at)[start + i] : 0;
+            if (expiry_time != 0) {
+                expiry[i] = htobe64(expiry_time);
+                paramValues.push_back(reinterpret_cast<const char*>(&expiry[i]));
+            } else {
+                paramValues.push_back(nullptr);
+            }
+            paramLengths.push_back(sizeof(uint64_t));
+        }
+        std::vector<int> paramFormats(paramValues.size(), 1);
+        sql += " ON CONFLICT (key) DO UPDATE SET value = EXCLUDED.value, expires_at = EXCLUDED.expires_at";
+        if (overwritten) {
+            sql += " RETURNING key, (xmax = 0)";
+        }
+        
+        PGresult* res = execute("Batch create", [&](PGconn* conn) {
+            return PQexecParams(conn, sql.c_str(), static_cast<int>(paramValues.size()), paramTypes.data(),
+                                paramValues.data(), paramLengths.data(), paramFormats.data(), kTextResult);
+        });
+        if (!res) return false;
+        if (overwritten) {
+            for (int i = 0; i < PQntuples(res); ++i) {
+                if (PQgetvalue(res, i, 1)[0] != 't') {
+                    overwritten->emplace_back(PQgetvalue(res, i, 0), PQgetlength(res, i, 0));
+                }
+            }
+        }
+        PQclear(res);
+    }
+    return true;
 }
 
-bool Database::delete_key(const std::string& key) {
-    if (!is_connected()) return false;
+bool Database::delete_many(const std::vector<std::string>& keys, std::vector<std::string>* deleted) {
+    if (keys.empty()) return true;
     
-    const char* paramValues[1] = {key.c_str()};
-    PGresult* res = PQexecParams(conn_,
-        "DELETE FROM kv_store WHERE key = $1",
-        1, nullptr, paramValues, nullptr, nullptr, 0);
+    std::string key_array = to_binary_text_array(keys);
+    PGresult* res = execute_prepared("Batch delete", deleted ? "kv_delete_many_returning" : "kv_delete_many",
+                                     {key_array}, kBinaryResult);
+    
+    if (!res) return false;
+    if (deleted) {
+        for (int i = 0; i < PQntuples(res); ++i) {
+            deleted->emplace_back(PQgetvalue(res, i, 0), PQgetlength(res, i, 0));
+        }
+    }
+    PQclear(res);
+    return true;
+}
+
+bool Database::delete_expired(size_t limit, std::vector<std::string>& deleted) {
+    uint32_t rows = htonl(static_cast<uint32_t>(std::min<size_t>(limit, INT32_MAX)));
+    PGresult* res = execute_prepared("Expiry sweep", "kv_delete_expired",
+                                     {std::string_view(reinterpret_cast<const char*>(&rows), sizeof(rows))},
+                                     kBinaryResult);
     
-    bool success = (PQresultStatus(res) == PGRES_COMMAND_OK);
-    if (!success) {
-        std::cerr << "Delete failed: " << PQerrorMessage(conn_) << std::endl;
+    if (!res) return false;
+    for (int i = 0; i < PQntuples(res); ++i) {
+        deleted.emplace_back(PQgetvalue(res, i, 0), PQgetlength(res, i, 0));
     }
     PQclear(res);
-    return success;
+    return true;
+}
+
+static void append_int32(std::string& out, uint32_t value) {
+    uint32_t net = htonl(value);
+    out.append(reinterpret_cast<const char*>(&net), sizeof(net));
+}
+
+void Database::get_stats(std::vector<std::pair<std::string, uint64_t>>& stats) const {
+    stats.emplace_back("db_pool_size", get_pool_size());
+    stats.emplace_back("db_idle_connections", get_idle_connections());
+    stats.emplace_back("db_pool_waits", get_pool_waits());
+    stats.emplace_back("db_reconnects", get_reconnects());
+    if (get_pipeline_connections() > 0) {
+        stats.emplace_back("db_pipeline_connections", get_pipeline_connections());
+        stats.emplace_back("db_pipeline_in_flight", get_pipeline_in_flight());
+        stats.emplace_back("db_pipeline_max_in_flight", get_pipeline_max_in_flight());
+    }
+}
+
+std::string Database::to_binary_text_array(const std::vector<std::string>& values) {
+    // Binary array wire format: ndim, has-nulls flag, element type, then
+    // (size, lower bound) per dimension and a length-prefixed element list
+    std::string out;
+    size_t total = 20;
+    for (const auto& value : values) {
+        total += 4 + value.size();
+    }
+    out.reserve(total);
+    append_int32(out, 1);
+    append_int32(out, 0);
+    append_int32(out, kTextOid);
+    append_int32(out, static_cast<uint32_t>(values.size()));
+    append_int32(out, 1);
+    for (const auto& value : values) {
+        append_int32(out, static_cast<uint32_t>(value.size()));
+        out += value;
+    }
+    return out;
 }
 
 bool Database::execute_query(const std::string& query) {
-    if (!is_connected()) return false;
+    PGresult* res = execute("Query", [&](PGconn* conn) {
+        return PQexec(conn, query.c_str());
+    });
     
-    PGresult* res = PQexec(conn_, query.c_str());
-    bool success = (PQresultStatus(res) == PGRES_COMMAND_OK);
+    if (!res) return false;
     PQclear(res);
-    return success;
+    return true;
 }
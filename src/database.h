@@ -1,35 +1,119 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include "connection_pool.h"
+#include "pipeline.h"
+#include "storage_backend.h"
 #include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <unordered_map>
 #include <memory>
+#include <functional>
+#include <initializer_list>
 #include <libpq-fe.h>
 
-class Database {
+// StorageBackend on PostgreSQL: a libpq connection pool, optionally with
+// pipelined connections for single-key statements
+class Database : public StorageBackend {
 public:
-    Database(const std::string& connection_string);
-    ~Database();
+    // pipeline_connections > 0 sends single-statement operations through that
+    // many pipelined connections instead of the pool; the pool still serves
+    // multi-row writes and startup scans
+    Database(const std::string& connection_string, size_t pool_size = 1, size_t pipeline_connections = 0);
+    ~Database() override;
     
-    // Connect to database
-    bool connect();
+    // Connect to database (opens the connection pool)
+    bool connect() override;
     
     // Disconnect from database
-    void disconnect();
+    void disconnect() override;
     
     // Check if connected
-    bool is_connected() const;
+    bool is_connected() const override;
     
-    // CRUD operations
-    bool create(const std::string& key, const std::string& value);
-    std::shared_ptr<std::string> read(const std::string& key);
+    // Round trip on a pooled connection
+    bool ping() override;
+    
+    // CRUD operations (see StorageBackend)
+    bool create(const std::string& key, const std::string& value, bool* inserted = nullptr,
+                uint64_t expires_at = 0) override;
+    std::shared_ptr<std::string> read(const std::string& key, bool* failed = nullptr,
+                                      uint64_t* expires_at = nullptr) override;
     bool update(const std::string& key, const std::string& value);
-    bool delete_key(const std::string& key);
+    bool delete_key(const std::string& key, bool* deleted = nullptr) override;
+    
+    // Only the range's bytes leave the server
+    std::shared_ptr<std::string> read_range(const std::string& key, uint64_t offset, uint64_t length,
+                                            uint64_t* total, bool* failed = nullptr,
+                                            uint64_t* expires_at = nullptr) override;
+    
+    // In pipeline mode `done` runs on a pipeline I/O thread and must not
+    // block; without pipelining the read is made before returning
+    void read_async(const std::string& key, ReadCallback done) override;
+    bool reads_async() const override { return pipeline_ != nullptr; }
+    
+    long long count_keys() override;
+    
+    // Streams rows with a single-row-mode query
+    bool scan_keys(const std::function<void(std::string_view)>& fn) override;
+    
+    // Batched read: one "key = ANY($1)" query
+    bool read_many(const std::vector<std::string>& keys,
+                   std::vector<std::shared_ptr<std::string>>& values,
+                   std::vector<uint64_t>* expires_at = nullptr) override;
+    
+    // Batched writes: one multi-row upsert / one DELETE per call. Batches
+    // stay under kMaxBatchRows rows to keep parameter counts under libpq's
+    // 65535 limit.
+    bool create_many(const std::vector<std::pair<std::string, std::string>>& items,
+                     std::vector<std::string>* overwritten = nullptr,
+                     const std::vector<uint64_t>* expires_at = nullptr) override;
+    bool delete_many(const std::vector<std::string>& keys, std::vector<std::string>* deleted = nullptr) override;
+    
+    // One DELETE ... LIMIT through the partial index on expires_at
+    bool delete_expired(size_t limit, std::vector<std::string>& deleted) override;
+    
+    // Pool and pipeline counters
+    void get_stats(std::vector<std::pair<std::string, uint64_t>>& stats) const override;
+    
+    // Connection pool statistics
+    size_t get_pool_size() const { return pool_->get_pool_size(); }
+    size_t get_idle_connections() const { return pool_->get_idle_count(); }
+    uint64_t get_reconnects() const { return pool_->get_reconnects(); }
+    uint64_t get_pool_waits() const { return pool_->get_waits(); }
+    
+    // Pipeline statistics (zero when pipelining is off)
+    size_t get_pipeline_connections() const { return pipeline_ ? pipeline_->get_num_connections() : 0; }
+    size_t get_pipeline_in_flight() const { return pipeline_ ? pipeline_->get_in_flight() : 0; }
+    uint64_t get_pipeline_max_in_flight() const { return pipeline_ ? pipeline_->get_max_in_flight() : 0; }
     
 private:
     std::string connection_string_;
-    PGconn* conn_;
+    std::unique_ptr<ConnectionPool> pool_;
+    std::unique_ptr<PipelineExecutor> pipeline_;
+    
+    // Run a query on a pooled connection, retrying once on a fresh connection
+    // if the server dropped the one we were given. Returns nullptr on failure.
+    PGresult* execute(const char* op, const std::function<PGresult*(PGconn*)>& query);
     
     bool execute_query(const std::string& query);
+    
+    // Run one of the statements prepared on every connection, passing
+    // parameters in binary. result_format is 0 for text, 1 for binary.
+    // Goes through the pipeline when enabled, waiting for the result.
+    PGresult* execute_prepared(const char* op, const char* statement,
+                               std::initializer_list<std::string_view> params, int result_format);
+    
+    // Null out a failed result, logging the error
+    static PGresult* check_result(const char* op, PGresult* res);
+    
+    // Connection setup hook for the pool: prepares every statement
+    static bool prepare_statements(PGconn* conn);
+    
+    // Encode values as a binary text[] for "= ANY($1)" parameters
+    static std::string to_binary_text_array(const std::vector<std::string>& values);
 };
 
 #endif // DATABASE_H
@@ -0,0 +1,376 @@
+#include "event_loop_server.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// epoll user data for the two fds that aren't connections
+static constexpr uint64_t kListenerId = UINT64_MAX;
+static constexpr uint64_t kWakeupId = UINT64_MAX - 1;
+
+EventLoopServer::EventLoopServer(std::shared_ptr<ThreadPool> pool, size_t max_buffered)
+    : pool_(pool), max_buffered_(max_buffered) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    reserve_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+EventLoopServer::~EventLoopServer() {
+    if (epoll_fd_ >= 0) ::close(epoll_fd_);
+    if (wakeup_fd_ >= 0) ::close(wakeup_fd_);
+    if (reserve_fd_ >= 0) ::close(reserve_fd_);
+}
+
+bool EventLoopServer::open_listener(const std::string& host, int port) {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        return false;
+    }
+
+    int yes = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+        bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        ::listen(listen_fd_, SOMAXCONN) < 0) {
+        std::cerr << "Event loop: cannot listen on " << host << ":" << port << ": " << std::strerror(errno)
+                  << std::endl;
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+bool EventLoopServer::listen(const std::string& host, int port) {
+    if (epoll_fd_ < 0 || wakeup_fd_ < 0 || !open_listener(host, port)) {
+        return false;
+    }
+
+    // The listener is level-triggered, so connections left in the backlog
+    // (accept failing for a moment) are reported again on the next wait
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = kListenerId;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = kWakeupId;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev);
+
+    // stop() may be called before the loop starts; the flag covers that
+    epoll_event events[256];
+    while (!stopping_.load(std::memory_order_acquire)) {
+        int n = epoll_wait(epoll_fd_, events, 256, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Event loop: epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            uint64_t id = events[i].data.u64;
+            if (id == kListenerId) {
+                accept_connections();
+                continue;
+            }
+            if (id == kWakeupId) {
+                uint64_t count;
+                ssize_t drained = read(wakeup_fd_, &count, sizeof(count));
+                (void)drained;
+                drain_completions();
+                continue;
+            }
+
+            auto it = connections_.find(id);
+            if (it == connections_.end()) continue;
+            Connection& conn = *it->second;
+            uint32_t flags = events[i].events;
+
+            if (flags & EPOLLERR) {
+                close_connection(id);
+                continue;
+            }
+            if (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+                on_readable(id, conn);
+                if (connections_.find(id) == connections_.end()) continue;
+            }
+            if (flags & EPOLLOUT) {
+                if (!flush(conn) || (conn.out.empty() && conn.close_after_write && !conn.busy)) {
+                    close_connection(id);
+                }
+            }
+        }
+    }
+
+    shutdown();
+    return true;
+}
+
+void EventLoopServer::stop() {
+    stopping_.store(true, std::memory_order_release);
+    wake();
+}
+
+void EventLoopServer::wake() {
+    uint64_t one = 1;
+    ssize_t written = write(wakeup_fd_, &one, sizeof(one));
+    (void)written;  // Only fails on counter overflow, when a wakeup is pending anyway
+}
+
+void EventLoopServer::accept_connections() {
+    while (true) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            if (!accept_failing_) {
+                std::cerr << "Event loop: accept failed: " << std::strerror(errno) << std::endl;
+                accept_failing_ = true;
+            }
+            if ((errno == EMFILE || errno == ENFILE) && reserve_fd_ >= 0) {
+                // Out of descriptors: free the spare one to accept the
+                // client and hang up at once, rather than leave it (and
+                // the level-triggered listener) waiting in the backlog
+                ::close(reserve_fd_);
+                fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0) ::close(fd);
+                reserve_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+            }
+            return;
+        }
+        accept_failing_ = false;
+
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        uint64_t id = next_conn_id_++;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.u64 = id;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            ::close(fd);
+            continue;
+        }
+
+        std::unique_ptr<Connection> conn(new Connection());
+        conn->fd = fd;
+        connections_.emplace(id, std::move(conn));
+        open_connections_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void EventLoopServer::on_readable(uint64_t id, Connection& conn) {
+    // Edge-triggered: read until the socket is drained, handing process()
+    // up to kReadAhead new bytes at a time (a large request gets there in
+    // steps, up to max_buffered_). While work is in flight the buffer stops
+    // at kReadAhead; drain_completions() reads on once the work finishes.
+    char buf[kReadChunk];
+    bool peer_closed = false;
+    while (true) {
+        size_t limit = conn.busy ? kReadAhead : std::min(max_buffered_, conn.in.size() + kReadAhead);
+        conn.read_paused = false;
+        while (true) {
+            if (conn.in.size() >= limit) {
+                conn.read_paused = true;
+                break;
+            }
+            ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                conn.in.append(buf, n);
+            } else if (n == 0) {
+                peer_closed = true;
+                break;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else {
+                close_connection(id);
+                return;
+            }
+        }
+
+        if (conn.busy || conn.close_after_write) {
+            break;
+        }
+        process(id, conn);
+        if (connections_.find(id) == connections_.end()) return;
+        if (!conn.read_paused || conn.busy || conn.close_after_write) {
+            break;
+        }
+        if (conn.in.size() >= max_buffered_) {
+            // More than any request the protocol accepts, yet not refused
+            close_connection(id);
+            return;
+        }
+    }
+
+    if (peer_closed) {
+        // The client may have half-closed after its last request; answer
+        // anything in progress, then close
+        auto it = connections_.find(id);
+        if (it == connections_.end()) return;
+        it->second->close_after_write = true;
+        if (!it->second->busy && it->second->out.empty()) {
+            close_connection(id);
+        }
+    }
+}
+
+void EventLoopServer::dispatch(uint64_t id, Connection& conn, Work work, bool keep_alive) {
+    dispatch_async(id, conn, [work = std::move(work)](Done done) { done(work()); }, keep_alive);
+}
+
+void EventLoopServer::dispatch_async(uint64_t id, Connection& conn, AsyncWork work, bool keep_alive) {
+    conn.busy = true;
+    {
+        std::unique_lock<std::mutex> lock(completions_mutex_);
+        outstanding_++;
+    }
+
+    auto task = [this, id, work = std::move(work), keep_alive]() {
+        // Whichever of done and a thrown exception comes first completes
+        auto completed = std::make_shared<std::atomic<bool>>(false);
+        try {
+            work([this, id, keep_alive, completed](std::string wire) {
+                if (!completed->exchange(true)) {
+                    complete(id, std::move(wire), keep_alive);
+                }
+            });
+        } catch (const std::exception& e) {
+            // Protocols answer their own errors; all we can do is hang up
+            std::cerr << "Event loop: request failed: " << e.what() << std::endl;
+            if (!completed->exchange(true)) {
+                complete(id, std::string(), false);
+            }
+        }
+    };
+
+    try {
+        pool_->enqueue(std::move(task));
+    } catch (const std::exception& e) {
+        // Pool already stopped
+        {
+            std::unique_lock<std::mutex> lock(completions_mutex_);
+            outstanding_--;
+        }
+        outstanding_cv_.notify_all();
+        conn.busy = false;
+        send_and_close(id, conn, unavailable_response());
+    }
+}
+
+void EventLoopServer::complete(uint64_t id, std::string wire, bool keep_alive) {
+    {
+        std::unique_lock<std::mutex> lock(completions_mutex_);
+        completions_.push_back({id, std::move(wire), keep_alive});
+        outstanding_--;
+    }
+    outstanding_cv_.notify_all();
+    wake();
+}
+
+void EventLoopServer::drain_completions() {
+    std::vector<Completion> done;
+    {
+        std::unique_lock<std::mutex> lock(completions_mutex_);
+        done.swap(completions_);
+    }
+
+    for (auto& completion : done) {
+        auto it = connections_.find(completion.conn_id);
+        if (it == connections_.end()) continue;  // Client went away meanwhile
+        Connection& conn = *it->second;
+
+        conn.busy = false;
+        if (conn.out.empty()) {
+            conn.out = std::move(completion.wire);
+        } else {
+            conn.out += completion.wire;
+        }
+        if (!completion.keep_alive) {
+            conn.close_after_write = true;
+        }
+
+        if (!flush(conn)) {
+            close_connection(completion.conn_id);
+            continue;
+        }
+        if (conn.close_after_write) {
+            if (conn.out.empty()) close_connection(completion.conn_id);
+            continue;
+        }
+        // Pipelined requests may already be waiting in the read buffer. If
+        // it filled up meanwhile, more wait on the socket: read on once the
+        // buffer holds no complete request.
+        process(completion.conn_id, conn);
+        if (connections_.find(completion.conn_id) != connections_.end() && conn.read_paused && !conn.busy &&
+            !conn.close_after_write) {
+            on_readable(completion.conn_id, conn);
+        }
+    }
+}
+
+bool EventLoopServer::flush(Connection& conn) {
+    while (conn.out_offset < conn.out.size()) {
+        ssize_t n = send(conn.fd, conn.out.data() + conn.out_offset, conn.out.size() - conn.out_offset,
+                         MSG_NOSIGNAL);
+        if (n > 0) {
+            conn.out_offset += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;  // EPOLLOUT resumes the write
+        } else {
+            return false;
+        }
+    }
+    conn.out.clear();
+    conn.out_offset = 0;
+    return true;
+}
+
+void EventLoopServer::send_and_close(uint64_t id, Connection& conn, const std::string& wire) {
+    conn.out += wire;
+    conn.in.clear();
+    conn.close_after_write = true;
+    if (!flush(conn) || conn.out.empty()) {
+        close_connection(id);
+    }
+}
+
+void EventLoopServer::close_connection(uint64_t id) {
+    auto it = connections_.find(id);
+    if (it == connections_.end()) return;
+    // Closing the fd also removes it from the epoll set
+    ::close(it->second->fd);
+    connections_.erase(it);
+    open_connections_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void EventLoopServer::shutdown() {
+    for (auto& entry : connections_) {
+        ::close(entry.second->fd);
+    }
+    connections_.clear();
+    open_connections_.store(0, std::memory_order_relaxed);
+    ::close(listen_fd_);
+    listen_fd_ = -1;
+
+    // Tasks still on the pool reference this server
+    std::unique_lock<std::mutex> lock(completions_mutex_);
+    outstanding_cv_.wait(lock, [this] { return outstanding_ == 0; });
+    completions_.clear();
+}
@@ -0,0 +1,123 @@
+#ifndef EVENT_LOOP_SERVER_H
+#define EVENT_LOOP_SERVER_H
+
+#include "thread_pool.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+// TCP server built on one edge-triggered epoll loop. The loop accepts,
+// reads and writes; subclasses parse their protocol from each connection's
+// read buffer and hand complete requests to the thread pool, so idle
+// connections cost a buffer rather than a thread. Work for one connection
+// runs one piece at a time, in order (anything pipelined behind it waits in
+// the read buffer, which stops growing at kReadAhead bytes until that work
+// finishes).
+class EventLoopServer {
+public:
+    virtual ~EventLoopServer();
+
+    // Serve until stop() is called; false if the address can't be bound
+    bool listen(const std::string& host, int port);
+
+    // Safe to call from any thread
+    void stop();
+
+    size_t get_open_connections() const { return open_connections_.load(std::memory_order_relaxed); }
+
+protected:
+    static constexpr size_t kReadChunk = 16 * 1024;
+    static constexpr size_t kReadAhead = 1024 * 1024;  // Read per process() call, or buffered behind busy work
+
+    struct Connection {
+        int fd;
+        std::string in;           // Received bytes not yet parsed
+        std::string out;          // Serialized responses not yet sent
+        size_t out_offset = 0;
+        bool busy = false;        // Work for this connection is running on the pool
+        bool sent_continue = false;  // HTTP: 100 Continue sent for the pending request
+        // HTTP: a chunked body is decoded in place, its data moved down to
+        // follow the headers; decoding resumes at chunk_next (0 = not started)
+        size_t chunk_next = 0;
+        size_t chunk_body = 0;
+        bool close_after_write = false;
+        bool read_paused = false; // The read buffer filled up; the socket wasn't drained
+    };
+
+    // Runs on the pool and returns the bytes to send back
+    using Work = std::function<std::string()>;
+
+    // Runs on the pool and calls `done` once, from any thread, with the
+    // bytes to send back; lets work wait for a callback without holding a
+    // pool thread
+    using Done = std::function<void(std::string wire)>;
+    using AsyncWork = std::function<void(Done done)>;
+
+    // max_buffered caps a connection's read buffer; it must hold the
+    // largest request the protocol accepts
+    EventLoopServer(std::shared_ptr<ThreadPool> pool, size_t max_buffered);
+
+    // Parse what has arrived on a connection with no work in flight, and
+    // dispatch() the next complete request. Runs on the loop thread.
+    virtual void process(uint64_t id, Connection& conn) = 0;
+
+    // Sent in place of a response when the pool refuses work (shutdown)
+    virtual std::string unavailable_response() = 0;
+
+    // Run work on the pool; the connection is busy until its bytes are queued
+    void dispatch(uint64_t id, Connection& conn, Work work, bool keep_alive);
+    void dispatch_async(uint64_t id, Connection& conn, AsyncWork work, bool keep_alive);
+
+    // Send final bytes (e.g. an error) and close once they are written
+    void send_and_close(uint64_t id, Connection& conn, const std::string& wire);
+
+    bool flush(Connection& conn);
+    void close_connection(uint64_t id);
+
+private:
+    // A response finished on the pool, waiting for the loop to send it
+    struct Completion {
+        uint64_t conn_id;
+        std::string wire;
+        bool keep_alive;
+    };
+
+    std::shared_ptr<ThreadPool> pool_;
+    size_t max_buffered_;
+
+    int listen_fd_ = -1;
+    int reserve_fd_ = -1;        // Given up to turn a client away when out of fds
+    bool accept_failing_ = false;  // Logged once until an accept succeeds
+    int epoll_fd_ = -1;
+    int wakeup_fd_ = -1;
+    std::atomic<bool> stopping_{false};
+
+    // Owned by the loop thread
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+    uint64_t next_conn_id_ = 0;
+    std::atomic<size_t> open_connections_{0};
+
+    std::mutex completions_mutex_;
+    std::vector<Completion> completions_;
+
+    // Work handed to the pool and not yet completed; listen() waits for it
+    // so no task outlives the server
+    size_t outstanding_ = 0;
+    std::condition_variable outstanding_cv_;
+
+    bool open_listener(const std::string& host, int port);
+    void accept_connections();
+    void on_readable(uint64_t id, Connection& conn);
+    void drain_completions();
+    void complete(uint64_t id, std::string wire, bool keep_alive);
+    void wake();
+    void shutdown();
+};
+
+#endif // EVENT_LOOP_SERVER_H
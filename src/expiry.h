@@ -0,0 +1,22 @@
+#ifndef EXPIRY_H
+#define EXPIRY_H
+
+#include <chrono>
+#include <cstdint>
+
+// Keys with a TTL carry an absolute expiry time: Unix time in seconds,
+// after which (at expires_at and later) the key reads as missing. 0 means
+// the key never expires. The cache, the storage backends and the sweeper
+// all compare against this clock.
+inline uint64_t expiry_now() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+            .count());
+}
+
+// Whether a key expiring at expires_at is dead at `now`
+inline bool is_expired(uint64_t expires_at, uint64_t now) {
+    return expires_at != 0 && expires_at <= now;
+}
+
+#endif // EXPIRY_H
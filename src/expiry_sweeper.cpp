@@ -0,0 +1,94 @@
+#include "expiry_sweeper.h"
+#include <iostream>
+#include <vector>
+#include <string>
+
+ExpirySweeper::ExpirySweeper(std::shared_ptr<Cache> cache, std::shared_ptr<StorageBackend> db,
+                             std::shared_ptr<KeyFilter> key_filter, std::chrono::milliseconds interval,
+                             size_t batch_size)
+    : cache_(cache), db_(db), key_filter_(key_filter), interval_(interval),
+      batch_size_(batch_size == 0 ? 1 : batch_size) {}
+
+ExpirySweeper::~ExpirySweeper() {
+    stop();
+}
+
+void ExpirySweeper::start() {
+    if (interval_.count() <= 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(sweeper_mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    sweeper_ = std::thread([this] { sweeper_loop(); });
+}
+
+void ExpirySweeper::stop() {
+    std::unique_lock<std::mutex> lock(sweeper_mutex_);
+    if (running_) {
+        running_ = false;
+        lock.unlock();
+        sweeper_cv_.notify_all();
+        sweeper_.join();
+    }
+}
+
+void ExpirySweeper::sweeper_loop() {
+    std::unique_lock<std::mutex> lock(sweeper_mutex_);
+    while (running_) {
+        if (sweeper_cv_.wait_for(lock, interval_, [this] { return !running_; })) {
+            break;
+        }
+        lock.unlock();
+        sweep();
+        lock.lock();
+    }
+}
+
+void ExpirySweeper::sweep() {
+    std::unique_lock<std::mutex> sweep_lock(sweep_mutex_);
+    auto start = std::chrono::steady_clock::now();
+
+    size_t cache_expired = cache_->expire(expiry_now());
+
+    // A short batch means nothing else was due
+    uint64_t rows_deleted = 0;
+    bool failed = false;
+    std::vector<std::string> deleted;
+    for (size_t batch = 0; batch < kMaxBatchesPerSweep; ++batch) {
+        deleted.clear();
+        if (!db_->delete_expired(batch_size_, deleted)) {
+            failed = true;
+            break;
+        }
+        if (key_filter_) {
+            for (const auto& key : deleted) {
+                key_filter_->remove(key);
+            }
+        }
+        rows_deleted += deleted.size();
+        if (deleted.size() < batch_size_) {
+            break;
+        }
+    }
+    if (failed) {
+        std::cerr << "Expiry sweep: failed to delete expired keys" << std::endl;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    stats_.sweeps++;
+    stats_.cache_expired += cache_expired;
+    stats_.rows_deleted += rows_deleted;
+    if (failed) {
+        stats_.failures++;
+    }
+    stats_.last_sweep_ms = ms;
+}
+
+SweeperStats ExpirySweeper::get_stats() const {
+    std::unique_lock<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
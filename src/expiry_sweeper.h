@@ -0,0 +1,66 @@
+#ifndef EXPIRY_SWEEPER_H
+#define EXPIRY_SWEEPER_H
+
+#include "cache.h"
+#include "storage_backend.h"
+#include "key_filter.h"
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+
+struct SweeperStats {
+    uint64_t sweeps = 0;
+    uint64_t cache_expired = 0;  // Entries the cache's timer wheels came due for
+    uint64_t rows_deleted = 0;
+    uint64_t failures = 0;
+    double last_sweep_ms = 0;
+};
+
+// Removes expired keys in the background. Reads already treat an expired
+// key as missing; the sweeper reclaims the space. Every interval it
+// advances the cache's timer wheels, then deletes expired rows from the
+// database in batches of batch_size, so a burst of expiries never turns
+// into one long statement. Deleted keys are taken out of the key filter.
+class ExpirySweeper {
+public:
+    // key_filter may be null
+    ExpirySweeper(std::shared_ptr<Cache> cache, std::shared_ptr<StorageBackend> db,
+                  std::shared_ptr<KeyFilter> key_filter, std::chrono::milliseconds interval,
+                  size_t batch_size);
+    ~ExpirySweeper();
+
+    void start();
+    void stop();
+
+    // One sweep now; safe to call from any thread
+    void sweep();
+
+    SweeperStats get_stats() const;
+
+    // Batches per sweep at most, so stopping never waits on a huge backlog;
+    // the rest is left for the next sweep
+    static constexpr size_t kMaxBatchesPerSweep = 100;
+
+private:
+    std::shared_ptr<Cache> cache_;
+    std::shared_ptr<StorageBackend> db_;
+    std::shared_ptr<KeyFilter> key_filter_;
+    std::chrono::milliseconds interval_;
+    size_t batch_size_;
+
+    std::thread sweeper_;
+    std::mutex sweeper_mutex_;
+    std::condition_variable sweeper_cv_;
+    bool running_ = false;
+
+    std::mutex sweep_mutex_;  // One sweep at a time
+    mutable std::mutex stats_mutex_;
+    SweeperStats stats_;
+
+    void sweeper_loop();
+};
+
+#endif // EXPIRY_SWEEPER_H
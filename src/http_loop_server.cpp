@@ -0,0 +1,324 @@
+#include "http_loop_server.h"
+#include <cstring>
+#include <cstdlib>
+#include <strings.h>
+
+static const char* reason_phrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 413: return "Payload Too Large";
+        case 416: return "Range Not Satisfiable";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
+
+static std::string serialize(const HttpResponse& res, bool keep_alive) {
+    size_t length = res.body_writer ? res.body_length : res.body.size();
+    std::string wire;
+    wire.reserve(128 + length);
+    wire += "HTTP/1.1 ";
+    wire += std::to_string(res.status);
+    wire += ' ';
+    wire += reason_phrase(res.status);
+    wire += "\r\nContent-Type: ";
+    wire += res.content_type;
+    wire += "\r\nContent-Length: ";
+    wire += std::to_string(length);
+    if (res.content_encoding) {
+        wire += "\r\nContent-Encoding: ";
+        wire += res.content_encoding;
+    }
+    if (res.status == 206) {
+        wire += "\r\nContent-Range: bytes ";
+        wire += std::to_string(res.range_offset);
+        wire += '-';
+        wire += std::to_string(res.range_offset + length - 1);
+        wire += '/';
+        wire += std::to_string(res.range_total);
+    } else if (res.status == 416) {
+        wire += "\r\nContent-Range: bytes */";
+        wire += std::to_string(res.range_total);
+    }
+    wire += keep_alive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+    if (res.body_writer) {
+        res.body_writer([&wire](const char* data, size_t size) {
+            wire.append(data, size);
+            return true;
+        });
+    } else {
+        wire += res.body;
+    }
+    return wire;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decode %XX escapes and '+' in a query string component
+static std::string url_decode(std::string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '%' && i + 2 < text.size()) {
+            int hi = hex_value(text[i + 1]);
+            int lo = hex_value(text[i + 2]);
+            if (hi >= 0 && lo >= 0) {
+                out += static_cast<char>(hi * 16 + lo);
+                i += 2;
+                continue;
+            }
+        }
+        out += (text[i] == '+') ? ' ' : text[i];
+    }
+    return out;
+}
+
+static void parse_query(std::string_view query, std::unordered_map<std::string, std::string>& params) {
+    while (!query.empty()) {
+        size_t amp = query.find('&');
+        std::string_view pair = query.substr(0, amp);
+        query = (amp == std::string_view::npos) ? std::string_view() : query.substr(amp + 1);
+        if (pair.empty()) continue;
+        size_t eq = pair.find('=');
+        std::string name = url_decode(pair.substr(0, eq));
+        std::string value = (eq == std::string_view::npos) ? std::string() : url_decode(pair.substr(eq + 1));
+        params.emplace(std::move(name), std::move(value));
+    }
+}
+
+static bool iequals(std::string_view a, const char* b) {
+    size_t n = std::strlen(b);
+    return a.size() == n && strncasecmp(a.data(), b, n) == 0;
+}
+
+static bool icontains(std::string_view haystack, const char* needle) {
+    size_t n = std::strlen(needle);
+    for (size_t i = 0; i + n <= haystack.size(); ++i) {
+        if (strncasecmp(haystack.data() + i, needle, n) == 0) return true;
+    }
+    return false;
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+HttpLoopServer::HttpLoopServer(std::shared_ptr<ThreadPool> pool, Handler handler)
+    : EventLoopServer(pool, kMaxHeaderBytes + kMaxRequestBodyBytes), handler_(std::move(handler)) {}
+
+void HttpLoopServer::process(uint64_t id, Connection& conn) {
+    size_t header_end = conn.in.find("\r\n\r\n");
+    if (header_end == std::string::npos) {
+        if (conn.in.size() > kMaxHeaderBytes) {
+            send_error(id, conn, 431, "Request headers too large");
+        }
+        return;
+    }
+
+    std::string_view head(conn.in.data(), header_end);
+    size_t line_end = head.find("\r\n");
+    std::string_view request_line = head.substr(0, line_end);
+    size_t sp1 = request_line.find(' ');
+    size_t sp2 = request_line.rfind(' ');
+    if (sp1 == std::string_view::npos || sp2 == sp1) {
+        send_error(id, conn, 400, "Malformed request line");
+        return;
+    }
+    std::string_view method = request_line.substr(0, sp1);
+    std::string_view target = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+    std::string_view version = request_line.substr(sp2 + 1);
+
+    bool keep_alive = (version == "HTTP/1.1");
+    bool expect_continue = false;
+    bool chunked = false;
+    size_t content_length = 0;
+    std::string_view accept;
+    std::string_view range;
+    std::string_view accept_encoding;
+    std::string_view headers = (line_end == std::string_view::npos) ? std::string_view() : head.substr(line_end + 2);
+    while (!headers.empty()) {
+        size_t eol = headers.find("\r\n");
+        std::string_view line = headers.substr(0, eol);
+        headers = (eol == std::string_view::npos) ? std::string_view() : headers.substr(eol + 2);
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = trim(line.substr(colon + 1));
+
+        if (iequals(name, "Content-Length")) {
+            char* end = nullptr;
+            std::string digits(value);
+            content_length = std::strtoull(digits.c_str(), &end, 10);
+            if (digits.empty() || *end != '\0') {
+                send_error(id, conn, 400, "Invalid Content-Length");
+                return;
+            }
+        } else if (iequals(name, "Transfer-Encoding")) {
+            if (!iequals(value, "chunked")) {
+                send_error(id, conn, 501, "Only chunked transfer coding is supported");
+                return;
+            }
+            chunked = true;
+        } else if (iequals(name, "Connection")) {
+            if (icontains(value, "close")) keep_alive = false;
+            if (icontains(value, "keep-alive")) keep_alive = true;
+        } else if (iequals(name, "Expect")) {
+            expect_continue = icontains(value, "100-continue");
+        } else if (iequals(name, "Accept")) {
+            accept = value;
+        } else if (iequals(name, "Range")) {
+            range = value;
+        } else if (iequals(name, "Accept-Encoding")) {
+            accept_encoding = value;
+        }
+    }
+
+    // Transfer-Encoding overrides Content-Length
+    size_t body_start = header_end + 4;
+    size_t total = body_start + content_length;
+    bool complete = conn.in.size() >= total;
+    if (chunked) {
+        switch (decode_chunked(conn, body_start)) {
+            case Chunked::kMalformed:
+                send_error(id, conn, 400, "Malformed chunked body");
+                return;
+            case Chunked::kTooLarge:
+                send_error(id, conn, 413, "Request body too large");
+                return;
+            case Chunked::kComplete:
+                content_length = conn.chunk_body;
+                total = conn.chunk_next;
+                complete = true;
+                break;
+            case Chunked::kIncomplete:
+                complete = false;
+                break;
+        }
+    } else if (content_length > kMaxRequestBodyBytes) {
+        send_error(id, conn, 413, "Request body too large");
+        return;
+    }
+
+    if (!complete) {
+        if (expect_continue && !conn.sent_continue) {
+            conn.sent_continue = true;
+            conn.out += "HTTP/1.1 100 Continue\r\n\r\n";
+            if (!flush(conn)) close_connection(id);
+        }
+        return;
+    }
+
+    HttpRequest request;
+    request.method = std::string(method);
+    size_t question = target.find('?');
+    request.path = std::string(target.substr(0, question));
+    if (question != std::string_view::npos) {
+        parse_query(target.substr(question + 1), request.params);
+    }
+    request.body = conn.in.substr(body_start, content_length);
+    request.accept = std::string(accept);
+    request.range = std::string(range);
+    request.accept_encoding = std::string(accept_encoding);
+
+    conn.in.erase(0, total);
+    conn.sent_continue = false;
+    conn.chunk_next = 0;
+    conn.chunk_body = 0;
+
+    dispatch(id, conn, [this, request = std::move(request), keep_alive]() {
+        HttpResponse response;
+        try {
+            handler_(request, response);
+        } catch (const std::exception& e) {
+            response = HttpResponse();
+            response.status = 500;
+            response.body = "{\"error\":\"Internal server error\"}";
+        }
+        return serialize(response, keep_alive);
+    }, keep_alive);
+}
+
+HttpLoopServer::Chunked HttpLoopServer::decode_chunked(Connection& conn, size_t body_start) {
+    std::string& in = conn.in;
+    if (conn.chunk_next == 0) {
+        conn.chunk_next = body_start;
+        conn.chunk_body = 0;
+    }
+    for (;;) {
+        // chunk-size [; extensions] CRLF
+        size_t line_end = in.find("\r\n", conn.chunk_next);
+        if (line_end == std::string::npos) {
+            return in.size() - conn.chunk_next > kMaxHeaderBytes ? Chunked::kMalformed : Chunked::kIncomplete;
+        }
+        size_t size = 0;
+        size_t pos = conn.chunk_next;
+        for (; pos < line_end && hex_value(in[pos]) >= 0; ++pos) {
+            if (size > kMaxRequestBodyBytes) {
+                return Chunked::kTooLarge;
+            }
+            size = size * 16 + hex_value(in[pos]);
+        }
+        if (pos == conn.chunk_next || (pos < line_end && in[pos] != ';' && in[pos] != ' ' && in[pos] != '\t')) {
+            return Chunked::kMalformed;
+        }
+        size_t data_start = line_end + 2;
+
+        if (size == 0) {
+            // Trailer fields are skipped, up to the empty line
+            size_t end;
+            if (in.compare(data_start, 2, "\r\n") == 0) {
+                end = data_start + 2;
+            } else {
+                size_t blank = in.find("\r\n\r\n", data_start);
+                if (blank == std::string::npos) {
+                    return in.size() - data_start > kMaxHeaderBytes ? Chunked::kMalformed : Chunked::kIncomplete;
+                }
+                end = blank + 4;
+            }
+            conn.chunk_next = end;
+            return Chunked::kComplete;
+        }
+
+        if (conn.chunk_body + size > kMaxRequestBodyBytes) {
+            return Chunked::kTooLarge;
+        }
+        if (in.size() < data_start + size + 2) {
+            return Chunked::kIncomplete;
+        }
+        if (in.compare(data_start + size, 2, "\r\n") != 0) {
+            return Chunked::kMalformed;
+        }
+        // Each chunk's data is moved once, when it has all arrived
+        std::memmove(&in[body_start + conn.chunk_body], in.data() + data_start, size);
+        conn.chunk_body += size;
+        conn.chunk_next = data_start + size + 2;
+    }
+}
+
+std::string HttpLoopServer::unavailable_response() {
+    HttpResponse response;
+    response.status = 503;
+    response.body = "{\"error\":\"Server is shutting down\"}";
+    return serialize(response, false);
+}
+
+void HttpLoopServer::send_error(uint64_t id, Connection& conn, int status, const char* message) {
+    HttpResponse response;
+    response.status = status;
+    response.body = std::string("{\"error\":\"") + message + "\"}";
+    send_and_close(id, conn, serialize(response, false));
+}
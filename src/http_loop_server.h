@@ -0,0 +1,35 @@
+#ifndef HTTP_LOOP_SERVER_H
+#define HTTP_LOOP_SERVER_H
+
+#include "event_loop_server.h"
+#include "http_message.h"
+#include <functional>
+
+// HTTP/1.1 on the epoll loop: keep-alive, pipelined requests, chunked
+// request bodies and Expect: 100-continue
+class HttpLoopServer : public EventLoopServer {
+public:
+    using Handler = std::function<void(const HttpRequest&, HttpResponse&)>;
+
+    HttpLoopServer(std::shared_ptr<ThreadPool> pool, Handler handler);
+
+protected:
+    void process(uint64_t id, Connection& conn) override;
+    std::string unavailable_response() override;
+
+private:
+    static constexpr size_t kMaxHeaderBytes = 64 * 1024;
+
+    enum class Chunked { kIncomplete, kComplete, kMalformed, kTooLarge };
+
+    Handler handler_;
+
+    // Decode as much of the chunked body starting at body_start as has
+    // arrived. Once complete, conn.chunk_body bytes of body follow the
+    // headers and the request ends at conn.chunk_next.
+    Chunked decode_chunked(Connection& conn, size_t body_start);
+
+    void send_error(uint64_t id, Connection& conn, int status, const char* message);
+};
+
+#endif // HTTP_LOOP_SERVER_H
@@ -0,0 +1,67 @@
+#ifndef HTTP_MESSAGE_H
+#define HTTP_MESSAGE_H
+
+#include "response_writer.h"
+#include <string>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include <cstdlib>
+
+// Largest request body either front end accepts
+constexpr size_t kMaxRequestBodyBytes = 64 * 1024 * 1024;
+
+// Transport-independent request and response, so the same routes can sit
+// behind httplib or the epoll front end.
+struct HttpRequest {
+    std::string method;  // "GET", "POST", "DELETE", ...
+    std::string path;    // Without the query string
+    std::unordered_map<std::string, std::string> params;  // Decoded query parameters
+    std::string body;
+    std::string accept;  // Accept header, empty if absent
+    std::string range;   // Range header, empty if absent
+    std::string accept_encoding;  // Accept-Encoding header, empty if absent
+    
+    // Empty if the parameter is absent
+    const std::string& get_param(const std::string& name) const {
+        static const std::string empty;
+        auto it = params.find(name);
+        return it == params.end() ? empty : it->second;
+    }
+    
+    // Accept: application/octet-stream asks for the value bytes alone
+    bool wants_raw() const { return accept.find("application/octet-stream") != std::string::npos; }
+    
+    // Accept-Encoding lists gzip, and not with q=0
+    bool accepts_gzip() const {
+        size_t pos = accept_encoding.find("gzip");
+        if (pos == std::string::npos) {
+            return false;
+        }
+        size_t end = accept_encoding.find(',', pos);
+        std::string params = accept_encoding.substr(pos + 4, end == std::string::npos ? end : end - pos - 4);
+        size_t q = params.find("q=");
+        return q == std::string::npos || std::strtod(params.c_str() + q + 2, nullptr) > 0;
+    }
+};
+
+struct HttpResponse {
+    int status = 200;
+    const char* content_type = "application/json";  // Static string
+    std::string body;
+    
+    // When set, the front end streams body_length bytes from this instead
+    // of sending `body`
+    std::function<bool(const WriteFn&)> body_writer;
+    size_t body_length = 0;
+    
+    // 206: the body is bytes [range_offset, range_offset + body_length) of
+    // a value of range_total bytes. 416: range_total is the value's size.
+    uint64_t range_offset = 0;
+    uint64_t range_total = 0;
+    
+    // Content-Encoding of the body ("gzip"), or nullptr; static string
+    const char* content_encoding = nullptr;
+};
+
+#endif // HTTP_MESSAGE_H
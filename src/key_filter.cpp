@@ -0,0 +1,113 @@
+#include "key_filter.h"
+#include <algorithm>
+#include <functional>
+
+static uint64_t hash_key(std::string_view key) {
+    return std::hash<std::string_view>{}(key);
+}
+
+KeyFilter::KeyFilter(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)),
+      num_counters_(capacity_ * kCountersPerKey),
+      counters_(new std::atomic<uint8_t>[num_counters_]) {
+    for (size_t i = 0; i < num_counters_; ++i) {
+        counters_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t KeyFilter::index_of(uint64_t hash, int i) const {
+    // Double hashing: probe i is h1 + i * h2, with h2 forced odd
+    uint64_t h1 = hash * 0x9E3779B97F4A7C15ULL;
+    uint64_t h2 = (hash >> 32) | 1;
+    return (h1 + i * h2) % num_counters_;
+}
+
+void KeyFilter::add(std::string_view key) {
+    uint64_t hash = hash_key(key);
+    for (int i = 0; i < kNumHashes; ++i) {
+        auto& counter = counters_[index_of(hash, i)];
+        uint8_t count = counter.load(std::memory_order_relaxed);
+        while (count < kMaxCount &&
+               !counter.compare_exchange_weak(count, count + 1, std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+        }
+    }
+}
+
+void KeyFilter::remove(std::string_view key) {
+    uint64_t hash = hash_key(key);
+    for (int i = 0; i < kNumHashes; ++i) {
+        auto& counter = counters_[index_of(hash, i)];
+        uint8_t count = counter.load(std::memory_order_relaxed);
+        // A saturated counter no longer knows how many keys share it
+        while (count > 0 && count < kMaxCount &&
+               !counter.compare_exchange_weak(count, count - 1, std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+        }
+    }
+}
+
+bool KeyFilter::may_contain(std::string_view key) const {
+    uint64_t hash = hash_key(key);
+    for (int i = 0; i < kNumHashes; ++i) {
+        if (counters_[index_of(hash, i)].load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+NegativeCache::NegativeCache(size_t capacity) : capacity_(capacity) {}
+
+void NegativeCache::insert(const std::string& key, uint64_t observed_epoch) {
+    if (capacity_ == 0) return;
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    // Checked under the lock: invalidate() bumps the epoch while holding it
+    if (epoch_.load(std::memory_order_relaxed) != observed_epoch) {
+        return;
+    }
+    
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        order_.splice(order_.begin(), order_, it->second);
+        return;
+    }
+    
+    order_.push_front(key);
+    index_.emplace(order_.front(), order_.begin());
+    if (order_.size() > capacity_) {
+        index_.erase(order_.back());
+        order_.pop_back();
+    }
+}
+
+void NegativeCache::invalidate(const std::string& key) {
+    if (capacity_ == 0) return;
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    epoch_.fetch_add(1, std::memory_order_release);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        auto node = it->second;
+        index_.erase(it);
+        order_.erase(node);
+    }
+}
+
+bool NegativeCache::contains(const std::string& key) {
+    if (capacity_ == 0) return false;
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        return false;
+    }
+    order_.splice(order_.begin(), order_, it->second);
+    return true;
+}
+
+size_t NegativeCache::get_size() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return order_.size();
+}
@@ -0,0 +1,80 @@
+#ifndef KEY_FILTER_H
+#define KEY_FILTER_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <list>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+// Counting Bloom filter over the keys stored in the database. A negative
+// answer is definite, so GETs for keys that were never written can be
+// answered without a database round trip. Counters saturate at 255 and are
+// never decremented after that, which can only cause false positives.
+// Thread-safe; lookups take no locks.
+class KeyFilter {
+public:
+    // capacity is the number of distinct keys the filter is sized for
+    explicit KeyFilter(size_t capacity);
+    
+    void add(std::string_view key);
+    
+    // Only call for a key that was previously added
+    void remove(std::string_view key);
+    
+    // False means the key is definitely absent
+    bool may_contain(std::string_view key) const;
+    
+    size_t get_capacity() const { return capacity_; }
+    size_t get_memory_bytes() const { return num_counters_; }
+    
+private:
+    static constexpr int kNumHashes = 7;
+    static constexpr size_t kCountersPerKey = 10;  // ~1% false positives at capacity
+    static constexpr uint8_t kMaxCount = 255;
+    
+    size_t capacity_;
+    size_t num_counters_;
+    std::unique_ptr<std::atomic<uint8_t>[]> counters_;
+    
+    size_t index_of(uint64_t hash, int i) const;
+};
+
+// Bounded LRU set of keys the database recently reported as missing.
+// Writes invalidate entries; a lookup that raced with a write is not cached
+// because every write bumps the epoch the lookup observed before reading.
+class NegativeCache {
+public:
+    // capacity 0 disables the cache
+    explicit NegativeCache(size_t capacity);
+    
+    bool enabled() const { return capacity_ > 0; }
+    
+    // Read before querying the database; pass to insert() afterwards
+    uint64_t epoch() const { return epoch_.load(std::memory_order_acquire); }
+    
+    // Remember a missing key unless a write happened since `observed_epoch`
+    void insert(const std::string& key, uint64_t observed_epoch);
+    
+    // Drop a key after it was written
+    void invalidate(const std::string& key);
+    
+    bool contains(const std::string& key);
+    
+    size_t get_size() const;
+    size_t get_capacity() const { return capacity_; }
+    
+private:
+    size_t capacity_;
+    std::atomic<uint64_t> epoch_{0};
+    
+    mutable std::mutex mutex_;
+    std::list<std::string> order_;  // Most recently used at the front
+    std::unordered_map<std::string_view, std::list<std::string>::iterator> index_;
+};
+
+#endif // KEY_FILTER_H
@@ -0,0 +1,1016 @@
+#include "log_store.h"
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace {
+
+// A record is this header, the key bytes and the value bytes, then for a
+// key with an expiry time that time (uint64). The checksum covers
+// everything after itself.
+struct RecordHeader {
+    uint32_t checksum;    // CRC-32C
+    uint32_t key_size;
+    uint32_t value_size;  // kTombstone for a delete; kExpiryFlag set if an expiry time follows
+};
+
+constexpr size_t kHeaderBytes = sizeof(RecordHeader);
+constexpr uint32_t kTombstone = 0xFFFFFFFF;
+constexpr uint32_t kExpiryFlag = 0x80000000;  // Above kMaxValueBytes
+constexpr size_t kExpiryBytes = sizeof(uint64_t);
+constexpr size_t kChecksumBytes = sizeof(uint32_t);
+constexpr int kReadAttempts = 3;
+
+uint32_t crc32c_software(uint32_t crc, const char* data, size_t length) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                c = (c >> 1) ^ ((c & 1) ? 0x82F63B78u : 0);
+            }
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hardware(uint32_t crc, const char* data, size_t length) {
+    uint64_t c = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        c = _mm_crc32_u64(c, word);
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    for (; length > 0; ++data, --length) {
+        c32 = _mm_crc32_u8(c32, static_cast<unsigned char>(*data));
+    }
+    return c32;
+}
+#endif
+
+// CRC-32C, with the SSE4.2 instruction where the CPU has it
+uint32_t crc32c(const char* data, size_t length) {
+#if defined(__x86_64__)
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    if (hardware) {
+        return ~crc32c_hardware(~0u, data, length);
+    }
+#endif
+    return ~crc32c_software(~0u, data, length);
+}
+
+size_t record_size(std::string_view key, const std::string* value, uint64_t expires_at) {
+    if (!value) {
+        return kHeaderBytes + key.size();
+    }
+    return kHeaderBytes + key.size() + value->size() + (expires_at != 0 ? kExpiryBytes : 0);
+}
+
+void append_record(std::string& out, std::string_view key, const std::string* value, uint64_t expires_at) {
+    RecordHeader header;
+    header.checksum = 0;
+    header.key_size = static_cast<uint32_t>(key.size());
+    header.value_size = value ? static_cast<uint32_t>(value->size()) : kTombstone;
+    if (value && expires_at != 0) {
+        header.value_size |= kExpiryFlag;
+    }
+
+    size_t start = out.size();
+    out.append(reinterpret_cast<const char*>(&header), kHeaderBytes);
+    out.append(key);
+    if (value) {
+        out.append(*value);
+        if (expires_at != 0) {
+            out.append(reinterpret_cast<const char*>(&expires_at), kExpiryBytes);
+        }
+    }
+    uint32_t checksum = crc32c(out.data() + start + kChecksumBytes, out.size() - start - kChecksumBytes);
+    memcpy(&out[start], &checksum, sizeof(checksum));
+}
+
+struct RecordView {
+    std::string_view key;
+    std::string_view value;
+    bool tombstone;
+    uint64_t expires_at;  // 0 if none
+    size_t size;          // Header included
+};
+
+// Decode the record at the start of data; false if it is cut short or damaged
+bool decode_record(const char* data, size_t length, RecordView& record) {
+    if (length < kHeaderBytes) {
+        return false;
+    }
+    RecordHeader header;
+    memcpy(&header, data, kHeaderBytes);
+    bool tombstone = header.value_size == kTombstone;
+    bool expiring = !tombstone && (header.value_size & kExpiryFlag);
+    size_t value_size = tombstone ? 0 : (header.value_size & ~kExpiryFlag);
+    if (header.key_size == 0 || header.key_size > LogStore::kMaxKeyBytes || value_size > LogStore::kMaxValueBytes) {
+        return false;
+    }
+    size_t size = kHeaderBytes + header.key_size + value_size + (expiring ? kExpiryBytes : 0);
+    if (size > length || crc32c(data + kChecksumBytes, size - kChecksumBytes) != header.checksum) {
+        return false;
+    }
+    record.key = std::string_view(data + kHeaderBytes, header.key_size);
+    record.value = std::string_view(data + kHeaderBytes + header.key_size, value_size);
+    record.tombstone = tombstone;
+    record.expires_at = 0;
+    if (expiring) {
+        memcpy(&record.expires_at, data + kHeaderBytes + header.key_size + value_size, kExpiryBytes);
+    }
+    record.size = size;
+    return true;
+}
+
+bool write_at(int fd, const char* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, static_cast<off_t>(offset));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+}
+
+bool read_at(int fd, char* data, size_t length, uint64_t offset) {
+    while (length > 0) {
+        ssize_t got = pread(fd, data, length, static_cast<off_t>(offset));
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (got == 0) {
+            errno = EIO;  // Shorter than the index says
+            return false;
+        }
+        data += got;
+        length -= static_cast<size_t>(got);
+        offset += static_cast<uint64_t>(got);
+    }
+    return true;
+}
+
+bool ends_with(const std::string& name, const std::string& suffix) {
+    return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+double millis_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+LogStore::Segment::~Segment() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+LogStore::LogStore(const LogStoreConfig& config) : config_(config) {}
+
+LogStore::~LogStore() {
+    disconnect();
+}
+
+LogStore::IndexShard& LogStore::shard_for(std::string_view key) {
+    return index_[std::hash<std::string_view>{}(key) % kIndexShards];
+}
+
+std::shared_ptr<LogStore::Segment> LogStore::find_segment(uint32_t id) const {
+    std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+    auto it = segments_.find(id);
+    return it == segments_.end() ? nullptr : it->second;
+}
+
+std::string LogStore::segment_path(uint64_t sequence) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%010llu.log", static_cast<unsigned long long>(sequence));
+    return config_.dir + "/" + name;
+}
+
+bool LogStore::connect() {
+    if (open_.load(std::memory_order_acquire)) {
+        return true;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    if (mkdir(config_.dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Cannot create data directory " << config_.dir << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    dir_fd_ = open(config_.dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd_ < 0) {
+        std::cerr << "Cannot open data directory " << config_.dir << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (!load_segments()) {
+        for (auto& shard : index_) {
+            shard.map.clear();
+            shard.expiring.clear();
+        }
+        std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+        segments_.clear();
+        active_.reset();
+        close(dir_fd_);
+        dir_fd_ = -1;
+        return false;
+    }
+
+    std::cout << "Local store opened in " << config_.dir << ": " << count_keys() << " keys, "
+              << segments_.size() << " segments (" << static_cast<long>(millis_since(start)) << " ms)"
+              << std::endl;
+
+    open_.store(true, std::memory_order_release);
+    stop_compactor_ = false;
+    compactor_ = std::thread([this] { compactor_loop(); });
+    return true;
+}
+
+void LogStore::disconnect() {
+    if (!open_.exchange(false)) {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(compact_mutex_);
+        stop_compactor_ = true;
+    }
+    compact_cv_.notify_all();
+    compactor_.join();
+
+    // Commits already queued still finish; new ones fail on open_
+    {
+        std::unique_lock<std::mutex> lock(commit_mutex_);
+        commit_cv_.wait(lock, [this] { return !committing_ && queue_.empty(); });
+    }
+    if (!config_.sync && active_ && fdatasync(active_->fd) != 0) {
+        std::cerr << "Cannot sync " << segment_path(active_->sequence) << ": " << std::strerror(errno) << std::endl;
+    }
+
+    for (auto& shard : index_) {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.map.clear();
+        shard.expiring.clear();
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+        segments_.clear();
+        active_.reset();
+    }
+    close(dir_fd_);
+    dir_fd_ = -1;
+}
+
+bool LogStore::load_segments() {
+    DIR* dir = opendir(config_.dir.c_str());
+    if (!dir) {
+        std::cerr << "Cannot list " << config_.dir << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::vector<uint64_t> sequences;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (ends_with(name, ".log.compact")) {
+            // A compaction that never finished; the segment it was
+            // replacing is still there
+            unlinkat(dir_fd_, name.c_str(), 0);
+        } else if (ends_with(name, ".log") &&
+                   std::all_of(name.begin(), name.end() - 4, [](char c) { return c >= '0' && c <= '9'; })) {
+            sequences.push_back(std::stoull(name.substr(0, name.size() - 4)));
+        }
+    }
+    closedir(dir);
+    std::sort(sequences.begin(), sequences.end());
+
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        std::string path = segment_path(sequences[i]);
+        int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) {
+            std::cerr << "Cannot open " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        auto segment = std::make_shared<Segment>(next_segment_id_++, sequences[i], fd);
+        segments_[segment->id] = segment;
+        if (!replay_segment(segment, i + 1 == sequences.size())) {
+            return false;
+        }
+        active_ = segment;
+    }
+
+    // Keep appending to the last segment unless it is full
+    if (active_ && active_->size.load() < config_.segment_bytes) {
+        return true;
+    }
+    return roll_segment();
+}
+
+bool LogStore::replay_segment(const std::shared_ptr<Segment>& segment, bool last) {
+    std::string path = segment_path(segment->sequence);
+    struct stat info;
+    if (fstat(segment->fd, &info) != 0) {
+        std::cerr << "Cannot stat " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    auto size = static_cast<size_t>(info.st_size);
+    std::string data(size, '\0');
+    if (!read_at(segment->fd, &data[0], size, 0)) {
+        std::cerr << "Cannot read " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // A value that has expired by now deletes the key like a tombstone,
+    // and is counted as the tombstone compaction would keep in its place
+    uint64_t now = expiry_now();
+    size_t pos = 0;
+    RecordView record;
+    while (pos < size && decode_record(data.data() + pos, size - pos, record)) {
+        Location location{segment->id, static_cast<uint32_t>(record.size), pos, record.expires_at};
+        bool expired = !record.tombstone && is_expired(record.expires_at, now);
+        if (expired) {
+            location.size = static_cast<uint32_t>(kHeaderBytes + record.key.size());
+        }
+        apply(std::string(record.key), record.tombstone || expired, location, nullptr);
+        pos += record.size;
+    }
+
+    if (pos < size && last) {
+        // A write torn by a crash; it was never acknowledged
+        if (ftruncate(segment->fd, static_cast<off_t>(pos)) != 0) {
+            std::cerr << "Cannot truncate " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        std::cerr << "Truncated " << size - pos << " bytes of an incomplete record at the end of " << path
+                  << std::endl;
+        size = pos;
+    } else if (pos < size) {
+        // Left in place: counted as dead, so compaction drops it
+        std::cerr << "Ignoring " << size - pos << " bytes after a damaged record in " << path << std::endl;
+    }
+    segment->size.store(size);
+    return true;
+}
+
+bool LogStore::roll_segment() {
+    if (active_ && active_->size.load() > 0 && fdatasync(active_->fd) != 0) {
+        std::cerr << "Cannot sync " << segment_path(active_->sequence) << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    uint64_t sequence = active_ ? active_->sequence + 1 : 1;
+    std::string path = segment_path(sequence);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Cannot create " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    fsync(dir_fd_);
+
+    std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+    auto segment = std::make_shared<Segment>(next_segment_id_++, sequence, fd);
+    segments_[segment->id] = segment;
+    active_ = segment;
+    return true;
+}
+
+void LogStore::apply(const std::string& key, bool tombstone, const Location& location, uint8_t* existed) {
+    IndexShard& shard = shard_for(key);
+    bool found = false;
+    Location previous{};
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it != shard.map.end()) {
+            found = true;
+            previous = it->second;
+            if (previous.expires_at != 0) {
+                shard.expiring.erase({previous.expires_at, key});
+            }
+            if (tombstone) {
+                shard.map.erase(it);
+            } else {
+                it->second = location;
+            }
+        } else if (!tombstone) {
+            shard.map.emplace(key, location);
+        }
+        if (!tombstone && location.expires_at != 0) {
+            shard.expiring.emplace(location.expires_at, key);
+        }
+    }
+    if (existed) {
+        *existed = found;
+    }
+
+    if (found) {
+        if (auto segment = find_segment(previous.segment)) {
+            segment->live_bytes.fetch_sub(previous.size);
+        }
+    }
+    // Tombstones are counted apart: needed until no older segment is left
+    if (auto segment = find_segment(location.segment)) {
+        (tombstone ? segment->tombstone_bytes : segment->live_bytes).fetch_add(location.size);
+    }
+}
+
+bool LogStore::commit(const Record* records, size_t count, std::vector<uint8_t>* existed) {
+    Commit commit{records, count, std::vector<uint8_t>(count, 0)};
+
+    std::unique_lock<std::mutex> lock(commit_mutex_);
+    // Checked under the lock: disconnect() clears open_ before waiting
+    // for the queue to drain
+    if (!open_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    queue_.push_back(&commit);
+    while (!commit.done) {
+        if (committing_) {
+            commit_cv_.wait(lock);
+            continue;
+        }
+        // Nobody is writing: commit everything queued, ours included
+        committing_ = true;
+        std::vector<Commit*> batch;
+        batch.swap(queue_);
+        lock.unlock();
+        bool ok = write_batch(batch);
+        lock.lock();
+        for (Commit* queued : batch) {
+            queued->ok = ok;
+            queued->done = true;
+        }
+        committing_ = false;
+        commit_cv_.notify_all();
+    }
+
+    if (existed) {
+        *existed = std::move(commit.existed);
+    }
+    return commit.ok;
+}
+
+bool LogStore::write_batch(const std::vector<Commit*>& batch) {
+    struct Pending {
+        const std::string* key;
+        bool tombstone;
+        Location location;
+        uint8_t* existed;
+    };
+    std::vector<Pending> pending;
+
+    // Write, sync and index what is buffered. Runs before a segment is
+    // sealed too, so the compactor never sees a sealed segment holding
+    // records the index doesn't know about yet.
+    auto flush = [&]() {
+        if (write_buffer_.empty()) {
+            return true;
+        }
+        if (!write_active(write_buffer_)) {
+            return false;
+        }
+        write_buffer_.clear();
+        if (config_.sync) {
+            if (fdatasync(active_->fd) != 0) {
+                std::cerr << "Cannot sync " << segment_path(active_->sequence) << ": " << std::strerror(errno)
+                          << std::endl;
+                return false;
+            }
+            syncs_.fetch_add(1, std::memory_order_relaxed);
+        }
+        for (const Pending& record : pending) {
+            apply(*record.key, record.tombstone, record.location, record.existed);
+        }
+        records_written_.fetch_add(pending.size(), std::memory_order_relaxed);
+        pending.clear();
+        return true;
+    };
+
+    write_buffer_.clear();
+    for (Commit* commit : batch) {
+        for (size_t i = 0; i < commit->count; ++i) {
+            const Record& record = commit->records[i];
+            size_t size = record_size(*record.key, record.value, record.expires_at);
+            uint64_t end = active_->size.load(std::memory_order_relaxed) + write_buffer_.size();
+            if (end > 0 && end + size > config_.segment_bytes) {
+                if (!flush() || !roll_segment()) {
+                    return false;
+                }
+                end = 0;
+            }
+            pending.push_back({record.key, record.value == nullptr,
+                               Location{active_->id, static_cast<uint32_t>(size), end, record.expires_at},
+                               &commit->existed[i]});
+            append_record(write_buffer_, *record.key, record.value, record.expires_at);
+        }
+    }
+    if (!flush()) {
+        return false;
+    }
+    commits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool LogStore::write_active(const std::string& data) {
+    if (data.empty()) {
+        return true;
+    }
+    uint64_t offset = active_->size.load(std::memory_order_relaxed);
+    // On failure the size stays put, so the next write overwrites the partial one
+    if (!write_at(active_->fd, data.data(), data.size(), offset)) {
+        std::cerr << "Cannot write " << segment_path(active_->sequence) << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    active_->size.store(offset + data.size(), std::memory_order_relaxed);
+    return true;
+}
+
+bool LogStore::create(const std::string& key, const std::string& value, bool* inserted, uint64_t expires_at) {
+    if (key.empty() || key.size() > kMaxKeyBytes || value.size() > kMaxValueBytes) {
+        return false;
+    }
+    Record record{&key, &value, expires_at};
+    std::vector<uint8_t> existed;
+    if (!commit(&record, 1, &existed)) {
+        return false;
+    }
+    if (inserted) {
+        *inserted = !existed[0];
+    }
+    return true;
+}
+
+std::shared_ptr<std::string> LogStore::read(const std::string& key, bool* failed, uint64_t* expires_at) {
+    if (failed) {
+        *failed = false;
+    }
+    IndexShard& shard = shard_for(key);
+    for (int attempt = 0; attempt < kReadAttempts; ++attempt) {
+        Location location;
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.map.find(key);
+            if (it == shard.map.end() || is_expired(it->second.expires_at, expiry_now())) {
+                return nullptr;
+            }
+            location = it->second;
+        }
+        auto segment = find_segment(location.segment);
+        if (!segment) {
+            continue;  // Compacted since; the index has the new location
+        }
+
+        std::string record(location.size, '\0');
+        RecordView view;
+        if (!read_at(segment->fd, &record[0], location.size, location.offset) ||
+            !decode_record(record.data(), record.size(), view) || view.tombstone || view.key != key) {
+            std::cerr << "Cannot read key " << key << " from " << segment_path(segment->sequence) << " at "
+                      << location.offset << std::endl;
+            break;
+        }
+        // Keep the value bytes in place of the whole record
+        size_t value_size = view.value.size();
+        record.erase(0, kHeaderBytes + key.size());
+        record.resize(value_size);
+        if (expires_at) {
+            *expires_at = view.expires_at;
+        }
+        return std::make_shared<std::string>(std::move(record));
+    }
+    read_errors_.fetch_add(1, std::memory_order_relaxed);
+    if (failed) {
+        *failed = true;
+    }
+    return nullptr;
+}
+
+std::shared_ptr<std::string> LogStore::read_range(const std::string& key, uint64_t offset, uint64_t length,
+                                                  uint64_t* total, bool* failed, uint64_t* expires_at) {
+    if (failed) {
+        *failed = false;
+    }
+    IndexShard& shard = shard_for(key);
+    for (int attempt = 0; attempt < kReadAttempts; ++attempt) {
+        Location location;
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto it = shard.map.find(key);
+            if (it == shard.map.end() || is_expired(it->second.expires_at, expiry_now())) {
+                return nullptr;
+            }
+            location = it->second;
+        }
+        uint64_t value_size = location.size - kHeaderBytes - key.size() -
+                              (location.expires_at != 0 ? kExpiryBytes : 0);
+        if (offset == 0 && length >= value_size) {
+            std::shared_ptr<std::string> value = read(key, failed, expires_at);
+            if (value) {
+                *total = value->size();
+            }
+            return value;
+        }
+        auto segment = find_segment(location.segment);
+        if (!segment) {
+            continue;
+        }
+
+        *total = value_size;
+        if (expires_at) {
+            *expires_at = location.expires_at;
+        }
+        if (offset >= value_size) {
+            return std::make_shared<std::string>();
+        }
+        auto value = std::make_shared<std::string>(std::min(length, value_size - offset), '\0');
+        if (!read_at(segment->fd, &(*value)[0], value->size(),
+                     location.offset + kHeaderBytes + key.size() + offset)) {
+            std::cerr << "Cannot read key " << key << " from " << segment_path(segment->sequence) << " at "
+                      << location.offset << std::endl;
+            break;
+        }
+        return value;
+    }
+    read_errors_.fetch_add(1, std::memory_order_relaxed);
+    if (failed) {
+        *failed = true;
+    }
+    return nullptr;
+}
+
+bool LogStore::delete_key(const std::string& key, bool* deleted) {
+    // A key that isn't there needs no tombstone
+    {
+        IndexShard& shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        if (shard.map.find(key) == shard.map.end()) {
+            if (deleted) *deleted = false;
+            return is_connected();
+        }
+    }
+    Record record{&key, nullptr, 0};
+    std::vector<uint8_t> existed;
+    if (!commit(&record, 1, &existed)) {
+        return false;
+    }
+    if (deleted) {
+        *deleted = existed[0];
+    }
+    return true;
+}
+
+bool LogStore::read_many(const std::vector<std::string>& keys,
+                         std::vector<std::shared_ptr<std::string>>& values,
+                         std::vector<uint64_t>* expires_at) {
+    values.assign(keys.size(), nullptr);
+    if (expires_at) {
+        expires_at->assign(keys.size(), 0);
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        bool failed = false;
+        values[i] = read(keys[i], &failed, expires_at ? &(*expires_at)[i] : nullptr);
+        if (failed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LogStore::create_many(const std::vector<std::pair<std::string, std::string>>& items,
+                           std::vector<std::string>* overwritten, const std::vector<uint64_t>* expires_at) {
+    std::vector<Record> records;
+    records.reserve(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        const auto& [key, value] = items[i];
+        if (key.empty() || key.size() > kMaxKeyBytes || value.size() > kMaxValueBytes) {
+            return false;
+        }
+        records.push_back({&key, &value, expires_at ? (*expires_at)[i] : 0});
+    }
+    if (records.empty()) {
+        return true;
+    }
+    std::vector<uint8_t> existed;
+    if (!commit(records.data(), records.size(), &existed)) {
+        return false;
+    }
+    if (overwritten) {
+        for (size_t i = 0; i < items.size(); ++i) {
+            if (existed[i]) overwritten->push_back(items[i].first);
+        }
+    }
+    return true;
+}
+
+bool LogStore::delete_many(const std::vector<std::string>& keys, std::vector<std::string>* deleted) {
+    std::vector<Record> records;
+    for (const auto& key : keys) {
+        IndexShard& shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        if (shard.map.find(key) != shard.map.end()) {
+            records.push_back({&key, nullptr, 0});
+        }
+    }
+    if (records.empty()) {
+        return is_connected();
+    }
+    std::vector<uint8_t> existed;
+    if (!commit(records.data(), records.size(), &existed)) {
+        return false;
+    }
+    if (deleted) {
+        for (size_t i = 0; i < records.size(); ++i) {
+            if (existed[i]) deleted->push_back(*records[i].key);
+        }
+    }
+    return true;
+}
+
+bool LogStore::delete_expired(size_t limit, std::vector<std::string>& deleted) {
+    if (!is_connected()) {
+        return false;
+    }
+    // Replay treats an expired record as deleted, so no tombstone is
+    // written: the record now counts as one, as long as it's needed
+    uint64_t now = expiry_now();
+    std::vector<Location> removed;
+    for (auto& shard : index_) {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto due = shard.expiring.begin();
+        while (due != shard.expiring.end() && due->first <= now && removed.size() < limit) {
+            auto it = shard.map.find(due->second);
+            deleted.push_back(due->second);
+            removed.push_back(it->second);
+            shard.map.erase(it);
+            due = shard.expiring.erase(due);
+        }
+    }
+    for (size_t i = 0; i < removed.size(); ++i) {
+        const Location& location = removed[i];
+        if (auto segment = find_segment(location.segment)) {
+            segment->live_bytes.fetch_sub(location.size);
+            segment->tombstone_bytes.fetch_add(kHeaderBytes + deleted[deleted.size() - removed.size() + i].size());
+        }
+    }
+    expired_.fetch_add(removed.size(), std::memory_order_relaxed);
+    return true;
+}
+
+long long LogStore::count_keys() {
+    long long count = 0;
+    for (auto& shard : index_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        count += static_cast<long long>(shard.map.size());
+    }
+    return count;
+}
+
+bool LogStore::scan_keys(const std::function<void(std::string_view)>& fn) {
+    for (auto& shard : index_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for (const auto& entry : shard.map) {
+            fn(entry.first);
+        }
+    }
+    return true;
+}
+
+void LogStore::compactor_loop() {
+    std::unique_lock<std::mutex> lock(compact_mutex_);
+    while (!stop_compactor_) {
+        compact_cv_.wait_for(lock, config_.compact_interval, [this] { return stop_compactor_; });
+        while (!stop_compactor_) {
+            auto run = pick_compaction();
+            if (run.empty()) {
+                break;
+            }
+            lock.unlock();
+            bool compacted = compact(run);
+            lock.lock();
+            if (!compacted) {
+                break;  // Retried next interval
+            }
+        }
+    }
+}
+
+std::vector<std::shared_ptr<LogStore::Segment>> LogStore::pick_compaction() const {
+    std::vector<std::shared_ptr<Segment>> sealed;
+    uint64_t oldest = UINT64_MAX;
+    {
+        std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+        for (const auto& [id, segment] : segments_) {
+            oldest = std::min(oldest, segment->sequence);
+            if (segment != active_) {
+                sealed.push_back(segment);
+            }
+        }
+    }
+    std::sort(sealed.begin(), sealed.end(),
+              [](const auto& a, const auto& b) { return a->sequence < b->sequence; });
+
+    // Bytes a segment would keep: live records, and tombstones while an
+    // older segment might hold a value they delete
+    auto kept = [oldest](const Segment& segment) {
+        uint64_t bytes = segment.live_bytes.load();
+        if (segment.sequence > oldest) {
+            bytes += segment.tombstone_bytes.load();
+        }
+        return std::min(bytes, segment.size.load());
+    };
+
+    // The segment with the largest dead fraction over the threshold...
+    size_t worst = sealed.size();
+    double worst_dead = 0;
+    for (size_t i = 0; i < sealed.size(); ++i) {
+        uint64_t size = sealed[i]->size.load();
+        double dead = size == 0 ? 1.0 : 1.0 - static_cast<double>(kept(*sealed[i])) / size;
+        if (dead >= config_.compact_threshold && dead > worst_dead) {
+            worst = i;
+            worst_dead = dead;
+        }
+    }
+    if (worst == sealed.size()) {
+        return {};
+    }
+
+    // ...and its neighbours, while what they keep fits in one segment
+    size_t first = worst;
+    size_t last = worst;
+    uint64_t total = kept(*sealed[worst]);
+    bool grew = true;
+    while (grew) {
+        grew = false;
+        if (last + 1 < sealed.size() && total + kept(*sealed[last + 1]) <= config_.segment_bytes) {
+            total += kept(*sealed[++last]);
+            grew = true;
+        }
+        if (first > 0 && total + kept(*sealed[first - 1]) <= config_.segment_bytes) {
+            total += kept(*sealed[--first]);
+            grew = true;
+        }
+    }
+    return std::vector<std::shared_ptr<Segment>>(sealed.begin() + first, sealed.begin() + last + 1);
+}
+
+bool LogStore::compact(const std::vector<std::shared_ptr<Segment>>& run) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t first_sequence = run.front()->sequence;
+    bool oldest = true;  // No segment before the run
+    {
+        std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+        for (const auto& [id, segment] : segments_) {
+            oldest = oldest && segment->sequence >= first_sequence;
+        }
+    }
+
+    // Copy the records the index points at, and tombstones an older segment
+    // might still hold a value under
+    struct Moved {
+        std::string key;
+        Location from;
+        uint64_t to;
+    };
+    std::vector<Moved> moved;
+    std::string out;
+    uint64_t tombstone_bytes = 0;
+    uint64_t input_bytes = 0;
+    uint64_t now = expiry_now();
+    for (const auto& segment : run) {
+        uint64_t size = segment->size.load();
+        input_bytes += size;
+        std::string data(size, '\0');
+        if (!read_at(segment->fd, &data[0], size, 0)) {
+            std::cerr << "Compaction cannot read " << segment_path(segment->sequence) << ": "
+                      << std::strerror(errno) << std::endl;
+            return false;
+        }
+        size_t pos = 0;
+        RecordView record;
+        while (pos < size && decode_record(data.data() + pos, size - pos, record)) {
+            Location here{segment->id, static_cast<uint32_t>(record.size), pos, record.expires_at};
+            std::string key(record.key);
+            // An expired value the index has let go of deletes the key
+            // like a tombstone, and is kept as one
+            bool deletes = record.tombstone || is_expired(record.expires_at, now);
+            bool live;
+            bool keep_tombstone;
+            {
+                IndexShard& shard = shard_for(key);
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                auto it = shard.map.find(key);
+                live = !record.tombstone && it != shard.map.end() && it->second == here;
+                keep_tombstone = !live && deletes && it == shard.map.end() && !oldest;
+            }
+            if (live) {
+                moved.push_back({std::move(key), here, out.size()});
+                out.append(data.data() + pos, record.size);
+            } else if (keep_tombstone) {
+                size_t start = out.size();
+                append_record(out, record.key, nullptr, 0);
+                tombstone_bytes += out.size() - start;
+            }
+            pos += record.size;
+        }
+    }
+
+    // The output replaces the run's first segment; the rest are removed
+    // in order afterwards, so a crash in between leaves only newer copies
+    // of what was merged
+    std::string path = segment_path(first_sequence);
+    std::shared_ptr<Segment> replacement;
+    if (!out.empty()) {
+        std::string temp_path = path + ".compact";
+        int fd = open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0 || !write_at(fd, out.data(), out.size(), 0) || fdatasync(fd) != 0 ||
+            rename(temp_path.c_str(), path.c_str()) != 0) {
+            std::cerr << "Compaction cannot write " << temp_path << ": " << std::strerror(errno) << std::endl;
+            if (fd >= 0) {
+                close(fd);
+                unlink(temp_path.c_str());
+            }
+            return false;
+        }
+        std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+        replacement = std::make_shared<Segment>(next_segment_id_++, first_sequence, fd);
+        replacement->size.store(out.size());
+        replacement->tombstone_bytes.store(tombstone_bytes);
+        segments_[replacement->id] = replacement;
+    }
+    for (size_t i = replacement ? 1 : 0; i < run.size(); ++i) {
+        unlink(segment_path(run[i]->sequence).c_str());
+    }
+    fsync(dir_fd_);
+
+    // Point the index at the copies, unless a newer write moved a key on.
+    // Readers that looked up an old location retry once it is gone.
+    for (const Moved& record : moved) {
+        IndexShard& shard = shard_for(record.key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.map.find(record.key);
+        if (it != shard.map.end() && it->second == record.from) {
+            it->second = Location{replacement->id, record.from.size, record.to, record.from.expires_at};
+            replacement->live_bytes.fetch_add(record.from.size);
+        }
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+        for (const auto& segment : run) {
+            segments_.erase(segment->id);
+        }
+    }
+
+    compactions_.fetch_add(1, std::memory_order_relaxed);
+    bytes_reclaimed_.fetch_add(input_bytes - out.size(), std::memory_order_relaxed);
+    std::cout << "Compacted " << run.size() << " segment(s) into " << path << ": " << input_bytes << " -> "
+              << out.size() << " bytes in " << static_cast<long>(millis_since(start)) << " ms" << std::endl;
+    return true;
+}
+
+void LogStore::get_stats(std::vector<std::pair<std::string, uint64_t>>& stats) const {
+    uint64_t disk_bytes = 0;
+    uint64_t live_bytes = 0;
+    size_t segments;
+    {
+        std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+        segments = segments_.size();
+        for (const auto& [id, segment] : segments_) {
+            disk_bytes += segment->size.load();
+            live_bytes += segment->live_bytes.load();
+        }
+    }
+    uint64_t keys = 0;
+    for (const auto& shard : index_) {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        keys += shard.map.size();
+    }
+    stats.emplace_back("local_keys", keys);
+    stats.emplace_back("local_segments", segments);
+    stats.emplace_back("local_disk_bytes", disk_bytes);
+    stats.emplace_back("local_live_bytes", live_bytes);
+    stats.emplace_back("local_commits", commits_.load(std::memory_order_relaxed));
+    stats.emplace_back("local_records_written", records_written_.load(std::memory_order_relaxed));
+    stats.emplace_back("local_syncs", syncs_.load(std::memory_order_relaxed));
+    stats.emplace_back("local_compactions", compactions_.load(std::memory_order_relaxed));
+    stats.emplace_back("local_bytes_reclaimed", bytes_reclaimed_.load(std::memory_order_relaxed));
+    stats.emplace_back("local_read_errors", read_errors_.load(std::memory_order_relaxed));
+    stats.emplace_back("local_expired", expired_.load(std::memory_order_relaxed));
+}
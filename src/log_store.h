@@ -0,0 +1,210 @@
+#ifndef LOG_STORE_H
+#define LOG_STORE_H
+
+#include "storage_backend.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <set>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+struct LogStoreConfig {
+    std::string dir = "kv_data";
+    size_t segment_bytes = 64 << 20;   // Start a new segment once the active one reaches this
+    bool sync = true;                  // fdatasync each group commit before acknowledging it
+    double compact_threshold = 0.5;    // Compact a sealed segment once this fraction is dead
+    std::chrono::milliseconds compact_interval{1000};
+};
+
+// StorageBackend in local files, for single-node deployments (the Bitcask
+// design). Writes are appended to the active segment of a log of numbered
+// segment files; an in-memory hash index maps every live key to its newest
+// record, so a read is one index lookup and one pread.
+//
+// A record may carry an expiry time. Once it passes, the key reads as
+// missing and replay treats the record as a delete; delete_expired() only
+// drops such keys from the index (finding them in a per-shard list ordered
+// by expiry time, so keys without a TTL cost the sweep nothing), and
+// compaction keeps their records as tombstones while an older segment might
+// still hold a value of the key.
+//
+// Writers queue their records and the first one to find no commit running
+// writes everything queued and fsyncs once for all of them (group commit);
+// the others wait for that commit instead of issuing their own.
+//
+// A background thread compacts sealed segments once the share of
+// overwritten or deleted records in one passes compact_threshold. It merges
+// that segment with its neighbours, up to a segment's worth of live data,
+// copying the live records into one file that takes the lowest of their
+// numbers. Since no other segment sits between them, replaying the
+// segments in order still yields the newest value of each key. On open, a
+// record cut short at the end of the last segment (a write torn by a crash)
+// is truncated away.
+class LogStore : public StorageBackend {
+public:
+    explicit LogStore(const LogStoreConfig& config);
+    ~LogStore() override;
+
+    LogStore(const LogStore&) = delete;
+    LogStore& operator=(const LogStore&) = delete;
+
+    // Open the directory (creating it if needed), rebuild the index from
+    // the segments and start the compactor
+    bool connect() override;
+
+    // Stop the compactor, sync and close the files
+    void disconnect() override;
+    bool is_connected() const override { return open_.load(std::memory_order_acquire); }
+
+    bool create(const std::string& key, const std::string& value, bool* inserted = nullptr,
+                uint64_t expires_at = 0) override;
+    std::shared_ptr<std::string> read(const std::string& key, bool* failed = nullptr,
+                                      uint64_t* expires_at = nullptr) override;
+    bool delete_key(const std::string& key, bool* deleted = nullptr) override;
+    
+    // Reads just the range from the record. Only a range covering the whole
+    // value is checked against the record's checksum.
+    std::shared_ptr<std::string> read_range(const std::string& key, uint64_t offset, uint64_t length,
+                                            uint64_t* total, bool* failed = nullptr,
+                                            uint64_t* expires_at = nullptr) override;
+    bool read_many(const std::vector<std::string>& keys,
+                   std::vector<std::shared_ptr<std::string>>& values,
+                   std::vector<uint64_t>* expires_at = nullptr) override;
+    bool create_many(const std::vector<std::pair<std::string, std::string>>& items,
+                     std::vector<std::string>* overwritten = nullptr,
+                     const std::vector<uint64_t>* expires_at = nullptr) override;
+    bool delete_many(const std::vector<std::string>& keys, std::vector<std::string>* deleted = nullptr) override;
+    
+    // Drops expired keys from the index; writes nothing
+    bool delete_expired(size_t limit, std::vector<std::string>& deleted) override;
+    
+    long long count_keys() override;
+    bool scan_keys(const std::function<void(std::string_view)>& fn) override;
+
+    // Segment, commit and compaction counters
+    void get_stats(std::vector<std::pair<std::string, uint64_t>>& stats) const override;
+
+    // Largest key and value accepted
+    static constexpr size_t kMaxKeyBytes = 64 << 10;
+    static constexpr size_t kMaxValueBytes = 512 << 20;
+
+private:
+    static constexpr size_t kIndexShards = 16;
+
+    // One segment file. Compaction replaces a run of segments with a new
+    // file (and a new id) under the first one's sequence number; readers
+    // still holding an old one keep reading it until they let go.
+    struct Segment {
+        uint32_t id;                 // Unique per file
+        uint64_t sequence;           // Replay order; also the file name
+        int fd = -1;
+        std::atomic<uint64_t> size{0};
+        std::atomic<uint64_t> live_bytes{0};       // Records the index points at
+        std::atomic<uint64_t> tombstone_bytes{0};
+
+        Segment(uint32_t id, uint64_t sequence, int fd) : id(id), sequence(sequence), fd(fd) {}
+        ~Segment();
+    };
+
+    // Where a key's newest record is
+    struct Location {
+        uint32_t segment;
+        uint32_t size;    // Whole record, header included
+        uint64_t offset;
+        uint64_t expires_at;  // 0 if none
+
+        bool operator==(const Location& other) const {
+            return segment == other.segment && size == other.size && offset == other.offset;
+        }
+    };
+
+    // expiring holds (expires_at, key) for every key in map with an
+    // expiry, so the sweep visits only the keys that are due
+    struct alignas(64) IndexShard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, Location> map;
+        std::set<std::pair<uint64_t, std::string>> expiring;
+    };
+
+    // A record to append; value nullptr writes a tombstone
+    struct Record {
+        const std::string* key;
+        const std::string* value;
+        uint64_t expires_at;
+    };
+
+    // One writer's records, waiting in the commit queue. existed[i] reports
+    // whether records[i]'s key was live before it was applied.
+    struct Commit {
+        const Record* records;
+        size_t count;
+        std::vector<uint8_t> existed;
+        bool ok = true;
+        bool done = false;
+    };
+
+    LogStoreConfig config_;
+    std::atomic<bool> open_{false};
+
+    IndexShard index_[kIndexShards];
+
+    // Every open segment by id; sequence order is replay order
+    mutable std::shared_mutex segments_mutex_;
+    std::unordered_map<uint32_t, std::shared_ptr<Segment>> segments_;
+    std::shared_ptr<Segment> active_;   // Only the committing thread writes it
+    uint32_t next_segment_id_ = 1;      // Under segments_mutex_
+    int dir_fd_ = -1;
+
+    // Group commit
+    std::mutex commit_mutex_;
+    std::condition_variable commit_cv_;
+    std::vector<Commit*> queue_;
+    bool committing_ = false;
+    std::string write_buffer_;          // Reused by the committing thread
+
+    // Compaction
+    std::mutex compact_mutex_;
+    std::condition_variable compact_cv_;
+    bool stop_compactor_ = false;
+    std::thread compactor_;
+
+    std::atomic<uint64_t> commits_{0};
+    std::atomic<uint64_t> records_written_{0};
+    std::atomic<uint64_t> syncs_{0};
+    std::atomic<uint64_t> compactions_{0};
+    std::atomic<uint64_t> bytes_reclaimed_{0};
+    std::atomic<uint64_t> read_errors_{0};
+    std::atomic<uint64_t> expired_{0};
+
+    IndexShard& shard_for(std::string_view key);
+    std::shared_ptr<Segment> find_segment(uint32_t id) const;
+    std::string segment_path(uint64_t sequence) const;
+
+    // Queue records and wait until they are written, synced and indexed
+    bool commit(const Record* records, size_t count, std::vector<uint8_t>* existed);
+    bool write_batch(const std::vector<Commit*>& batch);
+    bool write_active(const std::string& data);
+    bool roll_segment();
+    void apply(const std::string& key, bool tombstone, const Location& location, uint8_t* existed);
+
+    bool load_segments();
+    bool replay_segment(const std::shared_ptr<Segment>& segment, bool last);
+
+    void compactor_loop();
+
+    // Sealed segments to merge next, in sequence order; empty if none is
+    // dead enough
+    std::vector<std::shared_ptr<Segment>> pick_compaction() const;
+    bool compact(const std::vector<std::shared_ptr<Segment>>& run);
+};
+
+#endif // LOG_STORE_H
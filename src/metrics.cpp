@@ -0,0 +1,274 @@
+#include "metrics.h"
+#include <thread>
+#include <algorithm>
+#include <utility>
+#include <cstdio>
+
+size_t HistogramBuckets::index_of(uint64_t ns) {
+    if (ns < static_cast<uint64_t>(kSubBuckets)) {
+        return static_cast<size_t>(ns);
+    }
+    int magnitude = 63 - __builtin_clzll(ns);
+    if (magnitude > kMaxMagnitude) {
+        return kCount - 1;
+    }
+    int shift = magnitude - kSubBucketBits;
+    size_t sub = static_cast<size_t>(ns >> shift) - kSubBuckets;
+    return static_cast<size_t>(kSubBuckets) * (shift + 1) + sub;
+}
+
+uint64_t HistogramBuckets::value_of(size_t index) {
+    if (index < static_cast<size_t>(kSubBuckets)) {
+        return index;
+    }
+    int shift = static_cast<int>(index / kSubBuckets) - 1;
+    uint64_t lower = static_cast<uint64_t>(kSubBuckets + index % kSubBuckets) << shift;
+    return lower + ((uint64_t(1) << shift) >> 1);
+}
+
+namespace {
+
+#if defined(__x86_64__)
+// Count TSC ticks over a few ms of steady_clock time
+double measure_ns_per_tick() {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_ticks = __rdtsc();
+    auto end = start;
+    while (end - start < std::chrono::milliseconds(5)) {
+        end = std::chrono::steady_clock::now();
+    }
+    uint64_t ticks = __rdtsc() - start_ticks;
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    return ticks > 0 ? ns / ticks : 1.0;
+}
+#endif
+
+}  // namespace
+
+uint64_t TickClock::to_ns(uint64_t ticks) {
+#if defined(__x86_64__)
+    static const double ns_per_tick = measure_ns_per_tick();
+    return static_cast<uint64_t>(ticks * ns_per_tick);
+#else
+    return ticks;
+#endif
+}
+
+uint64_t HistogramSnapshot::quantile(double q) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return HistogramBuckets::value_of(i);
+        }
+    }
+    return HistogramBuckets::value_of(buckets.size() - 1);
+}
+
+namespace {
+
+// Written by one thread only, so an increment needs no atomic add
+inline void bump(std::atomic<uint64_t>& value, uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+struct Histogram {
+    std::atomic<uint64_t> buckets[HistogramBuckets::kCount];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_ns;
+
+    void record(uint64_t ns) {
+        bump(buckets[HistogramBuckets::index_of(ns)], 1);
+        bump(count, 1);
+        bump(sum_ns, ns);
+    }
+
+    void add_to(HistogramSnapshot& snapshot) const {
+        for (size_t i = 0; i < HistogramBuckets::kCount; ++i) {
+            snapshot.buckets[i] += buckets[i].load(std::memory_order_relaxed);
+        }
+        snapshot.count += count.load(std::memory_order_relaxed);
+        snapshot.sum_ns += sum_ns.load(std::memory_order_relaxed);
+    }
+};
+
+constexpr size_t kRoutes = static_cast<size_t>(Route::kCount);
+constexpr size_t kStages = static_cast<size_t>(Stage::kCount);
+constexpr size_t kCounters = static_cast<size_t>(Counter::kCount);
+
+std::atomic<uint64_t> next_instance{1};
+
+// The shard this thread used last, and which Metrics it belongs to
+thread_local uint64_t cached_instance = 0;
+thread_local void* cached_shard = nullptr;
+
+}  // namespace
+
+struct Metrics::Shard {
+    std::thread::id owner;
+    Histogram routes[kRoutes];
+    Histogram stages[kStages];
+    std::atomic<uint64_t> counters[kCounters];
+};
+
+Metrics::Metrics() : instance_(next_instance.fetch_add(1, std::memory_order_relaxed)) {
+    // Calibrate the clock now rather than in the first timed request
+    TickClock::to_ns(0);
+}
+
+Metrics::~Metrics() = default;
+
+Metrics::Shard& Metrics::local_shard() {
+    if (cached_instance == instance_) {
+        return *static_cast<Shard*>(cached_shard);
+    }
+    Shard* shard = create_shard();
+    cached_instance = instance_;
+    cached_shard = shard;
+    return *shard;
+}
+
+Metrics::Shard* Metrics::create_shard() {
+    std::unique_lock<std::mutex> lock(shards_mutex_);
+    // A thread switching between Metrics objects keeps its shard; so does a
+    // new thread that was handed the id of one that exited
+    std::thread::id self = std::this_thread::get_id();
+    for (const auto& shard : shards_) {
+        if (shard->owner == self) {
+            return shard.get();
+        }
+    }
+    // Value-initialized, so every counter starts at zero
+    shards_.emplace_back(new Shard());
+    shards_.back()->owner = self;
+    return shards_.back().get();
+}
+
+void Metrics::record(Route route, uint64_t ns) {
+    local_shard().routes[static_cast<size_t>(route)].record(ns);
+}
+
+void Metrics::record(Stage stage, uint64_t ns) {
+    local_shard().stages[static_cast<size_t>(stage)].record(ns);
+}
+
+void Metrics::add(Counter counter, uint64_t n) {
+    bump(local_shard().counters[static_cast<size_t>(counter)], n);
+}
+
+uint64_t Metrics::get(Counter counter) const {
+    std::unique_lock<std::mutex> lock(shards_mutex_);
+    uint64_t total = 0;
+    for (const auto& shard : shards_) {
+        total += shard->counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+HistogramSnapshot Metrics::snapshot(Route route) const {
+    HistogramSnapshot snapshot;
+    std::unique_lock<std::mutex> lock(shards_mutex_);
+    for (const auto& shard : shards_) {
+        shard->routes[static_cast<size_t>(route)].add_to(snapshot);
+    }
+    return snapshot;
+}
+
+HistogramSnapshot Metrics::snapshot(Stage stage) const {
+    HistogramSnapshot snapshot;
+    std::unique_lock<std::mutex> lock(shards_mutex_);
+    for (const auto& shard : shards_) {
+        shard->stages[static_cast<size_t>(stage)].add_to(snapshot);
+    }
+    return snapshot;
+}
+
+const char* Metrics::name(Route route) {
+    switch (route) {
+        case Route::kGet: return "get";
+        case Route::kPut: return "put";
+        case Route::kDelete: return "delete";
+        case Route::kBatchGet: return "batch_get";
+        case Route::kBatchPut: return "batch_put";
+        case Route::kBatchDelete: return "batch_delete";
+        case Route::kStats: return "stats";
+        case Route::kMetrics: return "metrics";
+        case Route::kHealth: return "health";
+        case Route::kNotFound: return "not_found";
+        case Route::kBinaryGet: return "binary_get";
+        case Route::kBinarySet: return "binary_set";
+        case Route::kBinaryDelete: return "binary_delete";
+        case Route::kRawGet: return "raw_get";
+        case Route::kRawPut: return "raw_put";
+        case Route::kCount: break;
+    }
+    return "unknown";
+}
+
+const char* Metrics::name(Stage stage) {
+    switch (stage) {
+        case Stage::kCacheLookup: return "cache_lookup";
+        case Stage::kDbQuery: return "db_query";
+        case Stage::kSerialization: return "serialization";
+        case Stage::kCompress: return "compress";
+        case Stage::kDecompress: return "decompress";
+        case Stage::kCount: break;
+    }
+    return "unknown";
+}
+
+// One summary series: quantiles, sum and count, with `label` as the first label
+static void write_summary(std::string& out, const char* metric, const char* label, const char* value,
+                          const HistogramSnapshot& histogram) {
+    static const std::pair<const char*, double> kQuantiles[] = {{"0.5", 0.5}, {"0.99", 0.99}, {"0.999", 0.999}};
+    char line[256];
+    for (const auto& quantile : kQuantiles) {
+        snprintf(line, sizeof(line), "%s{%s=\"%s\",quantile=\"%s\"} %.9f\n", metric, label, value, quantile.first,
+                 histogram.quantile(quantile.second) / 1e9);
+        out += line;
+    }
+    snprintf(line, sizeof(line), "%s_sum{%s=\"%s\"} %.9f\n%s_count{%s=\"%s\"} %llu\n", metric, label, value,
+             histogram.sum_ns / 1e9, metric, label, value, static_cast<unsigned long long>(histogram.count));
+    out += line;
+}
+
+void Metrics::write_prometheus(std::string& out) const {
+    out += "# HELP kv_request_duration_seconds Time to handle a request, by route\n"
+           "# TYPE kv_request_duration_seconds summary\n";
+    for (size_t i = 0; i < kRoutes; ++i) {
+        HistogramSnapshot histogram = snapshot(static_cast<Route>(i));
+        if (histogram.count > 0) {
+            write_summary(out, "kv_request_duration_seconds", "route", name(static_cast<Route>(i)), histogram);
+        }
+    }
+
+    out += "# HELP kv_stage_duration_seconds Time spent in each stage of a request\n"
+           "# TYPE kv_stage_duration_seconds summary\n";
+    for (size_t i = 0; i < kStages; ++i) {
+        HistogramSnapshot histogram = snapshot(static_cast<Stage>(i));
+        if (histogram.count > 0) {
+            write_summary(out, "kv_stage_duration_seconds", "stage", name(static_cast<Stage>(i)), histogram);
+        }
+    }
+
+    char line[512];
+    snprintf(line, sizeof(line),
+             "# HELP kv_requests_total Keys looked up, stored or deleted\n"
+             "# TYPE kv_requests_total counter\n"
+             "kv_requests_total %llu\n",
+             static_cast<unsigned long long>(get(Counter::kRequests)));
+    out += line;
+    snprintf(line, sizeof(line),
+             "# HELP kv_cache_lookups_total Key lookups, by cache result\n"
+             "# TYPE kv_cache_lookups_total counter\n"
+             "kv_cache_lookups_total{result=\"hit\"} %llu\n"
+             "kv_cache_lookups_total{result=\"miss\"} %llu\n",
+             static_cast<unsigned long long>(get(Counter::kCacheHits)),
+             static_cast<unsigned long long>(get(Counter::kCacheMisses)));
+    out += line;
+}
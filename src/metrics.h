@@ -0,0 +1,158 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+// What a request latency is recorded under: the HTTP routes and the binary
+// protocol's operations
+enum class Route : uint8_t {
+    kGet,
+    kPut,
+    kDelete,
+    kBatchGet,
+    kBatchPut,
+    kBatchDelete,
+    kStats,
+    kMetrics,
+    kHealth,
+    kNotFound,
+    kBinaryGet,
+    kBinarySet,
+    kBinaryDelete,
+    kRawGet,
+    kRawPut,
+    kCount
+};
+
+// Parts of a request timed separately
+enum class Stage : uint8_t {
+    kCacheLookup,    // Cache, write-behind queue and missing-key filters
+    kDbQuery,        // Statements sent to the database
+    kSerialization,  // Writing response bodies
+    kCompress,       // Compressing values on their way into the cache
+    kDecompress,     // Decompressing cache hits
+    kCount
+};
+
+enum class Counter : uint8_t {
+    kRequests,       // Keys looked up, stored or deleted
+    kCacheHits,
+    kCacheMisses,
+    kWarmupRequests, // Lookups in the first minute of serving...
+    kWarmupHits,     // ...and how many of them hit the cache
+    kCount
+};
+
+// Log-linear latency buckets in the style of HdrHistogram: values below
+// 2^kSubBucketBits ns are exact, and every power of two above is split into
+// 2^kSubBucketBits buckets, so a reported value is within ~3% of the real
+// one. Values beyond 2^kMaxMagnitude ns (~69 s) land in the last bucket.
+struct HistogramBuckets {
+    static constexpr int kSubBucketBits = 5;
+    static constexpr int kSubBuckets = 1 << kSubBucketBits;
+    static constexpr int kMaxMagnitude = 36;
+    static constexpr size_t kCount = kSubBuckets * (kMaxMagnitude - kSubBucketBits + 2);
+
+    static size_t index_of(uint64_t ns);
+
+    // Middle of the range a bucket covers, in ns
+    static uint64_t value_of(size_t index);
+};
+
+// Merged view of one histogram across threads
+struct HistogramSnapshot {
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(HistogramBuckets::kCount);
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+
+    // Value at quantile q (0..1) in ns; 0 when empty
+    uint64_t quantile(double q) const;
+};
+
+// Request counters and latency histograms. Each thread records into its own
+// shard, which only that thread writes, so recording is a plain load and
+// store with no lock, no read-modify-write and no shared cache line. Reads
+// add the shards up and may miss a sample that is being written.
+class Metrics {
+public:
+    Metrics();
+    ~Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    void record(Route route, uint64_t ns);
+    void record(Stage stage, uint64_t ns);
+    void add(Counter counter, uint64_t n = 1);
+
+    uint64_t get(Counter counter) const;
+    HistogramSnapshot snapshot(Route route) const;
+    HistogramSnapshot snapshot(Stage stage) const;
+
+    // Append request counts and p50/p99/p999 latencies in the Prometheus
+    // text format (as summaries, in seconds, since startup)
+    void write_prometheus(std::string& out) const;
+
+    static const char* name(Route route);
+    static const char* name(Stage stage);
+
+private:
+    struct Shard;
+
+    const uint64_t instance_;  // Tells apart Metrics objects in the per-thread lookup
+
+    mutable std::mutex shards_mutex_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    Shard& local_shard();
+    Shard* create_shard();
+};
+
+// Clock for request timers. On x86-64 this reads the TSC, which costs a
+// fraction of a steady_clock call and is converted to ns against
+// steady_clock once, when the first Metrics is created; elsewhere it is steady_clock in ns.
+class TickClock {
+public:
+    static uint64_t now() {
+#if defined(__x86_64__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static uint64_t to_ns(uint64_t ticks);
+};
+
+// Records the time from construction to destruction
+template <typename Key>
+class ScopedTimer {
+public:
+    ScopedTimer(Metrics& metrics, Key key) : metrics_(metrics), key_(key), start_(TickClock::now()) {}
+
+    ~ScopedTimer() {
+        // A thread moved to another core may read a slightly earlier TSC
+        uint64_t end = TickClock::now();
+        metrics_.record(key_, end > start_ ? TickClock::to_ns(end - start_) : 0);
+    }
+
+    // Record under a different key, e.g. once the route is known
+    void set_key(Key key) { key_ = key; }
+
+private:
+    Metrics& metrics_;
+    Key key_;
+    uint64_t start_;
+};
+
+#endif // METRICS_H
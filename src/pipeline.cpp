@@ -0,0 +1,269 @@
+#include "pipeline.h"
+#include <iostream>
+#include <algorithm>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+PipelinedConnection::PipelinedConnection(const std::string& connection_string, ConnectionPool::SetupFn setup)
+    : connection_string_(connection_string), setup_(std::move(setup)) {}
+
+PipelinedConnection::~PipelinedConnection() {
+    close();
+}
+
+bool PipelinedConnection::open() {
+    conn_ = PQconnectdb(connection_string_.c_str());
+    if (PQstatus(conn_) != CONNECTION_OK || !start_session()) {
+        std::cerr << "Pipelined connection failed: " << PQerrorMessage(conn_) << std::endl;
+        PQfinish(conn_);
+        conn_ = nullptr;
+        return false;
+    }
+
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ < 0) {
+        std::cerr << "Pipelined connection failed: cannot create eventfd" << std::endl;
+        PQfinish(conn_);
+        conn_ = nullptr;
+        return false;
+    }
+
+    running_ = true;
+    io_thread_ = std::thread([this] { io_loop(); });
+    return true;
+}
+
+void PipelinedConnection::close() {
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    wake();
+    io_thread_.join();
+
+    PQfinish(conn_);
+    conn_ = nullptr;
+    ::close(wakeup_fd_);
+    wakeup_fd_ = -1;
+}
+
+bool PipelinedConnection::start_session() {
+    // Session setup runs in blocking mode, outside the pipeline
+    PQexitPipelineMode(conn_);
+    PQsetnonblocking(conn_, 0);
+    if (setup_ && !setup_(conn_)) {
+        return false;
+    }
+    return PQsetnonblocking(conn_, 1) == 0 && PQenterPipelineMode(conn_) == 1;
+}
+
+bool PipelinedConnection::submit(PipelineQuery query) {
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        if (!running_) {
+            return false;
+        }
+        in_flight_.fetch_add(1, std::memory_order_relaxed);
+        submitted_.push_back(std::move(query));
+    }
+    wake();
+    return true;
+}
+
+void PipelinedConnection::wake() {
+    uint64_t one = 1;
+    ssize_t written = write(wakeup_fd_, &one, sizeof(one));
+    (void)written;  // Only fails on counter overflow, when a wakeup is pending anyway
+}
+
+void PipelinedConnection::io_loop() {
+    std::vector<PipelineQuery> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            if (!running_) break;
+            batch.swap(submitted_);
+        }
+
+        // Write everything that arrived since the last pass without waiting
+        // for earlier results
+        bool healthy = (PQstatus(conn_) == CONNECTION_OK);
+        for (auto& query : batch) {
+            if (!healthy || !send(query)) {
+                healthy = false;
+                complete(query, nullptr);
+            }
+        }
+        batch.clear();
+
+        int flush = healthy ? PQflush(conn_) : -1;
+        if (flush < 0) {
+            fail_awaiting();
+            std::cerr << "Pipelined connection lost: " << PQerrorMessage(conn_) << std::endl;
+            PQreset(conn_);
+            reconnects_.fetch_add(1, std::memory_order_relaxed);
+            if (PQstatus(conn_) != CONNECTION_OK || !start_session()) {
+                // Back off; queries arriving meanwhile fail fast
+                pollfd wakeup = {wakeup_fd_, POLLIN, 0};
+                poll(&wakeup, 1, 1000);
+            }
+            continue;
+        }
+
+        pollfd fds[2] = {
+            {PQsocket(conn_), static_cast<short>(POLLIN | (flush == 1 ? POLLOUT : 0)), 0},
+            {wakeup_fd_, POLLIN, 0},
+        };
+        if (poll(fds, 2, -1) < 0) {
+            continue;
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            ssize_t drained = read(wakeup_fd_, &count, sizeof(count));
+            (void)drained;
+        }
+        if ((fds[0].revents & (POLLIN | POLLERR | POLLHUP)) && !read_results()) {
+            // Make the next pass reset the connection
+            fail_awaiting();
+        }
+    }
+
+    fail_awaiting();
+    std::vector<PipelineQuery> leftover;
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        leftover.swap(submitted_);
+    }
+    for (auto& query : leftover) {
+        complete(query, nullptr);
+    }
+}
+
+bool PipelinedConnection::send(PipelineQuery& query) {
+    size_t count = query.params.size();
+    std::vector<const char*> values(count);
+    std::vector<int> lengths(count);
+    std::vector<int> formats(count, 1);
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = query.params[i].data();
+        lengths[i] = static_cast<int>(query.params[i].size());
+    }
+
+    if (!PQsendQueryPrepared(conn_, query.statement, static_cast<int>(count), values.data(),
+                             lengths.data(), formats.data(), query.result_format)) {
+        return false;
+    }
+    if (!PQpipelineSync(conn_)) {
+        // The query went out without its sync point; the caller fails it
+        // and the connection gets reset
+        return false;
+    }
+    awaiting_.push_back({std::move(query), nullptr});
+    return true;
+}
+
+bool PipelinedConnection::read_results() {
+    if (!PQconsumeInput(conn_)) {
+        return false;
+    }
+
+    // Each query yields its result(s), a null terminator, then its sync
+    int nulls = 0;
+    while (!awaiting_.empty() && !PQisBusy(conn_)) {
+        PGresult* res = PQgetResult(conn_);
+        if (res == nullptr) {
+            if (++nulls > 1) break;
+            continue;
+        }
+        nulls = 0;
+
+        Sent& front = awaiting_.front();
+        if (PQresultStatus(res) == PGRES_PIPELINE_SYNC) {
+            PQclear(res);
+            Sent sent = std::move(front);
+            awaiting_.pop_front();
+            complete(sent.query, sent.result);
+        } else if (front.result == nullptr) {
+            front.result = res;
+        } else {
+            PQclear(res);
+        }
+    }
+    return PQstatus(conn_) == CONNECTION_OK;
+}
+
+void PipelinedConnection::complete(PipelineQuery& query, PGresult* result) {
+    in_flight_.fetch_sub(1, std::memory_order_relaxed);
+    query.done(result);
+}
+
+void PipelinedConnection::fail_awaiting() {
+    while (!awaiting_.empty()) {
+        Sent sent = std::move(awaiting_.front());
+        awaiting_.pop_front();
+        PQclear(sent.result);
+        complete(sent.query, nullptr);
+    }
+}
+
+PipelineExecutor::PipelineExecutor(const std::string& connection_string, size_t num_connections,
+                                   ConnectionPool::SetupFn setup) {
+    for (size_t i = 0; i < std::max<size_t>(num_connections, 1); ++i) {
+        connections_.emplace_back(new PipelinedConnection(connection_string, setup));
+    }
+}
+
+bool PipelineExecutor::open() {
+    for (size_t i = 0; i < connections_.size(); ++i) {
+        if (!connections_[i]->open()) {
+            for (size_t j = 0; j < i; ++j) {
+                connections_[j]->close();
+            }
+            return false;
+        }
+    }
+    std::cout << "Database pipeline established (" << connections_.size() << " connections)" << std::endl;
+    return true;
+}
+
+void PipelineExecutor::close() {
+    for (auto& conn : connections_) {
+        conn->close();
+    }
+}
+
+bool PipelineExecutor::submit(PipelineQuery query) {
+    // Least loaded connection; counts are racy but only steer placement
+    PipelinedConnection* target = connections_[0].get();
+    size_t total = 0;
+    for (auto& conn : connections_) {
+        size_t in_flight = conn->get_in_flight();
+        total += in_flight;
+        if (in_flight < target->get_in_flight()) {
+            target = conn.get();
+        }
+    }
+
+    uint64_t peak = max_in_flight_.load(std::memory_order_relaxed);
+    while (total + 1 > peak && !max_in_flight_.compare_exchange_weak(peak, total + 1, std::memory_order_relaxed)) {
+    }
+    return target->submit(std::move(query));
+}
+
+size_t PipelineExecutor::get_in_flight() const {
+    size_t total = 0;
+    for (auto& conn : connections_) {
+        total += conn->get_in_flight();
+    }
+    return total;
+}
+
+uint64_t PipelineExecutor::get_reconnects() const {
+    uint64_t total = 0;
+    for (auto& conn : connections_) {
+        total += conn->get_reconnects();
+    }
+    return total;
+}
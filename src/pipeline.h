@@ -0,0 +1,102 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "connection_pool.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+#include <libpq-fe.h>
+
+// A prepared statement execution waiting to be sent or answered
+struct PipelineQuery {
+    // Called on the connection's I/O thread with the result, or nullptr if
+    // the query could not be run. The callback owns the result (PQclear it)
+    // and should return quickly.
+    using Callback = std::function<void(PGresult*)>;
+
+    const char* statement;            // Name of a prepared statement
+    std::vector<std::string> params;  // Sent in binary
+    int result_format;
+    Callback done;
+};
+
+// One connection in libpq pipeline mode, driven by its own I/O thread.
+// Queries from any number of threads are written back to back without
+// waiting for earlier results, each followed by a sync point so a failing
+// query cannot abort the ones behind it.
+class PipelinedConnection {
+public:
+    PipelinedConnection(const std::string& connection_string, ConnectionPool::SetupFn setup);
+    ~PipelinedConnection();
+
+    bool open();
+
+    // Stop the I/O thread; unanswered queries complete with nullptr
+    void close();
+
+    // Queue a query. Returns false (without calling back) once closed.
+    bool submit(PipelineQuery query);
+
+    // Queries submitted but not yet answered
+    size_t get_in_flight() const { return in_flight_.load(std::memory_order_relaxed); }
+    uint64_t get_reconnects() const { return reconnects_.load(std::memory_order_relaxed); }
+
+private:
+    std::string connection_string_;
+    ConnectionPool::SetupFn setup_;
+    PGconn* conn_ = nullptr;
+    int wakeup_fd_ = -1;
+    std::thread io_thread_;
+
+    std::mutex queue_mutex_;
+    std::vector<PipelineQuery> submitted_;  // Not yet handed to libpq
+    bool running_ = false;
+
+    // Owned by the I/O thread: queries sent, in order, awaiting results
+    struct Sent {
+        PipelineQuery query;
+        PGresult* result = nullptr;
+    };
+    std::deque<Sent> awaiting_;
+
+    std::atomic<size_t> in_flight_{0};
+    std::atomic<uint64_t> reconnects_{0};
+
+    bool start_session();
+    void io_loop();
+    bool send(PipelineQuery& query);
+    bool read_results();
+    void complete(PipelineQuery& query, PGresult* result);
+    void fail_awaiting();
+    void wake();
+};
+
+// Spreads queries over a few pipelined connections, picking the one with
+// the fewest queries outstanding.
+class PipelineExecutor {
+public:
+    PipelineExecutor(const std::string& connection_string, size_t num_connections,
+                     ConnectionPool::SetupFn setup);
+
+    bool open();
+    void close();
+
+    bool submit(PipelineQuery query);
+
+    size_t get_num_connections() const { return connections_.size(); }
+    size_t get_in_flight() const;
+    uint64_t get_max_in_flight() const { return max_in_flight_.load(std::memory_order_relaxed); }
+    uint64_t get_reconnects() const;
+
+private:
+    std::vector<std::unique_ptr<PipelinedConnection>> connections_;
+    std::atomic<uint64_t> max_in_flight_{0};
+};
+
+#endif // PIPELINE_H
@@ -1,112 +1,719 @@
 #include "request_handler.h"
+#include "response_writer.h"
+#include "compression.h"
 #include <json.hpp>
-#include <mutex>
+#include <unordered_map>
 
 using json = nlohmann::json;
 
-static std::mutex stats_mutex_;
+RequestHandler::RequestHandler(std::shared_ptr<Cache> cache, std::shared_ptr<StorageBackend> db,
+                               std::shared_ptr<WriteBehindQueue> write_behind,
+                               size_t negative_cache_size)
+    : cache_(cache), db_(db), write_behind_(write_behind), negative_keys_(negative_cache_size) {}
 
-RequestHandler::RequestHandler(std::shared_ptr<LRUCache> cache, std::shared_ptr<Database> db)
-    : cache_(cache), db_(db) {}
+void RequestHandler::set_key_filter(std::shared_ptr<KeyFilter> key_filter) {
+    key_filter_ = key_filter;
+}
 
-std::string RequestHandler::handle_get(const std::string& key) {
-    std::unique_lock<std::mutex> lock(stats_mutex_);
-    total_requests_++;
-    lock.unlock();
-    
+void RequestHandler::set_cache_snapshot(std::shared_ptr<CacheSnapshot> snapshot) {
+    snapshot_ = snapshot;
+}
+
+void RequestHandler::set_expiry_sweeper(std::shared_ptr<ExpirySweeper> sweeper) {
+    sweeper_ = sweeper;
+}
+
+void RequestHandler::set_trace_recorder(std::shared_ptr<TraceRecorder> trace) {
+    trace_ = trace;
+}
+
+void RequestHandler::set_cache_bypass_bytes(size_t bytes) {
+    cache_bypass_bytes_ = bytes;
+}
+
+void RequestHandler::set_cache_compression(size_t min_bytes) {
+    compress_min_bytes_ = min_bytes;
+}
+
+void RequestHandler::mark_ready(double startup_ms) {
+    startup_ms_ = startup_ms;
+    ready_at_ = std::chrono::steady_clock::now();
+    ready_.store(true, std::memory_order_release);
+    warming_up_.store(true, std::memory_order_release);
+}
+
+bool RequestHandler::resolve_locally(const std::string& key, LookupResult& result, bool accept_gzip) {
     // Try cache first
-    auto cached_value = cache_->get(key);
-    if (cached_value) {
-        lock.lock();
-        cache_hits_++;
-        lock.unlock();
-        
-        json response;
-        response["key"] = key;
-        response["value"] = *cached_value;
-        response["source"] = "cache";
-        return response.dump();
+    result.cached = cache_->get(key);
+    if (result.cached && result.cached.compressed()) {
+        if (accept_gzip) {
+            gzip_hits_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            ScopedTimer<Stage> timer(metrics_, Stage::kDecompress);
+            auto value = std::make_shared<std::string>();
+            if (gzip_decompress(result.cached.view(), result.cached.raw_size(), *value)) {
+                result.loaded = std::move(value);
+            } else {
+                // Can't happen short of memory corruption; ask the database
+                decompress_failures_.fetch_add(1, std::memory_order_relaxed);
+                cache_->remove(key);
+                result.cached = CacheValue();
+            }
+        }
+    }
+    if (result.cached) {
+        result.found = true;
+        result.source = "cache";
+        return true;
+    }
+    
+    // Writes not yet flushed are newer than anything in the database
+    if (write_behind_) {
+        std::string pending_value;
+        uint64_t expires_at = 0;
+        auto pending = write_behind_->lookup(key, &pending_value, &expires_at);
+        if (pending == WriteBehindQueue::Pending::kDelete ||
+            (pending == WriteBehindQueue::Pending::kPut && is_expired(expires_at, expiry_now()))) {
+            return true;
+        }
+        if (pending == WriteBehindQueue::Pending::kPut) {
+            result.loaded = std::make_shared<std::string>(std::move(pending_value));
+            cache_value(key, *result.loaded, expires_at);
+            result.found = true;
+            result.source = "write_buffer";
+            return true;
+        }
+    }
+    
+    if (key_filter_ && !key_filter_->may_contain(key)) {
+        filter_rejections_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (negative_keys_.contains(key)) {
+        negative_cache_hits_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+void RequestHandler::cache_value(const std::string& key, const std::string& value, uint64_t expires_at) {
+    if (cache_bypass_bytes_ > 0 && value.size() > cache_bypass_bytes_) {
+        // An older, smaller value may still be cached
+        cache_->remove(key);
+        cache_bypassed_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (compress_min_bytes_ > 0 && value.size() >= compress_min_bytes_) {
+        // Reused, so compressing doesn't allocate once it has grown
+        thread_local std::string compressed;
+        bool ok;
+        {
+            ScopedTimer<Stage> timer(metrics_, Stage::kCompress);
+            ok = gzip_compress(value, compressed);
+        }
+        // Every hit pays for a decompression, so it has to save at least
+        // an eighth of the value
+        if (ok && compressed.size() <= value.size() - value.size() / 8) {
+            cache_->put(key, compressed, value.size(), expires_at);
+            values_compressed_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        values_incompressible_.fetch_add(1, std::memory_order_relaxed);
+    }
+    cache_->put(key, value, 0, expires_at);
+}
+
+bool RequestHandler::begin_lookup(const std::string& key, LookupResult& result, bool accept_gzip) {
+    bool resolved;
+    {
+        ScopedTimer<Stage> timer(metrics_, Stage::kCacheLookup);
+        resolved = resolve_locally(key, result, accept_gzip);
+    }
+    
+    metrics_.add(Counter::kRequests);
+    metrics_.add(result.cached ? Counter::kCacheHits : Counter::kCacheMisses);
+    if (trace_) {
+        trace_->record(TraceOp::kGet, key);
+    }
+    if (warming_up_.load(std::memory_order_acquire)) {
+        if (std::chrono::steady_clock::now() - ready_at_ < kWarmupWindow) {
+            metrics_.add(Counter::kWarmupRequests);
+            if (result.cached) metrics_.add(Counter::kWarmupHits);
+        } else {
+            warming_up_.store(false, std::memory_order_relaxed);
+        }
+    }
+    return resolved;
+}
+
+LookupResult RequestHandler::lookup(const std::string& key, bool accept_gzip) {
+    // Taken before anything else is consulted, so a write that lands while
+    // we look keeps this lookup's miss out of the negative cache
+    uint64_t epoch = negative_keys_.epoch();
+    
+    LookupResult result;
+    if (begin_lookup(key, result, accept_gzip)) {
+        return result;
     }
     
     // Cache miss - fetch from database
-    lock.lock();
-    cache_misses_++;
-    lock.unlock();
+    result.loaded = db_reads_.load(key, [this, &key, epoch] {
+        bool failed = false;
+        uint64_t expires_at = 0;
+        std::shared_ptr<std::string> value;
+        {
+            ScopedTimer<Stage> timer(metrics_, Stage::kDbQuery);
+            value = db_->read(key, &failed, &expires_at);
+        }
+        if (value) {
+            // Put in cache for future access
+            cache_value(key, *value, expires_at);
+        } else if (!failed) {
+            db_misses_.fetch_add(1, std::memory_order_relaxed);
+            negative_keys_.insert(key, epoch);
+        }
+        return value;
+    });
+    if (!result.loaded) {
+        return result;
+    }
     
-    auto db_value = db_->read(key);
-    if (!db_value) {
-        json error;
-        error["error"] = "Key not found";
-        return error.dump();
+    result.found = true;
+    result.source = "database";
+    return result;
+}
+
+void RequestHandler::lookup_async(const std::string& key, LookupCallback done) {
+    if (!db_->reads_async()) {
+        done(lookup(key));
+        return;
     }
     
-    // Put in cache for future access
-    cache_->put(key, *db_value);
+    uint64_t epoch = negative_keys_.epoch();
+    
+    LookupResult result;
+    if (begin_lookup(key, result)) {
+        done(std::move(result));
+        return;
+    }
     
-    json response;
-    response["key"] = key;
-    response["value"] = *db_value;
-    response["source"] = "database";
-    return response.dump();
+    uint64_t start = TickClock::now();
+    db_->read_async(key, [this, key, epoch, start, done = std::move(done)](
+                             std::shared_ptr<std::string> value, bool failed, uint64_t expires_at) {
+        uint64_t end = TickClock::now();
+        metrics_.record(Stage::kDbQuery, end > start ? TickClock::to_ns(end - start) : 0);
+        
+        LookupResult result;
+        if (value) {
+            cache_value(key, *value, expires_at);
+            result.loaded = std::move(value);
+            result.found = true;
+            result.source = "database";
+        } else if (!failed) {
+            db_misses_.fetch_add(1, std::memory_order_relaxed);
+            negative_keys_.insert(key, epoch);
+        }
+        done(std::move(result));
+    });
 }
 
-std::string RequestHandler::handle_post(const std::string& key, const std::string& value) {
-    std::unique_lock<std::mutex> lock(stats_mutex_);
-    total_requests_++;
-    lock.unlock();
+LookupResult RequestHandler::lookup_range(const std::string& key, uint64_t offset, uint64_t length,
+                                          uint64_t& total) {
+    uint64_t epoch = negative_keys_.epoch();
     
-    // Store in both cache and database
-    cache_->put(key, value);
-    bool db_success = db_->create(key, value);
+    LookupResult result;
+    if (begin_lookup(key, result)) {
+        if (result.found) {
+            // Cut the range out of the whole value held locally
+            std::string_view value = result.value();
+            total = value.size();
+            result.loaded = std::make_shared<std::string>(
+                offset < value.size() ? value.substr(offset, length) : std::string_view());
+            result.cached = CacheValue();
+        }
+        return result;
+    }
     
-    json response;
-    if (db_success) {
-        response["status"] = "success";
-        response["key"] = key;
-    } else {
-        response["status"] = "error";
-        response["message"] = "Failed to create in database";
+    // Ranges bypass the single-flight: concurrent readers of one large
+    // value usually want different parts of it
+    bool failed = false;
+    uint64_t expires_at = 0;
+    {
+        ScopedTimer<Stage> timer(metrics_, Stage::kDbQuery);
+        result.loaded = db_->read_range(key, offset, length, &total, &failed, &expires_at);
     }
-    return response.dump();
+    if (!result.loaded) {
+        if (!failed) {
+            db_misses_.fetch_add(1, std::memory_order_relaxed);
+            negative_keys_.insert(key, epoch);
+        }
+        return result;
+    }
+    if (offset == 0 && result.loaded->size() == total) {
+        cache_value(key, *result.loaded, expires_at);
+    }
+    
+    result.found = true;
+    result.source = "database";
+    return result;
 }
 
-std::string RequestHandler::handle_delete(const std::string& key) {
-    std::unique_lock<std::mutex> lock(stats_mutex_);
-    total_requests_++;
-    lock.unlock();
+std::string RequestHandler::handle_get(const std::string& key) {
+    LookupResult result = lookup(key);
+    if (!result.found) {
+        return "{\"error\":\"Key not found\"}";
+    }
     
-    // Delete from database first
-    bool db_success = db_->delete_key(key);
+    return value_response(key, result.source, result.value());
+}
+
+bool RequestHandler::store(const std::string& key, const std::string& value, uint64_t expires_at) {
+    metrics_.add(Counter::kRequests);
+    if (trace_) {
+        trace_->record(TraceOp::kPut, key, value.size());
+    }
+    
+    // Store in both cache and database (or the write-behind queue, falling
+    // back to a direct write once the queue has shut down)
+    cache_value(key, value, expires_at);
+    
+    // Count the key before it becomes visible so the filter never
+    // rules out a stored key
+    if (key_filter_) {
+        key_filter_->add(key);
+    }
+    
+    bool queued = write_behind_ && write_behind_->enqueue_put(key, value, expires_at);
+    bool inserted = false;
+    bool db_success = queued;
+    if (!queued) {
+        ScopedTimer<Stage> timer(metrics_, Stage::kDbQuery);
+        db_success = db_->create(key, value, &inserted, expires_at);
+    }
+    if (key_filter_ && db_success && !queued && !inserted) {
+        // Overwrote an existing row, which was counted when first stored
+        key_filter_->remove(key);
+    }
+    if (!db_success) {
+        // Not stored, so not to be served; the next read goes to the database
+        cache_->remove(key);
+    }
+    negative_keys_.invalidate(key);
+    return db_success;
+}
+
+bool RequestHandler::remove(const std::string& key) {
+    metrics_.add(Counter::kRequests);
+    if (trace_) {
+        trace_->record(TraceOp::kDelete, key);
+    }
+    
+    uint64_t epoch = negative_keys_.epoch();
+    
+    // Delete from database (or queue the delete) first
+    bool queued = write_behind_ && write_behind_->enqueue_delete(key);
+    bool deleted = false;
+    bool db_success = queued;
+    if (!queued) {
+        ScopedTimer<Stage> timer(metrics_, Stage::kDbQuery);
+        db_success = db_->delete_key(key, &deleted);
+    }
     
     // Delete from cache
     cache_->remove(key);
     
-    json response;
-    if (db_success) {
-        response["status"] = "success";
-        response["key"] = key;
+    // Queued deletes leave the filter alone; the extra count only costs
+    // a database read on a later miss
+    if (db_success && !queued) {
+        if (key_filter_ && deleted) {
+            key_filter_->remove(key);
+        }
+        negative_keys_.insert(key, epoch);
+    }
+    return db_success;
+}
+
+// {"key":..,"status":"success"} or {"message":..,"status":"error"}, with
+// members in the order nlohmann::json used to write them
+static std::string write_result(bool success, const std::string& key, const char* failure) {
+    std::string body;
+    JsonWriter writer(body);
+    writer.begin_object();
+    if (success) {
+        writer.key("key").value(key).key("status").value("success");
     } else {
-        response["status"] = "error";
-        response["message"] = "Failed to delete from database";
+        writer.key("message").value(failure).key("status").value("error");
     }
-    return response.dump();
+    writer.end_object();
+    return body;
+}
+
+// {"count":..,"status":"success"} or {"message":..,"status":"error"}
+static std::string write_count_result(bool success, size_t count, const char* failure) {
+    std::string body;
+    JsonWriter writer(body);
+    writer.begin_object();
+    if (success) {
+        writer.key("count").value(static_cast<uint64_t>(count)).key("status").value("success");
+    } else {
+        writer.key("message").value(failure).key("status").value("error");
+    }
+    writer.end_object();
+    return body;
+}
+
+std::string RequestHandler::handle_post(const std::string& key, const std::string& value, uint64_t expires_at) {
+    return write_result(store(key, value, expires_at), key, "Failed to create in database");
+}
+
+std::string RequestHandler::handle_delete(const std::string& key) {
+    return write_result(remove(key), key, "Failed to delete from database");
+}
+
+std::string RequestHandler::handle_batch_get(const std::vector<std::string>& keys) {
+    uint64_t epoch = negative_keys_.epoch();
+    
+    // Serve everything we can from memory, collecting the rest
+    std::vector<LookupResult> results(keys.size());
+    std::vector<std::string> misses;
+    std::vector<size_t> miss_positions;
+    uint64_t hits = 0;
+    {
+        ScopedTimer<Stage> timer(metrics_, Stage::kCacheLookup);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (resolve_locally(keys[i], results[i])) {
+                if (results[i].cached) hits++;
+                continue;
+            }
+            misses.push_back(keys[i]);
+            miss_positions.push_back(i);
+        }
+    }
+    
+    metrics_.add(Counter::kRequests, keys.size());
+    metrics_.add(Counter::kCacheHits, hits);
+    metrics_.add(Counter::kCacheMisses, keys.size() - hits);
+    if (trace_) {
+        for (const auto& key : keys) {
+            trace_->record(TraceOp::kGet, key);
+        }
+    }
+    
+    // One query for all misses
+    std::vector<std::shared_ptr<std::string>> values;
+    std::vector<uint64_t> expiry;
+    bool db_ok = true;
+    if (!misses.empty()) {
+        ScopedTimer<Stage> timer(metrics_, Stage::kDbQuery);
+        db_ok = db_->read_many(misses, values, &expiry);
+    }
+    if (db_ok) {
+        for (size_t j = 0; j < misses.size(); ++j) {
+            LookupResult& result = results[miss_positions[j]];
+            if (values[j]) {
+                cache_value(misses[j], *values[j], expiry[j]);
+                result.loaded = values[j];
+                result.found = true;
+                result.source = "database";
+            } else {
+                db_misses_.fetch_add(1, std::memory_order_relaxed);
+                negative_keys_.insert(misses[j], epoch);
+            }
+        }
+    }
+    
+    ScopedTimer<Stage> timer(metrics_, Stage::kSerialization);
+    // Sized for the unescaped bodies, so it rarely grows while written
+    size_t length = 16;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        length += 48 + keys[i].size() + (results[i].found ? results[i].value().size() : 0);
+    }
+    std::string body;
+    body.reserve(length);
+    JsonWriter writer(body);
+    writer.begin_object().key("results").begin_array();
+    size_t next_miss = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        writer.begin_object();
+        bool db_failed = !db_ok && next_miss < miss_positions.size() && miss_positions[next_miss] == i;
+        if (db_failed) {
+            next_miss++;
+            writer.key("error").value("Failed to read from database").key("key").value(keys[i]);
+        } else if (results[i].found) {
+            writer.key("key").value(keys[i]).key("source").value(results[i].source)
+                  .key("value").value(results[i].value());
+        } else {
+            writer.key("error").value("Key not found").key("key").value(keys[i]);
+        }
+        writer.end_object();
+    }
+    writer.end_array().end_object();
+    return body;
+}
+
+std::string RequestHandler::handle_batch_put(const std::vector<std::pair<std::string, std::string>>& items) {
+    // A key written twice in one batch keeps its last value
+    std::vector<std::pair<std::string, std::string>> writes;
+    std::unordered_map<std::string, size_t> positions;
+    writes.reserve(items.size());
+    for (const auto& item : items) {
+        auto inserted = positions.emplace(item.first, writes.size());
+        if (inserted.second) {
+            writes.push_back(item);
+        } else {
+            writes[inserted.first->second].second = item.second;
+        }
+    }
+    
+    metrics_.add(Counter::kRequests, writes.size());
+    if (trace_) {
+        for (const auto& write : writes) {
+            trace_->record(TraceOp::kPut, write.first, write.second.size());
+        }
+    }
+    
+    std::vector<std::pair<std::string, std::string>> direct;
+    for (const auto& write : writes) {
+        cache_value(write.first, write.second);
+        if (key_filter_) {
+            key_filter_->add(write.first);
+        }
+        if (!write_behind_ || !write_behind_->enqueue_put(write.first, write.second)) {
+            direct.push_back(write);
+        }
+    }
+    
+    // One multi-row upsert for everything the queue didn't take
+    std::vector<std::string> overwritten;
+    bool db_success = true;
+    if (!direct.empty()) {
+        ScopedTimer<Stage> timer(metrics_, Stage::kDbQuery);
+        db_success = db_->create_many(direct, key_filter_ ? &overwritten : nullptr);
+    }
+    if (key_filter_) {
+        for (const auto& key : overwritten) {
+            key_filter_->remove(key);
+        }
+    }
+    if (!db_success) {
+        for (const auto& write : direct) {
+            cache_->remove(write.first);
+        }
+    }
+    for (const auto& write : writes) {
+        negative_keys_.invalidate(write.first);
+    }
+    
+    return write_count_result(db_success, writes.size(), "Failed to create in database");
+}
+
+std::string RequestHandler::handle_batch_delete(const std::vector<std::string>& keys) {
+    uint64_t epoch = negative_keys_.epoch();
+    
+    metrics_.add(Counter::kRequests, keys.size());
+    if (trace_) {
+        for (const auto& key : keys) {
+            trace_->record(TraceOp::kDelete, key);
+        }
+    }
+    
+    std::vector<std::string> direct;
+    for (const auto& key : keys) {
+        if (!write_behind_ || !write_behind_->enqueue_delete(key)) {
+            direct.push_back(key);
+        }
+    }
+    
+    // One DELETE for everything the queue didn't take
+    std::vector<std::string> deleted;
+    bool db_success = true;
+    if (!direct.empty()) {
+        ScopedTimer<Stage> timer(metrics_, Stage::kDbQuery);
+        db_success = db_->delete_many(direct, key_filter_ ? &deleted : nullptr);
+    }
+    
+    for (const auto& key : keys) {
+        cache_->remove(key);
+    }
+    
+    if (db_success) {
+        if (key_filter_) {
+            for (const auto& key : deleted) {
+                key_filter_->remove(key);
+            }
+        }
+        for (const auto& key : direct) {
+            negative_keys_.insert(key, epoch);
+        }
+    }
+    
+    return write_count_result(db_success, keys.size(), "Failed to delete from database");
 }
 
 std::string RequestHandler::handle_stats() {
-    std::unique_lock<std::mutex> lock(stats_mutex_);
+    CacheStats cache_stats = cache_->get_stats();
+    uint64_t cache_hits = metrics_.get(Counter::kCacheHits);
+    uint64_t total_requests = metrics_.get(Counter::kRequests);
+    uint64_t warmup_requests = metrics_.get(Counter::kWarmupRequests);
     
     json stats;
-    stats["cache_hits"] = cache_hits_;
-    stats["cache_misses"] = cache_misses_;
-    stats["total_requests"] = total_requests_;
-    stats["cache_size"] = cache_->get_size();
-    stats["cache_max_size"] = cache_->get_max_size();
+    stats["cache_hits"] = cache_hits;
+    stats["cache_misses"] = metrics_.get(Counter::kCacheMisses);
+    stats["total_requests"] = total_requests;
+    stats["cache_policy"] = cache_->get_policy();
+    stats["cache_size"] = cache_stats.size;
+    stats["cache_max_size"] = cache_stats.max_size;
+    stats["cache_bytes"] = cache_stats.bytes;
+    stats["cache_max_bytes"] = cache_stats.max_bytes;
+    stats["cache_reserved_bytes"] = cache_stats.reserved_bytes;
     
-    stats["cache_evictions"] = cache_->get_evictions();
+    stats["cache_evictions"] = cache_stats.evictions;
+    if (cache_bypass_bytes_ > 0) {
+        stats["cache_bypass_bytes"] = cache_bypass_bytes_;
+        stats["cache_bypassed"] = cache_bypassed_.load(std::memory_order_relaxed);
+    }
+    
+    if (compress_min_bytes_ > 0) {
+        HistogramSnapshot compress = metrics_.snapshot(Stage::kCompress);
+        HistogramSnapshot decompress = metrics_.snapshot(Stage::kDecompress);
+        json compression;
+        compression["min_bytes"] = compress_min_bytes_;
+        compression["entries"] = cache_stats.compressed_entries;
+        compression["saved_bytes"] = cache_stats.compression_saved_bytes;
+        // Memory the cached entries would take stored as is
+        size_t effective_bytes = cache_stats.bytes + cache_stats.compression_saved_bytes;
+        compression["effective_bytes"] = effective_bytes;
+        if (cache_stats.bytes > 0) {
+            compression["effective_ratio"] = (double)effective_bytes / cache_stats.bytes;
+        }
+        compression["compressed"] = values_compressed_.load(std::memory_order_relaxed);
+        compression["incompressible"] = values_incompressible_.load(std::memory_order_relaxed);
+        compression["compress_ms"] = compress.sum_ns / 1e6;
+        compression["decompressions"] = decompress.count;
+        compression["decompress_ms"] = decompress.sum_ns / 1e6;
+        compression["gzip_hits"] = gzip_hits_.load(std::memory_order_relaxed);
+        compression["decompress_failures"] = decompress_failures_.load(std::memory_order_relaxed);
+        stats["cache_compression"] = compression;
+    }
+    
+    if (cache_stats.admitted + cache_stats.rejected > 0) {
+        json admission;
+        admission["admitted"] = cache_stats.admitted;
+        admission["rejected"] = cache_stats.rejected;
+        admission["admitted_requests"] = cache_stats.admitted_requests;
+        admission["rejected_requests"] = cache_stats.rejected_requests;
+        if (cache_stats.admitted_requests > 0) {
+            admission["admitted_hit_rate"] = (double)cache_stats.admitted_hits / cache_stats.admitted_requests;
+        }
+        if (cache_stats.rejected_requests > 0) {
+            admission["rejected_hit_rate"] = (double)cache_stats.rejected_hits / cache_stats.rejected_requests;
+        }
+        stats["cache_admission"] = admission;
+    }
     
-    if (total_requests_ > 0) {
-        stats["hit_rate"] = (double)cache_hits_ / total_requests_;
+    if (sweeper_ || cache_stats.expiry_timers > 0 || cache_stats.expired > 0) {
+        json expiry;
+        expiry["cache_expired"] = cache_stats.expired;
+        expiry["cache_timers"] = cache_stats.expiry_timers;
+        if (sweeper_) {
+            SweeperStats sweeper_stats = sweeper_->get_stats();
+            expiry["sweeps"] = sweeper_stats.sweeps;
+            expiry["swept_cache_entries"] = sweeper_stats.cache_expired;
+            expiry["rows_deleted"] = sweeper_stats.rows_deleted;
+            expiry["failures"] = sweeper_stats.failures;
+            expiry["last_sweep_ms"] = sweeper_stats.last_sweep_ms;
+        }
+        stats["expiry"] = expiry;
+    }
+    
+    if (write_behind_) {
+        json write_behind;
+        write_behind["pending"] = write_behind_->get_pending();
+        write_behind["coalesced"] = write_behind_->get_coalesced();
+        write_behind["batches"] = write_behind_->get_batches();
+        write_behind["rows_written"] = write_behind_->get_rows_written();
+        write_behind["failures"] = write_behind_->get_failures();
+        write_behind["dropped"] = write_behind_->get_dropped();
+        stats["write_behind"] = write_behind;
+    }
+    
+    if (key_filter_ || negative_keys_.enabled()) {
+        json negative;
+        negative["filter_rejections"] = filter_rejections_.load(std::memory_order_relaxed);
+        negative["negative_cache_hits"] = negative_cache_hits_.load(std::memory_order_relaxed);
+        negative["negative_cache_size"] = negative_keys_.get_size();
+        negative["db_misses"] = db_misses_.load(std::memory_order_relaxed);
+        if (key_filter_) {
+            negative["filter_capacity"] = key_filter_->get_capacity();
+            negative["filter_bytes"] = key_filter_->get_memory_bytes();
+        }
+        stats["negative_lookups"] = negative;
+    }
+    
+    stats["db_reads_saved"] = db_reads_.get_shared_loads();
+    std::vector<std::pair<std::string, uint64_t>> backend_stats;
+    db_->get_stats(backend_stats);
+    for (const auto& [name, value] : backend_stats) {
+        stats[name] = value;
+    }
+    
+    if (total_requests > 0) {
+        stats["hit_rate"] = (double)cache_hits / total_requests;
+    }
+    
+    json warm_start;
+    bool ready = ready_.load(std::memory_order_acquire);
+    warm_start["startup_ms"] = ready ? startup_ms_ : 0.0;
+    warm_start["first_minute_requests"] = warmup_requests;
+    if (warmup_requests > 0) {
+        warm_start["first_minute_hit_rate"] = (double)metrics_.get(Counter::kWarmupHits) / warmup_requests;
+    }
+    warm_start["first_minute_complete"] = ready && std::chrono::steady_clock::now() - ready_at_ >= kWarmupWindow;
+    if (snapshot_) {
+        SnapshotStats snapshot_stats = snapshot_->get_stats();
+        warm_start["snapshot_loaded"] = snapshot_stats.loaded;
+        warm_start["snapshot_clean"] = snapshot_stats.loaded_clean;
+        warm_start["snapshot_entries"] = snapshot_stats.loaded_entries;
+        warm_start["snapshot_load_ms"] = snapshot_stats.load_ms;
+        
+        json snapshot;
+        snapshot["writes"] = snapshot_stats.writes;
+        snapshot["failures"] = snapshot_stats.failures;
+        snapshot["last_entries"] = snapshot_stats.last_entries;
+        snapshot["last_bytes"] = snapshot_stats.last_bytes;
+        snapshot["last_write_ms"] = snapshot_stats.last_write_ms;
+        stats["cache_snapshot"] = snapshot;
+    }
+    stats["warm_start"] = warm_start;
+    if (trace_) {
+        json trace;
+        trace["path"] = trace_->get_path();
+        trace["recorded"] = trace_->get_recorded();
+        trace["dropped"] = trace_->get_dropped();
+        stats["trace"] = trace;
     }
     
     return stats.dump();
 }
+
+std::string RequestHandler::handle_metrics() {
+    std::string body;
+    metrics_.write_prometheus(body);
+    
+    CacheStats cache_stats = cache_->get_stats();
+    body += "# HELP kv_cache_entries Entries in the cache\n"
+            "# TYPE kv_cache_entries gauge\n"
+            "kv_cache_entries " + std::to_string(cache_stats.size) + "\n"
+            "# HELP kv_cache_bytes Bytes charged to live cache entries\n"
+            "# TYPE kv_cache_bytes gauge\n"
+            "kv_cache_bytes " + std::to_string(cache_stats.bytes) + "\n"
+            "# HELP kv_cache_evictions_total Entries evicted from the cache\n"
+            "# TYPE kv_cache_evictions_total counter\n"
+            "kv_cache_evictions_total " + std::to_string(cache_stats.evictions) + "\n";
+    if (write_behind_) {
+        body += "# HELP kv_write_behind_pending Writes queued and not yet persisted\n"
+                "# TYPE kv_write_behind_pending gauge\n"
+                "kv_write_behind_pending " + std::to_string(write_behind_->get_pending()) + "\n";
+    }
+    return body;
+}
@@ -2,34 +2,179 @@
 #define REQUEST_HANDLER_H
 
 #include "cache.h"
-#include "database.h"
+#include "storage_backend.h"
+#include "write_behind.h"
+#include "single_flight.h"
+#include "key_filter.h"
+#include "cache_snapshot.h"
+#include "expiry_sweeper.h"
+#include "trace_recorder.h"
+#include "metrics.h"
 #include <string>
+#include <string_view>
 #include <memory>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+// Result of a key lookup. A cache hit references the cached bytes directly,
+// so the response can be written from them without copying.
+struct LookupResult {
+    bool found = false;
+    const char* source = "";               // "cache" or "database"
+    CacheValue cached;                     // Set on a cache hit
+    std::shared_ptr<std::string> loaded;   // Set when read from the database,
+                                           // or decompressed from a cache hit
+    
+    std::string_view value() const {
+        if (loaded) return *loaded;
+        return cached.view();
+    }
+    
+    // value() is still gzip-compressed, as cached (only when the lookup
+    // accepted that)
+    bool gzip() const { return cached.compressed() && !loaded; }
+};
 
 class RequestHandler {
 public:
-    RequestHandler(std::shared_ptr<LRUCache> cache, std::shared_ptr<Database> db);
+    // write_behind is optional; when set, writes are queued instead of
+    // being persisted before the response. negative_cache_size bounds the
+    // number of missing keys remembered (0 disables).
+    RequestHandler(std::shared_ptr<Cache> cache, std::shared_ptr<StorageBackend> db,
+                   std::shared_ptr<WriteBehindQueue> write_behind = nullptr,
+                   size_t negative_cache_size = 0);
+    
+    // Answer lookups for keys the filter rules out without asking the
+    // database. The filter must already hold every stored key; call before
+    // serving requests.
+    void set_key_filter(std::shared_ptr<KeyFilter> key_filter);
+    
+    // Report the snapshot's load and write statistics in the stats
+    void set_cache_snapshot(std::shared_ptr<CacheSnapshot> snapshot);
+    
+    // Report the expiry sweeper's statistics in the stats
+    void set_expiry_sweeper(std::shared_ptr<ExpirySweeper> sweeper);
+    
+    // Record every key operation to a trace; call before serving requests
+    void set_trace_recorder(std::shared_ptr<TraceRecorder> trace);
+    
+    // Values larger than this skip the cache (0 caches values of any size),
+    // so a few large blobs can't push out many small hot entries. Call
+    // before serving requests.
+    void set_cache_bypass_bytes(size_t bytes);
+    
+    // Cache values of at least min_bytes gzip-compressed (0 stores every
+    // value as is). Call before serving requests.
+    void set_cache_compression(size_t min_bytes);
+    
+    // Called once startup is done, just before serving. Starts the window
+    // in which the warm-up hit rate is measured.
+    void mark_ready(double startup_ms);
+    
+    // Look up a key: cache first, then the database (filling the cache).
+    // With accept_gzip a compressed cache entry is returned as it is
+    // (result.gzip()) instead of being decompressed.
+    LookupResult lookup(const std::string& key, bool accept_gzip = false);
+    
+    // lookup() that doesn't wait for the database when the backend reads
+    // asynchronously: `done` then runs on the backend's thread once the
+    // read completes (and must not block), otherwise before returning.
+    // Asynchronous reads aren't shared between concurrent misses.
+    using LookupCallback = std::function<void(LookupResult result)>;
+    void lookup_async(const std::string& key, LookupCallback done);
+    
+    // Bytes [offset, offset + length) of a value, cut short at its end, in
+    // result.loaded, and the value's full size in `total`. On a cache miss
+    // only that range is read from the database.
+    LookupResult lookup_range(const std::string& key, uint64_t offset, uint64_t length, uint64_t& total);
+    
+    // Store or delete a key: cache, filters and database (or the
+    // write-behind queue). False if the database write failed. A non-zero
+    // expires_at (see expiry.h) makes the key read as missing from then on.
+    bool store(const std::string& key, const std::string& value, uint64_t expires_at = 0);
+    bool remove(const std::string& key);
     
     // Handle GET request
     std::string handle_get(const std::string& key);
     
     // Handle POST request (create)
-    std::string handle_post(const std::string& key, const std::string& value);
+    std::string handle_post(const std::string& key, const std::string& value, uint64_t expires_at = 0);
     
     // Handle DELETE request
     std::string handle_delete(const std::string& key);
     
+    // Batch requests: cache hits are served in bulk, misses and writes go
+    // to the database as a single statement. Per-key results for gets.
+    std::string handle_batch_get(const std::vector<std::string>& keys);
+    std::string handle_batch_put(const std::vector<std::pair<std::string, std::string>>& items);
+    std::string handle_batch_delete(const std::vector<std::string>& keys);
+    
+    // Largest batch accepted in one request
+    static constexpr size_t kMaxBatchKeys = StorageBackend::kMaxBatchRows;
+    
+    // Longest key accepted for writing; kv_store.key is VARCHAR(255)
+    static constexpr size_t kMaxKeyBytes = 255;
+    
     // Handle stats request
     std::string handle_stats();
     
+    // Latency percentiles and counters in the Prometheus text format
+    std::string handle_metrics();
+    
+    // Shared with the front ends, which time whole requests
+    Metrics& get_metrics() { return metrics_; }
+    
 private:
-    std::shared_ptr<LRUCache> cache_;
-    std::shared_ptr<Database> db_;
+    // Answer a lookup from the cache, the write-behind queue or the
+    // missing-key filters. Returns false if the database must be asked.
+    bool resolve_locally(const std::string& key, LookupResult& result, bool accept_gzip = false);
+    
+    // resolve_locally, timed and counted as one lookup
+    bool begin_lookup(const std::string& key, LookupResult& result, bool accept_gzip = false);
+    
+    // Cache a value (compressed if it is large enough and that pays), or
+    // drop the key's entry if the value is too large to cache
+    void cache_value(const std::string& key, const std::string& value, uint64_t expires_at = 0);
+    
+    std::shared_ptr<Cache> cache_;
+    std::shared_ptr<StorageBackend> db_;
+    std::shared_ptr<WriteBehindQueue> write_behind_;
+    size_t cache_bypass_bytes_ = 0;
+    std::atomic<uint64_t> cache_bypassed_{0};
+    size_t compress_min_bytes_ = 0;
+    std::atomic<uint64_t> values_compressed_{0};
+    std::atomic<uint64_t> values_incompressible_{0};  // Stored as is: compression saved too little
+    std::atomic<uint64_t> gzip_hits_{0};              // Hits sent on still compressed
+    std::atomic<uint64_t> decompress_failures_{0};
+    
+    // Concurrent misses for one key share a single database read
+    SingleFlight db_reads_;
+    
+    // Known-missing keys: the filter rules most out, the negative cache
+    // catches the filter's false positives
+    std::shared_ptr<KeyFilter> key_filter_;
+    NegativeCache negative_keys_;
+    std::atomic<uint64_t> filter_rejections_{0};
+    std::atomic<uint64_t> negative_cache_hits_{0};
+    std::atomic<uint64_t> db_misses_{0};
+    
+    std::shared_ptr<CacheSnapshot> snapshot_;
+    std::shared_ptr<ExpirySweeper> sweeper_;
+    std::shared_ptr<TraceRecorder> trace_;
+    
+    // Warm-up: lookups and cache hits in the first kWarmupWindow of serving.
+    // startup_ms_ and ready_at_ are written once, before warming_up_ is set.
+    static constexpr std::chrono::seconds kWarmupWindow{60};
+    double startup_ms_ = 0;
+    std::chrono::steady_clock::time_point ready_at_;
+    std::atomic<bool> warming_up_{false};
+    std::atomic<bool> ready_{false};
     
-    // Statistics
-    uint64_t cache_hits_ = 0;
-    uint64_t cache_misses_ = 0;
-    uint64_t total_requests_ = 0;
+    // Request counts and latencies, recorded per thread
+    Metrics metrics_;
 };
 
 #endif // REQUEST_HANDLER_H
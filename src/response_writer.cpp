@@ -0,0 +1,241 @@
+#include "response_writer.h"
+#include "utf8.h"
+#include <charconv>
+#include <cstring>
+
+// Escaped length of each byte: 1 for bytes written verbatim, 2 for the
+// short escapes, 6 for \u00XX. Control bytes without a short form use
+// \u00XX, matching nlohmann::json. Bytes from 0x80 up are written verbatim
+// within a well-formed UTF-8 sequence; a byte that isn't part of one
+// becomes \ufffd (U+FFFD), as with nlohmann::json's replace handler, so a
+// value stored as arbitrary bytes still makes valid JSON.
+struct EscapeTable {
+    unsigned char length[256];
+    
+    constexpr EscapeTable() : length() {
+        for (int c = 0; c < 256; ++c) {
+            length[c] = (c < 0x20 || c >= 0x80) ? 6 : 1;
+        }
+        length[static_cast<unsigned char>('"')] = 2;
+        length[static_cast<unsigned char>('\\')] = 2;
+        length[static_cast<unsigned char>('\b')] = 2;
+        length[static_cast<unsigned char>('\f')] = 2;
+        length[static_cast<unsigned char>('\n')] = 2;
+        length[static_cast<unsigned char>('\r')] = 2;
+        length[static_cast<unsigned char>('\t')] = 2;
+    }
+};
+
+static constexpr EscapeTable kEscapes;
+
+// Length of the leading run of `text` that needs no escaping. Checks eight
+// bytes at a time for a quote, a backslash, a control byte or a non-ASCII
+// byte, since values are mostly long clean runs; non-ASCII bytes are then
+// checked one UTF-8 sequence at a time.
+static size_t clean_prefix(const char* text, size_t length) {
+    constexpr uint64_t kOnes = 0x0101010101010101ULL;
+    constexpr uint64_t kHigh = 0x8080808080808080ULL;
+    size_t i = 0;
+    while (i < length) {
+        for (; i + 8 <= length; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, text + i, sizeof(word));
+            uint64_t quote = word ^ (kOnes * '"');
+            uint64_t backslash = word ^ (kOnes * '\\');
+            uint64_t special = ((word - kOnes * 0x20) & ~word) |
+                               ((quote - kOnes) & ~quote) |
+                               ((backslash - kOnes) & ~backslash);
+            if ((special | word) & kHigh) {
+                break;
+            }
+        }
+        if (i == length) {
+            break;
+        }
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x80) {
+            size_t sequence = utf8_sequence_length(text + i, length - i);
+            if (sequence == 0) {
+                break;
+            }
+            i += sequence;
+        } else if (kEscapes.length[c] == 1) {
+            i++;
+        } else {
+            break;
+        }
+    }
+    return i;
+}
+
+// Escape sequence for a byte that needs one; writes at most 6 bytes
+static size_t escape(unsigned char c, char* out) {
+    out[0] = '\\';
+    switch (c) {
+        case '"': out[1] = '"'; return 2;
+        case '\\': out[1] = '\\'; return 2;
+        case '\b': out[1] = 'b'; return 2;
+        case '\f': out[1] = 'f'; return 2;
+        case '\n': out[1] = 'n'; return 2;
+        case '\r': out[1] = 'r'; return 2;
+        case '\t': out[1] = 't'; return 2;
+        default: break;
+    }
+    if (c >= 0x80) {
+        // Not part of a well-formed UTF-8 sequence
+        std::memcpy(out + 1, "ufffd", 5);
+        return 6;
+    }
+    static const char hex[] = "0123456789abcdef";
+    out[1] = 'u';
+    out[2] = '0';
+    out[3] = '0';
+    out[4] = hex[c >> 4];
+    out[5] = hex[c & 0xF];
+    return 6;
+}
+
+size_t json_escaped_length(std::string_view text) {
+    size_t length = 0;
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t run = clean_prefix(text.data() + i, text.size() - i);
+        length += run;
+        i += run;
+        if (i < text.size()) {
+            length += kEscapes.length[static_cast<unsigned char>(text[i])];
+            i++;
+        }
+    }
+    return length;
+}
+
+bool write_json_escaped(std::string_view text, const WriteFn& write) {
+    char buffer[6];
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t run = clean_prefix(text.data() + i, text.size() - i);
+        if (run > 0 && !write(text.data() + i, run)) {
+            return false;
+        }
+        i += run;
+        if (i < text.size()) {
+            if (!write(buffer, escape(static_cast<unsigned char>(text[i]), buffer))) {
+                return false;
+            }
+            i++;
+        }
+    }
+    return true;
+}
+
+// Append `text` JSON-escaped (without quotes)
+static void append_json_escaped(std::string& out, std::string_view text) {
+    char buffer[6];
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t run = clean_prefix(text.data() + i, text.size() - i);
+        out.append(text.data() + i, run);
+        i += run;
+        if (i < text.size()) {
+            out.append(buffer, escape(static_cast<unsigned char>(text[i]), buffer));
+            i++;
+        }
+    }
+}
+
+static bool write_literal(const WriteFn& write, std::string_view literal) {
+    return write(literal.data(), literal.size());
+}
+
+size_t value_response_length(std::string_view key, std::string_view source, std::string_view value) {
+    // {"key":"","source":"","value":""} is 33 bytes of framing
+    return 33 + json_escaped_length(key) + json_escaped_length(source) + json_escaped_length(value);
+}
+
+bool write_value_response(std::string_view key, std::string_view source, std::string_view value,
+                          const WriteFn& write) {
+    return write_literal(write, "{\"key\":\"") &&
+           write_json_escaped(key, write) &&
+           write_literal(write, "\",\"source\":\"") &&
+           write_json_escaped(source, write) &&
+           write_literal(write, "\",\"value\":\"") &&
+           write_json_escaped(value, write) &&
+           write_literal(write, "\"}");
+}
+
+std::string value_response(std::string_view key, std::string_view source, std::string_view value) {
+    std::string body;
+    body.reserve(value_response_length(key, source, value));
+    write_value_response(key, source, value, [&body](const char* data, size_t length) {
+        body.append(data, length);
+        return true;
+    });
+    return body;
+}
+
+void JsonWriter::separate() {
+    if (need_comma_) {
+        out_ += ',';
+    }
+}
+
+JsonWriter& JsonWriter::begin_object() {
+    separate();
+    out_ += '{';
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+    out_ += '}';
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_array() {
+    separate();
+    out_ += '[';
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+    out_ += ']';
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name) {
+    separate();
+    out_ += '"';
+    append_json_escaped(out_, name);
+    out_ += "\":";
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(std::string_view text) {
+    separate();
+    out_ += '"';
+    append_json_escaped(out_, text);
+    out_ += '"';
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(uint64_t number) {
+    separate();
+    char digits[20];
+    auto end = std::to_chars(digits, digits + sizeof(digits), number).ptr;
+    out_.append(digits, end - digits);
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool flag) {
+    separate();
+    out_ += flag ? "true" : "false";
+    need_comma_ = true;
+    return *this;
+}
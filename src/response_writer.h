@@ -0,0 +1,58 @@
+#ifndef RESPONSE_WRITER_H
+#define RESPONSE_WRITER_H
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+
+// Writes JSON responses straight from a value's buffer. A cache hit is
+// encoded slice by slice into the transport, without first copying the
+// value into a json object or an intermediate string.
+
+// Output callback, compatible with httplib::DataSink::write
+using WriteFn = std::function<bool(const char* data, size_t length)>;
+
+// Length of `text` once escaped as a JSON string body (without quotes).
+// Bytes that aren't valid UTF-8 are written as \ufffd.
+size_t json_escaped_length(std::string_view text);
+
+// Write `text` JSON-escaped (without quotes); unescaped runs go out as-is
+bool write_json_escaped(std::string_view text, const WriteFn& write);
+
+// {"key":<key>,"source":<source>,"value":<value>}
+size_t value_response_length(std::string_view key, std::string_view source, std::string_view value);
+bool write_value_response(std::string_view key, std::string_view source, std::string_view value,
+                          const WriteFn& write);
+
+// Convenience for callers that need the response as a string
+std::string value_response(std::string_view key, std::string_view source, std::string_view value);
+
+// Appends JSON to a string as it is written, without building a document
+// first. Commas are inserted between members and array elements; fields
+// come out in the order they are written.
+class JsonWriter {
+public:
+    explicit JsonWriter(std::string& out) : out_(out) {}
+    
+    JsonWriter& begin_object();
+    JsonWriter& end_object();
+    JsonWriter& begin_array();
+    JsonWriter& end_array();
+    
+    // Name of the next object member
+    JsonWriter& key(std::string_view name);
+    
+    JsonWriter& value(std::string_view text);
+    JsonWriter& value(const char* text) { return value(std::string_view(text)); }
+    JsonWriter& value(uint64_t number);
+    JsonWriter& value(bool flag);
+    
+private:
+    std::string& out_;
+    bool need_comma_ = false;
+    
+    void separate();
+};
+
+#endif // RESPONSE_WRITER_H
@@ -0,0 +1,354 @@
+#include "router.h"
+#include "body_parser.h"
+#include "expiry.h"
+#include <json.hpp>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstdlib>
+
+using json = nlohmann::json;
+
+static void set_error(HttpResponse& res, int status, std::string_view message) {
+    res.body.clear();
+    JsonWriter(res.body).begin_object().key("error").value(message).end_object();
+    res.status = status;
+}
+
+// Extract the "keys" array of a batch request body
+static bool parse_batch_keys(const json& body, std::vector<std::string>& keys) {
+    if (!body.contains("keys") || !body["keys"].is_array() || body["keys"].empty() ||
+        body["keys"].size() > RequestHandler::kMaxBatchKeys) {
+        return false;
+    }
+    keys.reserve(body["keys"].size());
+    for (const auto& key : body["keys"]) {
+        keys.push_back(key.get<std::string>());
+    }
+    return true;
+}
+
+// Longest TTL accepted, in seconds (ten years)
+static constexpr uint64_t kMaxTtlSeconds = 10ull * 365 * 24 * 3600;
+
+// A TTL in seconds, 1 to kMaxTtlSeconds, as the expiry time it gives now
+static bool ttl_to_expiry(uint64_t ttl, uint64_t& expires_at) {
+    if (ttl == 0 || ttl > kMaxTtlSeconds) {
+        return false;
+    }
+    expires_at = expiry_now() + ttl;
+    return true;
+}
+
+static void set_ttl_error(HttpResponse& res) {
+    set_error(res, 400, "ttl must be a whole number of seconds from 1 to " + std::to_string(kMaxTtlSeconds));
+}
+
+// A key too long to store gets a 400 rather than a failed database write
+static bool check_key_length(HttpResponse& res, const std::string& key) {
+    if (key.size() <= RequestHandler::kMaxKeyBytes) {
+        return true;
+    }
+    set_error(res, 400, "Key is longer than " + std::to_string(RequestHandler::kMaxKeyBytes) + " bytes");
+    return false;
+}
+
+static void set_batch_error(HttpResponse& res) {
+    set_error(res, 400, "Batch body must hold 1 to " + std::to_string(RequestHandler::kMaxBatchKeys) +
+                        " keys or items");
+}
+
+// A single "bytes=first-last" or "bytes=first-" range. Suffix ranges and
+// lists of ranges are not supported and get the whole value.
+static bool parse_range(const std::string& header, uint64_t& offset, uint64_t& length) {
+    static const char kPrefix[] = "bytes=";
+    if (header.compare(0, sizeof(kPrefix) - 1, kPrefix) != 0) {
+        return false;
+    }
+    const char* p = header.c_str() + sizeof(kPrefix) - 1;
+    char* end = nullptr;
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+    uint64_t first = std::strtoull(p, &end, 10);
+    if (*end != '-') {
+        return false;
+    }
+    p = end + 1;
+    if (*p == '\0') {
+        offset = first;
+        length = UINT64_MAX;
+        return true;
+    }
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+    uint64_t last = std::strtoull(p, &end, 10);
+    if (*end != '\0' || last < first) {
+        return false;
+    }
+    offset = first;
+    length = (last == UINT64_MAX) ? last : last - first + 1;
+    return true;
+}
+
+// Stream a value's bytes as the body, with no JSON around them
+static void set_raw_body(HttpResponse& res, const LookupResult& result, Metrics& metrics) {
+    res.content_type = "application/octet-stream";
+    res.body_length = result.value().size();
+    if (result.gzip()) {
+        // Still compressed, as cached; the client said it takes that
+        res.content_encoding = "gzip";
+    }
+    res.body_writer = [result, &metrics](const WriteFn& write) {
+        ScopedTimer<Stage> timer(metrics, Stage::kSerialization);
+        std::string_view value = result.value();
+        return write(value.data(), value.size());
+    };
+}
+
+Router::Router(std::shared_ptr<RequestHandler> handler) : handler_(handler) {}
+
+void Router::route(const HttpRequest& req, HttpResponse& res) {
+    // Until the response body; streamed bodies count as serialization
+    ScopedTimer<Route> timer(handler_->get_metrics(), Route::kNotFound);
+    try {
+        if (req.path == "/api/kv") {
+            if (req.method == "GET") {
+                timer.set_key(Route::kGet);
+                return get_kv(req, res);
+            }
+            if (req.method == "POST") {
+                timer.set_key(Route::kPut);
+                return post_kv(req, res);
+            }
+            if (req.method == "DELETE") {
+                timer.set_key(Route::kDelete);
+                return delete_kv(req, res);
+            }
+        } else if (req.path == "/api/kv/raw") {
+            if (req.method == "GET") {
+                timer.set_key(Route::kRawGet);
+                return get_raw(req, res);
+            }
+            if (req.method == "PUT" || req.method == "POST") {
+                timer.set_key(Route::kRawPut);
+                return put_raw(req, res);
+            }
+        } else if (req.method == "POST" && req.path == "/api/kv/batch/get") {
+            timer.set_key(Route::kBatchGet);
+            return batch_get(req, res);
+        } else if (req.method == "POST" && req.path == "/api/kv/batch/put") {
+            timer.set_key(Route::kBatchPut);
+            return batch_put(req, res);
+        } else if (req.method == "POST" && req.path == "/api/kv/batch/delete") {
+            timer.set_key(Route::kBatchDelete);
+            return batch_delete(req, res);
+        } else if (req.method == "GET" && req.path == "/api/stats") {
+            timer.set_key(Route::kStats);
+            res.body = handler_->handle_stats();
+            res.status = 200;
+            return;
+        } else if (req.method == "GET" && req.path == "/metrics") {
+            timer.set_key(Route::kMetrics);
+            res.body = handler_->handle_metrics();
+            res.content_type = "text/plain; version=0.0.4";
+            res.status = 200;
+            return;
+        } else if (req.method == "GET" && req.path == "/health") {
+            timer.set_key(Route::kHealth);
+            res.body = "{\"status\":\"healthy\"}";
+            res.status = 200;
+            return;
+        }
+        set_error(res, 404, "Not found");
+    } catch (const json::exception& e) {
+        set_error(res, 400, "Invalid JSON in request body");
+    } catch (const std::exception& e) {
+        set_error(res, 500, e.what());
+    }
+}
+
+void Router::get_kv(const HttpRequest& req, HttpResponse& res) {
+    const std::string& key = req.get_param("key");
+    if (key.empty()) {
+        set_error(res, 400, "Missing key parameter");
+        return;
+    }
+
+    // Only a raw body can go out gzip-compressed
+    LookupResult result = handler_->lookup(key, req.wants_raw() && req.accepts_gzip());
+    if (req.wants_raw()) {
+        // The value's bytes as stored, no JSON around them
+        res.content_type = "application/octet-stream";
+        res.status = result.found ? 200 : 404;
+        if (result.found) {
+            set_raw_body(res, result, handler_->get_metrics());
+        }
+        return;
+    }
+    if (!result.found) {
+        set_error(res, 200, "Key not found");
+        return;
+    }
+
+    // Stream the body from the value buffer; on a cache hit that is the
+    // cache's own chunk, kept alive by the captured handle
+    res.body_length = value_response_length(key, result.source, result.value());
+    res.body_writer = [key, result, &metrics = handler_->get_metrics()](const WriteFn& write) {
+        ScopedTimer<Stage> timer(metrics, Stage::kSerialization);
+        return write_value_response(key, result.source, result.value(), write);
+    };
+    res.status = 200;
+}
+
+void Router::post_kv(const HttpRequest& req, HttpResponse& res) {
+    // Reused across requests on this thread, so parsing a body doesn't
+    // allocate once they have grown to the usual sizes
+    thread_local std::string key;
+    thread_local std::string value;
+    uint64_t expires_at = 0;
+
+    // Anything but a flat {"key": .., "value": ..} takes the full parser, as
+    // does a body that may set a ttl (the fast parser skips other members)
+    if (req.body.find("\"ttl\"") != std::string::npos || !parse_key_value_body(req.body, key, value)) {
+        json body = json::parse(req.body);
+        if (!body.contains("key") || !body.contains("value")) {
+            set_error(res, 400, "Missing key or value in request body");
+            return;
+        }
+        if (body.contains("ttl") && !body["ttl"].is_null()) {
+            if (!body["ttl"].is_number_unsigned() || !ttl_to_expiry(body["ttl"].get<uint64_t>(), expires_at)) {
+                set_ttl_error(res);
+                return;
+            }
+        }
+        key = body["key"].get<std::string>();
+        value = body["value"].get<std::string>();
+    }
+    if (!check_key_length(res, key)) {
+        return;
+    }
+
+    res.body = handler_->handle_post(key, value, expires_at);
+    res.status = 200;
+}
+
+void Router::delete_kv(const HttpRequest& req, HttpResponse& res) {
+    const std::string& key = req.get_param("key");
+    if (key.empty()) {
+        set_error(res, 400, "Missing key parameter");
+        return;
+    }
+
+    res.body = handler_->handle_delete(key);
+    res.status = 200;
+}
+
+// Value bytes with no JSON; a Range header reads only that part of the value
+void Router::get_raw(const HttpRequest& req, HttpResponse& res) {
+    const std::string& key = req.get_param("key");
+    if (key.empty()) {
+        set_error(res, 400, "Missing key parameter");
+        return;
+    }
+
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    if (!parse_range(req.range, offset, length)) {
+        LookupResult result = handler_->lookup(key, req.accepts_gzip());
+        if (!result.found) {
+            set_error(res, 404, "Key not found");
+            return;
+        }
+        set_raw_body(res, result, handler_->get_metrics());
+        res.status = 200;
+        return;
+    }
+
+    uint64_t total = 0;
+    LookupResult result = handler_->lookup_range(key, offset, length, total);
+    if (!result.found) {
+        set_error(res, 404, "Key not found");
+        return;
+    }
+    res.range_total = total;
+    if (offset >= total) {
+        set_error(res, 416, "Range not satisfiable");
+        return;
+    }
+    set_raw_body(res, result, handler_->get_metrics());
+    res.range_offset = offset;
+    res.status = 206;
+}
+
+// The body is the value, as sent (Content-Length or chunked)
+void Router::put_raw(const HttpRequest& req, HttpResponse& res) {
+    const std::string& key = req.get_param("key");
+    if (key.empty()) {
+        set_error(res, 400, "Missing key parameter");
+        return;
+    }
+    if (!check_key_length(res, key)) {
+        return;
+    }
+
+    uint64_t expires_at = 0;
+    const std::string& ttl = req.get_param("ttl");
+    if (!ttl.empty()) {
+        char* end = nullptr;
+        uint64_t seconds = ttl[0] >= '0' && ttl[0] <= '9' ? std::strtoull(ttl.c_str(), &end, 10) : 0;
+        if (!end || *end != '\0' || !ttl_to_expiry(seconds, expires_at)) {
+            set_ttl_error(res);
+            return;
+        }
+    }
+
+    res.body = handler_->handle_post(key, req.body, expires_at);
+    res.status = 200;
+}
+
+// Batch bodies: {"keys": [...]} or {"items": [{"key": .., "value": ..}, ...]}
+void Router::batch_get(const HttpRequest& req, HttpResponse& res) {
+    std::vector<std::string> keys;
+    if (!parse_batch_keys(json::parse(req.body), keys)) {
+        set_batch_error(res);
+        return;
+    }
+    res.body = handler_->handle_batch_get(keys);
+    res.status = 200;
+}
+
+void Router::batch_put(const HttpRequest& req, HttpResponse& res) {
+    json body = json::parse(req.body);
+    if (!body.contains("items") || !body["items"].is_array() || body["items"].empty() ||
+        body["items"].size() > RequestHandler::kMaxBatchKeys) {
+        set_batch_error(res);
+        return;
+    }
+
+    std::vector<std::pair<std::string, std::string>> items;
+    items.reserve(body["items"].size());
+    for (const auto& item : body["items"]) {
+        if (!item.contains("key") || !item.contains("value")) {
+            set_batch_error(res);
+            return;
+        }
+        items.emplace_back(item["key"].get<std::string>(), item["value"].get<std::string>());
+        if (!check_key_length(res, items.back().first)) {
+            return;
+        }
+    }
+    res.body = handler_->handle_batch_put(items);
+    res.status = 200;
+}
+
+void Router::batch_delete(const HttpRequest& req, HttpResponse& res) {
+    std::vector<std::string> keys;
+    if (!parse_batch_keys(json::parse(req.body), keys)) {
+        set_batch_error(res);
+        return;
+    }
+    res.body = handler_->handle_batch_delete(keys);
+    res.status = 200;
+}
@@ -0,0 +1,30 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include "http_message.h"
+#include "request_handler.h"
+#include <memory>
+
+// Maps API requests onto the RequestHandler. Shared by every front end.
+class Router {
+public:
+    explicit Router(std::shared_ptr<RequestHandler> handler);
+    
+    // Fill in the response for one request; errors become 4xx/5xx
+    // responses, never exceptions
+    void route(const HttpRequest& req, HttpResponse& res);
+    
+private:
+    std::shared_ptr<RequestHandler> handler_;
+    
+    void get_kv(const HttpRequest& req, HttpResponse& res);
+    void post_kv(const HttpRequest& req, HttpResponse& res);
+    void delete_kv(const HttpRequest& req, HttpResponse& res);
+    void get_raw(const HttpRequest& req, HttpResponse& res);
+    void put_raw(const HttpRequest& req, HttpResponse& res);
+    void batch_get(const HttpRequest& req, HttpResponse& res);
+    void batch_put(const HttpRequest& req, HttpResponse& res);
+    void batch_delete(const HttpRequest& req, HttpResponse& res);
+};
+
+#endif // ROUTER_H
@@ -2,17 +2,113 @@
 #include <httplib.h>
 #include <iostream>
 #include <sstream>
-#include <json.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <csignal>
+#include <pthread.h>
+#include <unistd.h>
 
-using json = nlohmann::json;
+// Build the cache engine selected by --cache-policy, sharded if requested
+static std::shared_ptr<Cache> create_cache(const ServerConfig& config) {
+    bool admission = (config.cache_admission == "tinylfu");
+    if (!admission && config.cache_admission != "none") {
+        std::cerr << "Unknown cache admission policy '" << config.cache_admission << "', using none" << std::endl;
+    }
+    
+    ShardedCache::ShardFactory make_shard;
+    if (config.cache_policy == "clock") {
+        if (admission) {
+            std::cerr << "Admission filter is only supported with the lru policy; ignoring" << std::endl;
+        }
+        make_shard = [](size_t max_size, size_t max_bytes) {
+            return std::unique_ptr<Cache>(new ClockCache(max_size, max_bytes));
+        };
+    } else {
+        if (config.cache_policy != "lru") {
+            std::cerr << "Unknown cache policy '" << config.cache_policy << "', using lru" << std::endl;
+        }
+        make_shard = [admission](size_t max_size, size_t max_bytes) {
+            return std::unique_ptr<Cache>(new LRUCache(max_size, max_bytes, admission));
+        };
+    }
+    
+    // A byte budget replaces the entry limit
+    size_t max_size = config.cache_bytes > 0 ? 0 : config.cache_size;
+    if (config.cache_shards > 1) {
+        return std::make_shared<ShardedCache>(max_size, config.cache_bytes, config.cache_shards, make_shard);
+    }
+    return std::shared_ptr<Cache>(make_shard(max_size, config.cache_bytes));
+}
 
-KVServer::KVServer(int port, size_t num_threads, size_t cache_size, const std::string& db_connection)
-    : port_(port), num_threads_(num_threads) {
+KVServer::KVServer(const ServerConfig& config)
+    : port_(config.port), binary_port_(config.binary_port), num_threads_(config.num_threads),
+      use_key_filter_(config.key_filter),
+      expiry_interval_(config.expiry_interval_ms), expiry_batch_(config.expiry_batch),
+      created_at_(std::chrono::steady_clock::now()) {
+    
+    // With pipelining the pool only serves multi-row writes and scans
+    size_t db_pool_size = config.db_pool_size > 0 ? config.db_pool_size
+                        : config.db_pipeline > 0 ? config.db_pipeline
+                        : config.num_threads;
+    
+    thread_pool_ = std::make_shared<ThreadPool>(config.num_threads, config.pin_threads);
+    cache_ = create_cache(config);
+    if (config.backend == "local") {
+        LogStoreConfig log_config;
+        log_config.dir = config.data_dir;
+        log_config.segment_bytes = config.segment_bytes;
+        log_config.sync = config.log_sync;
+        log_config.compact_threshold = config.compact_threshold;
+        db_ = std::make_shared<LogStore>(log_config);
+        
+        // The store's own index already answers misses from memory
+        use_key_filter_ = false;
+    } else {
+        if (config.backend != "postgres") {
+            std::cerr << "Unknown backend '" << config.backend << "', using postgres" << std::endl;
+        }
+        db_ = std::make_shared<Database>(config.db_connection, db_pool_size, config.db_pipeline);
+    }
+    if (config.write_behind) {
+        write_behind_ = std::make_shared<WriteBehindQueue>(db_, config.write_queue_size, config.flush_size,
+                                                           std::chrono::milliseconds(config.flush_interval_ms));
+        // The cache already holds what was queued; writes that never reach
+        // the database must not be served (or snapshotted) from it
+        std::shared_ptr<Cache> cache = cache_;
+        write_behind_->set_drop_callback([cache](const std::string& key) { cache->remove(key); });
+    }
+    if (!config.snapshot_path.empty()) {
+        snapshot_ = std::make_shared<CacheSnapshot>(cache_, db_, config.snapshot_path,
+                                                     std::chrono::seconds(config.snapshot_interval_s));
+    }
+    if (!config.trace_file.empty()) {
+        trace_ = std::make_shared<TraceRecorder>(config.trace_file);
+    }
+    handler_ = std::make_shared<RequestHandler>(cache_, db_, write_behind_, config.negative_cache_size);
+    handler_->set_cache_bypass_bytes(config.cache_bypass_bytes);
+    handler_->set_cache_compression(config.cache_compress_bytes);
+    router_ = std::make_shared<Router>(handler_);
     
-    thread_pool_ = std::make_shared<ThreadPool>(num_threads);
-    cache_ = std::make_shared<LRUCache>(cache_size);
-    db_ = std::make_shared<Database>(db_connection);
-    handler_ = std::make_shared<RequestHandler>(cache_, db_);
+    if (config.frontend == "epoll") {
+        // Requests run on thread_pool_; the loop only does socket I/O
+        event_loop_.reset(new HttpLoopServer(thread_pool_, [this](const HttpRequest& req, HttpResponse& res) {
+            router_->route(req, res);
+        }));
+    } else {
+        if (config.frontend != "httplib") {
+            std::cerr << "Unknown front end '" << config.frontend << "', using httplib" << std::endl;
+        }
+        svr_.reset(new httplib::Server());
+    }
+    if (binary_port_ > 0) {
+        binary_.reset(new BinaryLoopServer(thread_pool_, handler_));
+    }
+}
+
+KVServer::~KVServer() {
+    stop();
 }
 
 bool KVServer::start() {
@@ -24,156 +120,393 @@ bool KVServer::start() {
     
     std::cout << "Connected to database successfully" << std::endl;
     
-    httplib::Server svr;
+    if (use_key_filter_ && !load_key_filter()) {
+        std::cerr << "Key filter disabled; missing keys will be looked up in the database" << std::endl;
+    }
     
-    svr.Get("/api/kv", [this](const httplib::Request& req, httplib::Response& res) {
-        auto key = req.get_param_value("key");
-        if (key.empty()) {
-            json error;
-            error["error"] = "Missing key parameter";
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
-            return;
-        }
-        
-        try {
-            std::string response = handler_->handle_get(key);
-            res.set_content(response, "application/json");
-            res.status = 200;
-        } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+    if (snapshot_) {
+        snapshot_->load();
+        snapshot_->start();
+        handler_->set_cache_snapshot(snapshot_);
+    }
+    
+    // After the key filter is loaded: swept keys are taken out of it
+    if (expiry_interval_.count() > 0) {
+        sweeper_ = std::make_shared<ExpirySweeper>(cache_, db_, key_filter_, expiry_interval_, expiry_batch_);
+        sweeper_->start();
+        handler_->set_expiry_sweeper(sweeper_);
+    }
+    
+    if (trace_ && !trace_->start()) {
+        trace_.reset();
+    }
+    if (trace_) {
+        handler_->set_trace_recorder(trace_);
+    }
+    
+    std::cout << "Starting KV Server on port " << port_ << " with " << num_threads_ << " threads" << std::endl;
+    CacheStats cache_stats = cache_->get_stats();
+    if (cache_stats.max_bytes > 0) {
+        std::cout << "Cache size: " << cache_stats.max_bytes << " bytes (" << cache_->get_policy() << ")" << std::endl;
+    } else {
+        std::cout << "Cache size: " << cache_stats.max_size << " entries (" << cache_->get_policy() << ")" << std::endl;
+    }
+    if (auto sharded = std::dynamic_pointer_cast<ShardedCache>(cache_)) {
+        std::cout << "Cache shards: " << sharded->get_num_shards() << std::endl;
+    }
+    if (auto database = std::dynamic_pointer_cast<Database>(db_)) {
+        std::cout << "Database pool size: " << database->get_pool_size() << " connections" << std::endl;
+        if (database->get_pipeline_connections() > 0) {
+            std::cout << "Database pipeline: " << database->get_pipeline_connections() << " connections" << std::endl;
         }
-    });
+    }
+    if (write_behind_) {
+        std::cout << "Write mode: write-behind" << std::endl;
+    }
+    std::cout << "Front end: " << (event_loop_ ? "epoll" : "httplib") << std::endl;
+    if (binary_) {
+        std::cout << "Binary protocol on port " << binary_port_ << std::endl;
+    }
+    if (trace_) {
+        std::cout << "Recording trace to " << trace_->get_path() << std::endl;
+    }
+    
+    double startup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - created_at_).count();
+    handler_->mark_ready(startup_ms);
+    std::cout << "Server ready in " << static_cast<long>(startup_ms) << " ms. Listening on http://0.0.0.0:"
+              << port_ << std::endl;
     
-    svr.Post("/api/kv", [this](const httplib::Request& req, httplib::Response& res) {
-        try {
-            json body = json::parse(req.body);
-            
-            if (!body.contains("key") || !body.contains("value")) {
-                json error;
-                error["error"] = "Missing key or value in request body";
-                res.set_content(error.dump(), "application/json");
-                res.status = 400;
-                return;
+    // The binary listener runs its own loop; stop() ends both
+    if (binary_) {
+        binary_thread_ = std::thread([this] {
+            if (!binary_->listen("0.0.0.0", binary_port_)) {
+                std::cerr << "Failed to start binary protocol on port " << binary_port_ << std::endl;
             }
-            
-            std::string key = body["key"].get<std::string>();
-            std::string value = body["value"].get<std::string>();
-            
-            std::string response = handler_->handle_post(key, value);
-            res.set_content(response, "application/json");
-            res.status = 200;
-        } catch (const json::exception& e) {
-            json error;
-            error["error"] = "Invalid JSON in request body";
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
-        } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
-        }
-    });
+        });
+    }
     
-    svr.Delete("/api/kv", [this](const httplib::Request& req, httplib::Response& res) {
-        auto key = req.get_param_value("key");
-        if (key.empty()) {
-            json error;
-            error["error"] = "Missing key parameter";
-            res.set_content(error.dump(), "application/json");
-            res.status = 400;
-            return;
-        }
+    // Start listening (blocking call)
+    bool listening = event_loop_ ? event_loop_->listen("0.0.0.0", port_) : listen_httplib();
+    if (binary_) {
+        binary_->stop();
+        binary_thread_.join();
+    }
+    
+    if (sweeper_) {
+        sweeper_->stop();
+    }
+    
+    // listen() returns once stop() (or SIGTERM) has shut the front end down
+    // and every request has finished. Once the write-behind queue has
+    // drained (dropping from the cache whatever it couldn't persist), the
+    // cache no longer changes.
+    if (write_behind_) {
+        write_behind_->stop();
+    }
+    if (snapshot_) {
+        snapshot_->stop(listening);
+    }
+    if (trace_) {
+        trace_->stop();
+    }
+    
+    if (!listening) {
+        std::cerr << "Failed to start server on port " << port_ << std::endl;
+        return false;
+    }
+    
+    return true;
+}
+
+bool KVServer::listen_httplib() {
+    httplib::Server& svr = *svr_;
+    
+    // Size httplib's worker pool from --threads so DB concurrency follows it
+    svr.new_task_queue = [this] { return new httplib::ThreadPool(num_threads_); };
+    
+    // Every path goes to the router, which answers unknown ones with 404
+    auto respond = [this](const HttpRequest& request, httplib::Response& res) {
+        HttpResponse response;
+        router_->route(request, response);
         
-        try {
-            std::string response = handler_->handle_delete(key);
-            res.set_content(response, "application/json");
-            res.status = 200;
-        } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+        res.status = response.status;
+        if (response.body_writer) {
+            // httplib applies Range headers itself, asking the provider for
+            // [offset, offset + length) of the whole value. A 206 body starts
+            // at range_offset of it; anything else is the whole value.
+            size_t full_length = response.status == 206 ? response.range_total : response.body_length;
+            res.set_content_provider(full_length, response.content_type,
+                [writer = response.body_writer, start = response.range_offset](size_t offset, size_t length,
+                                                                              httplib::DataSink& sink) {
+                    if (offset < start) {
+                        return false;
+                    }
+                    size_t skip = offset - start;
+                    return writer([&](const char* data, size_t size) {
+                        if (skip >= size) {
+                            skip -= size;
+                            return true;
+                        }
+                        size_t n = std::min(size - skip, length);
+                        bool ok = sink.write(data + skip, n);
+                        skip = 0;
+                        length -= n;
+                        return ok;
+                    });
+                });
+        } else {
+            res.set_content(response.body, response.content_type);
         }
-    });
-    
-    svr.Get("/api/stats", [this](const httplib::Request& req, httplib::Response& res) {
-        try {
-            std::string response = handler_->handle_stats();
-            res.set_content(response, "application/json");
-            res.status = 200;
-        } catch (const std::exception& e) {
-            json error;
-            error["error"] = e.what();
-            res.set_content(error.dump(), "application/json");
-            res.status = 500;
+        if (response.content_encoding) {
+            res.set_header("Content-Encoding", response.content_encoding);
         }
-    });
-    
-    svr.Get("/health", [](const httplib::Request& req, httplib::Response& res) {
-        json health;
-        health["status"] = "healthy";
-        res.set_content(health.dump(), "application/json");
-        res.status = 200;
-    });
+        if (response.status == 416) {
+            res.set_header("Content-Range", "bytes */" + std::to_string(response.range_total));
+        }
+    };
+    auto convert = [](const httplib::Request& req, HttpRequest& request) {
+        request.method = req.method;
+        request.path = req.path;
+        for (const auto& param : req.params) {
+            request.params.emplace(param.first, param.second);
+        }
+        request.accept = req.get_header_value("Accept");
+        request.range = req.get_header_value("Range");
+        request.accept_encoding = req.get_header_value("Accept-Encoding");
+    };
+    auto dispatch = [convert, respond](const httplib::Request& req, httplib::Response& res) {
+        HttpRequest request;
+        convert(req, request);
+        request.body = req.body;
+        respond(request, res);
+    };
     
-    svr.set_post_routing_handler([this](const httplib::Request& req, httplib::Response& res) {
-        // This allows us to use the thread pool for request handling
-    });
+    // Raw values are read from the socket straight into the request body,
+    // chunked or not, rather than into httplib's buffer and then copied
+    auto upload = [convert, respond](const httplib::Request& req, httplib::Response& res,
+                                     const httplib::ContentReader& content_reader) {
+        HttpRequest request;
+        convert(req, request);
+        if (req.has_header("Content-Length")) {
+            request.body.reserve(std::min<size_t>(std::strtoull(req.get_header_value("Content-Length").c_str(),
+                                                                nullptr, 10),
+                                                  kMaxRequestBodyBytes));
+        }
+        bool too_large = false;
+        content_reader([&](const char* data, size_t length) {
+            if (request.body.size() + length > kMaxRequestBodyBytes) {
+                too_large = true;
+                return false;
+            }
+            request.body.append(data, length);
+            return true;
+        });
+        if (too_large) {
+            res.status = 413;
+            res.set_content("{\"error\":\"Request body too large\"}", "application/json");
+            return;
+        }
+        respond(request, res);
+    };
+    svr.Put("/api/kv/raw", upload);
+    svr.Post("/api/kv/raw", upload);
+    svr.Get(".*", dispatch);
+    svr.Post(".*", dispatch);
+    svr.Delete(".*", dispatch);
     
-    std::cout << "Starting KV Server on port " << port_ << " with " << num_threads_ << " threads" << std::endl;
-    std::cout << "Cache size: " << cache_->get_max_size() << " entries" << std::endl;
-    std::cout << "Server ready. Listening on http://0.0.0.0:" << port_ << std::endl;
+    return svr.listen("0.0.0.0", port_);
+}
+
+bool KVServer::load_key_filter() {
+    long long rows = db_->count_keys();
+    if (rows < 0) {
+        return false;
+    }
     
-    // Start listening (blocking call)
-    if (!svr.listen("0.0.0.0", port_)) {
-        std::cerr << "Failed to start server on port " << port_ << std::endl;
+    // Sized with headroom for keys written after startup; the false
+    // positive rate creeps up once the table outgrows it
+    size_t capacity = std::max<size_t>(static_cast<size_t>(rows) * 2, kMinKeyFilterCapacity);
+    auto filter = std::make_shared<KeyFilter>(capacity);
+    size_t loaded = 0;
+    if (!db_->scan_keys([&](std::string_view key) {
+            filter->add(key);
+            loaded++;
+        })) {
         return false;
     }
     
+    key_filter_ = filter;
+    handler_->set_key_filter(filter);
+    std::cout << "Key filter loaded: " << loaded << " keys, " << filter->get_memory_bytes() / 1024
+              << " KB" << std::endl;
     return true;
 }
 
 void KVServer::stop() {
-    std::cout << "Stopping KV Server..." << std::endl;
+    std::call_once(stop_once_, [this] {
+        std::cout << "Stopping KV Server..." << std::endl;
+        if (event_loop_) {
+            event_loop_->stop();
+        } else {
+            svr_->stop();
+        }
+        if (binary_) {
+            binary_->stop();
+        }
+        
+        // Requests still in flight fall back to direct writes once this returns
+        if (write_behind_) {
+            write_behind_->stop();
+            std::cout << "Flushed write-behind queue" << std::endl;
+        }
+    });
+}
+
+// Parse a byte count with an optional K/M/G suffix (e.g. "64M")
+static size_t parse_bytes(const std::string& text) {
+    size_t pos = 0;
+    size_t value = std::stoull(text, &pos);
+    if (pos < text.size()) {
+        switch (text[pos]) {
+            case 'k': case 'K': value <<= 10; break;
+            case 'm': case 'M': value <<= 20; break;
+            case 'g': case 'G': value <<= 30; break;
+            default: throw std::invalid_argument("bad size suffix: " + text);
+        }
+    }
+    return value;
 }
 
 int main(int argc, char* argv[]) {
-    int port = 8080;
-    size_t num_threads = 4;
-    size_t cache_size = 1000;
-    std::string db_connection = "host=localhost user=postgres password=postgres dbname=kvstore";
+    ServerConfig config;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
         std::string arg = argv[i];
         if (arg == "--port" && i + 1 < argc) {
-            port = std::stoi(argv[++i]);
+            config.port = std::stoi(argv[++i]);
         } else if (arg == "--threads" && i + 1 < argc) {
-            num_threads = std::stoi(argv[++i]);
+            config.num_threads = std::stoi(argv[++i]);
         } else if (arg == "--cache-size" && i + 1 < argc) {
-            cache_size = std::stoi(argv[++i]);
+            config.cache_size = std::stoi(argv[++i]);
+        } else if (arg == "--cache-bytes" && i + 1 < argc) {
+            config.cache_bytes = parse_bytes(argv[++i]);
+        } else if (arg == "--cache-policy" && i + 1 < argc) {
+            config.cache_policy = argv[++i];
+        } else if (arg == "--cache-admission" && i + 1 < argc) {
+            config.cache_admission = argv[++i];
+        } else if (arg == "--cache-bypass-bytes" && i + 1 < argc) {
+            config.cache_bypass_bytes = parse_bytes(argv[++i]);
+        } else if (arg == "--cache-compress-bytes" && i + 1 < argc) {
+            config.cache_compress_bytes = parse_bytes(argv[++i]);
+        } else if (arg == "--cache-shards" && i + 1 < argc) {
+            config.cache_shards = std::stoi(argv[++i]);
+        } else if (arg == "--backend" && i + 1 < argc) {
+            config.backend = argv[++i];
+        } else if (arg == "--data-dir" && i + 1 < argc) {
+            config.data_dir = argv[++i];
+        } else if (arg == "--segment-size" && i + 1 < argc) {
+            config.segment_bytes = parse_bytes(argv[++i]);
+        } else if (arg == "--log-sync" && i + 1 < argc) {
+            config.log_sync = (std::string(argv[++i]) != "off");
+        } else if (arg == "--compact-threshold" && i + 1 < argc) {
+            config.compact_threshold = std::stod(argv[++i]);
         } else if (arg == "--db-conn" && i + 1 < argc) {
-            db_connection = argv[++i];
+            config.db_connection = argv[++i];
+        } else if (arg == "--db-pool-size" && i + 1 < argc) {
+            config.db_pool_size = std::stoi(argv[++i]);
+        } else if (arg == "--db-pipeline" && i + 1 < argc) {
+            config.db_pipeline = std::stoi(argv[++i]);
+        } else if (arg == "--write-mode" && i + 1 < argc) {
+            config.write_behind = (std::string(argv[++i]) == "behind");
+        } else if (arg == "--write-queue-size" && i + 1 < argc) {
+            config.write_queue_size = std::stoi(argv[++i]);
+        } else if (arg == "--flush-size" && i + 1 < argc) {
+            config.flush_size = std::stoi(argv[++i]);
+        } else if (arg == "--flush-interval-ms" && i + 1 < argc) {
+            config.flush_interval_ms = std::stoi(argv[++i]);
+        } else if (arg == "--key-filter" && i + 1 < argc) {
+            config.key_filter = (std::string(argv[++i]) == "on");
+        } else if (arg == "--negative-cache-size" && i + 1 < argc) {
+            config.negative_cache_size = std::stoi(argv[++i]);
+        } else if (arg == "--frontend" && i + 1 < argc) {
+            config.frontend = argv[++i];
+        } else if (arg == "--binary-port" && i + 1 < argc) {
+            config.binary_port = std::stoi(argv[++i]);
+        } else if (arg == "--snapshot-path" && i + 1 < argc) {
+            config.snapshot_path = argv[++i];
+        } else if (arg == "--snapshot-interval" && i + 1 < argc) {
+            config.snapshot_interval_s = std::stoi(argv[++i]);
+        } else if (arg == "--expiry-interval" && i + 1 < argc) {
+            config.expiry_interval_ms = std::stoi(argv[++i]);
+        } else if (arg == "--expiry-batch" && i + 1 < argc) {
+            config.expiry_batch = std::stoi(argv[++i]);
+        } else if (arg == "--trace-file" && i + 1 < argc) {
+            config.trace_file = argv[++i];
+        } else if (arg == "--pin-threads") {
+            config.pin_threads = true;
         } else if (arg == "--help") {
             std::cout << "Usage: kv_server [options]\n"
                       << "Options:\n"
                       << "  --port <port>              Server port (default: 8080)\n"
                       << "  --threads <num>            Number of worker threads (default: 4)\n"
+                      << "  --frontend <name>          httplib (thread per connection) or epoll (default: httplib)\n"
+                      << "  --pin-threads              Pin each worker thread to one CPU (epoll front end)\n"
+                      << "  --binary-port <port>       Also serve the binary protocol on this port (default: 0, off)\n"
                       << "  --cache-size <size>        Cache size in entries (default: 1000)\n"
+                      << "  --cache-bytes <size>       Cache capacity in bytes, e.g. 64M (overrides --cache-size)\n"
+                      << "  --cache-policy <policy>    Eviction policy: lru (exact) or clock (default: lru)\n"
+                      << "  --cache-admission <policy> Admission filter: none or tinylfu (default: none)\n"
+                      << "  --cache-shards <num>       Independently locked cache shards (default: 16)\n"
+                      << "  --cache-bypass-bytes <size> Never cache values larger than this, 0 = no limit (default: 1M)\n"
+                      << "  --cache-compress-bytes <size> Cache values this large gzip-compressed, 0 = off (default: 0)\n"
+                      << "  --backend <name>           postgres or local (log files under --data-dir) (default: postgres)\n"
+                      << "  --data-dir <dir>           Directory of the local backend (default: kv_data)\n"
+                      << "  --segment-size <size>      Local log segment size, e.g. 64M (default: 64M)\n"
+                      << "  --log-sync <on|off>        fdatasync local writes before acknowledging them (default: on)\n"
+                      << "  --compact-threshold <frac> Dead fraction at which a local segment is compacted (default: 0.5)\n"
                       << "  --db-conn <connection>     PostgreSQL connection string\n"
+                      << "  --db-pool-size <num>       Database connections in the pool (default: --threads)\n"
+                      << "  --db-pipeline <num>        Pipelined connections for single-key queries (default: 0, off)\n"
+                      << "  --write-mode <mode>        sync or behind (queue writes, persist in batches) (default: sync)\n"
+                      << "  --write-queue-size <num>   Max keys waiting in the write-behind queue (default: 10000)\n"
+                      << "  --flush-size <num>         Rows per write-behind batch (default: 500)\n"
+                      << "  --flush-interval-ms <ms>   Max time a write waits before flushing (default: 10)\n"
+                      << "  --key-filter <on|off>      Filter of stored keys; only if this server is kv_store's sole writer (default: off)\n"
+                      << "  --negative-cache-size <num> Missing keys remembered; only if this server is kv_store's sole writer (default: 0, off)\n"
+                      << "  --snapshot-path <file>     Cache snapshot for warm restarts (default: none)\n"
+                      << "  --snapshot-interval <sec>  Seconds between periodic snapshots, 0 = shutdown only (default: 300)\n"
+                      << "  --expiry-interval <ms>     Time between sweeps of expired keys, 0 = never (default: 1000)\n"
+                      << "  --expiry-batch <rows>      Expired rows deleted per statement (default: 1000)\n"
+                      << "  --trace-file <file>        Record key operations for load_generator --replay (default: none)\n"
                       << "  --help                     Show this help message\n";
             return 0;
         }
     }
     
-    KVServer server(port, num_threads, cache_size, db_connection);
+    // Route SIGINT/SIGTERM to a dedicated thread so shutdown can flush cleanly.
+    // Block them before any other thread starts so every thread inherits the mask.
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    
+    KVServer server(config);
+    std::thread signal_thread([&server, signals] {
+        int sig;
+        sigwait(&signals, &sig);
+        server.stop();
+    });
+    
+    bool started = server.start();
+    server.stop();
+    
+    // Release the signal thread if no signal arrived
+    kill(getpid(), SIGTERM);
+    signal_thread.join();
     
-    if (!server.start()) {
+    if (!started) {
         std::cerr << "Failed to start server" << std::endl;
         return 1;
     }
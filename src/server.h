@@ -3,28 +3,119 @@
 
 #include "thread_pool.h"
 #include "cache.h"
+#include "sharded_cache.h"
+#include "clock_cache.h"
 #include "database.h"
+#include "log_store.h"
 #include "request_handler.h"
+#include "write_behind.h"
+#include "router.h"
+#include "http_loop_server.h"
+#include "binary_loop_server.h"
+#include "cache_snapshot.h"
+#include "expiry_sweeper.h"
+#include "trace_recorder.h"
 #include <memory>
 #include <string>
+#include <mutex>
+#include <chrono>
+#include <thread>
+
+namespace httplib {
+class Server;
+}
+
+struct ServerConfig {
+    int port = 8080;
+    size_t num_threads = 4;
+    std::string frontend = "httplib";  // "httplib" or "epoll"
+    bool pin_threads = false;          // Pin ThreadPool workers to CPUs
+    int binary_port = 0;               // Binary protocol listener (0 = off)
+    size_t cache_size = 1000;
+    size_t cache_bytes = 0;  // Non-zero switches capacity from entries to bytes
+    size_t cache_shards = 16;
+    std::string cache_policy = "lru";  // "lru" or "clock"
+    std::string cache_admission = "none";  // "none" or "tinylfu" (lru only)
+    size_t cache_bypass_bytes = 1 << 20;   // Larger values are never cached (0 = cache any size)
+    size_t cache_compress_bytes = 0;       // Values this large are cached gzip-compressed (0 = never)
+    // "postgres", or "local" to keep keys in log-structured files under data_dir
+    std::string backend = "postgres";
+    std::string data_dir = "kv_data";
+    size_t segment_bytes = 64 << 20;   // Local segment file size before rolling to a new one
+    bool log_sync = true;              // fdatasync each local group commit before acknowledging it
+    double compact_threshold = 0.5;    // Dead fraction at which a local segment is compacted
+    size_t db_pool_size = 0;  // 0 = one connection per worker thread (or per pipeline connection)
+    size_t db_pipeline = 0;   // Pipelined connections for single-key queries (0 = off)
+    std::string db_connection = "host=localhost user=postgres password=postgres dbname=kvstore";
+    
+    // Write-behind mode: acknowledge writes once queued, persist in batches
+    bool write_behind = false;
+    size_t write_queue_size = 10000;  // Max distinct keys waiting to be written
+    size_t flush_size = 500;          // Rows per batched statement
+    size_t flush_interval_ms = 10;
+    
+    // Answer GETs for missing keys from memory. Both off unless asked for:
+    // they assume this server is the only writer to kv_store.
+    bool key_filter = false;
+    size_t negative_cache_size = 0;  // Missing keys remembered (0 disables)
+    
+    // Cache snapshot for warm restarts; written at shutdown and every
+    // snapshot_interval_s (0 = only at shutdown). Empty path disables.
+    std::string snapshot_path;
+    size_t snapshot_interval_s = 300;
+    
+    // Keys with a TTL: how often expired ones are swept from the cache and
+    // the database (0 = never; reads still skip them), and rows deleted
+    // per statement
+    size_t expiry_interval_ms = 1000;
+    size_t expiry_batch = 1000;
+    
+    // Record every key operation to this file for replay by the load
+    // generator. Empty disables.
+    std::string trace_file;
+};
 
 class KVServer {
 public:
-    KVServer(int port, size_t num_threads, size_t cache_size, const std::string& db_connection);
+    explicit KVServer(const ServerConfig& config);
+    ~KVServer();
     
-    // Start the server
+    // Start the server (blocks until stop() is called)
     bool start();
     
-    // Stop the server
+    // Stop the server: stop accepting requests and flush queued writes.
+    // Safe to call from another thread and more than once.
     void stop();
     
 private:
+    // Smallest key filter built at startup, leaving room for new keys
+    static constexpr size_t kMinKeyFilterCapacity = 1 << 20;
+    
     int port_;
+    int binary_port_;
     size_t num_threads_;
     std::shared_ptr<ThreadPool> thread_pool_;
-    std::shared_ptr<LRUCache> cache_;
-    std::shared_ptr<Database> db_;
+    std::shared_ptr<Cache> cache_;
+    std::shared_ptr<StorageBackend> db_;
+    std::shared_ptr<WriteBehindQueue> write_behind_;
+    std::shared_ptr<CacheSnapshot> snapshot_;
+    std::shared_ptr<KeyFilter> key_filter_;
+    std::shared_ptr<ExpirySweeper> sweeper_;
+    std::shared_ptr<TraceRecorder> trace_;
     std::shared_ptr<RequestHandler> handler_;
+    std::shared_ptr<Router> router_;
+    std::unique_ptr<httplib::Server> svr_;           // httplib front end
+    std::unique_ptr<EventLoopServer> event_loop_;    // epoll front end
+    std::unique_ptr<EventLoopServer> binary_;        // Binary protocol listener
+    std::thread binary_thread_;
+    bool use_key_filter_;
+    std::chrono::milliseconds expiry_interval_;
+    size_t expiry_batch_;
+    std::chrono::steady_clock::time_point created_at_;
+    std::once_flag stop_once_;
+    
+    bool load_key_filter();
+    bool listen_httplib();
 };
 
 #endif // SERVER_H
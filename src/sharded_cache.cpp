@@ -0,0 +1,95 @@
+#include "sharded_cache.h"
+#include <algorithm>
+
+ShardedCache::ShardedCache(size_t max_size, size_t max_bytes, size_t num_shards, ShardFactory make_shard)
+    : max_size_(max_size), shard_bits_(0) {
+    if (!make_shard) {
+        make_shard = [](size_t shard_size, size_t shard_bytes) {
+            return std::unique_ptr<Cache>(new LRUCache(shard_size, shard_bytes));
+        };
+    }
+    
+    size_t max_shards = max_bytes > 0 ? max_bytes / kMinShardBytes : max_size / kMinShardCapacity;
+    max_shards = std::max<size_t>(1, max_shards);
+    while ((size_t(1) << shard_bits_) < num_shards &&
+           (size_t(1) << (shard_bits_ + 1)) <= max_shards) {
+        shard_bits_++;
+    }
+    
+    size_t count = size_t(1) << shard_bits_;
+    for (size_t i = 0; i < count; ++i) {
+        // Spread the remainder so shard capacities add up to the total
+        size_t shard_size = max_size / count + (i < max_size % count ? 1 : 0);
+        size_t shard_bytes = max_bytes / count + (i < max_bytes % count ? 1 : 0);
+        shards_.push_back(make_shard(shard_size, shard_bytes));
+    }
+}
+
+Cache& ShardedCache::shard_for(std::string_view key) {
+    if (shard_bits_ == 0) {
+        return *shards_[0];
+    }
+    // Take the high bits of a remixed hash; the shard's own hash map uses
+    // the low bits of std::hash, so the two choices stay independent
+    uint64_t h = std::hash<std::string_view>{}(key) * 0x9E3779B97F4A7C15ULL;
+    return *shards_[h >> (64 - shard_bits_)];
+}
+
+CacheValue ShardedCache::get(const std::string& key) {
+    return shard_for(key).get(key);
+}
+
+void ShardedCache::put(const std::string& key, const std::string& value, size_t raw_size, uint64_t expires_at) {
+    shard_for(key).put(key, value, raw_size, expires_at);
+}
+
+bool ShardedCache::remove(const std::string& key) {
+    return shard_for(key).remove(key);
+}
+
+bool ShardedCache::exists(const std::string& key) {
+    return shard_for(key).exists(key);
+}
+
+void ShardedCache::collect_entries(std::vector<CacheValue>& entries) {
+    std::vector<std::vector<CacheValue>> per_shard(shards_.size());
+    size_t longest = 0;
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        shards_[i]->collect_entries(per_shard[i]);
+        longest = std::max(longest, per_shard[i].size());
+    }
+    
+    for (size_t rank = 0; rank < longest; ++rank) {
+        for (auto& shard_entries : per_shard) {
+            if (rank < shard_entries.size()) {
+                entries.push_back(std::move(shard_entries[rank]));
+            }
+        }
+    }
+}
+
+bool ShardedCache::restore(std::string_view key, std::string_view value, size_t raw_size, uint64_t expires_at) {
+    return shard_for(key).restore(key, value, raw_size, expires_at);
+}
+
+size_t ShardedCache::expire(uint64_t now) {
+    size_t expired = 0;
+    for (auto& shard : shards_) {
+        expired += shard->expire(now);
+    }
+    return expired;
+}
+
+CacheStats ShardedCache::get_stats() const {
+    CacheStats total;
+    for (const auto& shard : shards_) {
+        total += shard->get_stats();
+    }
+    return total;
+}
+
+void ShardedCache::reset_stats() {
+    for (auto& shard : shards_) {
+        shard->reset_stats();
+    }
+}
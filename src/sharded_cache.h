@@ -0,0 +1,53 @@
+#ifndef SHARDED_CACHE_H
+#define SHARDED_CACHE_H
+
+#include "cache.h"
+#include <vector>
+#include <functional>
+
+// Splits the key space across independent caches, each with its own lock,
+// so concurrent requests for different keys rarely contend.
+class ShardedCache : public Cache {
+public:
+    // Factory used to build each shard from its share of the capacity
+    using ShardFactory = std::function<std::unique_ptr<Cache>(size_t max_size, size_t max_bytes)>;
+    
+    // num_shards is rounded up to a power of two and reduced so that every
+    // shard keeps at least kMinShardCapacity entries (or kMinShardBytes)
+    ShardedCache(size_t max_size, size_t max_bytes, size_t num_shards, ShardFactory make_shard = nullptr);
+    
+    CacheValue get(const std::string& key) override;
+    void put(const std::string& key, const std::string& value, size_t raw_size = 0,
+             uint64_t expires_at = 0) override;
+    bool remove(const std::string& key) override;
+    bool exists(const std::string& key) override;
+    
+    // Interleaves the shards' lists, so the result is ordered by recency
+    // rank within a shard
+    void collect_entries(std::vector<CacheValue>& entries) override;
+    bool restore(std::string_view key, std::string_view value, size_t raw_size = 0,
+                 uint64_t expires_at = 0) override;
+    
+    // Each shard advances its own timer wheel
+    size_t expire(uint64_t now) override;
+    
+    // Per-shard statistics summed across all shards
+    CacheStats get_stats() const override;
+    size_t get_max_size() const override { return max_size_; }
+    void reset_stats() override;
+    std::string get_policy() const override { return shards_[0]->get_policy(); }
+    
+    size_t get_num_shards() const { return shards_.size(); }
+    
+    static constexpr size_t kMinShardCapacity = 64;
+    static constexpr size_t kMinShardBytes = 256 * 1024;
+    
+private:
+    size_t max_size_;
+    unsigned shard_bits_;
+    std::vector<std::unique_ptr<Cache>> shards_;
+    
+    Cache& shard_for(std::string_view key);
+};
+
+#endif // SHARDED_CACHE_H
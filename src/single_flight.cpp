@@ -0,0 +1,53 @@
+#include "single_flight.h"
+
+std::shared_ptr<std::string> SingleFlight::load(const std::string& key, const Loader& loader) {
+    std::shared_ptr<Call> call;
+    bool leader = false;
+    {
+        std::unique_lock<std::mutex> lock(flights_mutex_);
+        auto it = in_flight_.find(key);
+        if (it != in_flight_.end()) {
+            call = it->second;
+        } else {
+            call = std::make_shared<Call>();
+            in_flight_.emplace(key, call);
+            leader = true;
+        }
+    }
+    
+    if (!leader) {
+        shared_loads_.fetch_add(1, std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(call->mutex);
+        call->done_cv.wait(lock, [&call] { return call->done; });
+        if (call->error) {
+            std::rethrow_exception(call->error);
+        }
+        return call->value;
+    }
+    
+    std::shared_ptr<std::string> value;
+    std::exception_ptr error;
+    try {
+        value = loader();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    
+    // Unregister first so later misses start a fresh load, then wake waiters
+    {
+        std::unique_lock<std::mutex> lock(flights_mutex_);
+        in_flight_.erase(key);
+    }
+    {
+        std::unique_lock<std::mutex> lock(call->mutex);
+        call->value = value;
+        call->error = error;
+        call->done = true;
+    }
+    call->done_cv.notify_all();
+    
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return value;
+}
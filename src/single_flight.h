@@ -0,0 +1,42 @@
+#ifndef SINGLE_FLIGHT_H
+#define SINGLE_FLIGHT_H
+
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <atomic>
+#include <cstdint>
+
+// Collapses concurrent loads of the same key into one. The first caller runs
+// the loader; callers arriving while it is in flight wait for and share its
+// result instead of issuing their own database read.
+class SingleFlight {
+public:
+    using Loader = std::function<std::shared_ptr<std::string>()>;
+    
+    // Load `key`, or join a load already in progress. Exceptions thrown by
+    // the loader are rethrown in every caller that shared it.
+    std::shared_ptr<std::string> load(const std::string& key, const Loader& loader);
+    
+    // Loads that were answered by another caller's in-flight load
+    uint64_t get_shared_loads() const { return shared_loads_.load(std::memory_order_relaxed); }
+    
+private:
+    struct Call {
+        std::mutex mutex;
+        std::condition_variable done_cv;
+        bool done = false;
+        std::shared_ptr<std::string> value;
+        std::exception_ptr error;
+    };
+    
+    std::mutex flights_mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Call>> in_flight_;
+    std::atomic<uint64_t> shared_loads_{0};
+};
+
+#endif // SINGLE_FLIGHT_H
@@ -0,0 +1,177 @@
+#include "slab_allocator.h"
+#include <algorithm>
+#include <new>
+
+SlabAllocator::SlabAllocator(size_t page_size) : page_size_(kMinPageSize) {
+    // A power of two, so a chunk's page is found by masking its address
+    while (page_size_ < page_size) {
+        page_size_ *= 2;
+    }
+    // 64, 80, 100, ... up to the page size, each rounded up to 8-byte alignment
+    double size = kMinChunkSize;
+    while (size < page_size_) {
+        size_t aligned = (static_cast<size_t>(size) + 7) & ~size_t(7);
+        if (class_sizes_.empty() || aligned > class_sizes_.back()) {
+            class_sizes_.push_back(aligned);
+        }
+        size *= kGrowthFactor;
+    }
+    class_sizes_.push_back(page_size_);
+    pages_with_room_.assign(class_sizes_.size(), nullptr);
+    empty_pages_.assign(class_sizes_.size(), nullptr);
+}
+
+size_t SlabAllocator::page_size_for_budget(size_t max_bytes) {
+    if (max_bytes == 0) {
+        return kDefaultPageSize;
+    }
+    // Keep all pages of a fully spread-out cache within about half the budget
+    size_t page = kMinPageSize;
+    while (page < kDefaultPageSize && page * 64 <= max_bytes) {
+        page *= 2;
+    }
+    return page;
+}
+
+int SlabAllocator::class_for(size_t size) const {
+    auto it = std::lower_bound(class_sizes_.begin(), class_sizes_.end(), size);
+    if (it == class_sizes_.end()) {
+        return -1;  // Large allocation
+    }
+    return static_cast<int>(it - class_sizes_.begin());
+}
+
+size_t SlabAllocator::chunk_size_for(size_t size) const {
+    int size_class = class_for(size);
+    return size_class < 0 ? size : class_sizes_[size_class];
+}
+
+SlabAllocator::~SlabAllocator() {
+    for (auto& entry : pages_) {
+        ::operator delete(entry.second.memory, std::align_val_t(page_size_));
+    }
+}
+
+void SlabAllocator::link_room(Page* page) {
+    Page*& head = pages_with_room_[page->size_class];
+    page->prev = nullptr;
+    page->next = head;
+    if (head != nullptr) {
+        head->prev = page;
+    }
+    head = page;
+}
+
+void SlabAllocator::unlink_room(Page* page) {
+    if (page->prev != nullptr) {
+        page->prev->next = page->next;
+    } else {
+        pages_with_room_[page->size_class] = page->next;
+    }
+    if (page->next != nullptr) {
+        page->next->prev = page->prev;
+    }
+    page->prev = nullptr;
+    page->next = nullptr;
+}
+
+SlabAllocator::Page* SlabAllocator::grow(int size_class) {
+    // Chunks are carved off as they are needed, so a fresh page costs no
+    // more than the allocation
+    char* memory = static_cast<char*>(::operator new(page_size_, std::align_val_t(page_size_)));
+    Page& page = pages_[memory];
+    page.memory = memory;
+    page.size_class = size_class;
+    reserved_bytes_ += page_size_;
+    link_room(&page);
+    return &page;
+}
+
+void SlabAllocator::release(Page* page) {
+    unlink_room(page);
+    char* memory = page->memory;
+    pages_.erase(memory);
+    ::operator delete(memory, std::align_val_t(page_size_));
+    reserved_bytes_ -= page_size_;
+}
+
+void* SlabAllocator::allocate(size_t size, size_t& chunk_size) {
+    int size_class = class_for(size);
+    if (size_class < 0) {
+        chunk_size = size;
+        used_bytes_ += size;
+        reserved_bytes_ += size;
+        return ::operator new(size);
+    }
+    
+    std::unique_lock<std::mutex> lock(slab_mutex_);
+    Page* page = pages_with_room_[size_class];
+    if (page == nullptr) {
+        page = grow(size_class);
+    }
+    
+    chunk_size = class_sizes_[size_class];
+    void* chunk;
+    if (page->free != nullptr) {
+        chunk = page->free;
+        page->free = page->free->next;
+    } else {
+        chunk = page->memory + page->carved * chunk_size;
+        page->carved++;
+    }
+    if (page->live++ == 0 && empty_pages_[size_class] == page) {
+        empty_pages_[size_class] = nullptr;
+    }
+    if (page->free == nullptr && page->carved == page_size_ / chunk_size) {
+        unlink_room(page);  // Full
+    }
+    used_bytes_ += chunk_size;
+    return chunk;
+}
+
+void SlabAllocator::deallocate(void* ptr, size_t chunk_size) {
+    if (ptr == nullptr) return;
+    
+    used_bytes_ -= chunk_size;
+    if (chunk_size > page_size_) {
+        reserved_bytes_ -= chunk_size;
+        ::operator delete(ptr);
+        return;
+    }
+    
+    auto* base = reinterpret_cast<const char*>(reinterpret_cast<uintptr_t>(ptr) & ~(page_size_ - 1));
+    std::unique_lock<std::mutex> lock(slab_mutex_);
+    Page* page = &pages_.find(base)->second;
+    bool was_full = page->free == nullptr && page->carved == page_size_ / chunk_size;
+    auto* node = static_cast<FreeChunk*>(ptr);
+    node->next = page->free;
+    page->free = node;
+    page->live--;
+    if (was_full) {
+        link_room(page);
+    }
+    if (page->live == 0) {
+        // Keep one empty page per class, so a class that drops to no live
+        // chunks and back (its only entry being replaced) doesn't free and
+        // allocate a page each time
+        Page*& empty = empty_pages_[page->size_class];
+        if (empty == nullptr) {
+            empty = page;
+        } else {
+            release(page);
+        }
+    }
+}
+
+size_t SlabAllocator::trim() {
+    std::unique_lock<std::mutex> lock(slab_mutex_);
+    size_t released = 0;
+    for (Page*& empty : empty_pages_) {
+        if (empty != nullptr) {
+            release(empty);
+            empty = nullptr;
+            released += page_size_;
+        }
+    }
+    return released;
+}
@@ -0,0 +1,101 @@
+#ifndef SLAB_ALLOCATOR_H
+#define SLAB_ALLOCATOR_H
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Size-class slab allocator for cache entries.
+// Memory is reserved in fixed pages, each carved into equal chunks of one
+// size class. Freed chunks go back to their page's free list and are reused
+// by the next allocation of that class, so churn does not fragment the heap
+// and the footprint only grows when the working set does. Each class keeps
+// at most one page with no live chunks for reuse; further empty pages go
+// back to the system at once, and the kept ones on trim(), so when the mix
+// of entry sizes shifts, memory moves to the classes now in use instead of
+// staying pinned to the old ones. Requests larger than a page fall through
+// to operator new.
+// Thread-safe: chunks may be released by whichever thread drops the last
+// reference to a cached value, not only by the owning cache.
+class SlabAllocator {
+public:
+    static constexpr size_t kDefaultPageSize = 64 * 1024;
+    static constexpr size_t kMinPageSize = 4 * 1024;
+    static constexpr size_t kMinChunkSize = 64;
+    static constexpr double kGrowthFactor = 1.25;
+    
+    explicit SlabAllocator(size_t page_size = kDefaultPageSize);
+    ~SlabAllocator();
+    
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+    
+    // Allocate at least `size` bytes; chunk_size receives the bytes actually reserved
+    void* allocate(size_t size, size_t& chunk_size);
+    
+    // Return a chunk; chunk_size must be the value reported by allocate()
+    void deallocate(void* ptr, size_t chunk_size);
+    
+    // Return the empty pages kept for reuse to the system, returning how
+    // many bytes that released
+    size_t trim();
+    
+    // Bytes handed out in chunks (including size-class rounding)
+    size_t get_used_bytes() const { return used_bytes_.load(std::memory_order_relaxed); }
+    
+    // Bytes held from the system: slab pages (with live chunks or kept
+    // for reuse) plus live large allocations
+    size_t get_reserved_bytes() const { return reserved_bytes_.load(std::memory_order_relaxed); }
+    
+    // Bytes of chunks that their owner has let go of but that are still in
+    // use elsewhere, so evicting more would not shrink the reservation
+    size_t get_pinned_bytes() const { return pinned_bytes_.load(std::memory_order_relaxed); }
+    void pin(size_t chunk_size) { pinned_bytes_.fetch_add(chunk_size, std::memory_order_relaxed); }
+    void unpin(size_t chunk_size) { pinned_bytes_.fetch_sub(chunk_size, std::memory_order_relaxed); }
+    
+    // Chunk size that an allocation of `size` bytes would occupy
+    size_t chunk_size_for(size_t size) const;
+    
+    // A power of two; pages are aligned to it
+    size_t get_page_size() const { return page_size_; }
+    
+    // Page size for a cache with the given byte budget. Every size class in
+    // use pins at least one page, so small budgets get small pages.
+    static size_t page_size_for_budget(size_t max_bytes);
+    
+private:
+    struct FreeChunk {
+        FreeChunk* next;
+    };
+    
+    struct Page {
+        char* memory;
+        int size_class;
+        size_t live = 0;              // Chunks handed out
+        size_t carved = 0;            // Chunks ever handed out; the rest is untouched
+        FreeChunk* free = nullptr;    // Chunks returned
+        Page* prev = nullptr;         // In its class's list of pages with room
+        Page* next = nullptr;
+    };
+    
+    size_t page_size_;
+    std::vector<size_t> class_sizes_;     // ascending, last == page_size_
+    std::vector<Page*> pages_with_room_;  // one list per size class
+    std::vector<Page*> empty_pages_;      // per size class; also in pages_with_room_
+    std::unordered_map<const char*, Page> pages_;  // by address
+    std::mutex slab_mutex_;
+    std::atomic<size_t> used_bytes_{0};
+    std::atomic<size_t> reserved_bytes_{0};
+    std::atomic<size_t> pinned_bytes_{0};
+    
+    int class_for(size_t size) const;
+    Page* grow(int size_class);
+    void release(Page* page);
+    void link_room(Page* page);
+    void unlink_room(Page* page);
+};
+
+#endif // SLAB_ALLOCATOR_H
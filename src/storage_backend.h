@@ -0,0 +1,110 @@
+#ifndef STORAGE_BACKEND_H
+#define STORAGE_BACKEND_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include "expiry.h"
+
+// Persistent store behind the cache. The server runs on Database
+// (PostgreSQL, the default) or LogStore (local segment files, --backend
+// local); the request handler, write-behind queue, expiry sweeper and cache
+// snapshot only see this interface, so they can run against other stores
+// too (the benchmarks use an in-memory one).
+class StorageBackend {
+public:
+    virtual ~StorageBackend() = default;
+
+    virtual bool connect() = 0;
+    virtual void disconnect() = 0;
+    virtual bool is_connected() const = 0;
+
+    // Whether the store answers right now. Tells a write the store rejects
+    // from one that failed because the store is unreachable.
+    virtual bool ping() { return is_connected(); }
+
+    // `inserted` reports whether create added a new key (rather than
+    // overwriting one); `deleted` whether delete_key removed one. read
+    // returns nullptr both for a missing key and on error; `failed` tells
+    // the two apart.
+    //
+    // A non-zero expires_at (see expiry.h) makes the key read as missing
+    // from that time on; writing a key replaces its expiry time, so a
+    // write without one makes the key permanent. Reads report the expiry
+    // time of what they return in `expires_at` (0 for none).
+    virtual bool create(const std::string& key, const std::string& value, bool* inserted = nullptr,
+                        uint64_t expires_at = 0) = 0;
+    virtual std::shared_ptr<std::string> read(const std::string& key, bool* failed = nullptr,
+                                              uint64_t* expires_at = nullptr) = 0;
+    virtual bool delete_key(const std::string& key, bool* deleted = nullptr) = 0;
+    
+    // Bytes [offset, offset + length) of a value, cut short at its end
+    // (empty past it), and the value's full size in `total`, both from the
+    // same version. nullptr like read. Backends that can read part of a
+    // value override this; the default reads all of it.
+    virtual std::shared_ptr<std::string> read_range(const std::string& key, uint64_t offset, uint64_t length,
+                                                    uint64_t* total, bool* failed = nullptr,
+                                                    uint64_t* expires_at = nullptr) {
+        std::shared_ptr<std::string> value = read(key, failed, expires_at);
+        if (!value) {
+            return nullptr;
+        }
+        *total = value->size();
+        return std::make_shared<std::string>(offset < value->size() ? value->substr(offset, length) : std::string());
+    }
+
+    // Read without waiting for the store. `done` runs once with what read
+    // would have returned; backends that can't overlap reads run it before
+    // returning. reads_async() says whether this one can.
+    using ReadCallback = std::function<void(std::shared_ptr<std::string> value, bool failed, uint64_t expires_at)>;
+    virtual void read_async(const std::string& key, ReadCallback done) {
+        bool failed = false;
+        uint64_t expires_at = 0;
+        std::shared_ptr<std::string> value = read(key, &failed, &expires_at);
+        done(std::move(value), failed, expires_at);
+    }
+    virtual bool reads_async() const { return false; }
+
+    // values[i] receives the value of keys[i], or nullptr if it is missing,
+    // and (*expires_at)[i] its expiry time
+    virtual bool read_many(const std::vector<std::string>& keys,
+                           std::vector<std::shared_ptr<std::string>>& values,
+                           std::vector<uint64_t>* expires_at = nullptr) = 0;
+
+    // Keys within a batch must be unique. `overwritten` receives the keys
+    // that already existed; `deleted` the keys that were removed. When
+    // given, (*expires_at)[i] is the expiry time of items[i].
+    virtual bool create_many(const std::vector<std::pair<std::string, std::string>>& items,
+                             std::vector<std::string>* overwritten = nullptr,
+                             const std::vector<uint64_t>* expires_at = nullptr) = 0;
+    virtual bool delete_many(const std::vector<std::string>& keys, std::vector<std::string>* deleted = nullptr) = 0;
+
+    // Remove up to `limit` keys whose expiry time has passed, appending
+    // them to `deleted`. Called periodically by the expiry sweeper, so
+    // expired keys don't stay on disk until someone overwrites them.
+    virtual bool delete_expired(size_t limit, std::vector<std::string>& deleted) {
+        (void)limit;
+        (void)deleted;
+        return true;
+    }
+
+    // Number of stored keys, or -1 on failure
+    virtual long long count_keys() = 0;
+
+    // Stream every stored key to `fn` without buffering them all
+    virtual bool scan_keys(const std::function<void(std::string_view)>& fn) = 0;
+
+    // Backend-specific counters reported by /api/stats
+    virtual void get_stats(std::vector<std::pair<std::string, uint64_t>>& stats) const {
+        (void)stats;
+    }
+
+    // Largest batch passed to read_many, create_many or delete_many
+    static constexpr size_t kMaxBatchRows = 10000;
+};
+
+#endif // STORAGE_BACKEND_H
@@ -1,16 +1,76 @@
 #include "thread_pool.h"
+#include <stdexcept>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <cstdint>
+#include <algorithm>
 
-ThreadPool::ThreadPool(size_t num_threads) 
-    : num_threads_(num_threads), stop_(false) {
-    for (size_t i = 0; i < num_threads; ++i) {
-        workers_.emplace_back([this] { worker_thread(); });
+ThreadPool::WorkQueue::WorkQueue(size_t capacity)
+    : cells_(new Cell[capacity]), mask_(capacity - 1) {
+    for (size_t i = 0; i < capacity; ++i) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool ThreadPool::WorkQueue::try_push(Task& task) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells_[pos & mask_];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.task = std::move(task);
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Full
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool ThreadPool::WorkQueue::try_pop(Task& task) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells_[pos & mask_];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                task = std::move(cell.task);
+                cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Empty
+        } else {
+            pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Index of the calling thread's queue, if it is a worker of this pool
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local size_t current_index = 0;
+
+ThreadPool::ThreadPool(size_t num_threads, bool pin_threads)
+    : num_threads_(std::max<size_t>(num_threads, 1)) {
+    for (size_t i = 0; i < num_threads_; ++i) {
+        queues_.emplace_back(new WorkQueue(kQueueCapacity));
+    }
+    for (size_t i = 0; i < num_threads_; ++i) {
+        workers_.emplace_back([this, i, pin_threads] { worker_thread(i, pin_threads); });
     }
 }
 
 ThreadPool::~ThreadPool() {
     {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
-        stop_ = true;
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        stop_.store(true);
     }
     condition_.notify_all();
     for (auto& worker : workers_) {
@@ -20,31 +80,99 @@ ThreadPool::~ThreadPool() {
     }
 }
 
-void ThreadPool::enqueue(std::function<void()> task) {
-    {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
-        if (stop_) {
-            throw std::runtime_error("ThreadPool is stopped");
+void ThreadPool::enqueue(Task task) {
+    if (stop_.load(std::memory_order_relaxed)) {
+        throw std::runtime_error("ThreadPool is stopped");
+    }
+
+    // Counted before it is visible so a taker never sees it uncounted.
+    // Pairs with the sleeper's increment of sleepers_ and recheck of
+    // pending_: one of the two sides always sees the other.
+    pending_.fetch_add(1);
+
+    // A worker keeps the tasks it spawns; anyone else deals round-robin.
+    // A full queue passes the task on to the next one.
+    size_t index = (current_pool == this) ? current_index
+                 : next_queue_.fetch_add(1, std::memory_order_relaxed) % num_threads_;
+    bool queued = queues_[index]->try_push(task);
+    for (size_t i = 1; !queued && i < num_threads_; ++i) {
+        queued = queues_[(index + i) % num_threads_]->try_push(task);
+    }
+    if (!queued) {
+        std::unique_lock<std::mutex> lock(overflow_mutex_);
+        overflow_.push_back(std::move(task));
+        overflow_size_.fetch_add(1, std::memory_order_release);
+    }
+
+    if (sleepers_.load() > 0) {
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        condition_.notify_one();
+    }
+}
+
+bool ThreadPool::try_take(size_t index, Task& task) {
+    if (queues_[index]->try_pop(task)) {
+        return true;
+    }
+    for (size_t i = 1; i < num_threads_; ++i) {
+        if (queues_[(index + i) % num_threads_]->try_pop(task)) {
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
         }
-        tasks_.push(task);
     }
-    condition_.notify_one();
+    if (overflow_size_.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(overflow_mutex_);
+    if (overflow_.empty()) {
+        return false;
+    }
+    task = std::move(overflow_.front());
+    overflow_.pop_front();
+    overflow_size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
 }
 
-void ThreadPool::worker_thread() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(queue_mutex_);
-        condition_.wait(lock, [this] { return !tasks_.empty() || stop_; });
-        
-        if (stop_ && tasks_.empty()) {
-            break;
+void ThreadPool::worker_thread(size_t index, bool pin) {
+    current_pool = this;
+    current_index = index;
+
+    if (pin) {
+        unsigned cpus = std::thread::hardware_concurrency();
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % (cpus > 0 ? cpus : 1), &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            std::cerr << "Could not pin worker " << index << " to a CPU" << std::endl;
         }
-        
-        if (!tasks_.empty()) {
-            auto task = std::move(tasks_.front());
-            tasks_.pop();
-            lock.unlock();
+    }
+
+    Task task;
+    int idle_rounds = 0;
+    while (true) {
+        if (try_take(index, task)) {
+            pending_.fetch_sub(1, std::memory_order_relaxed);
+            idle_rounds = 0;
             task();
+            task.reset();
+            continue;
+        }
+
+        // pending_ counts a task before its push lands; spin on it rather
+        // than sleeping
+        if (++idle_rounds < kSpinRounds || pending_.load(std::memory_order_relaxed) > 0) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleepers_.fetch_add(1);
+        condition_.wait(lock, [this] { return pending_.load() > 0 || stop_.load(); });
+        sleepers_.fetch_sub(1);
+        // Drain everything that was queued before stopping
+        if (stop_.load() && pending_.load() == 0) {
+            break;
         }
+        idle_rounds = 0;
     }
 }
@@ -2,33 +2,179 @@
 #define THREAD_POOL_H
 
 #include <vector>
-#include <queue>
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
-#include <functional>
+#include <atomic>
 #include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
 
+// Move-only callable. Callables up to kInlineSize bytes are stored in place,
+// so submitting a lambda with a few captures doesn't allocate; larger ones
+// fall back to the heap.
+class Task {
+public:
+    static constexpr size_t kInlineSize = 64;
+
+    Task() = default;
+
+    template <typename F, typename = typename std::enable_if<
+                              !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& fn) {
+        using Fn = typename std::decay<F>::type;
+        if constexpr (fits_inline<Fn>()) {
+            new (storage_) Fn(std::forward<F>(fn));
+            ops_ = &inline_ops<Fn>;
+        } else {
+            *reinterpret_cast<Fn**>(storage_) = new Fn(std::forward<F>(fn));
+            ops_ = &heap_ops<Fn>;
+        }
+    }
+
+    Task(Task&& other) noexcept { take(other); }
+
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            reset();
+            take(other);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() { reset(); }
+
+    void operator()() { ops_->invoke(storage_); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void reset() {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*move)(void* dst, void* src);  // Leaves src destroyed
+        void (*destroy)(void* storage);
+    };
+
+    template <typename Fn>
+    static constexpr bool fits_inline() {
+        return sizeof(Fn) <= kInlineSize && alignof(Fn) <= alignof(std::max_align_t) &&
+               std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template <typename Fn>
+    static void invoke_inline(void* storage) { (*static_cast<Fn*>(storage))(); }
+    template <typename Fn>
+    static void move_inline(void* dst, void* src) {
+        new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+        static_cast<Fn*>(src)->~Fn();
+    }
+    template <typename Fn>
+    static void destroy_inline(void* storage) { static_cast<Fn*>(storage)->~Fn(); }
+
+    template <typename Fn>
+    static void invoke_heap(void* storage) { (**static_cast<Fn**>(storage))(); }
+    static void move_heap(void* dst, void* src) { *static_cast<void**>(dst) = *static_cast<void**>(src); }
+    template <typename Fn>
+    static void destroy_heap(void* storage) { delete *static_cast<Fn**>(storage); }
+
+    template <typename Fn>
+    static constexpr Ops inline_ops = {&invoke_inline<Fn>, &move_inline<Fn>, &destroy_inline<Fn>};
+    template <typename Fn>
+    static constexpr Ops heap_ops = {&invoke_heap<Fn>, &move_heap, &destroy_heap<Fn>};
+
+    void take(Task& other) {
+        ops_ = other.ops_;
+        if (ops_) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+    const Ops* ops_ = nullptr;
+};
+
+// Work-stealing pool. Each worker owns a bounded lock-free queue; tasks
+// submitted from outside the pool are spread over the workers round-robin,
+// tasks submitted from a worker go to its own queue, and an idle worker
+// takes from its neighbours before going to sleep. When every queue is full
+// tasks spill into a shared overflow list under a mutex.
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t num_threads);
+    // pin_threads binds worker i to CPU i (mod the CPU count)
+    explicit ThreadPool(size_t num_threads, bool pin_threads = false);
     ~ThreadPool();
-    
-    // Submit a task to the thread pool
-    void enqueue(std::function<void()> task);
-    
+
+    // Submit a task to the thread pool; throws once the pool is stopping
+    void enqueue(Task task);
+
     // Get number of threads
     size_t get_num_threads() const { return num_threads_; }
-    
+
+    // Tasks a worker took from another worker's queue
+    uint64_t get_steals() const { return steals_.load(std::memory_order_relaxed); }
+
 private:
+    static constexpr size_t kQueueCapacity = 4096;  // Per worker, power of two
+    static constexpr int kSpinRounds = 64;          // Empty scans before sleeping
+
+    // Bounded multi-producer multi-consumer ring (Vyukov). Each cell carries
+    // a sequence number that says whether it is free for the producer of a
+    // given position or holds a task for the consumer of it, so a task is
+    // only ever touched by the one thread that claimed its cell.
+    class WorkQueue {
+    public:
+        explicit WorkQueue(size_t capacity);
+
+        bool try_push(Task& task);  // Moves from task on success
+        bool try_pop(Task& task);
+
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            Task task;
+        };
+
+        std::unique_ptr<Cell[]> cells_;
+        size_t mask_;
+        alignas(64) std::atomic<size_t> enqueue_pos_{0};
+        alignas(64) std::atomic<size_t> dequeue_pos_{0};
+    };
+
     size_t num_threads_;
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
     std::vector<std::thread> workers_;
-    std::queue<std::function<void()>> tasks_;
-    std::mutex queue_mutex_;
+    std::atomic<size_t> next_queue_{0};
+
+    std::mutex overflow_mutex_;
+    std::deque<Task> overflow_;
+    std::atomic<size_t> overflow_size_{0};  // Lets idle scans skip the lock
+
+    // Tasks submitted and not yet taken; sleepers recheck it under sleep_mutex_
+    std::atomic<size_t> pending_{0};
+    std::atomic<size_t> sleepers_{0};
+    std::mutex sleep_mutex_;
     std::condition_variable condition_;
-    bool stop_;
-    
-    void worker_thread();
+    std::atomic<bool> stop_{false};
+
+    std::atomic<uint64_t> steals_{0};
+
+    void worker_thread(size_t index, bool pin);
+    bool try_take(size_t index, Task& task);
 };
 
 #endif // THREAD_POOL_H
@@ -0,0 +1,94 @@
+#include "timer_wheel.h"
+#include <algorithm>
+
+TimerWheel::TimerWheel(uint64_t now) : now_(now) {
+    for (auto& level : slots_) {
+        for (TimerLink& head : level) {
+            head.prev = &head;
+            head.next = &head;
+        }
+    }
+}
+
+void TimerWheel::schedule(TimerLink* timer) {
+    // The slot for the current second has already been emptied
+    insert(timer, now_ + 1);
+}
+
+void TimerWheel::cancel(TimerLink* timer) {
+    if (!timer->scheduled()) {
+        return;
+    }
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = nullptr;
+    timer->next = nullptr;
+    size_--;
+}
+
+void TimerWheel::insert(TimerLink* timer, uint64_t earliest) {
+    // Beyond the last level: wait in its farthest slot and be placed again
+    uint64_t when = std::min(std::max(timer->expires_at, earliest), now_ + kSpan - 1);
+    uint64_t delta = when - now_;
+    size_t level = 0;
+    while (level + 1 < kLevels && delta >= (uint64_t(kSlots) << (kLevelBits * level))) {
+        level++;
+    }
+    TimerLink& head = slots_[level][(when >> (kLevelBits * level)) & (kSlots - 1)];
+    timer->prev = head.prev;
+    timer->next = &head;
+    head.prev->next = timer;
+    head.prev = timer;
+    size_++;
+}
+
+TimerLink* TimerWheel::detach(TimerLink& head) {
+    if (head.next == &head) {
+        return nullptr;
+    }
+    TimerLink* first = head.next;
+    head.prev->next = nullptr;
+    head.prev = &head;
+    head.next = &head;
+    return first;
+}
+
+void TimerWheel::cascade(size_t level) {
+    TimerLink* timer = detach(slots_[level][(now_ >> (kLevelBits * level)) & (kSlots - 1)]);
+    while (timer != nullptr) {
+        TimerLink* next = timer->next;
+        size_--;
+        insert(timer, now_);
+        timer = next;
+    }
+}
+
+void TimerWheel::advance(uint64_t now, std::vector<TimerLink*>& due) {
+    while (now_ < now) {
+        now_++;
+
+        // Crossing into a new slot of level n also starts a new slot of
+        // every level below it; fill them top down
+        size_t top = 0;
+        while (top + 1 < kLevels && (now_ & ((uint64_t(1) << (kLevelBits * (top + 1))) - 1)) == 0) {
+            top++;
+        }
+        for (size_t level = top; level > 0; --level) {
+            cascade(level);
+        }
+
+        TimerLink* timer = detach(slots_[0][now_ & (kSlots - 1)]);
+        while (timer != nullptr) {
+            TimerLink* next = timer->next;
+            size_--;
+            if (timer->expires_at <= now_) {
+                timer->prev = nullptr;
+                timer->next = nullptr;
+                due.push_back(timer);
+            } else {
+                insert(timer, now_ + 1);
+            }
+            timer = next;
+        }
+    }
+}
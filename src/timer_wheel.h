@@ -0,0 +1,68 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// A timer, embedded in the object it times (CacheEntry), so scheduling
+// allocates nothing and cancelling unlinks it in O(1)
+struct TimerLink {
+    TimerLink* prev = nullptr;  // nullptr while not scheduled
+    TimerLink* next = nullptr;
+    uint64_t expires_at = 0;    // Expiry time (see expiry.h); 0 never
+
+    bool scheduled() const { return prev != nullptr; }
+};
+
+// Hierarchical timer wheel of key expiry times, one-second ticks. Level 0
+// has a slot per second for the next 64 seconds, level 1 a slot per 64
+// seconds for the next ~68 minutes, and so on over four levels (~194
+// days; later times wait in the last level and are placed again when it
+// comes round). Scheduling links the timer into one slot, O(1). Advancing
+// the clock empties the slot of each second passed, and at every level
+// boundary moves the next higher-level slot's timers down to finer slots.
+//
+// Owners cancel the timer of anything they drop before its time, so the
+// wheel only holds live timers. Not thread-safe; the owner locks around it.
+class TimerWheel {
+public:
+    explicit TimerWheel(uint64_t now = 0);
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Due at timer->expires_at; times already passed come due on the next
+    // advance. The timer must not be scheduled already.
+    void schedule(TimerLink* timer);
+
+    // Take a timer off the wheel; does nothing if it isn't scheduled
+    void cancel(TimerLink* timer);
+
+    // Move the clock to `now`, appending the timers that came due to
+    // `due`. They are no longer scheduled.
+    void advance(uint64_t now, std::vector<TimerLink*>& due);
+
+    size_t size() const { return size_; }
+
+private:
+    static constexpr unsigned kLevelBits = 6;
+    static constexpr size_t kSlots = size_t(1) << kLevelBits;
+    static constexpr size_t kLevels = 4;
+    static constexpr uint64_t kSpan = uint64_t(1) << (kLevelBits * kLevels);  // Seconds covered
+
+    uint64_t now_;  // Every second up to and including this one has been processed
+    size_t size_ = 0;
+    TimerLink slots_[kLevels][kSlots];  // Heads of circular lists
+
+    // Place a timer due no earlier than `earliest`
+    void insert(TimerLink* timer, uint64_t earliest);
+
+    // Empty a slot, returning its timers as a chain ending in nullptr
+    static TimerLink* detach(TimerLink& head);
+
+    // Re-place the timers of one slot of a higher level
+    void cascade(size_t level);
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,176 @@
+#include "trace_recorder.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+
+namespace {
+
+// Bytes written as %XX so a key stays one space-free token
+bool needs_escape(unsigned char c) {
+    return c <= ' ' || c == '%' || c >= 0x7f;
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parse a decimal number up to the next space; advances pos past it
+bool parse_number(std::string_view line, size_t& pos, uint64_t& value) {
+    size_t start = pos;
+    value = 0;
+    while (pos < line.size() && line[pos] >= '0' && line[pos] <= '9') {
+        value = value * 10 + static_cast<uint64_t>(line[pos] - '0');
+        pos++;
+    }
+    return pos > start && pos < line.size() && line[pos++] == ' ';
+}
+
+}  // namespace
+
+void append_trace_line(std::string& out, uint64_t offset_us, TraceOp op, size_t value_size, std::string_view key) {
+    static const char kHex[] = "0123456789ABCDEF";
+    char prefix[48];
+    int length = snprintf(prefix, sizeof(prefix), "%llu %c %zu ", static_cast<unsigned long long>(offset_us),
+                          static_cast<char>(op), value_size);
+    out.append(prefix, static_cast<size_t>(length));
+    for (char c : key) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (needs_escape(byte)) {
+            out += '%';
+            out += kHex[byte >> 4];
+            out += kHex[byte & 0xf];
+        } else {
+            out += c;
+        }
+    }
+    out += '\n';
+}
+
+bool parse_trace_line(std::string_view line, TraceEntry& entry) {
+    if (!line.empty() && line.back() == '\n') {
+        line.remove_suffix(1);
+    }
+    if (line.empty() || line[0] == '#') {
+        return false;
+    }
+
+    size_t pos = 0;
+    uint64_t value_size;
+    if (!parse_number(line, pos, entry.offset_us) || pos + 2 > line.size() || line[pos + 1] != ' ') {
+        return false;
+    }
+    char op = line[pos];
+    if (op != static_cast<char>(TraceOp::kGet) && op != static_cast<char>(TraceOp::kPut) &&
+        op != static_cast<char>(TraceOp::kDelete)) {
+        return false;
+    }
+    entry.op = static_cast<TraceOp>(op);
+    pos += 2;
+    if (!parse_number(line, pos, value_size)) {
+        return false;
+    }
+    entry.value_size = static_cast<size_t>(value_size);
+
+    entry.key.clear();
+    for (; pos < line.size(); ++pos) {
+        if (line[pos] != '%') {
+            entry.key += line[pos];
+            continue;
+        }
+        int high = pos + 2 < line.size() ? hex_value(line[pos + 1]) : -1;
+        int low = pos + 2 < line.size() ? hex_value(line[pos + 2]) : -1;
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        entry.key += static_cast<char>(high << 4 | low);
+        pos += 2;
+    }
+    return !entry.key.empty();
+}
+
+TraceRecorder::TraceRecorder(const std::string& path) : path_(path) {}
+
+TraceRecorder::~TraceRecorder() {
+    stop();
+}
+
+bool TraceRecorder::start() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (running_) {
+        return true;
+    }
+    file_ = fopen(path_.c_str(), "w");
+    if (!file_) {
+        std::cerr << "Cannot create trace file " << path_ << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    fputs("# kv trace: <offset_us> <G|P|D> <value_size> <key>\n", file_);
+    started_at_ = std::chrono::steady_clock::now();
+    running_ = true;
+    writer_ = std::thread([this] { writer_loop(); });
+    return true;
+}
+
+void TraceRecorder::stop() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    cv_.notify_all();
+    writer_.join();
+
+    // The writer has exited; whatever was recorded since is written here
+    fwrite(buffer_.data(), 1, buffer_.size(), file_);
+    buffer_.clear();
+    fclose(file_);
+    file_ = nullptr;
+    std::cout << "Trace written to " << path_ << ": " << get_recorded() << " operations";
+    if (get_dropped() > 0) {
+        std::cout << " (" << get_dropped() << " dropped)";
+    }
+    std::cout << std::endl;
+}
+
+void TraceRecorder::record(TraceOp op, const std::string& key, size_t value_size) {
+    auto offset = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started_at_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!running_ || buffer_.size() >= kMaxBuffered) {
+        lock.unlock();
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    append_trace_line(buffer_, static_cast<uint64_t>(offset.count()), op, value_size, key);
+    bool wake = buffer_.size() >= kFlushBytes;
+    lock.unlock();
+
+    recorded_.fetch_add(1, std::memory_order_relaxed);
+    if (wake) {
+        cv_.notify_one();
+    }
+}
+
+void TraceRecorder::writer_loop() {
+    std::string pending;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        cv_.wait_for(lock, kFlushInterval, [this] { return !running_ || buffer_.size() >= kFlushBytes; });
+        if (buffer_.empty()) {
+            continue;
+        }
+        // Write without the lock so requests keep recording meanwhile
+        pending.swap(buffer_);
+        lock.unlock();
+        if (fwrite(pending.data(), 1, pending.size(), file_) != pending.size()) {
+            std::cerr << "Cannot write trace file " << path_ << ": " << std::strerror(errno) << std::endl;
+        }
+        pending.clear();
+        lock.lock();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <string>
+#include <string_view>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+
+enum class TraceOp : char {
+    kGet = 'G',
+    kPut = 'P',
+    kDelete = 'D',
+};
+
+// One recorded operation. A trace file holds one per line:
+//   <offset_us> <G|P|D> <value_size> <key>
+// where offset_us counts from the start of recording and the key is
+// percent-encoded so it contains no spaces or line breaks. Lines starting
+// with '#' are comments.
+struct TraceEntry {
+    uint64_t offset_us = 0;
+    TraceOp op = TraceOp::kGet;
+    size_t value_size = 0;
+    std::string key;
+};
+
+void append_trace_line(std::string& out, uint64_t offset_us, TraceOp op, size_t value_size, std::string_view key);
+
+// False for comments and malformed lines
+bool parse_trace_line(std::string_view line, TraceEntry& entry);
+
+// Writes every key operation the server handles to a trace file that the
+// load generator can replay (--replay). Recording appends a line to a
+// buffer under a lock; a background thread writes the buffer out. If the
+// disk falls more than kMaxBuffered bytes behind, lines are dropped (and
+// counted) rather than slowing requests down.
+class TraceRecorder {
+public:
+    explicit TraceRecorder(const std::string& path);
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+    // Create the file and start the writer; false if the file can't be created
+    bool start();
+
+    // Write out what is buffered and close the file
+    void stop();
+
+    void record(TraceOp op, const std::string& key, size_t value_size = 0);
+
+    uint64_t get_recorded() const { return recorded_.load(std::memory_order_relaxed); }
+    uint64_t get_dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    const std::string& get_path() const { return path_; }
+
+private:
+    static constexpr size_t kFlushBytes = 1 << 20;     // Wake the writer early
+    static constexpr size_t kMaxBuffered = 64 << 20;
+    static constexpr std::chrono::milliseconds kFlushInterval{500};
+
+    std::string path_;
+    FILE* file_ = nullptr;
+    std::chrono::steady_clock::time_point started_at_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::string buffer_;
+    bool running_ = false;
+    std::thread writer_;
+
+    std::atomic<uint64_t> recorded_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    void writer_loop();
+};
+
+#endif // TRACE_RECORDER_H
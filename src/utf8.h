@@ -0,0 +1,46 @@
+#ifndef UTF8_H
+#define UTF8_H
+
+#include <cstddef>
+
+// Length of the well-formed UTF-8 sequence at the start of `text` (1 to
+// 4), or 0 if it doesn't start with one: stray continuation bytes,
+// truncated or overlong sequences, surrogates and code points past
+// U+10FFFF are all rejected.
+inline size_t utf8_sequence_length(const char* text, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    auto byte = [text](size_t i) { return static_cast<unsigned char>(text[i]); };
+    unsigned char lead = byte(0);
+    if (lead < 0x80) {
+        return 1;
+    }
+    size_t size;
+    unsigned char low = 0x80;   // Range of the second byte
+    unsigned char high = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        size = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        size = 3;
+        if (lead == 0xE0) low = 0xA0;        // Overlong
+        else if (lead == 0xED) high = 0x9F;  // Surrogates
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        size = 4;
+        if (lead == 0xF0) low = 0x90;        // Overlong
+        else if (lead == 0xF4) high = 0x8F;  // Past U+10FFFF
+    } else {
+        return 0;
+    }
+    if (length < size || byte(1) < low || byte(1) > high) {
+        return 0;
+    }
+    for (size_t i = 2; i < size; ++i) {
+        if ((byte(i) & 0xC0) != 0x80) {
+            return 0;
+        }
+    }
+    return size;
+}
+
+#endif // UTF8_H
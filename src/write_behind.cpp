@@ -0,0 +1,253 @@
+#include "write_behind.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+WriteBehindQueue::WriteBehindQueue(std::shared_ptr<StorageBackend> db, size_t max_pending,
+                                   size_t flush_size, std::chrono::milliseconds flush_interval)
+    : db_(db), max_pending_(max_pending == 0 ? 1 : max_pending),
+      flush_size_(flush_size == 0 ? 1 : flush_size), flush_interval_(flush_interval) {
+    flusher_ = std::thread([this] { flusher_thread(); });
+}
+
+WriteBehindQueue::~WriteBehindQueue() {
+    stop();
+}
+
+bool WriteBehindQueue::enqueue_put(const std::string& key, const std::string& value, uint64_t expires_at) {
+    return enqueue(key, {false, value, expires_at});
+}
+
+bool WriteBehindQueue::enqueue_delete(const std::string& key) {
+    return enqueue(key, {true, std::string(), 0});
+}
+
+bool WriteBehindQueue::enqueue(const std::string& key, Write write) {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    
+    auto it = pending_.find(key);
+    if (it != pending_.end()) {
+        // Coalesce: only the latest write to a key needs to reach the database
+        it->second = std::move(write);
+        enqueued_seq_++;
+        coalesced_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    
+    space_available_.wait(lock, [this] { return stop_ || pending_.size() < max_pending_; });
+    if (stop_) {
+        return false;
+    }
+    
+    pending_.emplace(key, std::move(write));
+    enqueued_seq_++;
+    if (pending_.size() == 1 || pending_.size() >= flush_size_) {
+        work_available_.notify_one();
+    }
+    return true;
+}
+
+WriteBehindQueue::Pending WriteBehindQueue::lookup(const std::string& key, std::string* value,
+                                                   uint64_t* expires_at) const {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    
+    // pending_ is newer than in_flight_
+    for (const WriteMap* writes : {&pending_, &in_flight_}) {
+        auto it = writes->find(key);
+        if (it != writes->end()) {
+            if (it->second.is_delete) {
+                return Pending::kDelete;
+            }
+            if (value != nullptr) {
+                *value = it->second.value;
+            }
+            if (expires_at != nullptr) {
+                *expires_at = it->second.expires_at;
+            }
+            return Pending::kPut;
+        }
+    }
+    return Pending::kNone;
+}
+
+void WriteBehindQueue::flush() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    uint64_t target = enqueued_seq_;
+    flush_requested_ = true;
+    work_available_.notify_one();
+    flushed_.wait(lock, [this, target] { return flushed_seq_ >= target || flusher_exited_; });
+}
+
+void WriteBehindQueue::stop() {
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        if (stop_) {
+            // Someone else is stopping it; wait until the flusher is done
+            flushed_.wait(lock, [this] { return flusher_exited_; });
+            return;
+        }
+        stop_ = true;
+    }
+    work_available_.notify_one();
+    space_available_.notify_all();
+    
+    // The flusher drains everything that was accepted before exiting
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+}
+
+size_t WriteBehindQueue::get_pending() const {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    return pending_.size() + in_flight_.size();
+}
+
+void WriteBehindQueue::flusher_thread() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    while (true) {
+        // Sleep until there is something to write, then give writers up to
+        // one interval to fill a batch
+        work_available_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+        work_available_.wait_for(lock, flush_interval_, [this] {
+            return stop_ || flush_requested_ || pending_.size() >= flush_size_;
+        });
+        flush_requested_ = false;
+        
+        if (pending_.empty()) {
+            break;  // Stopping with nothing left to write
+        }
+        
+        // Take the whole pending set; writers refill pending_ meanwhile
+        uint64_t batch_seq = enqueued_seq_;
+        in_flight_.swap(pending_);
+        space_available_.notify_all();
+        lock.unlock();
+        
+        bool ok = write_batch(in_flight_);
+        
+        lock.lock();
+        if (!ok) {
+            // Put back whatever wasn't overwritten since, and back off
+            failures_.fetch_add(1, std::memory_order_relaxed);
+            for (auto& item : in_flight_) {
+                pending_.emplace(item.first, std::move(item.second));
+            }
+            in_flight_.clear();
+            if (stop_) {
+                std::cerr << "Write-behind: dropping " << pending_.size()
+                          << " unpersisted writes at shutdown" << std::endl;
+                WriteMap lost;
+                lost.swap(pending_);
+                lock.unlock();
+                for (const auto& item : lost) {
+                    dropped(item.first);
+                }
+                lock.lock();
+                break;
+            }
+            work_available_.wait_for(lock, flush_interval_, [this] { return stop_; });
+            continue;
+        }
+        
+        in_flight_.clear();
+        flushed_seq_ = batch_seq;
+        flushed_.notify_all();
+    }
+    
+    flushed_seq_ = enqueued_seq_;
+    flusher_exited_ = true;
+    flushed_.notify_all();
+}
+
+bool WriteBehindQueue::write_batch(const WriteMap& batch) {
+    std::vector<std::pair<std::string, std::string>> puts;
+    std::vector<uint64_t> expiry;
+    std::vector<std::string> deletes;
+    for (const auto& item : batch) {
+        if (item.second.is_delete) {
+            deletes.push_back(item.first);
+        } else {
+            puts.emplace_back(item.first, item.second.value);
+            expiry.push_back(item.second.expires_at);
+        }
+    }
+    
+    // Keys are unique across the batch, so the two statements commute
+    for (size_t start = 0; start < puts.size(); start += flush_size_) {
+        size_t end = std::min(puts.size(), start + flush_size_);
+        std::vector<std::pair<std::string, std::string>> chunk(puts.begin() + start, puts.begin() + end);
+        std::vector<uint64_t> chunk_expiry(expiry.begin() + start, expiry.begin() + end);
+        if (!db_->create_many(chunk, nullptr, &chunk_expiry)) {
+            if (!write_rows(chunk, chunk_expiry)) {
+                return false;
+            }
+            continue;
+        }
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        rows_written_.fetch_add(chunk.size(), std::memory_order_relaxed);
+    }
+    if (!deletes.empty()) {
+        if (!db_->delete_many(deletes)) {
+            return delete_rows(deletes);
+        }
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        rows_written_.fetch_add(deletes.size(), std::memory_order_relaxed);
+    }
+    return true;
+}
+
+bool WriteBehindQueue::write_rows(const std::vector<std::pair<std::string, std::string>>& puts,
+                                  const std::vector<uint64_t>& expiry) {
+    std::vector<size_t> rejected;
+    for (size_t i = 0; i < puts.size(); ++i) {
+        if (db_->create(puts[i].first, puts[i].second, nullptr, expiry[i])) {
+            rows_written_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            rejected.push_back(i);
+        }
+    }
+    if (rejected.empty()) {
+        return true;
+    }
+    // Rows written so far are written again with the retry; that's harmless
+    if (!db_->ping()) {
+        return false;
+    }
+    for (size_t i : rejected) {
+        std::cerr << "Write-behind: dropping write of key " << puts[i].first << " ("
+                  << puts[i].second.size() << " bytes) rejected by the database" << std::endl;
+        dropped(puts[i].first);
+    }
+    dropped_.fetch_add(rejected.size(), std::memory_order_relaxed);
+    return true;
+}
+
+bool WriteBehindQueue::delete_rows(const std::vector<std::string>& deletes) {
+    std::vector<size_t> rejected;
+    for (size_t i = 0; i < deletes.size(); ++i) {
+        if (db_->delete_key(deletes[i])) {
+            rows_written_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            rejected.push_back(i);
+        }
+    }
+    if (rejected.empty()) {
+        return true;
+    }
+    if (!db_->ping()) {
+        return false;
+    }
+    for (size_t i : rejected) {
+        std::cerr << "Write-behind: dropping delete of key " << deletes[i] << " rejected by the database"
+                  << std::endl;
+        dropped(deletes[i]);
+    }
+    dropped_.fetch_add(rejected.size(), std::memory_order_relaxed);
+    return true;
+}
+
+void WriteBehindQueue::dropped(const std::string& key) {
+    if (on_drop_) {
+        on_drop_(key);
+    }
+}
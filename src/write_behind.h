@@ -0,0 +1,109 @@
+#ifndef WRITE_BEHIND_H
+#define WRITE_BEHIND_H
+
+#include "storage_backend.h"
+#include <string>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Write-behind buffer in front of the database. Writes are acknowledged once
+// they are queued; a background flusher coalesces repeated writes to the
+// same key and persists them with batched upserts and deletes. The queue is
+// bounded: producers block once max_pending keys are waiting.
+//
+// A failed batch is retried later as a whole, unless the database still
+// answers: then it is written row by row, and rows it rejects on their own
+// (say, a value the column type can't hold) are logged and dropped, so one
+// bad row can't hold up every write behind it.
+class WriteBehindQueue {
+public:
+    enum class Pending { kNone, kPut, kDelete };
+    
+    // Told about each key whose write was dropped rather than persisted
+    using DropCallback = std::function<void(const std::string& key)>;
+    
+    WriteBehindQueue(std::shared_ptr<StorageBackend> db, size_t max_pending,
+                     size_t flush_size, std::chrono::milliseconds flush_interval);
+    ~WriteBehindQueue();
+    
+    // Called from the flusher thread for rejected rows and for writes still
+    // unpersisted at shutdown, so the caller can forget values the database
+    // never got (the cache, say). Set before queueing anything.
+    void set_drop_callback(DropCallback on_drop) { on_drop_ = std::move(on_drop); }
+    
+    // Queue a write. Returns false once the queue is stopped, in which case
+    // the caller must write through to the database itself.
+    bool enqueue_put(const std::string& key, const std::string& value, uint64_t expires_at = 0);
+    bool enqueue_delete(const std::string& key);
+    
+    // Latest unpersisted write for a key, so readers see their own writes
+    Pending lookup(const std::string& key, std::string* value, uint64_t* expires_at = nullptr) const;
+    
+    // Block until everything queued so far has been written
+    void flush();
+    
+    // Flush and stop the flusher; later enqueues return false. Returns
+    // once the flusher has exited, whichever thread asked first.
+    void stop();
+    
+    // Statistics
+    size_t get_pending() const;
+    uint64_t get_coalesced() const { return coalesced_.load(std::memory_order_relaxed); }
+    uint64_t get_batches() const { return batches_.load(std::memory_order_relaxed); }
+    uint64_t get_rows_written() const { return rows_written_.load(std::memory_order_relaxed); }
+    uint64_t get_failures() const { return failures_.load(std::memory_order_relaxed); }
+    uint64_t get_dropped() const { return dropped_.load(std::memory_order_relaxed); }
+    
+private:
+    struct Write {
+        bool is_delete;
+        std::string value;
+        uint64_t expires_at;
+    };
+    using WriteMap = std::unordered_map<std::string, Write>;
+    
+    std::shared_ptr<StorageBackend> db_;
+    size_t max_pending_;
+    size_t flush_size_;
+    std::chrono::milliseconds flush_interval_;
+    DropCallback on_drop_;
+    
+    WriteMap pending_;    // Accepted, not yet picked up by the flusher
+    WriteMap in_flight_;  // Being written by the flusher right now
+    uint64_t enqueued_seq_ = 0;
+    uint64_t flushed_seq_ = 0;
+    bool flush_requested_ = false;
+    bool flusher_exited_ = false;
+    bool stop_ = false;
+    mutable std::mutex queue_mutex_;
+    std::condition_variable work_available_;
+    std::condition_variable space_available_;
+    std::condition_variable flushed_;
+    std::thread flusher_;
+    
+    std::atomic<uint64_t> coalesced_{0};
+    std::atomic<uint64_t> batches_{0};
+    std::atomic<uint64_t> rows_written_{0};
+    std::atomic<uint64_t> failures_{0};
+    std::atomic<uint64_t> dropped_{0};  // Rows the database rejected on their own
+    
+    bool enqueue(const std::string& key, Write write);
+    void flusher_thread();
+    bool write_batch(const WriteMap& batch);
+    
+    // After a failed batch statement: write its rows one at a time and
+    // drop those that still fail. False if the database doesn't answer.
+    bool write_rows(const std::vector<std::pair<std::string, std::string>>& puts,
+                    const std::vector<uint64_t>& expiry);
+    bool delete_rows(const std::vector<std::string>& deletes);
+    void dropped(const std::string& key);
+};
+
+#endif // WRITE_BEHIND_H